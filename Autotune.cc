@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "Autotune.h"
+#include "FrameQueue.h"
+
+#define AUTOTUNE_MAXIMUM_ENCODE 32  // MAX_ENCODE_QUEUE
+#define AUTOTUNE_MAXIMUM_OUTPUT 8
+
+std::string GetHostName()
+{
+    char host[256];
+
+    if(gethostname(host, sizeof(host)) != 0)
+        return "unknown";
+
+    host[sizeof(host) - 1] = '\0';
+    return host;
+}
+
+// Reads each line of the profile, without its line ending
+static int ReadLines(const char* filename, std::vector<std::string>& lines)
+{
+    char buffer[1024];
+    auto continued = false;
+    FILE* file;
+    int failed;
+
+    if((file = fopen(filename, "r")) == NULL)
+        return -1;
+
+    while(fgets(buffer, sizeof(buffer), file) != NULL)
+    {
+        if(!continued)
+            lines.push_back(std::string());
+        lines.back() += buffer;
+
+        if(!(continued = lines.back().back() != '\n'))
+            lines.back().pop_back();
+    }
+
+    failed = ferror(file);
+    fclose(file);
+    return failed ? -1 : 0;
+}
+
+static bool IsBlank(const std::string& line)
+{
+    return line.find_first_not_of(" \t\r") == std::string::npos;
+}
+
+static bool ParseTunedProfile(const std::string& line, TunedProfile& profile)
+{
+    char host[256], preset[64];
+    int inlineDecode, consumed = 0;
+
+    if(sscanf(line.c_str(), "%255s %d %63s %dx%d %lux%lu %d %u %u %d %u %u %lf %n",
+              host, &profile.codec, preset, &profile.width, &profile.height, &profile.rows, &profile.columns,
+              &inlineDecode, &profile.settings.depths.decodeSurfaces, &profile.settings.depths.outputSurfaces,
+              &profile.settings.depths.displayDelay, &profile.settings.depths.queueSize,
+              &profile.settings.depths.encodeBuffers, &profile.framesPerSecond, &consumed) != 14 ||
+       consumed == 0 || line[consumed] != '\0')
+        return false;
+
+    profile.host = host;
+    profile.preset = preset;
+    profile.settings.inlineDecode = inlineDecode != 0;
+    return true;
+}
+
+int LoadTunedProfiles(const char* filename, std::vector<TunedProfile>& profiles)
+{
+    std::vector<std::string> lines;
+    TunedProfile profile;
+    auto malformed = 0;
+
+    if(ReadLines(filename, lines) != 0)
+        return -1;
+
+    for(auto& line: lines)
+        if(ParseTunedProfile(line, profile))
+            profiles.push_back(profile);
+        else if(!IsBlank(line))
+            malformed++;
+
+    if(malformed > 0)
+        fprintf(stderr, "Ignoring %d malformed tuned profile entries in %s\n", malformed, filename);
+
+    return 0;
+}
+
+static bool IsSameKey(const TunedProfile& left, const TunedProfile& right)
+{
+    return left.host == right.host && left.codec == right.codec && left.preset == right.preset &&
+           left.width == right.width && left.height == right.height &&
+           left.rows == right.rows && left.columns == right.columns;
+}
+
+int SaveTunedProfile(const char* filename, const TunedProfile& profile)
+{
+    std::vector<std::string> lines;
+    std::string temporary = std::string(filename) + ".tmp";
+    TunedProfile entry;
+    FILE* file;
+
+    // A missing profile is created
+    if(access(filename, F_OK) == 0 && ReadLines(filename, lines) != 0)
+        return -1;
+
+    // Every other line is kept as written, including any that cannot be parsed
+    lines.erase(std::remove_if(lines.begin(), lines.end(),
+                               [&](const std::string& line)
+                               { return ParseTunedProfile(line, entry) && IsSameKey(entry, profile); }),
+                lines.end());
+
+    if((file = fopen(temporary.c_str(), "w")) == NULL)
+        return -1;
+
+    for(auto& line: lines)
+        fprintf(file, "%s\n", line.c_str());
+    fprintf(file, "%s %d %s %dx%d %lux%lu %d %u %u %d %u %u %f\n",
+            profile.host.c_str(), profile.codec, profile.preset.c_str(), profile.width, profile.height,
+            profile.rows, profile.columns, profile.settings.inlineDecode ? 1 : 0,
+            profile.settings.depths.decodeSurfaces, profile.settings.depths.outputSurfaces,
+            profile.settings.depths.displayDelay, profile.settings.depths.queueSize,
+            profile.settings.depths.encodeBuffers, profile.framesPerSecond);
+
+    // Readers never see a partially written profile
+    if(fclose(file) != 0 || rename(temporary.c_str(), filename) != 0)
+        return unlink(temporary.c_str()), -1;
+
+    return 0;
+}
+
+TunedProfile MakeTunedProfile(const EncodeConfig& configuration, const TileDimensions& dimensions,
+                              const AutotuneTrial& trial)
+{
+    TunedProfile profile;
+
+    profile.host = GetHostName();
+    profile.codec = configuration.codec;
+    profile.preset = configuration.encoderPreset ? configuration.encoderPreset : "default";
+    profile.width = std::max(configuration.width, 0);
+    profile.height = std::max(configuration.height, 0);
+    profile.rows = dimensions.rows;
+    profile.columns = dimensions.columns;
+    profile.settings = trial.settings;
+    profile.framesPerSecond = trial.GetFramesPerSecond();
+
+    return profile;
+}
+
+const TunedProfile* FindTunedProfile(const std::vector<TunedProfile>& profiles, const std::string& host,
+                                     const EncodeConfig& configuration, const TileDimensions& dimensions)
+{
+    AutotuneTrial trial = {};
+    auto key = MakeTunedProfile(configuration, dimensions, trial);
+
+    key.host = host;
+    for(auto& profile: profiles)
+        if(IsSameKey(profile, key))
+            return &profile;
+
+    return NULL;
+}
+
+AutotuneSearch::AutotuneSearch(const AutotuneSettings& requested, const bool inlinePinned, const bool decoderSource,
+                               const unsigned int minimumEncodeBuffers)
+    : baseline(requested), searched(KNOB_COUNT), minimumEncodeBuffers(minimumEncodeBuffers), knob(-1), best(0)
+{
+    auto& depths = requested.depths;
+
+    searched[KNOB_INLINE] = decoderSource && !inlinePinned;
+    searched[KNOB_DECODE] = decoderSource && depths.decodeSurfaces == 0;
+    searched[KNOB_QUEUE]  = decoderSource && depths.queueSize == 0;
+    searched[KNOB_OUTPUT] = decoderSource && depths.outputSurfaces == 0;
+    searched[KNOB_DELAY]  = decoderSource && depths.displayDelay < 0;
+    searched[KNOB_ENCODE] = depths.encodeBuffers == 0;
+}
+
+int AutotuneSearch::Get(const AutotuneSettings& settings, const int knob)
+{
+    switch(knob)
+    {
+        case KNOB_INLINE: return settings.inlineDecode ? 1 : 0;
+        case KNOB_DECODE: return settings.depths.decodeSurfaces;
+        case KNOB_QUEUE:  return settings.depths.queueSize;
+        case KNOB_OUTPUT: return settings.depths.outputSurfaces;
+        case KNOB_DELAY:  return settings.depths.displayDelay;
+        default:          return settings.depths.encodeBuffers;
+    }
+}
+
+void AutotuneSearch::Set(AutotuneSettings& settings, const int knob, const int value)
+{
+    switch(knob)
+    {
+        case KNOB_INLINE: settings.inlineDecode = value != 0; break;
+        case KNOB_DECODE: settings.depths.decodeSurfaces = value; break;
+        case KNOB_QUEUE:  settings.depths.queueSize = value; break;
+        case KNOB_OUTPUT: settings.depths.outputSurfaces = value; break;
+        case KNOB_DELAY:  settings.depths.displayDelay = value; break;
+        default:          settings.depths.encodeBuffers = value; break;
+    }
+}
+
+// Values to try, around the (resolved) best so far.  Decode and output surfaces only grow, since the
+// defaults are the least that the stream and the lookahead require.
+std::vector<int> AutotuneSearch::GetCandidates(const int knob) const
+{
+    auto& current = GetBest().settings;
+    auto value = Get(current, knob);
+    std::vector<int> values;
+
+    switch(knob)
+    {
+        case KNOB_INLINE:
+            values = { 1 - value };
+            break;
+        case KNOB_DECODE:
+            values = { value + 4, value + 8 };
+            break;
+        case KNOB_QUEUE:
+            values = { 2, 4, 8, 16, (int)FrameQueue::cnDefaultSize };
+            break;
+        case KNOB_OUTPUT:
+            values = { value + 1, value + 2 };
+            break;
+        case KNOB_DELAY:
+            values = { 0, 1, 2, 4 };
+            break;
+        default:
+            values = { (int)minimumEncodeBuffers, 4, 8, 16 };
+            break;
+    }
+
+    values.erase(std::remove_if(values.begin(), values.end(), [&](const int candidate)
+        {
+            return candidate == value ||
+                   (knob == KNOB_DECODE && candidate > (int)FrameQueue::cnMaximumSize) ||
+                   (knob == KNOB_QUEUE && candidate > (int)current.depths.decodeSurfaces) ||
+                   (knob == KNOB_OUTPUT && candidate > AUTOTUNE_MAXIMUM_OUTPUT) ||
+                   (knob == KNOB_ENCODE && (candidate < (int)minimumEncodeBuffers ||
+                                            candidate > AUTOTUNE_MAXIMUM_ENCODE));
+        }), values.end());
+
+    return values;
+}
+
+bool AutotuneSearch::Next(AutotuneSettings& settings)
+{
+    // The requested settings are measured first, resolving the defaults that the search starts from
+    if(trials.empty())
+        return settings = baseline, true;
+
+    while(candidates.empty())
+        if(++knob == KNOB_COUNT)
+            return false;
+        else if(searched[knob])
+            candidates = GetCandidates(knob);
+
+    settings = GetBest().settings;
+    Set(settings, knob, candidates.front());
+    candidates.erase(candidates.begin());
+
+    return true;
+}
+
+void AutotuneSearch::Report(const AutotuneTrial& trial)
+{
+    trials.push_back(trial);
+
+    if(trial.GetFramesPerSecond() > GetBest().GetFramesPerSecond() * (1 + AUTOTUNE_MINIMUM_GAIN))
+        best = trials.size() - 1;
+}
+
+std::string AutotuneSearch::Describe() const
+{
+    std::stringstream description;
+    char row[256];
+
+    description << "trial  inline  depths                                         fps   stalled ms "
+                   "(surface/enqueue/dequeue/output)\n";
+
+    for(auto i = 0u; i < trials.size(); i++)
+    {
+        auto& trial = trials[i];
+
+        snprintf(row, sizeof(row), "%c%4u  %-6s  %-44s %7.1f   %.1f/%.1f/%.1f/%.1f\n",
+                 i == best ? '*' : ' ', i, trial.settings.inlineDecode ? "yes" : "no",
+                 DescribePipelineDepths(trial.settings.depths).c_str(), trial.GetFramesPerSecond(),
+                 trial.stalls.surface / 1000., trial.stalls.enqueue / 1000., trial.stalls.dequeue / 1000.,
+                 trial.stalls.output / 1000.);
+        description << row;
+    }
+
+    return description.str();
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    if(!patterns.empty() && cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        for(auto pattern: patterns)
+            cuMemFree(pattern);
+        cuvidCtxUnlock(lock, 0);
+    }
+}
+
+int SyntheticFrameSource::Open()
+{
+    std::vector<uint8_t> frame((size_t)width * height * 3 / 2);
+    CUDA_MEMCPY2D parameters;
+    CUdeviceptr pattern;
+    CUresult result = CUDA_SUCCESS;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+
+    for(auto i = 0u; i < SYNTHETIC_PATTERNS && result == CUDA_SUCCESS; i++)
+    {
+        // Blocky noise over a gradient, shifted a few pixels each frame so that motion search has work to do
+        for(auto y = 0; y < height; y++)
+            for(auto x = 0; x < width; x++)
+            {
+                unsigned int hash = ((x + 6 * i) / 4) * 73856093u ^ (y / 4) * 19349663u;
+                frame[(size_t)y * width + x] = (uint8_t)((x + y) * 128 / (width + height) + (hash >> 7) % 128);
+            }
+        for(auto y = 0; y < height / 2; y++)
+            for(auto x = 0; x < width; x++)
+                frame[(size_t)(height + y) * width + x] = (uint8_t)(96 + ((x / 2 + 3 * i) % 64));
+
+        if((result = cuMemAllocPitch(&pattern, &pitch, width, height * 3 / 2, 16)) != CUDA_SUCCESS)
+            break;
+        patterns.push_back(pattern);
+
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.srcMemoryType = CU_MEMORYTYPE_HOST;
+        parameters.srcHost = frame.data();
+        parameters.srcPitch = width;
+        parameters.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+        parameters.dstDevice = pattern;
+        parameters.dstPitch = pitch;
+        parameters.WidthInBytes = width;
+        parameters.Height = height * 3 / 2;
+        result = cuMemcpy2D(&parameters);
+    }
+
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return fprintf(stderr, "CUDA error %d creating synthetic frames\n", result), -1;
+
+    return 0;
+}
+
+bool SyntheticFrameSource::NextFrame(DecodedFrame& frame, bool& cut)
+{
+    if(cancelled || next == frames)
+        return false;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.info.progressive_frame = 1;
+    frame.device = patterns[next % patterns.size()];
+    frame.pitch = pitch;
+    frame.index = next++;
+    frame.decoded = PipelineTuner::Now();
+    cut = false;
+
+    return true;
+}
@@ -0,0 +1,116 @@
+#ifndef _AUTOTUNE
+#define _AUTOTUNE
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "../common/inc/NvHWEncoder.h"
+#include "PipelineStages.h"
+#include "PipelineTuner.h"
+#include "TileDimensions.h"
+
+#define DEFAULT_AUTOTUNE_FRAMES 300
+#define AUTOTUNE_MINIMUM_GAIN   0.03  // Fraction by which a setting must beat the best so far to replace it
+#define SYNTHETIC_PATTERNS      16    // Distinct synthetic frames, repeated in turn
+
+// Settings searched by the autotuner
+typedef struct AutotuneSettings
+{
+    bool           inlineDecode;
+    PipelineDepths depths;
+} AutotuneSettings;
+
+// Outcome of one calibration transcode
+typedef struct AutotuneTrial
+{
+    AutotuneSettings   settings;  // As resolved by the transcode
+    size_t             frames;    // Encoded
+    double             seconds;   // From the first frame to the encoders being flushed
+    PipelineStalls     stalls;
+
+    double GetFramesPerSecond() const { return seconds > 0 ? frames / seconds : 0; }
+} AutotuneTrial;
+
+// Settings found for a host, encode configuration and tile geometry
+typedef struct TunedProfile
+{
+    std::string      host;
+    int              codec;
+    std::string      preset;
+    int              width, height;  // As requested; zero is the source's own
+    size_t           rows, columns;
+    AutotuneSettings settings;
+    double           framesPerSecond;
+} TunedProfile;
+
+std::string GetHostName();
+// A profile holds an entry per line:
+//     <host> <codec> <preset> <width>x<height> <rows>x<columns> <inline> <decode> <output> <delay> <queue> <encode> <fps>
+int         LoadTunedProfiles(const char* filename, std::vector<TunedProfile>&);
+// Replaces any entry for the same host, configuration and geometry, keeping every other line (even one that
+// cannot be parsed) as it was
+int         SaveTunedProfile(const char* filename, const TunedProfile&);
+const TunedProfile* FindTunedProfile(const std::vector<TunedProfile>&, const std::string& host,
+                                     const EncodeConfig&, const TileDimensions&);
+TunedProfile        MakeTunedProfile(const EncodeConfig&, const TileDimensions&, const AutotuneTrial&);
+
+// Searches one setting at a time (decode thread placement, then each depth), keeping a value only when it
+// is measurably faster than the best so far.  Settings pinned on the command line are not searched, and
+// those of the decoder only when frames come from it.
+class AutotuneSearch
+{
+public:
+    AutotuneSearch(const AutotuneSettings& requested, bool inlinePinned, bool decoderSource,
+                   unsigned int minimumEncodeBuffers);
+
+    // Settings for the next trial; false once every setting has been searched
+    bool                 Next(AutotuneSettings&);
+    void                 Report(const AutotuneTrial&);
+    const AutotuneTrial& GetBest() const { return trials.at(best); }
+    std::string          Describe() const;
+
+private:
+    enum Knob { KNOB_INLINE, KNOB_DECODE, KNOB_QUEUE, KNOB_OUTPUT, KNOB_DELAY, KNOB_ENCODE, KNOB_COUNT };
+
+    AutotuneSettings           baseline;
+    std::vector<bool>          searched;     // Per knob
+    unsigned int               minimumEncodeBuffers;
+    int                        knob;         // Being searched; -1 until the baseline has been measured
+    std::vector<int>           candidates;   // Values of the knob still to be tried
+    std::vector<AutotuneTrial> trials;
+    size_t                     best;
+
+    static int       Get(const AutotuneSettings&, int knob);
+    static void      Set(AutotuneSettings&, int knob, int value);
+    std::vector<int> GetCandidates(int knob) const;
+};
+
+// Frames of a textured pattern panning across the picture, standing in for a decoded input when there is
+// none to sample.  Patterns are uploaded once and handed out in turn, so that the encoders (and not the
+// source) bound the throughput.
+class SyntheticFrameSource : public FrameSource
+{
+public:
+    SyntheticFrameSource(CUvideoctxlock lock, int width, int height, size_t frames) :
+        lock(lock), width(width), height(height), frames(frames), next(0), pitch(0), cancelled(false)
+        { }
+    ~SyntheticFrameSource();
+
+    int  Open();
+    // Returns to the first frame for another pass
+    void Rewind() { next = 0; cancelled = false; }
+    bool NextFrame(DecodedFrame&, bool& cut);
+    void ReleaseFrame(DecodedFrame&) { }
+    void Cancel() { cancelled = true; }
+
+private:
+    CUvideoctxlock           lock;
+    int                      width, height;
+    size_t                   frames, next;
+    size_t                   pitch;
+    bool                     cancelled;
+    std::vector<CUdeviceptr> patterns;
+};
+
+#endif
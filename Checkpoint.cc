@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+
+#include "Checkpoint.h"
+
+#define CHECKPOINT_VERSION 1
+
+int LoadCheckpoint(const char* filename, const TileDimensions& dimensions, Checkpoint& checkpoint)
+{
+    FILE* file;
+    int version;
+    size_t count;
+
+    if((file = fopen(filename, "r")) == NULL)
+        return -1;
+    else if(fscanf(file, "tiler-checkpoint %d frame %d processed %d actual %d tiles %lu",
+                   &version, &checkpoint.frame, &checkpoint.frmProcessed, &checkpoint.frmActual, &count) != 5 ||
+            version != CHECKPOINT_VERSION || count != dimensions.count)
+    {
+        fprintf(stderr, "Checkpoint %s does not match the tile layout\n", filename);
+        return fclose(file), -1;
+    }
+
+    checkpoint.offsets.assign(count, -1);
+    for(auto& offset: checkpoint.offsets)
+        if(fscanf(file, "%lld", &offset) != 1)
+        {
+            fprintf(stderr, "Checkpoint %s is truncated\n", filename);
+            return fclose(file), -1;
+        }
+
+    fclose(file);
+    return 0;
+}
+
+int SaveCheckpoint(const char* filename, const Checkpoint& checkpoint)
+{
+    auto temporary = std::string(filename) + ".tmp";
+    FILE* file;
+    auto result = 0;
+
+    if((file = fopen(temporary.c_str(), "w")) == NULL)
+        return -1;
+
+    fprintf(file, "tiler-checkpoint %d\nframe %d\nprocessed %d\nactual %d\ntiles %lu\n",
+            CHECKPOINT_VERSION, checkpoint.frame, checkpoint.frmProcessed, checkpoint.frmActual,
+            checkpoint.offsets.size());
+    for(auto offset: checkpoint.offsets)
+        fprintf(file, "%lld\n", offset);
+
+    if(fflush(file) != 0 || fsync(fileno(file)) != 0)
+        result = -1;
+    if(fclose(file) != 0 || result != 0 || rename(temporary.c_str(), filename) != 0)
+        return unlink(temporary.c_str()), -1;
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef _CHECKPOINT
+#define _CHECKPOINT
+
+#include <vector>
+
+#include "TileDimensions.h"
+
+// Progress of a transcode at a frame that was encoded as an IDR on every tile.  Resuming truncates
+// each tile output to its offset and restarts encoding at the checkpoint frame with fresh encoders.
+typedef struct Checkpoint
+{
+    int                    frame;         // Index of the decoded frame encoded as the aligned IDR
+    int                    frmProcessed;  // Frame-rate conversion counters before that frame
+    int                    frmActual;
+    std::vector<long long> offsets;       // Per-tile output offset at which the IDR begins; -1 if pending
+} Checkpoint;
+
+int LoadCheckpoint(const char* filename, const TileDimensions&, Checkpoint&);
+// Atomically replaces the checkpoint file; tile outputs must be durable up to the offsets beforehand
+int SaveCheckpoint(const char* filename, const Checkpoint&);
+
+#endif
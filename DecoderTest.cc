@@ -0,0 +1,251 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "VideoDecoder.h"
+
+// Decodes, without a decode thread, a stream whose frames are so small that one parse chunk displays far
+// more of them than the frame queue holds.  Parsing a whole chunk on the only consumer thread would fill
+// the queue and wait on it forever, so the test fails by timing out if NextFrame does not return as soon as
+// a frame is displayed.  The stream is written by the test: one I_PCM IDR frame followed by P frames whose
+// macroblocks are all skipped (a few bytes each).  Needs a GPU.
+
+#define TEST_WIDTH_MBS  4
+#define TEST_HEIGHT_MBS 4
+#define TEST_FRAMES     1000
+#define TEST_TIMEOUT    30   // seconds before a run is taken to have deadlocked
+
+#define H264_NAL_SLICE  1
+#define H264_NAL_IDR    5
+#define H264_NAL_SPS    7
+#define H264_NAL_PPS    8
+
+// Writes the fields of an H.264 RBSP, most significant bit first
+class RbspWriter
+{
+public:
+    RbspWriter() : bits(0) { }
+
+    void WriteBits(const uint32_t value, const unsigned int count)
+    {
+        for(auto i = count; i > 0; i--, bits++)
+        {
+            if(bits % 8 == 0)
+                data.push_back(0);
+            data.back() |= ((value >> (i - 1)) & 1) << (7 - bits % 8);
+        }
+    }
+
+    void WriteUE(const uint32_t value)
+    {
+        auto length = 0u;
+
+        while((value + 1) >> (length + 1))
+            length++;
+        WriteBits(0, length);
+        WriteBits(value + 1, length + 1);
+    }
+
+    void WriteSE(const int32_t value) { WriteUE(value > 0 ? 2 * value - 1 : -2 * value); }
+    void Align()                      { WriteBits(0, (8 - bits % 8) % 8); }
+    void WriteTrailingBits()          { WriteBits(1, 1); Align(); }
+
+    std::vector<uint8_t> data;
+
+private:
+    size_t bits;
+};
+
+// Appends a NAL unit with a four-byte start code, inserting emulation prevention bytes
+static void WriteNal(std::vector<uint8_t>& stream, const unsigned int referenceIdc, const unsigned int type,
+                     const std::vector<uint8_t>& rbsp)
+{
+    auto zeros = 0;
+
+    stream.insert(stream.end(), { 0, 0, 0, 1, (uint8_t)(referenceIdc << 5 | type) });
+
+    for(auto byte: rbsp)
+    {
+        if(zeros == 2 && byte <= 3)
+        {
+            stream.push_back(3);
+            zeros = 0;
+        }
+        stream.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+}
+
+// Baseline profile, CAVLC, picture order following frame_num (so that frames display in decode order)
+static std::vector<uint8_t> WriteTestStream(const int frames)
+{
+    std::vector<uint8_t> stream;
+    RbspWriter sps, pps, idr;
+
+    sps.WriteBits(66, 8);                     // profile_idc
+    sps.WriteBits(0, 8);                      // constraint flags
+    sps.WriteBits(30, 8);                     // level_idc
+    sps.WriteUE(0);                           // seq_parameter_set_id
+    sps.WriteUE(0);                           // log2_max_frame_num_minus4
+    sps.WriteUE(2);                           // pic_order_cnt_type
+    sps.WriteUE(1);                           // max_num_ref_frames
+    sps.WriteBits(0, 1);                      // gaps_in_frame_num_value_allowed_flag
+    sps.WriteUE(TEST_WIDTH_MBS - 1);
+    sps.WriteUE(TEST_HEIGHT_MBS - 1);
+    sps.WriteBits(1, 1);                      // frame_mbs_only_flag
+    sps.WriteBits(1, 1);                      // direct_8x8_inference_flag
+    sps.WriteBits(0, 1);                      // frame_cropping_flag
+    sps.WriteBits(0, 1);                      // vui_parameters_present_flag
+    sps.WriteTrailingBits();
+    WriteNal(stream, 3, H264_NAL_SPS, sps.data);
+
+    pps.WriteUE(0);                           // pic_parameter_set_id
+    pps.WriteUE(0);                           // seq_parameter_set_id
+    pps.WriteBits(0, 1);                      // entropy_coding_mode_flag
+    pps.WriteBits(0, 1);                      // bottom_field_pic_order_in_frame_present_flag
+    pps.WriteUE(0);                           // num_slice_groups_minus1
+    pps.WriteUE(0);                           // num_ref_idx_l0_default_active_minus1
+    pps.WriteUE(0);                           // num_ref_idx_l1_default_active_minus1
+    pps.WriteBits(0, 3);                      // weighted_pred_flag, weighted_bipred_idc
+    pps.WriteSE(0);                           // pic_init_qp_minus26
+    pps.WriteSE(0);                           // pic_init_qs_minus26
+    pps.WriteSE(0);                           // chroma_qp_index_offset
+    pps.WriteBits(0, 3);                      // deblocking, constrained intra and redundant_pic_cnt flags
+    pps.WriteTrailingBits();
+    WriteNal(stream, 3, H264_NAL_PPS, pps.data);
+
+    idr.WriteUE(0);                           // first_mb_in_slice
+    idr.WriteUE(7);                           // slice_type (I)
+    idr.WriteUE(0);                           // pic_parameter_set_id
+    idr.WriteBits(0, 4);                      // frame_num
+    idr.WriteUE(0);                           // idr_pic_id
+    idr.WriteBits(0, 2);                      // no_output_of_prior_pics_flag, long_term_reference_flag
+    idr.WriteSE(0);                           // slice_qp_delta
+    for(auto mb = 0; mb < TEST_WIDTH_MBS * TEST_HEIGHT_MBS; mb++)
+    {
+        idr.WriteUE(25);                      // mb_type (I_PCM)
+        idr.Align();
+        for(auto sample = 0; sample < 256 + 2 * 64; sample++)
+            idr.WriteBits(sample < 256 ? 16 + mb * 8 : 128, 8);
+    }
+    idr.WriteTrailingBits();
+    WriteNal(stream, 3, H264_NAL_IDR, idr.data);
+
+    for(auto frame = 1; frame < frames; frame++)
+    {
+        RbspWriter slice;
+
+        slice.WriteUE(0);                     // first_mb_in_slice
+        slice.WriteUE(5);                     // slice_type (P)
+        slice.WriteUE(0);                     // pic_parameter_set_id
+        slice.WriteBits(frame % 16, 4);       // frame_num
+        slice.WriteBits(0, 3);                // num_ref_idx_active_override, reordering and marking flags
+        slice.WriteSE(0);                     // slice_qp_delta
+        slice.WriteUE(TEST_WIDTH_MBS * TEST_HEIGHT_MBS);  // mb_skip_run
+        slice.WriteTrailingBits();
+        WriteNal(stream, 2, H264_NAL_SLICE, slice.data);
+    }
+
+    return stream;
+}
+
+// Pulls every frame, keeping up to held frames mapped at once (as the stream scheduler keeps two)
+static int Decode(const char* filename, CUvideoctxlock lock, const unsigned int capacity, const size_t held)
+{
+    CudaDecoder decoder;
+    CUVIDFrameQueue queue(lock);
+    std::vector<DecodedFrame> frames;
+    DecodedFrame frame;
+    auto decoded = 0;
+
+    if(!decoder.InitVideoDecoder(filename, lock, &queue))
+        return fprintf(stderr, "InitVideoDecoder failed\n"), -1;
+
+    queue.setCapacity(capacity);
+    alarm(TEST_TIMEOUT);
+
+    while(decoder.NextFrame(frame))
+    {
+        frames.push_back(frame);
+        decoded++;
+
+        if(frames.size() == held)
+        {
+            decoder.ReleaseFrame(frames.front());
+            frames.erase(frames.begin());
+        }
+    }
+
+    for(auto& remaining: frames)
+        decoder.ReleaseFrame(remaining);
+    alarm(0);
+
+    printf("Queue capacity %u, %lu held: %d of %d frames%s\n", capacity, held, decoded, TEST_FRAMES,
+           decoder.HasFailed() ? ", decoding failed" : "");
+    return decoded == TEST_FRAMES && !decoder.HasFailed() ? 0 : -1;
+}
+
+static void TimedOut(int)
+{
+    static const char message[] = "Timed out: the inline decoder deadlocked\n";
+
+    if(write(STDERR_FILENO, message, sizeof(message) - 1) < 0)
+        _exit(2);
+    _exit(1);
+}
+
+int main(int argc, char*[])
+{
+    typedef void *CUDADRIVER;
+    CUDADRIVER hHandleDriver = 0;
+    char filename[] = "/tmp/decoder_test_XXXXXX.h264";
+    auto stream = WriteTestStream(TEST_FRAMES);
+    CUcontext context, current;
+    CUvideoctxlock lock;
+    CUdevice device;
+    FILE* file;
+    size_t written;
+    int descriptor, status = 0;
+
+    if(argc > 1)
+        return fprintf(stderr, "Usage : decoder_test\n"), 1;
+
+    // The whole stream falls within one parse chunk
+    printf("Test stream: %d frames in %lu bytes (parse chunks of %d bytes)\n", TEST_FRAMES, stream.size(),
+           PARSE_CHUNK_SIZE);
+
+    signal(SIGALRM, TimedOut);
+
+    if((descriptor = mkstemps(filename, 5)) < 0 || (file = fdopen(descriptor, "wb")) == NULL)
+        return fprintf(stderr, "Unable to create %s\n", filename), 1;
+
+    written = fwrite(stream.data(), 1, stream.size(), file);
+    if(fclose(file) != 0 || written != stream.size())
+        status = fprintf(stderr, "Unable to write %s\n", filename);
+    else if(cuInit(0, __CUDA_API_VERSION, hHandleDriver) != CUDA_SUCCESS)
+        status = fprintf(stderr, "cuInit failed\n");
+    else if(cuvidInit(0) != CUDA_SUCCESS)
+        status = fprintf(stderr, "cuvidInit failed\n");
+    else if(cuDeviceGet(&device, 0) != CUDA_SUCCESS || cuCtxCreate(&context, CU_CTX_SCHED_AUTO, device) != CUDA_SUCCESS)
+        status = fprintf(stderr, "Unable to create a CUDA context\n");
+    else
+    {
+        if(cuCtxPopCurrent(&current) != CUDA_SUCCESS || cuvidCtxLockCreate(&lock, context) != CUDA_SUCCESS)
+            status = fprintf(stderr, "Unable to create a context lock\n");
+        else
+        {
+            // The smallest queue (as the tuner may leave it), then the default with frames held across pulls
+            status |= Decode(filename, lock, 1, 1);
+            status |= Decode(filename, lock, FrameQueue::cnDefaultSize, 2);
+            cuvidCtxLockDestroy(lock);
+        }
+        cuCtxDestroy(context);
+    }
+
+    unlink(filename);
+    return status != 0 ? 1 : 0;
+}
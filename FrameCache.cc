@@ -0,0 +1,332 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FrameCache.h"
+#include "PipelineTuner.h"
+#include "Trace.h"
+
+FrameCacheWriter::FrameCacheWriter(FrameSource& upstream, CUvideoctxlock lock, const std::string& key,
+                                   const std::string& filename, const FrameCacheHeader& header, const size_t limit)
+    : upstream(upstream), lock(lock), key(key), filename(filename), header(header), limit(limit),
+      bytes(sizeof(header)), file(NULL), staging(NULL), cancelled(false)
+{
+    this->header.frames = 0;
+
+    if(cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        if(cuMemAllocHost((void**)&staging, header.width * header.height * 3 / 2) != CUDA_SUCCESS)
+            staging = NULL;
+        cuvidCtxUnlock(lock, 0);
+    }
+
+    // A spill that cannot begin leaves the writer passing frames through
+    if(staging != NULL && (file = fopen(filename.c_str(), "wb")) != NULL &&
+       fwrite(&this->header, sizeof(this->header), 1, file) != 1)
+        Abandon();
+}
+
+FrameCacheWriter::~FrameCacheWriter()
+{
+    Abandon();
+
+    if(staging != NULL && cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        cuMemFreeHost(staging);
+        cuvidCtxUnlock(lock, 0);
+    }
+}
+
+void FrameCacheWriter::Abandon()
+{
+    if(file == NULL)
+        return;
+
+    fclose(file);
+    unlink(filename.c_str());
+    file = NULL;
+}
+
+int FrameCacheWriter::Write(const DecodedFrame& frame)
+{
+    TraceSpan span("spill", frame.index);
+    FrameCacheRecord record;
+    CUDA_MEMCPY2D parameters;
+    CUresult result;
+    auto frameBytes = (size_t)header.width * header.height * 3 / 2;
+
+    if(limit != 0 && bytes + sizeof(record) + frameBytes > limit)
+        return -1;
+
+    // The chroma plane follows the luma rows at the same pitch, so one copy takes both
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.srcDevice = frame.device;
+    parameters.srcPitch = frame.pitch;
+    parameters.dstMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.dstHost = staging;
+    parameters.dstPitch = header.width;
+    parameters.WidthInBytes = header.width;
+    parameters.Height = header.height * 3 / 2;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    memset(&record, 0, sizeof(record));
+    record.info = frame.info;
+    record.index = frame.index;
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+    else if(fwrite(&record, sizeof(record), 1, file) != 1 || fwrite(staging, 1, frameBytes, file) != frameBytes)
+        return -1;
+
+    bytes += sizeof(record) + frameBytes;
+    header.frames++;
+    return 0;
+}
+
+bool FrameCacheWriter::NextFrame(DecodedFrame& frame, bool& cut)
+{
+    if(!upstream.NextFrame(frame, cut))
+        return false;
+
+    // The frame goes on to the encoder whether or not it could be spilled
+    if(IsSpilling() && Write(frame) != 0)
+    {
+        fprintf(stderr, "Frame cache: stopped spilling at frame %d (size limit or write failure)\n", frame.index);
+        Abandon();
+    }
+
+    return true;
+}
+
+int FrameCacheWriter::Commit(const std::string& destination)
+{
+    if(!IsSpilling())
+        return -1;
+    // The header is rewritten with the frame count only once every frame is in place
+    else if(fflush(file) != 0 || fseeko(file, 0, SEEK_SET) != 0 ||
+            fwrite(&header, sizeof(header), 1, file) != 1 || fclose(file) != 0)
+        return file = NULL, unlink(filename.c_str()), -1;
+
+    file = NULL;
+    if(rename(filename.c_str(), destination.c_str()) != 0)
+        return unlink(filename.c_str()), -1;
+
+    return 0;
+}
+
+FrameCacheReader::~FrameCacheReader()
+{
+    if(!surfaces.empty() && cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        for(auto surface: surfaces)
+            cuMemFree(surface);
+        cuvidCtxUnlock(lock, 0);
+    }
+
+    if(data != NULL)
+        munmap(data, length);
+}
+
+int FrameCacheReader::Open(const std::string& filename)
+{
+    struct stat status;
+    int descriptor;
+
+    if((descriptor = open(filename.c_str(), O_RDONLY)) < 0)
+        return -1;
+    else if(fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(FrameCacheHeader))
+        return close(descriptor), -1;
+    else if((data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0)) == MAP_FAILED)
+        return data = NULL, close(descriptor), -1;
+
+    close(descriptor);
+    length = status.st_size;
+    header = (const FrameCacheHeader*)data;
+
+    if(header->magic != FRAME_CACHE_MAGIC || header->version != FRAME_CACHE_VERSION ||
+       header->width == 0 || header->height == 0 ||
+       length != sizeof(FrameCacheHeader) + header->frames * GetFrameBytes())
+        return -1;
+
+    // Frames are read once, front to back
+    madvise(data, length, MADV_SEQUENTIAL);
+    return 0;
+}
+
+bool FrameCacheReader::NextFrame(DecodedFrame& frame, bool& cut)
+{
+    CUDA_MEMCPY2D parameters;
+    CUresult result = CUDA_SUCCESS;
+    CUdeviceptr surface = 0;
+
+    if(cancelled || next == header->frames)
+        return false;
+
+    auto* frames = (const uint8_t*)data + sizeof(FrameCacheHeader);
+    auto* record = (const FrameCacheRecord*)(frames + next++ * GetFrameBytes());
+    TraceSpan span("cached frame", record->index);
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return failed = true, false;
+    // Surfaces are allocated as the consumer holds more of them (e.g., a scene-cut lookahead)
+    if(available.empty() && (result = cuMemAllocPitch(&surface, &pitch, header->width, header->height * 3 / 2, 16))
+                            == CUDA_SUCCESS)
+        surfaces.push_back(surface);
+    else if(!available.empty())
+    {
+        surface = available.back();
+        available.pop_back();
+    }
+
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.srcHost = record + 1;
+    parameters.srcPitch = header->width;
+    parameters.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.dstDevice = surface;
+    parameters.dstPitch = pitch;
+    parameters.WidthInBytes = header->width;
+    parameters.Height = header->height * 3 / 2;
+
+    if(result == CUDA_SUCCESS && (result = cuMemcpy2D(&parameters)) != CUDA_SUCCESS)
+        available.push_back(surface);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return fprintf(stderr, "CUDA error %d reading cached frame %d\n", result, record->index), failed = true, false;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.info = record->info;
+    frame.device = surface;
+    frame.pitch = pitch;
+    frame.index = record->index;
+    frame.decoded = PipelineTuner::Now();
+    cut = false;
+
+    return true;
+}
+
+int FrameCache::Open()
+{
+    DIR* handle;
+    struct dirent* entry;
+    struct stat status;
+    const std::string extension = ".frames";
+
+    if(mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        return fprintf(stderr, "Unable to create frame cache %s\n", directory.c_str()), -1;
+    else if((handle = opendir(directory.c_str())) == NULL)
+        return fprintf(stderr, "Unable to open frame cache %s\n", directory.c_str()), -1;
+
+    entries.clear();
+    statistics.occupancy = 0;
+
+    while((entry = readdir(handle)) != NULL)
+    {
+        std::string filename = entry->d_name;
+
+        if(filename.size() > extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0 &&
+           stat((directory + "/" + filename).c_str(), &status) == 0)
+        {
+            entries[filename.substr(0, filename.size() - extension.size())] = { (size_t)status.st_size, status.st_mtime };
+            statistics.occupancy += status.st_size;
+        }
+    }
+
+    closedir(handle);
+
+    // The capacity may have been lowered since the cache was last used
+    return Evict(0), 0;
+}
+
+std::string FrameCache::Key(const std::string& sourceFingerprint, const int width, const int height,
+                            const int firstFrame, const int lastFrame) const
+{
+    char parameters[64];
+
+    // A size of zero (the source's own) and an open-ended range are keyed as requested
+    snprintf(parameters, sizeof(parameters), "-%dx%d-%d-%d", width, height, firstFrame, lastFrame);
+    return sourceFingerprint + parameters;
+}
+
+FrameCacheReader* FrameCache::Fetch(const std::string& key, CUvideoctxlock lock)
+{
+    auto entry = entries.find(key);
+    FrameCacheReader* reader;
+
+    if(entry == entries.end())
+        return statistics.misses++, (FrameCacheReader*)NULL;
+    else if((reader = new FrameCacheReader(lock))->Open(EntryFilename(key)) != 0)
+    {
+        // Entry was removed or damaged outside of this process
+        delete reader;
+        unlink(EntryFilename(key).c_str());
+        statistics.occupancy -= entry->second.size;
+        entries.erase(entry);
+        return statistics.misses++, (FrameCacheReader*)NULL;
+    }
+
+    entry->second.lastAccess = time(NULL);
+    utime(EntryFilename(key).c_str(), NULL);
+    statistics.hits++;
+
+    return reader;
+}
+
+FrameCacheWriter* FrameCache::Spill(const std::string& key, FrameSource& upstream, CUvideoctxlock lock,
+                                    const FrameCacheHeader& header)
+{
+    return new FrameCacheWriter(upstream, lock, key, EntryFilename(key) + ".tmp", header, statistics.capacity);
+}
+
+int FrameCache::Store(FrameCacheWriter& writer)
+{
+    auto& key = writer.GetKey();
+
+    if(!writer.IsSpilling())
+        return -1;
+    else if(Evict(writer.GetBytes()) != 0)
+        return -1;
+    else if(writer.Commit(EntryFilename(key)) != 0)
+        return -1;
+
+    if(entries.count(key))
+        statistics.occupancy -= entries[key].size;
+    entries[key] = { writer.GetBytes(), time(NULL) };
+    statistics.occupancy += writer.GetBytes();
+    statistics.stores++;
+
+    return 0;
+}
+
+int FrameCache::Evict(const size_t required)
+{
+    if(statistics.capacity && required > statistics.capacity)
+        return -1;
+
+    while(statistics.capacity && statistics.occupancy + required > statistics.capacity && !entries.empty())
+    {
+        auto victim = entries.begin();
+        for(auto entry = entries.begin(); entry != entries.end(); entry++)
+            if(entry->second.lastAccess < victim->second.lastAccess)
+                victim = entry;
+
+        unlink(EntryFilename(victim->first).c_str());
+        statistics.occupancy -= victim->second.size;
+        statistics.evictions++;
+        entries.erase(victim);
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef _FRAME_CACHE
+#define _FRAME_CACHE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PipelineStages.h"
+#include "TileCache.h"
+
+#define FRAME_CACHE_MAGIC   0x43465254  // "TRFC"
+#define FRAME_CACHE_VERSION 1
+
+// A spill file begins with this header, followed by a FrameCacheRecord and the NV12 frame (at a pitch of
+// width) for each frame in display order
+typedef struct FrameCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height;
+    int32_t  frameRateNumerator, frameRateDenominator;  // Of the source
+    uint32_t progressive;
+    uint32_t frames;
+} FrameCacheHeader;
+
+typedef struct FrameCacheRecord
+{
+    CUVIDPARSERDISPINFO info;
+    int32_t             index;
+    uint32_t            reserved;
+} FrameCacheRecord;
+
+// Spills each frame of the upstream source to a file on its way through.  Spilling stops (and the frames
+// are not cached) when the file would exceed the limit or cannot be written.
+class FrameCacheWriter : public FrameSource
+{
+public:
+    FrameCacheWriter(FrameSource& upstream, CUvideoctxlock lock, const std::string& key, const std::string& filename,
+                     const FrameCacheHeader& header, size_t limit);
+    ~FrameCacheWriter();
+
+    bool NextFrame(DecodedFrame&, bool& cut);
+    void ReleaseFrame(DecodedFrame& frame) { upstream.ReleaseFrame(frame); }
+    void Cancel() { cancelled = true; upstream.Cancel(); }
+
+    // Completes the file once every frame has passed; a cancelled or abandoned spill cannot be committed
+    int                Commit(const std::string& destination);
+    bool               IsSpilling() const { return file != NULL && !cancelled; }
+    const std::string& GetKey() const { return key; }
+    size_t             GetBytes() const { return bytes; }
+
+private:
+    FrameSource&   upstream;
+    CUvideoctxlock lock;
+    std::string    key, filename;
+    FrameCacheHeader header;
+    size_t         limit, bytes;
+    FILE*          file;
+    uint8_t*       staging;  // Pinned copy of the frame being spilled
+    bool           cancelled;
+
+    int  Write(const DecodedFrame&);
+    void Abandon();
+};
+
+// Frames read back from a spill file, uploaded to the device as the encoder asks for them
+class FrameCacheReader : public FrameSource
+{
+public:
+    FrameCacheReader(CUvideoctxlock lock) :
+        lock(lock), data(NULL), length(0), header(NULL), next(0), pitch(0), cancelled(false), failed(false)
+        { }
+    ~FrameCacheReader();
+
+    int  Open(const std::string& filename);
+    bool NextFrame(DecodedFrame&, bool& cut);
+    void ReleaseFrame(DecodedFrame& frame) { available.push_back(frame.device); }
+    void Cancel() { cancelled = true; }
+
+    const FrameCacheHeader& GetHeader() const { return *header; }
+    // Whether the frames ended early because one could not be uploaded
+    bool                    HasFailed() const { return failed; }
+
+private:
+    CUvideoctxlock           lock;
+    void*                    data;
+    size_t                   length;
+    const FrameCacheHeader*  header;
+    size_t                   next;
+    size_t                   pitch;
+    bool                     cancelled, failed;
+    std::vector<CUdeviceptr> surfaces;   // Every surface allocated
+    std::vector<CUdeviceptr> available;  // Those not held by the consumer
+
+    size_t GetFrameBytes() const { return sizeof(FrameCacheRecord) + header->width * header->height * 3 / 2; }
+};
+
+// Decoded frames spilled by earlier runs, keyed by a fingerprint of the source, the requested decode size
+// and the frame range, so that re-tiling the same source with another grid or encode settings skips the
+// decode.  Entries are raw NV12 (which maps and uploads without further work) and evicted least recently
+// used first when a spill would exceed the capacity.
+class FrameCache
+{
+public:
+    FrameCache(const std::string& directory, const size_t capacity) :
+        directory(directory),
+        statistics({0, 0, 0, 0, 0, capacity})
+        { }
+
+    // Scans the cache directory for existing entries; returns nonzero on failure
+    int         Open();
+    std::string Key(const std::string& sourceFingerprint, int width, int height, int firstFrame, int lastFrame) const;
+    // Opens the frames of a cached entry; returns NULL (and records a miss) when absent
+    FrameCacheReader* Fetch(const std::string& key, CUvideoctxlock lock);
+    // Spills the frames of a miss as they are decoded, to be stored once decoding completes
+    FrameCacheWriter* Spill(const std::string& key, FrameSource& upstream, CUvideoctxlock lock,
+                            const FrameCacheHeader& header);
+    int         Store(FrameCacheWriter&);
+
+    const TileCacheStatistics& GetStatistics() const { return statistics; }
+
+private:
+    typedef struct Entry
+    {
+        size_t size;
+        time_t lastAccess;
+    } Entry;
+
+    std::string EntryFilename(const std::string& key) const { return directory + "/" + key + ".frames"; }
+    int         Evict(size_t required);
+
+    std::string                  directory;
+    std::map<std::string, Entry> entries;
+    TileCacheStatistics          statistics;
+};
+
+#endif
@@ -12,16 +12,18 @@
 #include "FrameQueue.h"
 #include <stdio.h>
 #include <assert.h>
+#include <time.h>
 
 FrameQueue::FrameQueue(CUvideoctxlock ctxLock): hEvent_(0)
     , nReadPosition_(0), nWritePosition_(0), nFramesInQueue_(0)
-    , bEndOfDecode_(0), m_ctxLock(ctxLock)
+    , bEndOfDecode_(0), nCapacity_(cnDefaultSize), bBlocking_(true), nEnqueueStall_(0), nSurfaceStall_(0), m_ctxLock(ctxLock)
 {
 #ifdef _WIN32
     hEvent_ = CreateEvent(NULL, false, false, NULL);
     InitializeCriticalSection(&oCriticalSection_);
 #else
     pthread_mutex_init(&oCriticalSection_, NULL);
+    pthread_cond_init(&oQueueUpdate_, NULL);
 #endif
 
     memset((void*)aIsFrameInUse_, 0, cnMaximumSize * sizeof(int));
@@ -33,6 +35,7 @@ FrameQueue::~FrameQueue()
     DeleteCriticalSection(&oCriticalSection_);
     CloseHandle(hEvent_);
 #else
+    pthread_cond_destroy(&oQueueUpdate_);
     pthread_mutex_destroy(&oCriticalSection_);
 #endif
 }
@@ -42,6 +45,17 @@ FrameQueue::waitForQueueUpdate()
 {
 #ifdef _WIN32
     WaitForSingleObject(hEvent_, 10);
+#else
+    struct timespec oDeadline;
+    clock_gettime(CLOCK_REALTIME, &oDeadline);
+    oDeadline.tv_nsec += 10 * 1000000;
+    oDeadline.tv_sec += oDeadline.tv_nsec / 1000000000;
+    oDeadline.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&oCriticalSection_);
+    if (nFramesInQueue_ == 0 && !bEndOfDecode_)
+        pthread_cond_timedwait(&oQueueUpdate_, &oCriticalSection_, &oDeadline);
+    pthread_mutex_unlock(&oCriticalSection_);
 #endif
 }
 
@@ -71,6 +85,10 @@ FrameQueue::set_event(HANDLE event)
 {
 #ifdef _WIN32
    SetEvent(event);
+#else
+   pthread_mutex_lock(&oCriticalSection_);
+   pthread_cond_broadcast(&oQueueUpdate_);
+   pthread_mutex_unlock(&oCriticalSection_);
 #endif
 }
 
@@ -116,7 +134,10 @@ FrameQueue::waitUntilFrameAvailable(int nPictureIndex)
 {
     while (isInUse(nPictureIndex))
     {
+        if (!bBlocking_)
+            return false;
         Sleep(1);   // Decoder is getting too far ahead from display
+        nSurfaceStall_++;
         if (isEndOfDecode())
             return false;
     }
@@ -124,6 +145,12 @@ FrameQueue::waitUntilFrameAvailable(int nPictureIndex)
     return true;
 }
 
+void
+FrameQueue::setCapacity(unsigned int nCapacity)
+{
+    nCapacity_ = nCapacity < 1 ? 1 : nCapacity > cnMaximumSize ? cnMaximumSize : nCapacity;
+}
+
 void
 FrameQueue::signalStatusChange()
 {
@@ -145,12 +172,14 @@ CUVIDFrameQueue::enqueue(const void * pData)
     // for display
     const CUVIDPARSERDISPINFO* pPicParams = (const CUVIDPARSERDISPINFO*)(pData);
     aIsFrameInUse_[pPicParams->picture_index] = true;
+    // Each queued frame holds its own decode surface, so a queue that may not block always has room
+    int nCapacity = bBlocking_ ? (int)nCapacity_ : (int)cnMaximumSize;
     // Wait until we have a free entry in the display queue (should never block if we have enough entries)
     do
     {
         bool bPlacedFrame = false;
         enter_CS(&oCriticalSection_);
-        if (nFramesInQueue_ < (int)FrameQueue::cnMaximumSize)
+        if (nFramesInQueue_ < nCapacity)
         {
             int iWritePosition = (nReadPosition_ + nFramesInQueue_) % cnMaximumSize;
             aDisplayQueue_[iWritePosition] = *pPicParams;
@@ -161,7 +190,9 @@ CUVIDFrameQueue::enqueue(const void * pData)
         leave_CS(&oCriticalSection_);
         if (bPlacedFrame) // Done
             break;
+        assert(bBlocking_);
         Sleep(1);   // Wait a bit
+        nEnqueueStall_++;
     } while (!bEndOfDecode_);
     signalStatusChange();  // Signal for the display thread
 }
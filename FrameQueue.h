@@ -31,7 +31,8 @@
 class FrameQueue
 {
 public:
-    static const unsigned int cnMaximumSize = 20; // MAX_FRM_CNT;
+    static const unsigned int cnMaximumSize = 32; // MAX_FRM_CNT; also bounds decode surface indices
+    static const unsigned int cnDefaultSize = 20;
 
     FrameQueue(CUvideoctxlock ctxLock);
 
@@ -98,18 +99,38 @@ public:
 
     bool isEmpty() { return nFramesInQueue_ == 0; }
 
+    // Limits the number of frames awaiting display; may be changed while decoding
+    void setCapacity(unsigned int nCapacity);
+    unsigned int getCapacity() const { return nCapacity_; }
+
+    // A queue filled and drained by the same thread (decoding without a decode thread) must never wait for
+    // itself: enqueue then ignores the capacity, which the decode surfaces bound in any case, and
+    // waitUntilFrameAvailable returns false at once for a surface still in use
+    void setBlocking(bool bBlocking) { bBlocking_ = bBlocking; }
+
+    // Milliseconds the decoder has spent blocked on a full queue, or on a surface still held for display
+    unsigned long long getEnqueueStall() const { return nEnqueueStall_; }
+    unsigned long long getSurfaceStall() const { return nSurfaceStall_; }
+
 protected:
     void
     signalStatusChange();
 
     HANDLE hEvent_;
     CRITICAL_SECTION    oCriticalSection_;
+#ifndef _WIN32
+    pthread_cond_t      oQueueUpdate_;
+#endif
     volatile int        nReadPosition_;
     volatile int        nWritePosition_;
 
     volatile int        nFramesInQueue_;
     volatile int        aIsFrameInUse_[cnMaximumSize];
     volatile int        bEndOfDecode_;
+    volatile unsigned int nCapacity_;
+    volatile bool       bBlocking_;
+    volatile unsigned long long nEnqueueStall_;
+    volatile unsigned long long nSurfaceStall_;
 
     CUvideoctxlock      m_ctxLock;
     size_t              nPitch;
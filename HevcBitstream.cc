@@ -0,0 +1,258 @@
+#include <assert.h>
+#include <string.h>
+
+#include "HevcBitstream.h"
+
+#define ANNEXB_READ_SIZE 4*1024*1024
+
+uint32_t BitReader::ReadBits(const unsigned int count)
+{
+    uint32_t value = 0;
+
+    for(auto i = 0u; i < count; i++, position++)
+    {
+        auto bit = position < size * 8 ? (data[position >> 3] >> (7 - (position & 7))) & 1 : 0;
+        value = (value << 1) | bit;
+    }
+
+    return value;
+}
+
+uint32_t BitReader::ReadUE()
+{
+    auto leadingZeros = 0u;
+
+    while(!ReadFlag() && !IsOverrun())
+        if(++leadingZeros > 31)
+        {
+            malformed = true;
+            return 0;
+        }
+
+    return leadingZeros ? ((1u << leadingZeros) - 1) + ReadBits(leadingZeros) : 0;
+}
+
+int32_t BitReader::ReadSE()
+{
+    auto value = ReadUE();
+    return value & 1 ? (int32_t)((value + 1) / 2) : -(int32_t)(value / 2);
+}
+
+void BitWriter::WriteBits(const uint32_t value, const unsigned int count)
+{
+    for(auto i = count; i > 0; i--)
+    {
+        pending = (pending << 1) | ((value >> (i - 1)) & 1);
+
+        if(++pendingBits == 8)
+        {
+            data.push_back(pending);
+            pending = 0;
+            pendingBits = 0;
+        }
+    }
+}
+
+void BitWriter::WriteUE(const uint32_t value)
+{
+    auto codeNum = value + 1;
+    auto length = 0u;
+
+    assert(value < 0xffffffffu);
+    while((codeNum >> length) > 1)
+        length++;
+
+    WriteBits(0, length);
+    WriteBits(codeNum, length + 1);
+}
+
+void BitWriter::WriteSE(const int32_t value)
+{
+    WriteUE(value > 0 ? 2 * (uint32_t)value - 1 : 2 * (uint32_t)(-(int64_t)value));
+}
+
+void BitWriter::WriteTrailingBits()
+{
+    WriteFlag(true);
+    while(pendingBits)
+        WriteFlag(false);
+}
+
+void BitWriter::WriteBytes(const uint8_t* bytes, const size_t count)
+{
+    assert(pendingBits == 0);
+    data.insert(data.end(), bytes, bytes + count);
+}
+
+void BitCopier::CopyPayload(const std::vector<uint8_t>& rbsp)
+{
+    auto end = RbspPayloadBits(rbsp);
+
+    while(reader.Position() + 32 <= end)
+        Bits(32);
+    if(reader.Position() < end)
+        Bits(end - reader.Position());
+}
+
+unsigned int CeilLog2(const uint32_t value)
+{
+    auto result = 0u;
+
+    while(result < 32 && (1ull << result) < value)
+        result++;
+
+    return result;
+}
+
+size_t RbspPayloadBits(const std::vector<uint8_t>& rbsp)
+{
+    for(auto i = rbsp.size(); i > 0; i--)
+        if(rbsp[i - 1])
+        {
+            auto trailing = 0u;
+            while(!((rbsp[i - 1] >> trailing) & 1))
+                trailing++;
+            return i * 8 - trailing - 1;
+        }
+
+    return 0;
+}
+
+bool AnnexBReader::Open(const char* filename)
+{
+    Close();
+
+    buffer.resize(ANNEXB_READ_SIZE);
+    start = end = 0;
+    eof = false;
+
+    return (file = fopen(filename, "rb")) != NULL;
+}
+
+void AnnexBReader::Close()
+{
+    if(file)
+        fclose(file);
+    file = NULL;
+}
+
+bool AnnexBReader::Fill()
+{
+    if(eof)
+        return false;
+
+    if(start > 0)
+    {
+        memmove(buffer.data(), buffer.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+
+    if(end == buffer.size())
+        buffer.resize(buffer.size() * 2);
+
+    auto count = fread(buffer.data() + end, 1, buffer.size() - end, file);
+    end += count;
+    eof = count == 0;
+
+    return count > 0;
+}
+
+// Returns the offset of the byte following the next three-byte start code at or after offset, or zero
+static size_t FindStartCode(const uint8_t* data, size_t offset, const size_t size)
+{
+    while(offset + 2 < size)
+    {
+        auto* one = (const uint8_t*)memchr(data + offset + 2, 1, size - offset - 2);
+        if(!one)
+            return 0;
+
+        auto position = one - data;
+        if(data[position - 1] == 0 && data[position - 2] == 0)
+            return position + 1;
+        offset = position - 1;
+    }
+
+    return 0;
+}
+
+bool AnnexBReader::Read(NalUnit& nal)
+{
+    size_t payload, next;
+
+    while(!(payload = FindStartCode(buffer.data(), start, end)))
+        if(!Fill())
+            return false;
+
+    // Rebase so that a refill cannot invalidate the payload offset
+    start = payload;
+    while(!(next = FindStartCode(buffer.data(), start, end)) && Fill())
+        ;
+
+    auto payloadEnd = next ? next - 3 : end;
+    while(payloadEnd > start && buffer[payloadEnd - 1] == 0)
+        payloadEnd--;
+
+    if(payloadEnd - start < 2)
+    {
+        start = next ? next - 3 : end;
+        return Read(nal);
+    }
+
+    const uint8_t* data = buffer.data() + start;
+    auto size = payloadEnd - start;
+
+    nal.type = (data[0] >> 1) & 0x3f;
+    nal.layerId = ((data[0] & 1) << 5) | (data[1] >> 3);
+    nal.temporalIdPlus1 = data[1] & 7;
+    nal.rbsp.clear();
+    nal.rbsp.reserve(size);
+
+    for(auto i = 2u, zeros = 0u; i < size; i++)
+    {
+        if(zeros >= 2 && data[i] == 3)
+        {
+            zeros = 0;
+            continue;
+        }
+
+        zeros = data[i] == 0 ? zeros + 1 : 0;
+        nal.rbsp.push_back(data[i]);
+    }
+
+    start = next ? next - 3 : end;
+    return true;
+}
+
+bool AnnexBWriter::Write(const unsigned int type, const unsigned int layerId, const unsigned int temporalIdPlus1,
+                         const std::vector<uint8_t>& rbsp)
+{
+    escaped.clear();
+    escaped.reserve(rbsp.size() + rbsp.size() / 64 + 6);
+    escaped.push_back(0);
+    escaped.push_back(0);
+    escaped.push_back(0);
+    escaped.push_back(1);
+    escaped.push_back((uint8_t)((type << 1) | (layerId >> 5)));
+    escaped.push_back((uint8_t)(((layerId & 0x1f) << 3) | temporalIdPlus1));
+
+    auto zeros = 0u;
+    for(auto byte: rbsp)
+    {
+        if(zeros >= 2 && byte <= 3)
+        {
+            escaped.push_back(3);
+            zeros = 0;
+        }
+
+        zeros = byte == 0 ? zeros + 1 : 0;
+        escaped.push_back(byte);
+    }
+
+    // A payload ending in zero must not run into the next start code
+    if(!rbsp.empty() && rbsp.back() == 0)
+        escaped.push_back(3);
+
+    written += escaped.size();
+    return fwrite(escaped.data(), 1, escaped.size(), file) == escaped.size();
+}
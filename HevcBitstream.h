@@ -0,0 +1,155 @@
+#ifndef _HEVC_BITSTREAM
+#define _HEVC_BITSTREAM
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#define HEVC_NAL_IDR_W_RADL   19
+#define HEVC_NAL_IDR_N_LP     20
+#define HEVC_NAL_BLA_W_LP     16
+#define HEVC_NAL_RSV_IRAP_23  23
+#define HEVC_NAL_VPS          32
+#define HEVC_NAL_SPS          33
+#define HEVC_NAL_PPS          34
+#define HEVC_NAL_AUD          35
+#define HEVC_NAL_EOS          36
+#define HEVC_NAL_EOB          37
+#define HEVC_NAL_FD           38
+#define HEVC_NAL_PREFIX_SEI   39
+#define HEVC_NAL_SUFFIX_SEI   40
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, const size_t size) :
+        data(data), size(size), position(0), malformed(false)
+        { }
+
+    uint32_t ReadBits(unsigned int count);
+    bool     ReadFlag()         { return ReadBits(1) != 0; }
+    uint32_t ReadUE();
+    int32_t  ReadSE();
+
+    size_t   Position()   const { return position; }
+    size_t   Size()       const { return size * 8; }
+    bool     IsAligned()  const { return (position & 7) == 0; }
+    bool     IsOverrun()  const { return position > size * 8; }
+    // Whether the stream ran out or held a value that cannot be represented (an Exp-Golomb code of over 32 bits)
+    bool     HasFailed()  const { return malformed || IsOverrun(); }
+
+private:
+    const uint8_t* data;
+    size_t         size;
+    size_t         position;
+    bool           malformed;
+};
+
+class BitWriter
+{
+public:
+    BitWriter() : pending(0), pendingBits(0)
+        { }
+
+    void WriteBits(uint32_t value, unsigned int count);
+    void WriteFlag(const bool value)   { WriteBits(value ? 1 : 0, 1); }
+    void WriteUE(uint32_t value);
+    void WriteSE(int32_t value);
+    // Writes rbsp_trailing_bits (or byte_alignment in a slice header): a stop bit followed by zero alignment
+    void WriteTrailingBits();
+    // Appends whole bytes; the writer must be byte-aligned
+    void WriteBytes(const uint8_t* bytes, size_t count);
+
+    std::vector<uint8_t>& Data() { return data; }
+
+private:
+    std::vector<uint8_t> data;
+    uint8_t              pending;
+    unsigned int         pendingBits;
+};
+
+// Reads fields from a reader and, when a writer is present, reproduces them verbatim.  Used to
+// rewrite syntax structures in place while changing only the fields of interest.
+class BitCopier
+{
+public:
+    BitCopier(BitReader& reader, BitWriter* writer) : reader(reader), writer(writer)
+        { }
+
+    uint32_t Bits(const unsigned int count)
+        { auto value = reader.ReadBits(count); if(writer) writer->WriteBits(value, count); return value; }
+    bool     Flag()
+        { return Bits(1) != 0; }
+    uint32_t UE()
+        { auto value = reader.ReadUE(); if(writer) writer->WriteUE(value); return value; }
+    int32_t  SE()
+        { auto value = reader.ReadSE(); if(writer) writer->WriteSE(value); return value; }
+    // Copies all remaining payload bits, stopping before the rbsp stop bit
+    void     CopyPayload(const std::vector<uint8_t>& rbsp);
+
+    BitReader& Reader()  { return reader; }
+    BitWriter* Writer()  { return writer; }
+
+private:
+    BitReader& reader;
+    BitWriter* writer;
+};
+
+typedef struct NalUnit
+{
+    unsigned int         type;
+    unsigned int         layerId;
+    unsigned int         temporalIdPlus1;
+    std::vector<uint8_t> rbsp;  // Payload following the two-byte header, with emulation prevention removed
+} NalUnit;
+
+inline bool IsVclNal(const NalUnit& nal) { return nal.type < 32; }
+inline bool IsIrapNal(const NalUnit& nal) { return nal.type >= HEVC_NAL_BLA_W_LP && nal.type <= HEVC_NAL_RSV_IRAP_23; }
+inline bool IsIdrNal(const NalUnit& nal) { return nal.type == HEVC_NAL_IDR_W_RADL || nal.type == HEVC_NAL_IDR_N_LP; }
+
+// Returns the ceiling of log2(value), which is the width of most fixed-length HEVC indices
+unsigned int CeilLog2(uint32_t value);
+
+// Position (in bits) of the rbsp_stop_one_bit, or the payload length when none is present
+size_t RbspPayloadBits(const std::vector<uint8_t>& rbsp);
+
+class AnnexBReader
+{
+public:
+    AnnexBReader() : file(NULL), start(0), end(0), eof(false)
+        { }
+    ~AnnexBReader()
+        { Close(); }
+
+    bool Open(const char* filename);
+    void Close();
+    // Reads the next NAL unit; returns false at end of stream
+    bool Read(NalUnit& nal);
+
+private:
+    bool Fill();
+
+    FILE*                file;
+    std::vector<uint8_t> buffer;
+    size_t               start, end;
+    bool                 eof;
+};
+
+class AnnexBWriter
+{
+public:
+    AnnexBWriter(FILE* file) : file(file), written(0)
+        { }
+
+    // Writes a NAL unit with a four-byte start code, reinserting emulation prevention bytes
+    bool   Write(unsigned int type, unsigned int layerId, unsigned int temporalIdPlus1,
+                 const std::vector<uint8_t>& rbsp);
+    size_t GetWrittenBytes() const { return written; }
+
+private:
+    FILE*                file;
+    std::vector<uint8_t> escaped;
+    size_t               written;
+};
+
+#endif
@@ -0,0 +1,854 @@
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+
+#include "HevcStitcher.h"
+
+#define SLICE_TYPE_B 0
+#define SLICE_TYPE_P 1
+
+static int error(const char* message, const int exitCode = -1)
+{
+    std::cerr << message << std::endl;
+    return exitCode;
+}
+
+typedef struct HevcLevelLimits
+{
+    unsigned int levelIdc;
+    unsigned int maxLumaPs;
+    unsigned int maxTileRows, maxTileColumns;
+} HevcLevelLimits;
+
+// ref HEVC spec: Table A.6 General tier and level limits
+static const HevcLevelLimits levelLimits[] = {
+    {  30,    36864,  1,  1 }, {  60,   122880,  1,  1 }, {  63,   245760,  1,  1 },
+    {  90,   552960,  2,  2 }, {  93,   983040,  3,  3 }, { 120,  2228224,  5,  5 },
+    { 123,  2228224,  5,  5 }, { 150,  8912896, 11, 10 }, { 153,  8912896, 11, 10 },
+    { 156,  8912896, 11, 10 }, { 180, 35651584, 22, 20 }, { 183, 35651584, 22, 20 },
+    { 186, 35651584, 22, 20 } };
+
+static unsigned int MinimumLevel(const unsigned int width, const unsigned int height,
+                                 const size_t rows, const size_t columns)
+{
+    for(auto& limits: levelLimits)
+    {
+        auto maxDimension = sqrt(8.0 * limits.maxLumaPs);
+        if((size_t)width * height <= limits.maxLumaPs && width <= maxDimension && height <= maxDimension &&
+           rows <= limits.maxTileRows && columns <= limits.maxTileColumns)
+            return limits.levelIdc;
+    }
+
+    return 0;
+}
+
+// Copies profile_tier_level, optionally replacing general_level_idc; returns the original level
+static unsigned int CopyProfileTierLevel(BitCopier& copier, const unsigned int maxSubLayersMinus1,
+                                         const unsigned int levelIdc = 0)
+{
+    bool profilePresent[8], levelPresent[8];
+
+    copier.Bits(32);
+    copier.Bits(32);
+    copier.Bits(24);
+
+    auto originalLevel = copier.Reader().ReadBits(8);
+    if(copier.Writer())
+        copier.Writer()->WriteBits(levelIdc ? levelIdc : originalLevel, 8);
+
+    for(auto i = 0u; i < maxSubLayersMinus1; i++)
+    {
+        profilePresent[i] = copier.Flag();
+        levelPresent[i] = copier.Flag();
+    }
+    if(maxSubLayersMinus1 > 0)
+        for(auto i = maxSubLayersMinus1; i < 8; i++)
+            copier.Bits(2);
+    for(auto i = 0u; i < maxSubLayersMinus1; i++)
+    {
+        if(profilePresent[i])
+        {
+            copier.Bits(32);
+            copier.Bits(32);
+            copier.Bits(24);
+        }
+        if(levelPresent[i])
+            copier.Bits(8);
+    }
+
+    return originalLevel;
+}
+
+static void CopyScalingListData(BitCopier& copier)
+{
+    for(auto sizeId = 0u; sizeId < 4; sizeId++)
+        for(auto matrixId = 0u; matrixId < 6; matrixId += sizeId == 3 ? 3 : 1)
+            if(!copier.Flag())
+                copier.UE();
+            else
+            {
+                auto coefficients = std::min(64u, 1u << (4 + (sizeId << 1)));
+                if(sizeId > 1)
+                    copier.SE();
+                for(auto i = 0u; i < coefficients; i++)
+                    copier.SE();
+            }
+}
+
+// ref HEVC spec: 7.3.7 Short-term reference picture set syntax and 7.4.8 semantics
+static HevcShortTermRps CopyShortTermRps(BitCopier& copier, const unsigned int index, const unsigned int count,
+                                         const std::vector<HevcShortTermRps>& sets)
+{
+    HevcShortTermRps rps;
+
+    if(index != 0 && copier.Flag())
+    {
+        auto deltaIndex = index == count ? copier.UE() + 1 : 1;
+        auto sign = copier.Flag();
+        auto deltaRps = (1 - 2 * (int)sign) * (int)(copier.UE() + 1);
+        auto& reference = sets.at(index - deltaIndex);
+        auto negative = reference.deltaPocS0.size(), positive = reference.deltaPocS1.size();
+        std::vector<bool> usedByCurrPic(negative + positive + 1), useDelta(negative + positive + 1, true);
+
+        for(auto j = 0u; j <= negative + positive; j++)
+            if(!(usedByCurrPic[j] = copier.Flag()))
+                useDelta[j] = copier.Flag();
+
+        for(auto j = (int)positive - 1; j >= 0; j--)
+        {
+            auto deltaPoc = reference.deltaPocS1[j] + deltaRps;
+            if(deltaPoc < 0 && useDelta[negative + j])
+            {
+                rps.deltaPocS0.push_back(deltaPoc);
+                rps.usedS0.push_back(usedByCurrPic[negative + j]);
+            }
+        }
+        if(deltaRps < 0 && useDelta[negative + positive])
+        {
+            rps.deltaPocS0.push_back(deltaRps);
+            rps.usedS0.push_back(usedByCurrPic[negative + positive]);
+        }
+        for(auto j = 0u; j < negative; j++)
+        {
+            auto deltaPoc = reference.deltaPocS0[j] + deltaRps;
+            if(deltaPoc < 0 && useDelta[j])
+            {
+                rps.deltaPocS0.push_back(deltaPoc);
+                rps.usedS0.push_back(usedByCurrPic[j]);
+            }
+        }
+
+        for(auto j = (int)negative - 1; j >= 0; j--)
+        {
+            auto deltaPoc = reference.deltaPocS0[j] + deltaRps;
+            if(deltaPoc > 0 && useDelta[j])
+            {
+                rps.deltaPocS1.push_back(deltaPoc);
+                rps.usedS1.push_back(usedByCurrPic[j]);
+            }
+        }
+        if(deltaRps > 0 && useDelta[negative + positive])
+        {
+            rps.deltaPocS1.push_back(deltaRps);
+            rps.usedS1.push_back(usedByCurrPic[negative + positive]);
+        }
+        for(auto j = 0u; j < positive; j++)
+        {
+            auto deltaPoc = reference.deltaPocS1[j] + deltaRps;
+            if(deltaPoc > 0 && useDelta[negative + j])
+            {
+                rps.deltaPocS1.push_back(deltaPoc);
+                rps.usedS1.push_back(usedByCurrPic[negative + j]);
+            }
+        }
+    }
+    else
+    {
+        auto negative = copier.UE(), positive = copier.UE();
+        auto poc = 0;
+
+        for(auto i = 0u; i < negative; i++)
+        {
+            rps.deltaPocS0.push_back(poc -= copier.UE() + 1);
+            rps.usedS0.push_back(copier.Flag());
+        }
+        poc = 0;
+        for(auto i = 0u; i < positive; i++)
+        {
+            rps.deltaPocS1.push_back(poc += copier.UE() + 1);
+            rps.usedS1.push_back(copier.Flag());
+        }
+    }
+
+    return rps;
+}
+
+// Parses (and, when the copier has a writer, reproduces) a sequence parameter set up to and including
+// the conformance window; the caller is responsible for writing the picture size it wants
+static void CopySpsHeader(BitCopier& copier, HevcSps& sps, const unsigned int levelIdc = 0)
+{
+    copier.Bits(4);
+    sps.maxSubLayersMinus1 = copier.Bits(3);
+    copier.Flag();
+    sps.levelIdc = CopyProfileTierLevel(copier, sps.maxSubLayersMinus1, levelIdc);
+    sps.id = copier.UE();
+
+    auto chromaFormatIdc = copier.UE();
+    sps.separateColourPlane = chromaFormatIdc == 3 ? copier.Flag() : 0;
+    sps.chromaArrayType = sps.separateColourPlane ? 0 : chromaFormatIdc;
+
+    auto& reader = copier.Reader();
+    sps.width = reader.ReadUE();
+    sps.height = reader.ReadUE();
+    if(reader.ReadFlag())
+        for(auto i = 0; i < 4; i++)
+            sps.conformanceWindow[i] = reader.ReadUE();
+    else
+        sps.conformanceWindow[0] = sps.conformanceWindow[1] = sps.conformanceWindow[2] = sps.conformanceWindow[3] = 0;
+}
+
+static bool ParseSps(const NalUnit& nal, HevcSps& sps)
+{
+    BitReader reader(nal.rbsp.data(), nal.rbsp.size());
+    BitCopier copier(reader, NULL);
+
+    CopySpsHeader(copier, sps);
+
+    copier.UE();
+    copier.UE();
+    sps.log2MaxPocLsb = copier.UE() + 4;
+
+    auto subLayerOrderingInfoPresent = copier.Flag();
+    for(auto i = subLayerOrderingInfoPresent ? 0 : sps.maxSubLayersMinus1; i <= sps.maxSubLayersMinus1; i++)
+    {
+        copier.UE();
+        copier.UE();
+        copier.UE();
+    }
+
+    auto log2MinCbSize = copier.UE() + 3;
+    sps.log2CtbSize = log2MinCbSize + copier.UE();
+    copier.UE();
+    copier.UE();
+    copier.UE();
+    copier.UE();
+
+    if(copier.Flag() && copier.Flag())
+        CopyScalingListData(copier);
+
+    copier.Flag();
+    sps.saoEnabled = copier.Flag();
+    if(copier.Flag())
+    {
+        copier.Bits(4);
+        copier.Bits(4);
+        copier.UE();
+        copier.UE();
+        copier.Flag();
+    }
+
+    auto numShortTermRefPicSets = copier.UE();
+    if(numShortTermRefPicSets > 64)
+        return false;
+
+    sps.shortTermRps.clear();
+    for(auto i = 0u; i < numShortTermRefPicSets; i++)
+        sps.shortTermRps.push_back(CopyShortTermRps(copier, i, numShortTermRefPicSets, sps.shortTermRps));
+
+    sps.longTermUsedByCurrPic.clear();
+    if((sps.longTermRefPicsPresent = copier.Flag()))
+        for(auto i = copier.UE(); i > 0; i--)
+        {
+            copier.Bits(sps.log2MaxPocLsb);
+            sps.longTermUsedByCurrPic.push_back(copier.Flag());
+        }
+
+    sps.temporalMvpEnabled = copier.Flag();
+
+    return !reader.HasFailed();
+}
+
+static bool ParsePps(const NalUnit& nal, HevcPps& pps, BitWriter* writer = NULL,
+                     const size_t tileRows = 0, const size_t tileColumns = 0)
+{
+    BitReader reader(nal.rbsp.data(), nal.rbsp.size());
+    BitCopier copier(reader, writer);
+
+    pps.id = copier.UE();
+    pps.spsId = copier.UE();
+    pps.dependentSliceSegmentsEnabled = copier.Flag();
+    pps.outputFlagPresent = copier.Flag();
+    pps.numExtraSliceHeaderBits = copier.Bits(3);
+    copier.Flag();
+    pps.cabacInitPresent = copier.Flag();
+    pps.numRefIdxL0DefaultActive = copier.UE() + 1;
+    pps.numRefIdxL1DefaultActive = copier.UE() + 1;
+    copier.SE();
+    copier.Flag();
+    auto transformSkipEnabled = copier.Flag();
+    if(copier.Flag())
+        copier.UE();
+    copier.SE();
+    copier.SE();
+    pps.sliceChromaQpOffsetsPresent = copier.Flag();
+    pps.weightedPred = copier.Flag();
+    pps.weightedBipred = copier.Flag();
+    copier.Flag();
+
+    pps.tilesEnabled = reader.ReadFlag();
+    pps.entropyCodingSyncEnabled = reader.ReadFlag();
+    if(pps.tilesEnabled)
+    {
+        auto columns = reader.ReadUE() + 1, rows = reader.ReadUE() + 1;
+        if(!reader.ReadFlag())
+            for(auto i = 0u; i < columns + rows - 2; i++)
+                reader.ReadUE();
+        reader.ReadFlag();
+    }
+
+    if(writer)
+    {
+        auto tiled = tileRows * tileColumns > 1;
+
+        writer->WriteFlag(tiled);
+        writer->WriteFlag(pps.entropyCodingSyncEnabled);
+        if(tiled)
+        {
+            writer->WriteUE(tileColumns - 1);
+            writer->WriteUE(tileRows - 1);
+            writer->WriteFlag(true);   // uniform_spacing_flag
+            writer->WriteFlag(false);  // loop_filter_across_tiles_enabled_flag
+        }
+    }
+
+    pps.loopFilterAcrossSlicesEnabled = copier.Flag();
+    pps.deblockingFilterOverrideEnabled = pps.deblockingFilterDisabled = false;
+    if(copier.Flag())
+    {
+        pps.deblockingFilterOverrideEnabled = copier.Flag();
+        if(!(pps.deblockingFilterDisabled = copier.Flag()))
+        {
+            copier.SE();
+            copier.SE();
+        }
+    }
+    if(copier.Flag())
+        CopyScalingListData(copier);
+    pps.listsModificationPresent = copier.Flag();
+    copier.UE();
+    pps.sliceSegmentHeaderExtensionPresent = copier.Flag();
+
+    pps.chromaQpOffsetListEnabled = false;
+    if(copier.Flag())
+    {
+        auto rangeExtension = copier.Flag();
+        copier.Bits(7);
+        if(rangeExtension)
+        {
+            if(transformSkipEnabled)
+                copier.UE();
+            copier.Flag();
+            if((pps.chromaQpOffsetListEnabled = copier.Flag()))
+            {
+                copier.UE();
+                for(auto i = copier.UE() + 1; i > 0; i--)
+                {
+                    copier.SE();
+                    copier.SE();
+                }
+            }
+            copier.UE();
+            copier.UE();
+        }
+    }
+
+    if(writer)
+    {
+        copier.CopyPayload(nal.rbsp);
+        writer->WriteTrailingBits();
+    }
+
+    return !reader.HasFailed();
+}
+
+static void RewriteVps(const NalUnit& nal, const unsigned int levelIdc, BitWriter& writer)
+{
+    BitReader reader(nal.rbsp.data(), nal.rbsp.size());
+    BitCopier copier(reader, &writer);
+
+    copier.Bits(12);
+    auto maxSubLayersMinus1 = copier.Bits(3);
+    copier.Bits(17);
+    CopyProfileTierLevel(copier, maxSubLayersMinus1, levelIdc);
+    copier.CopyPayload(nal.rbsp);
+    writer.WriteTrailingBits();
+}
+
+static void RewriteSps(const NalUnit& nal, const unsigned int width, const unsigned int height,
+                       const unsigned int conformanceWindow[4], const unsigned int levelIdc, BitWriter& writer)
+{
+    BitReader reader(nal.rbsp.data(), nal.rbsp.size());
+    BitCopier copier(reader, &writer);
+    HevcSps sps;
+    auto cropped = conformanceWindow[0] || conformanceWindow[1] || conformanceWindow[2] || conformanceWindow[3];
+
+    CopySpsHeader(copier, sps, levelIdc);
+
+    writer.WriteUE(width);
+    writer.WriteUE(height);
+    writer.WriteFlag(cropped);
+    if(cropped)
+        for(auto i = 0; i < 4; i++)
+            writer.WriteUE(conformanceWindow[i]);
+
+    copier.CopyPayload(nal.rbsp);
+    writer.WriteTrailingBits();
+}
+
+static void CopyPredWeightTable(BitCopier& copier, const HevcSps& sps, const unsigned int sliceType,
+                                const unsigned int numRefIdxL0, const unsigned int numRefIdxL1)
+{
+    copier.UE();
+    if(sps.chromaArrayType)
+        copier.SE();
+
+    for(auto list = 0; list < (sliceType == SLICE_TYPE_B ? 2 : 1); list++)
+    {
+        auto count = list == 0 ? numRefIdxL0 : numRefIdxL1;
+        std::vector<bool> lumaWeight(count), chromaWeight(count);
+
+        for(auto i = 0u; i < count; i++)
+            lumaWeight[i] = copier.Flag();
+        if(sps.chromaArrayType)
+            for(auto i = 0u; i < count; i++)
+                chromaWeight[i] = copier.Flag();
+
+        for(auto i = 0u; i < count; i++)
+        {
+            if(lumaWeight[i])
+            {
+                copier.SE();
+                copier.SE();
+            }
+            if(chromaWeight[i])
+                for(auto j = 0; j < 4; j++)
+                    copier.SE();
+        }
+    }
+}
+
+// ref HEVC spec: 7.3.6.1 General slice segment header syntax.  Rewrites the segment address so that it
+// refers to the stitched picture and adds the entry point syntax required once tiles are enabled.
+static bool RewriteSliceHeader(const NalUnit& nal, const HevcSps& sps, const HevcPps& pps,
+                               const unsigned int ctbX, const unsigned int ctbY, const unsigned int pictureWidthInCtbs,
+                               const unsigned int pictureSizeInCtbs, const bool tiled, BitWriter& writer)
+{
+    BitReader reader(nal.rbsp.data(), nal.rbsp.size());
+    BitCopier copier(reader, &writer);
+
+    auto firstSliceSegment = reader.ReadFlag();
+    auto noOutputOfPriorPics = IsIrapNal(nal) ? reader.ReadFlag() : false;
+    auto ppsId = reader.ReadUE();
+    auto dependentSliceSegment = false;
+    auto localAddress = 0u;
+
+    if(!firstSliceSegment)
+    {
+        if(pps.dependentSliceSegmentsEnabled)
+            dependentSliceSegment = reader.ReadFlag();
+        localAddress = reader.ReadBits(CeilLog2(sps.WidthInCtbs() * sps.HeightInCtbs()));
+    }
+
+    auto address = (ctbY + localAddress / sps.WidthInCtbs()) * pictureWidthInCtbs +
+                   ctbX + localAddress % sps.WidthInCtbs();
+
+    writer.WriteFlag(address == 0);
+    if(IsIrapNal(nal))
+        writer.WriteFlag(noOutputOfPriorPics);
+    writer.WriteUE(ppsId);
+    if(address != 0)
+    {
+        if(pps.dependentSliceSegmentsEnabled)
+            writer.WriteFlag(dependentSliceSegment);
+        writer.WriteBits(address, CeilLog2(pictureSizeInCtbs));
+    }
+
+    if(!dependentSliceSegment)
+    {
+        auto numPicTotalCurr = 0u;
+        auto temporalMvpEnabled = false, saoLuma = false, saoChroma = false;
+
+        copier.Bits(pps.numExtraSliceHeaderBits);
+        auto sliceType = copier.UE();
+        if(pps.outputFlagPresent)
+            copier.Flag();
+        if(sps.separateColourPlane)
+            copier.Bits(2);
+
+        if(!IsIdrNal(nal))
+        {
+            HevcShortTermRps rps;
+            auto numShortTermRefPicSets = sps.shortTermRps.size();
+
+            copier.Bits(sps.log2MaxPocLsb);
+            if(!copier.Flag())
+                rps = CopyShortTermRps(copier, numShortTermRefPicSets, numShortTermRefPicSets, sps.shortTermRps);
+            else
+                rps = sps.shortTermRps.at(numShortTermRefPicSets > 1 ? copier.Bits(CeilLog2(numShortTermRefPicSets)) : 0);
+
+            numPicTotalCurr += std::count(rps.usedS0.begin(), rps.usedS0.end(), true) +
+                               std::count(rps.usedS1.begin(), rps.usedS1.end(), true);
+
+            if(sps.longTermRefPicsPresent)
+            {
+                auto numLongTermSps = sps.longTermUsedByCurrPic.empty() ? 0u : copier.UE();
+                auto numLongTermPics = copier.UE();
+
+                for(auto i = 0u; i < numLongTermSps + numLongTermPics; i++)
+                {
+                    if(i < numLongTermSps)
+                    {
+                        auto index = sps.longTermUsedByCurrPic.size() > 1
+                                ? copier.Bits(CeilLog2(sps.longTermUsedByCurrPic.size())) : 0;
+                        numPicTotalCurr += sps.longTermUsedByCurrPic.at(index);
+                    }
+                    else
+                    {
+                        copier.Bits(sps.log2MaxPocLsb);
+                        numPicTotalCurr += copier.Flag();
+                    }
+
+                    if(copier.Flag())
+                        copier.UE();
+                }
+            }
+
+            if(sps.temporalMvpEnabled)
+                temporalMvpEnabled = copier.Flag();
+        }
+
+        if(sps.saoEnabled)
+        {
+            saoLuma = copier.Flag();
+            if(sps.chromaArrayType)
+                saoChroma = copier.Flag();
+        }
+
+        if(sliceType == SLICE_TYPE_P || sliceType == SLICE_TYPE_B)
+        {
+            auto numRefIdxL0 = pps.numRefIdxL0DefaultActive, numRefIdxL1 = pps.numRefIdxL1DefaultActive;
+
+            if(copier.Flag())
+            {
+                numRefIdxL0 = copier.UE() + 1;
+                if(sliceType == SLICE_TYPE_B)
+                    numRefIdxL1 = copier.UE() + 1;
+            }
+
+            if(pps.listsModificationPresent && numPicTotalCurr > 1)
+            {
+                if(copier.Flag())
+                    for(auto i = 0u; i < numRefIdxL0; i++)
+                        copier.Bits(CeilLog2(numPicTotalCurr));
+                if(sliceType == SLICE_TYPE_B && copier.Flag())
+                    for(auto i = 0u; i < numRefIdxL1; i++)
+                        copier.Bits(CeilLog2(numPicTotalCurr));
+            }
+
+            if(sliceType == SLICE_TYPE_B)
+                copier.Flag();
+            if(pps.cabacInitPresent)
+                copier.Flag();
+            if(temporalMvpEnabled)
+            {
+                auto collocatedFromL0 = sliceType == SLICE_TYPE_B ? copier.Flag() : true;
+                if((collocatedFromL0 && numRefIdxL0 > 1) || (!collocatedFromL0 && numRefIdxL1 > 1))
+                    copier.UE();
+            }
+            if((pps.weightedPred && sliceType == SLICE_TYPE_P) || (pps.weightedBipred && sliceType == SLICE_TYPE_B))
+                CopyPredWeightTable(copier, sps, sliceType, numRefIdxL0, numRefIdxL1);
+            copier.UE();
+        }
+
+        copier.SE();
+        if(pps.sliceChromaQpOffsetsPresent)
+        {
+            copier.SE();
+            copier.SE();
+        }
+        if(pps.chromaQpOffsetListEnabled)
+            copier.Flag();
+
+        auto deblockingFilterDisabled = pps.deblockingFilterDisabled;
+        if(pps.deblockingFilterOverrideEnabled && copier.Flag())
+            if(!(deblockingFilterDisabled = copier.Flag()))
+            {
+                copier.SE();
+                copier.SE();
+            }
+
+        if(pps.loopFilterAcrossSlicesEnabled && (saoLuma || saoChroma || !deblockingFilterDisabled))
+            copier.Flag();
+    }
+
+    if(pps.tilesEnabled || pps.entropyCodingSyncEnabled)
+    {
+        auto entryPoints = copier.UE();
+        if(entryPoints > 0)
+        {
+            auto offsetLength = copier.UE() + 1;
+            for(auto i = 0u; i < entryPoints; i++)
+                copier.Bits(offsetLength);
+        }
+    }
+    else if(tiled)
+        writer.WriteUE(0);
+
+    if(pps.sliceSegmentHeaderExtensionPresent)
+        for(auto length = copier.UE(); length > 0; length--)
+            copier.Bits(8);
+
+    // byte_alignment() precedes the slice data, which is copied as-is
+    reader.ReadFlag();
+    while(!reader.IsAligned())
+        reader.ReadFlag();
+    writer.WriteTrailingBits();
+
+    if(reader.HasFailed())
+        return false;
+
+    writer.WriteBytes(nal.rbsp.data() + reader.Position() / 8, nal.rbsp.size() - reader.Position() / 8);
+    return true;
+}
+
+int HevcStitcher::Select(const size_t row, const size_t column, const size_t rows, const size_t columns)
+{
+    if(rows == 0 || columns == 0 || row + rows > dimensions.rows || column + columns > dimensions.columns)
+        return error("Tile selection lies outside of the tile grid");
+
+    firstRow = row;
+    firstColumn = column;
+    selection.rows = rows;
+    selection.columns = columns;
+    selection.count = rows * columns;
+
+    return 0;
+}
+
+int HevcStitcher::ReadPicture(TileStream& stream, std::vector<NalUnit>& parameterSets, std::vector<NalUnit>& slices)
+{
+    parameterSets.clear();
+    slices.clear();
+
+    while(true)
+    {
+        NalUnit nal;
+
+        if(stream.hasPending)
+        {
+            std::swap(nal, stream.pending);
+            stream.hasPending = false;
+        }
+        else if(!stream.reader.Read(nal))
+            return slices.empty() ? 0 : 1;
+
+        // A new access unit begins with its first slice segment or any parameter set, AUD or prefix SEI
+        auto startsAccessUnit = IsVclNal(nal)
+                ? !nal.rbsp.empty() && (nal.rbsp[0] & 0x80)
+                : nal.type >= HEVC_NAL_VPS && nal.type <= HEVC_NAL_PREFIX_SEI &&
+                  nal.type != HEVC_NAL_EOS && nal.type != HEVC_NAL_EOB && nal.type != HEVC_NAL_FD;
+
+        if(startsAccessUnit && !slices.empty())
+        {
+            std::swap(nal, stream.pending);
+            stream.hasPending = true;
+            return 1;
+        }
+        else if(IsVclNal(nal))
+            slices.push_back(std::move(nal));
+        else if(nal.type >= HEVC_NAL_VPS && nal.type <= HEVC_NAL_PPS)
+            parameterSets.push_back(std::move(nal));
+        // Remaining NAL units (AUD, SEI, filler, end of sequence) describe a single tile and are dropped
+    }
+}
+
+int HevcStitcher::UpdateParameterSets(TileStream& stream, const std::vector<NalUnit>& parameterSets,
+                                      const bool reference)
+{
+    for(auto& nal: parameterSets)
+    {
+        unsigned int id;
+
+        if(nal.type == HEVC_NAL_VPS)
+            id = nal.rbsp.empty() ? 0 : nal.rbsp[0] >> 4;
+        else if(nal.type == HEVC_NAL_SPS)
+        {
+            HevcSps sps;
+            if(!ParseSps(nal, sps))
+                return error("Malformed sequence parameter set");
+            stream.sps[id = sps.id] = sps;
+        }
+        else
+        {
+            HevcPps pps;
+            if(!ParsePps(nal, pps))
+                return error("Malformed picture parameter set");
+            else if(pps.tilesEnabled)
+                return error("Input tile streams must not themselves use HEVC tiles");
+            stream.pps[id = pps.id] = pps;
+        }
+
+        auto key = (nal.type << 8) | id;
+        stream.parameterSets[key] = nal.rbsp;
+
+        if(!reference && streams[0].parameterSets[key] != nal.rbsp)
+            return error("Tile streams were not produced with identical parameters");
+    }
+
+    return 0;
+}
+
+int HevcStitcher::WriteParameterSets(AnnexBWriter& writer, const std::vector<NalUnit>& parameterSets)
+{
+    auto& stream = streams[0];
+
+    for(auto& nal: parameterSets)
+    {
+        BitWriter rewritten;
+
+        if(nal.type == HEVC_NAL_PPS)
+        {
+            HevcPps pps;
+            ParsePps(nal, pps, &rewritten, selection.rows, selection.columns);
+        }
+        else
+        {
+            HevcSps sps;
+
+            if(nal.type == HEVC_NAL_SPS)
+                ParseSps(nal, sps);
+            else if(stream.sps.empty())
+                return error("Video parameter set without a sequence parameter set");
+            else
+                sps = stream.sps.begin()->second;
+
+            auto ctbSize = 1u << sps.log2CtbSize;
+            auto& window = sps.conformanceWindow;
+            unsigned int conformanceWindow[4] = { 0,
+                                                  selection.columns == 1 ? window[1] : 0,
+                                                  0,
+                                                  selection.rows == 1 ? window[3] : 0 };
+            auto width = sps.width * selection.columns, height = sps.height * selection.rows;
+            auto croppedWidth = width - conformanceWindow[1] * (sps.chromaArrayType == 1 || sps.chromaArrayType == 2 ? 2 : 1);
+            auto croppedHeight = height - conformanceWindow[3] * (sps.chromaArrayType == 1 ? 2 : 1);
+            auto levelIdc = std::max(sps.levelIdc, MinimumLevel(width, height, selection.rows, selection.columns));
+
+            if(window[0] || window[2] || (selection.columns > 1 && window[1]) || (selection.rows > 1 && window[3]))
+                return error("Tile streams with conformance cropping cannot be stitched along the cropped edge");
+            else if((selection.columns > 1 && sps.width % ctbSize) || (selection.rows > 1 && sps.height % ctbSize))
+                return error("Tile dimensions must be a multiple of the coding tree block size to be stitched");
+            else if(selection.count > 1 && (croppedWidth / selection.columns < 256 || croppedHeight / selection.rows < 64))
+                return error("HEVC tiles must be at least 256 luma samples wide and 64 high");
+            else if(MinimumLevel(width, height, selection.rows, selection.columns) == 0)
+                return error("Stitched picture exceeds the limits of every HEVC level");
+
+            if(nal.type == HEVC_NAL_VPS)
+                RewriteVps(nal, levelIdc, rewritten);
+            else
+                RewriteSps(nal, width, height, conformanceWindow, levelIdc, rewritten);
+
+            if(nal.type == HEVC_NAL_SPS)
+            {
+                pictureWidthInCtbs = sps.WidthInCtbs() * selection.columns;
+                pictureSizeInCtbs = pictureWidthInCtbs * sps.HeightInCtbs() * selection.rows;
+            }
+        }
+
+        if(!writer.Write(nal.type, nal.layerId, nal.temporalIdPlus1, rewritten.Data()))
+            return error("Error writing stitched stream");
+    }
+
+    return 0;
+}
+
+int HevcStitcher::WriteSlice(AnnexBWriter& writer, const TileStream& stream, const NalUnit& slice,
+                             const size_t tileRow, const size_t tileColumn)
+{
+    BitWriter rewritten;
+    BitReader prefix(slice.rbsp.data(), slice.rbsp.size());
+
+    prefix.ReadFlag();
+    if(IsIrapNal(slice))
+        prefix.ReadFlag();
+
+    auto pps = stream.pps.find(prefix.ReadUE());
+    if(pps == stream.pps.end() || stream.sps.find(pps->second.spsId) == stream.sps.end())
+        return error("Slice refers to a missing parameter set");
+
+    auto& sps = stream.sps.find(pps->second.spsId)->second;
+    auto ctbX = tileColumn * sps.WidthInCtbs(), ctbY = tileRow * sps.HeightInCtbs();
+
+    if(!RewriteSliceHeader(slice, sps, pps->second, ctbX, ctbY, pictureWidthInCtbs, pictureSizeInCtbs,
+                           selection.count > 1, rewritten))
+        return error("Malformed slice segment header");
+    else if(!writer.Write(slice.type, slice.layerId, slice.temporalIdPlus1, rewritten.Data()))
+        return error("Error writing stitched stream");
+
+    return 0;
+}
+
+int HevcStitcher::Stitch(FILE* output)
+{
+    AnnexBWriter writer(output);
+    std::vector<NalUnit> parameterSets, slices;
+    std::vector<unsigned int> types;
+
+    streams.clear();
+    streams.resize(selection.count);
+    for(auto i = 0u; i < selection.count; i++)
+    {
+        auto index = (firstRow + i / selection.columns) * dimensions.columns + firstColumn + i % selection.columns;
+        auto filename = TileFilename(filenameTemplate, index);
+
+        streams[i].hasPending = false;
+        if(!streams[i].reader.Open(filename.c_str()))
+            return error(filename.c_str());
+    }
+
+    while(true)
+    {
+        for(auto i = 0u; i < selection.count; i++)
+        {
+            auto& stream = streams[i];
+            auto result = ReadPicture(stream, parameterSets, slices);
+
+            if(result == 0 && i == 0)
+                return 0;
+            else if(result == 0)
+                return error("Tile streams contain different numbers of frames");
+            else if(UpdateParameterSets(stream, parameterSets, i == 0) != 0)
+                return -1;
+            else if(i == 0 && WriteParameterSets(writer, parameterSets) != 0)
+                return -1;
+            else if(stream.sps.empty() || stream.pps.empty())
+                return error("Tile stream does not begin with parameter sets");
+
+            if(i == 0)
+            {
+                types.clear();
+                for(auto& slice: slices)
+                    types.push_back(slice.type);
+            }
+            else if(slices.size() != types.size() ||
+                    !std::equal(types.begin(), types.end(), slices.begin(),
+                                [](unsigned int type, const NalUnit& slice) { return type == slice.type; }))
+                return error("Tile streams are not aligned picture-by-picture");
+
+            for(auto& slice: slices)
+                if(WriteSlice(writer, stream, slice, i / selection.columns, i % selection.columns) != 0)
+                    return -1;
+        }
+
+        stitchedFrames++;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef _HEVC_STITCHER
+#define _HEVC_STITCHER
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HevcBitstream.h"
+#include "TileDimensions.h"
+
+typedef struct HevcShortTermRps
+{
+    std::vector<int>  deltaPocS0, deltaPocS1;
+    std::vector<bool> usedS0, usedS1;
+} HevcShortTermRps;
+
+typedef struct HevcSps
+{
+    unsigned int id;
+    unsigned int maxSubLayersMinus1;
+    unsigned int chromaArrayType;
+    unsigned int separateColourPlane;
+    unsigned int width, height;
+    unsigned int conformanceWindow[4];  // left, right, top, bottom
+    unsigned int levelIdc;
+    unsigned int log2MaxPocLsb;
+    unsigned int log2CtbSize;
+    bool         longTermRefPicsPresent;
+    bool         temporalMvpEnabled;
+    bool         saoEnabled;
+    std::vector<HevcShortTermRps> shortTermRps;
+    std::vector<bool>             longTermUsedByCurrPic;
+
+    unsigned int WidthInCtbs()  const { return (width + (1 << log2CtbSize) - 1) >> log2CtbSize; }
+    unsigned int HeightInCtbs() const { return (height + (1 << log2CtbSize) - 1) >> log2CtbSize; }
+} HevcSps;
+
+typedef struct HevcPps
+{
+    unsigned int id;
+    unsigned int spsId;
+    bool         dependentSliceSegmentsEnabled;
+    bool         outputFlagPresent;
+    unsigned int numExtraSliceHeaderBits;
+    bool         cabacInitPresent;
+    unsigned int numRefIdxL0DefaultActive, numRefIdxL1DefaultActive;
+    bool         sliceChromaQpOffsetsPresent;
+    bool         weightedPred, weightedBipred;
+    bool         tilesEnabled;
+    bool         entropyCodingSyncEnabled;
+    bool         loopFilterAcrossSlicesEnabled;
+    bool         deblockingFilterOverrideEnabled;
+    bool         deblockingFilterDisabled;
+    bool         listsModificationPresent;
+    bool         sliceSegmentHeaderExtensionPresent;
+    bool         chromaQpOffsetListEnabled;
+} HevcPps;
+
+// Merges HEVC tile bitstreams produced by Tiler (with identical encode parameters) into a single HEVC
+// stream that carries each input as one HEVC tile.  Only parameter sets and slice segment headers are
+// rewritten; slice data is copied without being decoded.
+//
+// Each input must consist of whole CTBs in any dimension that is stitched (i.e., a tile width that is a
+// multiple of the CTB size when more than one column is merged), and must not carry conformance cropping
+// on an interior edge.  Because NVENC does not restrict motion vectors to the tile picture, inter
+// prediction near tile edges may reference neighbouring content once stitched; streams intended for
+// stitching should be intra-only or encoded with short GOPs when exact reconstruction matters.
+class HevcStitcher
+{
+public:
+    HevcStitcher(const TileDimensions& dimensions, const std::string& filenameTemplate) :
+        dimensions(dimensions),
+        filenameTemplate(filenameTemplate),
+        selection({dimensions.rows, dimensions.columns, dimensions.count}),
+        firstRow(0),
+        firstColumn(0),
+        pictureWidthInCtbs(0),
+        pictureSizeInCtbs(0),
+        stitchedFrames(0)
+        { }
+
+    // Restricts stitching to a rectangular subset of the tile grid; by default the whole grid is merged
+    int    Select(size_t row, size_t column, size_t rows, size_t columns);
+    int    Stitch(FILE* output);
+    size_t GetStitchedFrames() const { return stitchedFrames; }
+
+private:
+    typedef struct TileStream
+    {
+        AnnexBReader                                 reader;
+        NalUnit                                      pending;
+        bool                                         hasPending;
+        std::map<unsigned int, HevcSps>              sps;
+        std::map<unsigned int, HevcPps>              pps;
+        std::map<unsigned int, std::vector<uint8_t>> parameterSets;  // keyed by (type << 8) | id
+    } TileStream;
+
+    int  ReadPicture(TileStream&, std::vector<NalUnit>& parameterSets, std::vector<NalUnit>& slices);
+    int  UpdateParameterSets(TileStream&, const std::vector<NalUnit>& parameterSets, bool reference);
+    int  WriteParameterSets(AnnexBWriter&, const std::vector<NalUnit>& parameterSets);
+    int  WriteSlice(AnnexBWriter&, const TileStream&, const NalUnit& slice, size_t tileRow, size_t tileColumn);
+
+    TileDimensions          dimensions;
+    std::string             filenameTemplate;
+    TileDimensions          selection;
+    size_t                  firstRow, firstColumn;
+    unsigned int            pictureWidthInCtbs, pictureSizeInCtbs;
+    std::vector<TileStream> streams;
+    size_t                  stitchedFrames;
+};
+
+#endif
@@ -0,0 +1,439 @@
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "HttpSink.h"
+#include "PipelineTuner.h"
+#include "TileDimensions.h"
+
+HttpTileSink::HttpTileSink(const std::string& urlTemplate, const size_t tiles, const size_t bufferBytes)
+    : urlTemplate(urlTemplate), bufferBytes(bufferBytes), connections(tiles, NULL), closed(false)
+{
+}
+
+HttpTileSink::~HttpTileSink()
+{
+    Close();
+
+    for(auto* connection: connections)
+        if(connection != NULL)
+        {
+            Disconnect(*connection);
+            pthread_cond_destroy(&connection->changed);
+            pthread_mutex_destroy(&connection->mutex);
+            delete connection;
+        }
+}
+
+int HttpTileSink::ParseUrl()
+{
+    const std::string scheme = "http://";
+    size_t authorityEnd, portStart;
+
+    if(urlTemplate.compare(0, scheme.size(), scheme) != 0 ||
+       (authorityEnd = urlTemplate.find('/', scheme.size())) == std::string::npos ||
+       urlTemplate.find('%', authorityEnd) == std::string::npos)
+        return -1;
+
+    host = urlTemplate.substr(scheme.size(), authorityEnd - scheme.size());
+    pathTemplate = urlTemplate.substr(authorityEnd);
+    port = "80";
+
+    if((portStart = host.rfind(':')) != std::string::npos)
+    {
+        port = host.substr(portStart + 1);
+        host = host.substr(0, portStart);
+    }
+
+    return host.empty() || port.empty() ? -1 : 0;
+}
+
+int HttpTileSink::Open(const std::vector<bool>& enabled)
+{
+    if(ParseUrl() != 0)
+        return fprintf(stderr, "Expected http://<host>[:<port>]/<path with %%d>, not %s\n", urlTemplate.c_str()), -1;
+
+    for(auto i = 0u; i < connections.size(); i++)
+    {
+        if(!enabled.at(i))
+            continue;
+
+        auto* connection = connections[i] = new Connection();
+        connection->sink = this;
+        connection->tile = i;
+        connection->path = TileFilename(pathTemplate, i);
+        connection->socket = -1;
+        connection->requested = false;
+        connection->offset = 0;
+        connection->pendingBytes = 0;
+        connection->closing = false;
+        connection->failed = false;
+        connection->response = 0;
+        connection->started = false;
+        connection->statistics = PushStatistics();
+        pthread_mutex_init(&connection->mutex, NULL);
+        pthread_cond_init(&connection->changed, NULL);
+
+        // An unreachable origin is reported before encoding begins
+        if(Connect(*connection) != 0)
+            return fprintf(stderr, "Unable to connect to %s:%s for tile %u\n", host.c_str(), port.c_str(), i), -1;
+        else if(pthread_create(&connection->thread, NULL, Sender, connection) != 0)
+            return -1;
+
+        connection->started = true;
+    }
+
+    return 0;
+}
+
+int HttpTileSink::Connect(Connection& connection)
+{
+    struct addrinfo hints, *addresses, *address;
+    auto enable = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+        return -1;
+
+    for(address = addresses; address != NULL && connection.socket < 0; address = address->ai_next)
+        if((connection.socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol)) >= 0 &&
+           connect(connection.socket, address->ai_addr, address->ai_addrlen) != 0)
+            Disconnect(connection);
+
+    freeaddrinfo(addresses);
+
+    // Frames are sent as soon as they are encoded rather than coalesced
+    if(connection.socket >= 0)
+        setsockopt(connection.socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    connection.requested = false;
+    return connection.socket >= 0 ? 0 : -1;
+}
+
+void HttpTileSink::Disconnect(Connection& connection)
+{
+    if(connection.socket >= 0)
+        close(connection.socket);
+
+    connection.socket = -1;
+    connection.requested = false;
+}
+
+static int SendAll(const int socket, const void* data, size_t size, const int flags)
+{
+    ssize_t sent;
+
+    for(auto* remaining = (const uint8_t*)data; size > 0; remaining += sent, size -= sent)
+        if((sent = send(socket, remaining, size, flags | MSG_NOSIGNAL)) < 0 && errno != EINTR)
+            return -1;
+        else if(sent < 0)
+            sent = 0;
+
+    return 0;
+}
+
+int HttpTileSink::SendRequest(Connection& connection)
+{
+    std::stringstream request;
+
+    request << "PUT " << connection.path << " HTTP/1.1\r\n"
+            << "Host: " << host << ":" << port << "\r\n"
+            << "Content-Type: application/octet-stream\r\n"
+            << "Transfer-Encoding: chunked\r\n"
+            << "X-Tile: " << connection.tile << "\r\n"
+            << "X-Tile-Offset: " << connection.offset << "\r\n"
+            << "\r\n";
+
+    if(SendAll(connection.socket, request.str().data(), request.str().size(), MSG_MORE) != 0)
+        return -1;
+
+    connection.requested = true;
+    return 0;
+}
+
+int HttpTileSink::SendChunk(Connection& connection, const Chunk& chunk)
+{
+    char header[64];
+    auto length = snprintf(header, sizeof(header), "%zx;pts=%llu\r\n", chunk.data.size(),
+                           (unsigned long long)chunk.timestamp);
+
+    return SendAll(connection.socket, header, length, MSG_MORE) == 0 &&
+           SendAll(connection.socket, chunk.data.data(), chunk.data.size(), MSG_MORE) == 0 &&
+           SendAll(connection.socket, "\r\n", 2, 0) == 0 ? 0 : -1;
+}
+
+// Ends the request (with the tile's length when it completes the tile) and waits for the origin to confirm it
+int HttpTileSink::Finish(Connection& connection, const bool complete)
+{
+    char trailer[64];
+    auto length = complete ? snprintf(trailer, sizeof(trailer), "0\r\nX-Tile-Complete: %llu\r\n\r\n",
+                                      (unsigned long long)connection.offset + connection.pendingBytes) :
+                             snprintf(trailer, sizeof(trailer), "0\r\n\r\n");
+
+    auto closed = false;
+
+    if(SendAll(connection.socket, trailer, length, 0) != 0 || ReadResponse(connection, closed) != 0)
+        return -1;
+
+    // The next request is sent afresh, on this connection unless the origin closed it
+    if(closed)
+        Disconnect(connection);
+    connection.requested = false;
+    return connection.response >= 200 && connection.response < 300 ? 0 : -1;
+}
+
+// Reads the whole of the origin's response, so that the connection can carry the next request
+int HttpTileSink::ReadResponse(Connection& connection, bool& closed)
+{
+    struct timeval timeout = { PUSH_RESPONSE_TIMEOUT, 0 };
+    char response[4096];
+    size_t length = 0, headerBytes, bodyBytes = 0;
+    ssize_t received;
+    const char* end;
+
+    if(setsockopt(connection.socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0)
+        return -1;
+
+    while((end = (const char*)memmem(response, length, "\r\n\r\n", 4)) == NULL)
+        if(length == sizeof(response) - 1)
+            return -1;
+        else if((received = recv(connection.socket, response + length, sizeof(response) - 1 - length, 0)) > 0)
+            length += received;
+        else if(received == 0 || errno != EINTR)
+            return -1;
+
+    headerBytes = end + 4 - response;
+    response[headerBytes - 2] = '\0';
+    if(sscanf(response, "HTTP/%*d.%*d %d", &connection.response) != 1)
+        return -1;
+
+    // Header names are case-insensitive; a response without a length has no body (as a PUT's need not)
+    for(auto* line = strstr(response, "\r\n") + 2; *line != '\0'; line = strstr(line, "\r\n") + 2)
+    {
+        std::string header(line, strstr(line, "\r\n") - line);
+
+        if(!strncasecmp(header.c_str(), "Content-Length:", 15))
+            bodyBytes = strtoull(header.c_str() + 15, NULL, 10);
+        else if(!strncasecmp(header.c_str(), "Connection:", 11) && strcasestr(header.c_str() + 11, "close") != NULL)
+            closed = true;
+    }
+
+    for(bodyBytes -= std::min(bodyBytes, length - headerBytes); bodyBytes > 0; bodyBytes -= received)
+        if((received = recv(connection.socket, response, std::min(bodyBytes, sizeof(response)), 0)) <= 0 &&
+           (received == 0 || errno != EINTR))
+            return -1;
+        else if(received < 0)
+            received = 0;
+
+    return 0;
+}
+
+void* HttpTileSink::Sender(void* argument)
+{
+    auto* connection = (Connection*)argument;
+
+    connection->sink->Send(*connection);
+    return NULL;
+}
+
+void HttpTileSink::Send(Connection& connection)
+{
+    auto failures = 0u;
+    size_t sent = 0, sentBytes = 0;  // Chunks at the front of pending sent in the current request
+
+    for(;;)
+    {
+        pthread_mutex_lock(&connection.mutex);
+        // A request ends once it holds half of the buffer, so that the rest can fill while it is confirmed
+        while(connection.pending.size() == sent && !connection.closing && sentBytes < bufferBytes / 2)
+            pthread_cond_wait(&connection.changed, &connection.mutex);
+        // Chunks are only appended by Write, and removed here, so those held stay in place while they are sent
+        auto* chunk = connection.pending.size() > sent ? &connection.pending[sent] : NULL;
+        auto complete = chunk == NULL && connection.closing;
+        auto finishing = complete || sentBytes >= bufferBytes / 2;
+        pthread_mutex_unlock(&connection.mutex);
+
+        auto result = (connection.socket >= 0 || Connect(connection) == 0) &&
+                      (connection.requested || SendRequest(connection) == 0) &&
+                      (finishing ? Finish(connection, complete) : SendChunk(connection, *chunk)) == 0;
+
+        if(result && finishing)
+        {
+            // The origin holds everything sent in the request, which makes room for the encoder
+            failures = 0;
+            connection.offset += sentBytes;
+            connection.statistics.requests++;
+
+            pthread_mutex_lock(&connection.mutex);
+            connection.pendingBytes -= sentBytes;
+            connection.pending.erase(connection.pending.begin(), connection.pending.begin() + sent);
+            pthread_cond_broadcast(&connection.changed);
+            pthread_mutex_unlock(&connection.mutex);
+
+            sent = sentBytes = 0;
+            if(complete)
+                break;
+            continue;
+        }
+        else if(result)
+        {
+            auto& statistics = connection.statistics;
+
+            if(!chunk->sent)
+            {
+                chunk->sent = true;
+                statistics.bytes += chunk->data.size();
+                statistics.chunks++;
+                statistics.latency.Record(PipelineTuner::Now() - chunk->queued);
+            }
+
+            sent++;
+            sentBytes += chunk->data.size();
+            continue;
+        }
+
+        // Everything after the last confirmed offset is resent in a new request
+        Disconnect(connection);
+        sent = sentBytes = 0;
+        if(++failures > PUSH_RETRIES)
+        {
+            fprintf(stderr, "Giving up pushing tile %lu after %u failed attempts\n", connection.tile, failures);
+
+            pthread_mutex_lock(&connection.mutex);
+            connection.failed = true;
+            connection.pending.clear();
+            connection.pendingBytes = 0;
+            pthread_cond_broadcast(&connection.changed);
+            pthread_mutex_unlock(&connection.mutex);
+            break;
+        }
+
+        connection.statistics.reconnects++;
+        usleep((PUSH_RETRY_DELAY * 1000) << (failures - 1));
+    }
+
+    Disconnect(connection);
+}
+
+int HttpTileSink::Write(const size_t tile, const void* data, const size_t size, const uint64_t timestamp,
+                        const TileIndexPictureType type)
+{
+    auto* connection = connections.at(tile);
+    auto start = PipelineTuner::Now();
+    auto status = 0;
+
+    // An empty chunk would end the request
+    if(connection == NULL || size == 0)
+        return 0;
+
+    pthread_mutex_lock(&connection->mutex);
+    // A frame larger than the whole buffer is still accepted once the buffer is empty
+    while(!connection->failed && connection->pendingBytes > 0 && connection->pendingBytes + size > bufferBytes)
+        pthread_cond_wait(&connection->changed, &connection->mutex);
+
+    if(connection->failed)
+        status = -1;
+    else
+    {
+        connection->pending.push_back(Chunk());
+        connection->pending.back().data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+        connection->pending.back().timestamp = timestamp;
+        connection->pending.back().queued = start;
+        connection->pending.back().sent = false;
+        connection->pendingBytes += size;
+        pthread_cond_broadcast(&connection->changed);
+    }
+    pthread_mutex_unlock(&connection->mutex);
+
+    connection->statistics.stall += PipelineTuner::Now() - start;
+    return status;
+}
+
+int HttpTileSink::Close()
+{
+    auto status = 0;
+
+    if(closed)
+        return 0;
+    closed = true;
+
+    for(auto* connection: connections)
+        if(connection != NULL)
+        {
+            pthread_mutex_lock(&connection->mutex);
+            connection->closing = true;
+            pthread_cond_broadcast(&connection->changed);
+            pthread_mutex_unlock(&connection->mutex);
+        }
+
+    // Each tile either ended with a confirmed request or gave up
+    for(auto* connection: connections)
+        if(connection == NULL || !connection->started)
+            continue;
+        else if(pthread_join(connection->thread, NULL) != 0 || connection->failed)
+            status = -1;
+
+    return status;
+}
+
+std::string HttpTileSink::Describe() const
+{
+    std::stringstream stream;
+    auto bytes = 0ull, stall = 0ull, worst = 0ull;
+    auto chunks = 0lu, reconnects = 0lu, tiles = 0lu;
+
+    for(auto* connection: connections)
+        if(connection != NULL)
+        {
+            auto& statistics = connection->statistics;
+
+            bytes += statistics.bytes;
+            chunks += statistics.chunks;
+            reconnects += statistics.reconnects;
+            stall += statistics.stall;
+            worst = std::max(worst, statistics.latency.Percentile(.99));
+            tiles++;
+        }
+
+    stream.precision(1);
+    stream << std::fixed
+           << "HTTP push: " << bytes << " bytes in " << chunks << " chunks over " << tiles << " tiles, "
+           << reconnects << " reconnects, " << stall / 1000. << "ms stalled, worst tile p99 "
+           << worst / 1000. << "ms\n";
+    return stream.str();
+}
+
+int HttpTileSink::WriteReport(const char* filename) const
+{
+    FILE* file;
+
+    if((file = fopen(filename, "w")) == NULL)
+        return -1;
+
+    fprintf(file, "tile,bytes,chunks,requests,reconnects,stall_ms,p50_ms,p99_ms,max_ms\n");
+    for(auto* connection: connections)
+        if(connection != NULL)
+        {
+            auto& statistics = connection->statistics;
+
+            fprintf(file, "%lu,%llu,%lu,%lu,%lu,%.3f,%.3f,%.3f,%.3f\n", connection->tile,
+                    (unsigned long long)statistics.bytes, statistics.chunks, statistics.requests,
+                    statistics.reconnects,
+                    statistics.stall / 1000., statistics.latency.Percentile(.5) / 1000.,
+                    statistics.latency.Percentile(.99) / 1000., statistics.latency.GetMaximum() / 1000.);
+        }
+
+    return fclose(file) == 0 ? 0 : -1;
+}
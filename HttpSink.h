@@ -0,0 +1,105 @@
+#ifndef _HTTP_SINK
+#define _HTTP_SINK
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "TileVideoEncoder.h"
+#include "LiveMode.h"
+
+#define DEFAULT_PUSH_BUFFER_BYTES 4*1024*1024  // Per tile
+#define PUSH_RETRIES              5            // Consecutive failed reconnects before a tile gives up
+#define PUSH_RETRY_DELAY          100          // ms before the first reconnect, doubling with each failure
+#define PUSH_RESPONSE_TIMEOUT     10           // seconds to wait for the origin to acknowledge a closed stream
+
+typedef struct PushStatistics
+{
+    uint64_t           bytes;       // Bitstream bytes sent (each once, however often it is resent)
+    size_t             chunks;
+    size_t             requests;    // Requests the origin confirmed
+    size_t             reconnects;
+    unsigned long long stall;       // Microseconds the encoder waited for buffer space
+    LatencyHistogram   latency;     // From the encoder handing over a frame to it being sent, in microseconds
+} PushStatistics;
+
+// Streams each tile's bitstream to an HTTP origin as it is encoded, in place of (or alongside) writing files
+// for a separate uploader.  Each tile is PUT to the URL template expanded with its index, over its own
+// persistent connection, in requests with chunked transfer encoding and a chunk per frame.  Frames are sent
+// from a thread per tile; the encoder waits once a tile has more than the buffer limit unconfirmed.
+//
+// Each request carries the tile's byte offset in an X-Tile-Offset header, at which the origin writes its
+// body, and ends once it holds half of the buffer.  The origin's successful response confirms the request's
+// bytes, which only then leave the buffer.  A failed request reconnects (backing off between attempts) and
+// resends everything from the last confirmed offset, so that a connection dropped after send() accepted
+// bytes loses nothing.  The last request of a tile ends with an X-Tile-Complete trailer giving the tile's
+// length.  Each chunk carries the frame's presentation index as a "pts" chunk extension.  Only plain http://
+// is supported.
+//
+// WriteReport writes CSV rows:
+//     tile,bytes,chunks,requests,reconnects,stall_ms,p50_ms,p99_ms,max_ms
+class HttpTileSink : public TileSink
+{
+public:
+    HttpTileSink(const std::string& urlTemplate, size_t tiles, size_t bufferBytes = DEFAULT_PUSH_BUFFER_BYTES);
+    ~HttpTileSink();
+
+    // Connects every enabled tile; returns nonzero when the URL is malformed or the origin unreachable
+    int    Open(const std::vector<bool>& enabled);
+    int    Write(size_t tile, const void* data, size_t size, uint64_t timestamp, TileIndexPictureType);
+    // Ends every stream and waits for the origin to accept it
+    int    Close();
+
+    const PushStatistics& GetStatistics(size_t tile) const { return connections.at(tile)->statistics; }
+    std::string Describe() const;
+    int    WriteReport(const char* filename) const;
+
+private:
+    typedef struct Chunk
+    {
+        std::vector<uint8_t> data;
+        uint64_t             timestamp;
+        unsigned long long   queued;   // When Write handed it over
+        bool                 sent;     // At least once; resending is not counted again
+    } Chunk;
+
+    typedef struct Connection
+    {
+        HttpTileSink*     sink;
+        size_t            tile;
+        std::string       path;
+        int               socket;
+        bool              requested;  // The request headers have been sent on this socket
+        uint64_t          offset;     // Bytes of the tile's stream the origin has confirmed
+        std::deque<Chunk> pending;    // Every chunk not yet confirmed, whether sent or not
+        size_t            pendingBytes;
+        bool              closing;
+        bool              failed;
+        int               response;   // Status of the completed request
+        pthread_t         thread;
+        bool              started;
+        pthread_mutex_t   mutex;
+        pthread_cond_t    changed;
+        PushStatistics    statistics;
+    } Connection;
+
+    std::string              urlTemplate;
+    std::string              host, port, pathTemplate;
+    size_t                   bufferBytes;
+    std::vector<Connection*> connections;  // NULL for tiles that are not pushed
+    bool                     closed;
+
+    int          ParseUrl();
+    int          Connect(Connection&);
+    int          SendRequest(Connection&);
+    int          SendChunk(Connection&, const Chunk&);
+    int          Finish(Connection&, bool complete);
+    int          ReadResponse(Connection&, bool& closed);
+    void         Disconnect(Connection&);
+    void         Send(Connection&);
+    static void* Sender(void*);
+};
+
+#endif
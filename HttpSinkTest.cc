@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HttpSink.h"
+
+// Pushes tiles to a stand-in origin on the loopback interface and checks that the origin ends up holding each
+// tile's exact bitstream: over plain chunked uploads, when the origin drops a connection part way through a
+// request (after send() has accepted bytes it never receives), and when slow responses hold the encoder back.
+// Needs no GPU.
+
+#define TEST_TILES       2
+#define TEST_FRAMES      400
+#define TEST_FRAME_BYTES 3000   // Varies by up to half again from frame to frame
+
+// The stand-in origin writes each request's body at its X-Tile-Offset, and confirms the request once the
+// final chunk arrives
+typedef struct Origin
+{
+    int                                         listener;
+    unsigned short                              port;
+    pthread_mutex_t                             mutex;
+    std::map<std::string, std::vector<uint8_t>> bodies;
+    std::map<std::string, uint64_t>             completed;   // X-Tile-Complete trailer of each path
+    size_t                                      requests;    // Confirmed
+    size_t                                      drops;       // Requests dropped before their end
+    size_t                                      dropAfter;   // Body bytes after which the next request is dropped;
+                                                             // zero drops none
+    unsigned int                                responseDelay;  // ms before each confirmation
+    bool                                        malformed;   // A request the origin could not follow
+} Origin;
+
+// Buffers a connection's input for reading by line and by length
+class Reader
+{
+public:
+    Reader(const int socket) : socket(socket), start(0) { }
+
+    bool ReadLine(std::string& line)
+    {
+        size_t end;
+
+        while((end = buffer.find("\r\n", start)) == std::string::npos)
+            if(!Fill())
+                return false;
+
+        line = buffer.substr(start, end - start);
+        start = end + 2;
+        return true;
+    }
+
+    bool Read(const size_t size, std::string& data)
+    {
+        while(buffer.size() - start < size)
+            if(!Fill())
+                return false;
+
+        data = buffer.substr(start, size);
+        start += size;
+        return true;
+    }
+
+private:
+    int         socket;
+    std::string buffer;
+    size_t      start;
+
+    bool Fill()
+    {
+        char data[4096];
+        auto received = recv(socket, data, sizeof(data), 0);
+
+        buffer.erase(0, start);
+        start = 0;
+        if(received > 0)
+            buffer.append(data, received);
+        return received > 0;
+    }
+};
+
+typedef struct OriginConnection
+{
+    Origin* origin;
+    int     socket;
+} OriginConnection;
+
+static bool HasPrefix(const std::string& value, const char* prefix)
+{
+    return strncasecmp(value.c_str(), prefix, strlen(prefix)) == 0;
+}
+
+// Serves the requests of one connection until the sink closes it (or the origin drops it)
+static void* Serve(void* argument)
+{
+    auto* connection = (OriginConnection*)argument;
+    auto& origin = *connection->origin;
+    Reader reader(connection->socket);
+    std::string line, path, data;
+    unsigned long long offset, complete, size;
+    size_t received;
+    char method[16], target[256];
+
+    while(reader.ReadLine(line))
+    {
+        if(sscanf(line.c_str(), "%15s %255s HTTP/1.1", method, target) != 2 || strcmp(method, "PUT") != 0)
+            break;
+
+        path = target;
+        offset = ~0ull;
+        while(reader.ReadLine(line) && !line.empty())
+            if(HasPrefix(line, "X-Tile-Offset:"))
+                offset = strtoull(line.c_str() + 14, NULL, 10);
+
+        pthread_mutex_lock(&origin.mutex);
+        auto& body = origin.bodies[path];
+        // A request resumes within what the origin holds, and replaces anything it holds past there
+        if(offset > body.size())
+            origin.malformed = true;
+        else
+            body.resize(offset);
+        pthread_mutex_unlock(&origin.mutex);
+
+        for(received = 0, complete = ~0ull; reader.ReadLine(line); received += size)
+        {
+            if(sscanf(line.c_str(), "%llx", &size) != 1 || (size > 0 && line.find(";pts=") == std::string::npos))
+                origin.malformed = true;
+            else if(size == 0)
+            {
+                while(reader.ReadLine(line) && !line.empty())
+                    if(HasPrefix(line, "X-Tile-Complete:"))
+                        complete = strtoull(line.c_str() + 16, NULL, 10);
+                break;
+            }
+
+            if(!reader.Read(size, data) || !reader.ReadLine(line) || !line.empty())
+                break;
+
+            pthread_mutex_lock(&origin.mutex);
+            auto drop = origin.dropAfter > 0 && received + size > origin.dropAfter;
+            if(drop)
+                origin.dropAfter = 0, origin.drops++;
+            else
+                origin.bodies[path].insert(origin.bodies[path].end(), data.begin(), data.end());
+            pthread_mutex_unlock(&origin.mutex);
+
+            // Ends the connection without confirming what the sink has already sent
+            if(drop)
+            {
+                shutdown(connection->socket, SHUT_RDWR);
+                break;
+            }
+        }
+
+        if(size != 0)
+            break;
+
+        usleep(origin.responseDelay * 1000);
+
+        pthread_mutex_lock(&origin.mutex);
+        origin.requests++;
+        if(complete != ~0ull)
+            origin.completed[path] = complete;
+        pthread_mutex_unlock(&origin.mutex);
+
+        // A body, so that the sink must read the whole response to reuse the connection
+        static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+        if(send(connection->socket, response, sizeof(response) - 1, MSG_NOSIGNAL) < 0)
+            break;
+    }
+
+    close(connection->socket);
+    delete connection;
+    return NULL;
+}
+
+static void* Listen(void* argument)
+{
+    auto* origin = (Origin*)argument;
+    pthread_t thread;
+    int socket;
+
+    while((socket = accept(origin->listener, NULL, NULL)) >= 0)
+    {
+        auto* connection = new OriginConnection();
+
+        connection->origin = origin;
+        connection->socket = socket;
+        if(pthread_create(&thread, NULL, Serve, connection) == 0)
+            pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+static int StartOrigin(Origin& origin)
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    pthread_t thread;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if((origin.listener = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+       bind(origin.listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+       listen(origin.listener, 16) != 0 ||
+       getsockname(origin.listener, (struct sockaddr*)&address, &length) != 0 ||
+       pthread_create(&thread, NULL, Listen, &origin) != 0)
+        return fprintf(stderr, "Unable to start the origin: %s\n", strerror(errno)), -1;
+
+    pthread_detach(thread);
+    origin.port = ntohs(address.sin_port);
+    return 0;
+}
+
+// Pushes every tile's frames through a sink, then compares what the origin holds with what was written
+static int Push(Origin& origin, const char* name, const size_t bufferBytes, const size_t dropAfter,
+                const unsigned int responseDelay)
+{
+    std::vector<std::vector<uint8_t>> written(TEST_TILES);
+    std::vector<uint8_t> frame;
+    char url[64];
+    auto failures = 0;
+
+    pthread_mutex_lock(&origin.mutex);
+    origin.bodies.clear();
+    origin.completed.clear();
+    origin.requests = origin.drops = 0;
+    origin.dropAfter = dropAfter;
+    origin.responseDelay = responseDelay;
+    origin.malformed = false;
+    pthread_mutex_unlock(&origin.mutex);
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/%s/%%d.hevc", origin.port, name);
+    HttpTileSink sink(url, TEST_TILES, bufferBytes);
+
+    if(sink.Open(std::vector<bool>(TEST_TILES, true)) != 0)
+        return fprintf(stderr, "%s: unable to open the sink\n", name), -1;
+
+    for(auto i = 0u; i < TEST_FRAMES; i++)
+        for(auto tile = 0u; tile < TEST_TILES; tile++)
+        {
+            frame.resize(TEST_FRAME_BYTES + (i * 7919 + tile * 104729) % (TEST_FRAME_BYTES / 2));
+            for(auto j = 0u; j < frame.size(); j++)
+                frame[j] = (uint8_t)((i * 31 + tile * 17 + j) * 2654435761u >> 24);
+
+            if(sink.Write(tile, frame.data(), frame.size(), i, i ? TILE_PICTURE_P : TILE_PICTURE_IDR) != 0)
+                failures++;
+            written[tile].insert(written[tile].end(), frame.begin(), frame.end());
+        }
+
+    if(sink.Close() != 0)
+        failures++;
+
+    auto stall = 0ull;
+    auto reconnects = 0lu;
+    for(auto tile = 0u; tile < TEST_TILES; tile++)
+    {
+        char path[64];
+
+        snprintf(path, sizeof(path), "/%s/%u.hevc", name, tile);
+        if(origin.bodies[path] != written[tile])
+            failures++, fprintf(stderr, "%s: the origin holds %lu of tile %u's %lu bytes, or different bytes\n",
+                                name, origin.bodies[path].size(), tile, written[tile].size());
+        if(origin.completed.count(path) == 0 || origin.completed[path] != written[tile].size())
+            failures++, fprintf(stderr, "%s: tile %u did not complete with its length\n", name, tile);
+
+        stall += sink.GetStatistics(tile).stall;
+        reconnects += sink.GetStatistics(tile).reconnects;
+    }
+
+    if(origin.malformed)
+        failures++, fprintf(stderr, "%s: the origin received a malformed request\n", name);
+    if(dropAfter > 0 && (origin.drops == 0 || reconnects == 0))
+        failures++, fprintf(stderr, "%s: no connection was dropped and resumed\n", name);
+    if(responseDelay > 0 && stall == 0)
+        failures++, fprintf(stderr, "%s: the encoder never waited for the origin\n", name);
+
+    printf("%-12s %s: %lu requests, %lu reconnects, %.1fms stalled\n", name, failures ? "failed" : "passed",
+           origin.requests, reconnects, stall / 1000.);
+    return failures ? -1 : 0;
+}
+
+int main(int argc, char*[])
+{
+    Origin origin;
+    auto status = 0;
+
+    if(argc > 1)
+        return fprintf(stderr, "Usage : httpsink_test\n"), 1;
+
+    pthread_mutex_init(&origin.mutex, NULL);
+    if(StartOrigin(origin) != 0)
+        return 1;
+
+    // Each request ends at half of the buffer, so a small buffer makes for many of them
+    status |= Push(origin, "chunked", 64 * 1024, 0, 0);
+    // Dropped after send() has accepted some of the request's bytes, which must be resent
+    status |= Push(origin, "resume", 64 * 1024, 20 * 1024, 0);
+    // Slow confirmations fill the buffer, so that Write waits
+    status |= Push(origin, "backpressure", 32 * 1024, 0, 20);
+
+    close(origin.listener);
+    return status != 0 ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "KeyframeIndex.h"
+
+#define KEYFRAME_INDEX_VERSION 1
+#define KEYFRAME_SCAN_CHUNK    (4*1024*1024)
+// A start code followed by the NAL header and the first payload byte
+#define NAL_PREFIX_BYTES       6
+
+typedef struct NalHeader
+{
+    bool vcl;
+    bool idr;
+    bool firstSlice;  // Begins a new picture
+    bool prefix;      // Non-VCL unit that begins (or belongs to the start of) an access unit
+} NalHeader;
+
+static NalHeader ParseNalHeader(const uint8_t* nal, const bool hevc)
+{
+    NalHeader header;
+
+    if(hevc)
+    {
+        auto type = (nal[0] >> 1) & 0x3f;
+        header.vcl = type < 32;
+        header.idr = type == 19 || type == 20;
+        header.firstSlice = (nal[2] & 0x80) != 0;
+        header.prefix = (type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44);
+    }
+    else
+    {
+        auto type = nal[0] & 0x1f;
+        header.vcl = type >= 1 && type <= 5;
+        header.idr = type == 5;
+        // first_mb_in_slice is zero exactly when its exp-Golomb code is a single one bit
+        header.firstSlice = (nal[1] & 0x80) != 0;
+        header.prefix = (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+    }
+
+    return header;
+}
+
+static long long GetFileSize(const char* filename)
+{
+    struct stat status;
+
+    return stat(filename, &status) == 0 ? (long long)status.st_size : -1;
+}
+
+int BuildKeyframeIndex(const char* inputFilename, const bool hevc, KeyframeIndex& index)
+{
+    std::vector<uint8_t> buffer(KEYFRAME_SCAN_CHUNK + NAL_PREFIX_BYTES);
+    long long base = 0;        // Input offset of buffer[0]
+    long long unitStart = -1;  // Start of the non-VCL units preceding the next picture
+    size_t carry = 0, read;
+    FILE* file;
+
+    if((file = fopen(inputFilename, "rb")) == NULL)
+        return -1;
+
+    index.inputSize = GetFileSize(inputFilename);
+    index.headerBytes = -1;
+    index.frames = 0;
+    index.keyframes.clear();
+
+    do
+    {
+        read = fread(buffer.data() + carry, 1, KEYFRAME_SCAN_CHUNK, file);
+
+        auto size = carry + read;
+        // Start codes near the end are revisited with the next chunk, unless this is the last
+        auto limit = read > 0 ? (size >= NAL_PREFIX_BYTES ? size - NAL_PREFIX_BYTES + 1 : 0) : size;
+        auto i = 0ul;
+
+        for(; i < limit; i++)
+        {
+            if(i + NAL_PREFIX_BYTES > size || buffer[i] != 0 || buffer[i + 1] != 0 || buffer[i + 2] != 1)
+                continue;
+
+            auto header = ParseNalHeader(&buffer[i + 3], hevc);
+            auto offset = base + (long long)i;
+
+            if(header.vcl && header.firstSlice)
+            {
+                if(index.headerBytes < 0)
+                    index.headerBytes = offset;
+                if(header.idr)
+                    index.keyframes.push_back({ index.frames, unitStart >= 0 ? unitStart : offset });
+                index.frames++;
+            }
+
+            if(header.vcl)
+                unitStart = -1;
+            else if(header.prefix && unitStart < 0)
+                unitStart = offset;
+        }
+
+        carry = size - i;
+        std::copy(buffer.begin() + i, buffer.begin() + size, buffer.begin());
+        base += i;
+    } while(read > 0);
+
+    fclose(file);
+    return index.headerBytes >= 0 ? 0 : -1;
+}
+
+int LoadKeyframeIndex(const char* filename, const char* inputFilename, KeyframeIndex& index)
+{
+    FILE* file;
+    int version;
+    size_t count;
+
+    if((file = fopen(filename, "r")) == NULL)
+        return -1;
+    else if(fscanf(file, "tiler-keyframes %d input %lld header %lld frames %d keyframes %lu",
+                   &version, &index.inputSize, &index.headerBytes, &index.frames, &count) != 5 ||
+            version != KEYFRAME_INDEX_VERSION || index.inputSize != GetFileSize(inputFilename))
+    {
+        fprintf(stderr, "Keyframe index %s does not match %s; rebuilding\n", filename, inputFilename);
+        return fclose(file), -1;
+    }
+
+    index.keyframes.resize(count);
+    for(auto& keyframe: index.keyframes)
+        if(fscanf(file, "%d %lld", &keyframe.frame, &keyframe.offset) != 2)
+        {
+            fprintf(stderr, "Keyframe index %s is truncated\n", filename);
+            return fclose(file), -1;
+        }
+
+    fclose(file);
+    return 0;
+}
+
+int SaveKeyframeIndex(const char* filename, const KeyframeIndex& index)
+{
+    auto temporary = std::string(filename) + ".tmp";
+    FILE* file;
+
+    if((file = fopen(temporary.c_str(), "w")) == NULL)
+        return -1;
+
+    fprintf(file, "tiler-keyframes %d\ninput %lld\nheader %lld\nframes %d\nkeyframes %lu\n",
+            KEYFRAME_INDEX_VERSION, index.inputSize, index.headerBytes, index.frames, index.keyframes.size());
+    for(auto& keyframe: index.keyframes)
+        fprintf(file, "%d %lld\n", keyframe.frame, keyframe.offset);
+
+    if(fclose(file) != 0 || rename(temporary.c_str(), filename) != 0)
+        return unlink(temporary.c_str()), -1;
+
+    return 0;
+}
+
+const Keyframe* FindKeyframe(const KeyframeIndex& index, const int frame)
+{
+    auto next = std::upper_bound(index.keyframes.begin(), index.keyframes.end(), frame,
+                                 [](const int value, const Keyframe& keyframe) { return value < keyframe.frame; });
+
+    return next == index.keyframes.begin() ? NULL : &*(next - 1);
+}
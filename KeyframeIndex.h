@@ -0,0 +1,31 @@
+#ifndef _KEYFRAME_INDEX
+#define _KEYFRAME_INDEX
+
+#include <vector>
+
+// An IDR access unit in an H.264 or HEVC elementary stream.  Decoding from an IDR first displays the
+// frame whose index equals the number of pictures preceding it in decode order.
+typedef struct Keyframe
+{
+    int       frame;   // Display index of the first frame output when decoding starts here
+    long long offset;  // Start of the access unit, including any parameter sets that precede the IDR
+} Keyframe;
+
+typedef struct KeyframeIndex
+{
+    long long             inputSize;    // Detects an index that no longer matches its input
+    long long             headerBytes;  // Leading bytes (parameter sets) that must be parsed before any seek
+    int                   frames;
+    std::vector<Keyframe> keyframes;    // Ascending by frame
+} KeyframeIndex;
+
+// Scans the start codes of an Annex-B stream, counting pictures by their first slice.  Field-coded H.264
+// counts each field as a picture.
+int             BuildKeyframeIndex(const char* inputFilename, bool hevc, KeyframeIndex&);
+// Fails when the index is missing, malformed or was built for an input of a different size
+int             LoadKeyframeIndex(const char* filename, const char* inputFilename, KeyframeIndex&);
+int             SaveKeyframeIndex(const char* filename, const KeyframeIndex&);
+// The last keyframe at or before the given frame, or NULL when there is none
+const Keyframe* FindKeyframe(const KeyframeIndex&, int frame);
+
+#endif
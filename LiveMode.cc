@@ -0,0 +1,155 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "LiveMode.h"
+#include "PipelineTuner.h"
+
+size_t LatencyHistogram::Bucket(const unsigned long long value)
+{
+    if(value < SUBBUCKETS)
+        return value;
+
+    auto exponent = 63 - __builtin_clzll(value);  // At least log2(SUBBUCKETS)
+    auto shift = exponent - 4;
+
+    return SUBBUCKETS * (shift + 1) + ((value >> shift) & (SUBBUCKETS - 1));
+}
+
+unsigned long long LatencyHistogram::UpperBound(const size_t bucket)
+{
+    if(bucket < SUBBUCKETS)
+        return bucket;
+
+    auto shift = bucket / SUBBUCKETS - 1;
+    auto mantissa = SUBBUCKETS + bucket % SUBBUCKETS;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(const unsigned long long microseconds)
+{
+    counts[Bucket(microseconds)]++;
+    count++;
+    maximum = std::max(maximum, microseconds);
+}
+
+unsigned long long LatencyHistogram::Percentile(const double fraction) const
+{
+    auto target = (size_t)std::max(1., fraction * count + .5);
+    auto seen = 0lu;
+
+    for(auto i = 0u; i < counts.size() && count > 0; i++)
+        if((seen += counts[i]) >= target)
+            return std::min(UpperBound(i), maximum);
+
+    return maximum;
+}
+
+LiveSchedule::LiveSchedule(const unsigned long long deadline, const size_t tiles,
+                           const std::vector<size_t>& important)
+    : deadline(deadline), tiles(tiles), dropped(0)
+{
+    for(auto& tile: this->tiles)
+    {
+        tile.important = false;
+        tile.skipped = 0;
+    }
+
+    for(auto tile: important)
+        if(tile < tiles && !this->tiles[tile].important)
+        {
+            this->tiles[tile].important = true;
+            order.push_back(tile);
+        }
+
+    for(auto i = 0u; i < tiles; i++)
+        if(!this->tiles[i].important)
+            order.push_back(i);
+}
+
+NVENCSTATUS LiveSchedule::EncodeFrame(VideoEncoder& encoder, const EncodeFrameConfig& frame,
+                                      const NV_ENC_PIC_STRUCT type)
+{
+    NVENCSTATUS status;
+    auto encoded = false, due = false;
+
+    if((status = encoder.AdaptRate(&frame)) != NV_ENC_SUCCESS)
+        return status;
+
+    for(auto tile: order)
+    {
+        auto& state = tiles[tile];
+        auto limit = state.important ? LIVE_IMPORTANT_SLACK * deadline : deadline;
+
+        if(!encoder.IsTileDue(tile))
+            continue;
+
+        due = true;
+        // The age is taken per tile, since earlier tiles of the frame consume its budget
+        if(frame.decoded != 0 && PipelineTuner::Now() - frame.decoded > limit)
+            state.skipped++;
+        else if((status = encoder.EncodeTile(tile, &frame, type)) != NV_ENC_SUCCESS)
+            return status;
+        else
+            encoded = true;
+    }
+
+    // A frame on which no tile is due (every tile being decimated) still advances their cadence
+    if(encoded || !due)
+        encoder.CompleteFrame();
+    else
+        dropped++;
+
+    return NV_ENC_SUCCESS;
+}
+
+void LiveSchedule::RecordOutput(const size_t tile, const unsigned long long latency)
+{
+    tiles.at(tile).latency.Record(latency);
+    overall.Record(latency);
+}
+
+std::string LiveSchedule::Describe() const
+{
+    std::stringstream stream;
+    auto skipped = 0lu;
+
+    for(auto& tile: tiles)
+        skipped += tile.skipped;
+
+    stream.precision(1);
+    stream << std::fixed
+           << "Live latency: p50 " << overall.Percentile(.5) / 1000. << "ms, p90 " << overall.Percentile(.9) / 1000.
+           << "ms, p99 " << overall.Percentile(.99) / 1000. << "ms, max " << overall.GetMaximum() / 1000.
+           << "ms over " << overall.GetCount() << " tile frames (deadline " << deadline / 1000. << "ms); "
+           << skipped << " tile frames skipped, " << dropped << " frames dropped\n";
+    return stream.str();
+}
+
+int LiveSchedule::WriteReport(const char* filename) const
+{
+    FILE* file;
+    auto skipped = 0lu;
+
+    if((file = fopen(filename, "w")) == NULL)
+        return -1;
+
+    fprintf(file, "tile,frames,skipped,p50_ms,p90_ms,p99_ms,max_ms\n");
+    for(auto i = 0u; i < tiles.size(); i++)
+    {
+        auto& latency = tiles[i].latency;
+
+        skipped += tiles[i].skipped;
+        if(latency.GetCount() > 0 || tiles[i].skipped > 0)
+            fprintf(file, "%u,%lu,%lu,%.3f,%.3f,%.3f,%.3f\n", i, latency.GetCount(), tiles[i].skipped,
+                    latency.Percentile(.5) / 1000., latency.Percentile(.9) / 1000.,
+                    latency.Percentile(.99) / 1000., latency.GetMaximum() / 1000.);
+    }
+    fprintf(file, "all,%lu,%lu,%.3f,%.3f,%.3f,%.3f\n", overall.GetCount(), skipped,
+            overall.Percentile(.5) / 1000., overall.Percentile(.9) / 1000.,
+            overall.Percentile(.99) / 1000., overall.GetMaximum() / 1000.);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -0,0 +1,76 @@
+#ifndef _LIVE_MODE
+#define _LIVE_MODE
+
+#include <string>
+#include <vector>
+
+#include "TileVideoEncoder.h"
+
+#define LIVE_IMPORTANT_SLACK 2  // Important tiles are skipped only once this many deadlines late
+#define LIVE_QUEUE_SIZE      1  // Decoded frames waiting for the encoder
+#define LIVE_ENCODE_BUFFERS  2  // Frames in flight per tile
+
+// Distribution of latencies in microseconds.  Each power of two is split into 16 buckets, so a reported
+// percentile is within 1/16 of the true value.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() : counts(BUCKETS), count(0), maximum(0) { }
+
+    void               Record(unsigned long long microseconds);
+    // Upper bound of the bucket holding the given fraction (0-1) of samples; zero when empty
+    unsigned long long Percentile(double fraction) const;
+    size_t             GetCount() const { return count; }
+    unsigned long long GetMaximum() const { return maximum; }
+
+private:
+    static const size_t SUBBUCKETS = 16;
+    static const size_t BUCKETS = SUBBUCKETS * 61;
+
+    std::vector<size_t> counts;
+    size_t              count;
+    unsigned long long  maximum;
+
+    static size_t             Bucket(unsigned long long);
+    static unsigned long long UpperBound(size_t bucket);
+};
+
+// Encodes a live input against a deadline.  Each tile of a frame must be submitted within the deadline of
+// the frame being decoded; a tile that falls behind omits the frame from its output so that it catches up,
+// rather than adding to the latency of every later frame.
+// Important tiles (e.g., the likely viewport) are submitted first and are given LIVE_IMPORTANT_SLACK
+// deadlines before they skip.
+//
+// Latency is measured per tile from decode to the output being written; WriteReport writes CSV rows:
+//     tile,frames,skipped,p50_ms,p90_ms,p99_ms,max_ms
+// with an 'all' row over every tile.  Every method is called on the encoder thread.
+class LiveSchedule
+{
+public:
+    LiveSchedule(unsigned long long deadline, size_t tiles, const std::vector<size_t>& important);
+
+    // Encodes the tiles of a frame that are still within their deadline, counting the frame when any was
+    NVENCSTATUS EncodeFrame(VideoEncoder&, const EncodeFrameConfig&, NV_ENC_PIC_STRUCT type);
+    void        RecordOutput(size_t tile, unsigned long long latency);
+
+    // Frames of which no tile was encoded
+    size_t      GetDroppedFrames() const { return dropped; }
+    std::string Describe() const;
+    int         WriteReport(const char* filename) const;
+
+private:
+    typedef struct TileLatency
+    {
+        bool             important;
+        size_t           skipped;
+        LatencyHistogram latency;
+    } TileLatency;
+
+    unsigned long long       deadline;  // microseconds
+    std::vector<size_t>      order;     // Important tiles first
+    std::vector<TileLatency> tiles;
+    LatencyHistogram         overall;
+    size_t                   dropped;
+};
+
+#endif
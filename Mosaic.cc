@@ -0,0 +1,335 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "Mosaic.h"
+#include "Transcode.h"
+#include "Trace.h"
+
+int LoadMosaicInputs(const char* filename, std::vector<std::string>& inputs)
+{
+    std::ifstream file(filename);
+    std::string line, input;
+
+    if(!file)
+        return -1;
+
+    while(std::getline(file, line))
+    {
+        std::istringstream fields(line);
+
+        if((fields >> input) && input[0] != '#')
+            inputs.push_back(input);
+    }
+
+    return 0;
+}
+
+TileDimensions GetMosaicGrid(const size_t count)
+{
+    TileDimensions grid;
+
+    for(grid.columns = 1; grid.columns * grid.columns < count; grid.columns++);
+    grid.rows = (count + grid.columns - 1) / grid.columns;
+    grid.count = grid.rows * grid.columns;
+
+    return grid;
+}
+
+MosaicFrameSource::MosaicFrameSource(CUvideoctxlock lock, const std::vector<std::string>& filenames,
+                                     const TileDimensions& grid, const int width, const int height,
+                                     const unsigned int stallTimeout, const Placement& placement)
+    : lock(lock), grid(grid), width(width), height(height),
+      cellWidth(width / (int)grid.columns & ~1), cellHeight(height / (int)grid.rows & ~1),
+      stallTimeout(stallTimeout), placement(placement), pitch(0), next(0), cancelled(false), failed(false)
+{
+    for(auto& filename: filenames)
+    {
+        auto* input = new Input(lock);
+
+        input->filename = filename;
+        input->fpsRatio = 1.f;
+        memset(&input->held, 0, sizeof(input->held));
+        input->shown = false;
+        input->pulled = 0;
+        input->started = input->stalled = input->ended = false;
+        input->placement = &this->placement;
+        input->statistics = MosaicStatistics();
+        inputs.push_back(input);
+    }
+}
+
+MosaicFrameSource::~MosaicFrameSource()
+{
+    Close();
+
+    if(!surfaces.empty() && cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        for(auto surface: surfaces)
+            cuMemFree(surface);
+        cuvidCtxUnlock(lock, 0);
+    }
+
+    for(auto input: inputs)
+        delete input;
+}
+
+void* MosaicFrameSource::DecodeThread(void* argument)
+{
+    auto* input = (Input*)argument;
+
+    TraceSetThreadName("mosaic decoder");
+    ApplyPlacement(*input->placement, STAGE_DECODER);
+    input->decoder.Start();
+
+    return NULL;
+}
+
+int MosaicFrameSource::Open(EncodeConfig& configuration, const PipelineDepths& depths)
+{
+    for(auto input: inputs)
+    {
+        auto inputConfiguration = configuration;
+        auto inputDepths = depths;
+
+        // Each decoder scales to the cell; the first input sets the output rate when it is unset
+        inputConfiguration.inputFileName = (char*)input->filename.c_str();
+        inputConfiguration.width = cellWidth;
+        inputConfiguration.height = cellHeight;
+
+        if((input->fpsRatio = InitializeDecoder(input->decoder, input->queue, lock, inputConfiguration,
+                                                inputDepths)) < 0)
+            return fprintf(stderr, "Unable to decode mosaic input %s\n", input->filename.c_str()), -1;
+        // A cell keeps its frame mapped while the next is mapped
+        else if(inputDepths.outputSurfaces < 2)
+            return fprintf(stderr, "Mosaic inputs need at least two output surfaces\n"), -1;
+
+        configuration.fps = inputConfiguration.fps;
+    }
+
+    // Composed frames are progressive, whatever the inputs
+    configuration.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
+
+    for(auto input: inputs)
+    {
+        input->decoder.SetThreaded();
+        if(pthread_create(&input->thread, NULL, DecodeThread, input) != 0)
+            return fprintf(stderr, "Unable to start decoding %s\n", input->filename.c_str()), -1;
+        input->started = true;
+    }
+
+    return 0;
+}
+
+// Brings a cell up to the output frame given: it shows the last input frame displayed at or before that
+// frame's time, waiting for it until the deadline unless the input is already behind
+void MosaicFrameSource::Advance(Input& input, const int frame, const unsigned long long deadline)
+{
+    auto due = (int)(frame / (double)input.fpsRatio + 1e-3);
+    auto timedOut = false;
+    DecodedFrame decoded;
+
+    while(!input.ended && input.pulled <= due)
+        if(input.decoder.NextFrame(decoded, input.stalled ? 0 : deadline, timedOut))
+        {
+            if(input.held.device != 0)
+            {
+                input.statistics.dropped += input.shown ? 0 : 1;
+                input.decoder.ReleaseFrame(input.held);
+            }
+            input.held = decoded;
+            input.shown = false;
+            input.pulled++;
+        }
+        else if(timedOut)
+            break;
+        else
+        {
+            input.ended = true;
+            failed = failed || input.decoder.HasFailed();
+            if(input.held.device != 0)
+                input.decoder.ReleaseFrame(input.held);
+        }
+
+    // Stalled from the first output frame the input misses until it catches up
+    auto stalled = !input.ended && input.pulled <= due;
+    if(stalled && !input.stalled)
+        input.statistics.stalls++;
+    input.stalled = stalled;
+}
+
+int MosaicFrameSource::AcquireSurface(CUdeviceptr& surface)
+{
+    CUresult result;
+
+    if(!available.empty())
+    {
+        surface = available.back();
+        available.pop_back();
+        return 0;
+    }
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    // Cells without an input are blanked once, when the frame is allocated
+    if((result = cuMemAllocPitch(&surface, &pitch, width, height * 3 / 2, 16)) == CUDA_SUCCESS)
+    {
+        surfaces.push_back(surface);
+        if((result = cuMemsetD2D8(surface, pitch, MOSAIC_LUMA, width, height)) == CUDA_SUCCESS)
+            result = cuMemsetD2D8(surface + pitch * height, pitch, MOSAIC_CHROMA, width, height / 2);
+    }
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return fprintf(stderr, "CUDA error %d allocating a mosaic frame\n", result), -1;
+
+    return 0;
+}
+
+int MosaicFrameSource::Compose(const CUdeviceptr surface)
+{
+    CUDA_MEMCPY2D parameters;
+    CUresult result = CUDA_SUCCESS;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+
+    for(auto i = 0u; i < inputs.size() && result == CUDA_SUCCESS; i++)
+    {
+        auto& input = *inputs[i];
+        auto x = i % grid.columns * cellWidth, y = i / grid.columns * cellHeight;
+
+        if(input.held.device == 0)
+        {
+            if((result = cuMemsetD2D8(surface + y * pitch + x, pitch, MOSAIC_LUMA, cellWidth,
+                                      cellHeight)) == CUDA_SUCCESS)
+                result = cuMemsetD2D8(surface + (height + y / 2) * pitch + x, pitch, MOSAIC_CHROMA, cellWidth,
+                                      cellHeight / 2);
+            continue;
+        }
+
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+        parameters.srcDevice = input.held.device;
+        parameters.srcPitch = input.held.pitch;
+        parameters.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+        parameters.dstDevice = surface;
+        parameters.dstXInBytes = x;
+        parameters.dstY = y;
+        parameters.dstPitch = pitch;
+        parameters.WidthInBytes = cellWidth;
+        parameters.Height = cellHeight;
+
+        if((result = cuMemcpy2D(&parameters)) != CUDA_SUCCESS)
+            break;
+
+        // Chroma follows the cell's luma rows in the decoded frame, and the frame's in the composite
+        parameters.srcY = cellHeight;
+        parameters.dstY = height + y / 2;
+        parameters.Height = cellHeight / 2;
+        result = cuMemcpy2D(&parameters);
+    }
+
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return fprintf(stderr, "CUDA error %d composing a mosaic frame\n", result), -1;
+
+    return 0;
+}
+
+bool MosaicFrameSource::NextFrame(DecodedFrame& frame, bool& cut)
+{
+    auto deadline = stallTimeout ? PipelineTuner::Now() + stallTimeout * 1000ull : ULLONG_MAX;
+    auto ended = true;
+    CUdeviceptr surface;
+
+    if(cancelled || failed)
+        return false;
+
+    for(auto input: inputs)
+    {
+        Advance(*input, next, deadline);
+        ended = ended && input->ended;
+    }
+
+    if(ended)
+        return false;
+
+    TraceSpan span("mosaic", next);
+
+    if(AcquireSurface(surface) != 0)
+        return failed = true, false;
+    else if(Compose(surface) != 0)
+        return available.push_back(surface), failed = true, false;
+
+    for(auto input: inputs)
+        if(input->held.device == 0)
+            input->statistics.placeholder++;
+        else
+        {
+            input->statistics.frames += input->shown ? 0 : 1;
+            input->statistics.repeated += input->stalled ? 1 : 0;
+            input->shown = true;
+        }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.info.progressive_frame = 1;
+    frame.device = surface;
+    frame.pitch = (unsigned int)pitch;
+    frame.index = next++;
+    frame.decoded = PipelineTuner::Now();
+    cut = false;
+
+    return true;
+}
+
+void MosaicFrameSource::ReleaseFrame(DecodedFrame& frame)
+{
+    available.push_back(frame.device);
+    frame.device = 0;
+}
+
+// Stops every decoder, releasing the frames it still displays so that its thread can finish
+void MosaicFrameSource::Close()
+{
+    DecodedFrame frame;
+
+    for(auto input: inputs)
+    {
+        if(input->held.device != 0)
+            input->decoder.ReleaseFrame(input->held);
+        if(!input->started)
+            continue;
+
+        input->decoder.m_bStop = true;
+        while(input->decoder.NextFrame(frame))
+            input->decoder.ReleaseFrame(frame);
+
+        pthread_join(input->thread, NULL);
+        input->started = false;
+    }
+}
+
+std::string MosaicFrameSource::DescribeStatistics() const
+{
+    std::stringstream description;
+    char row[256];
+
+    description << "cell  frames  dropped  repeated  placeholder  stalls  input\n";
+
+    for(auto i = 0u; i < inputs.size(); i++)
+    {
+        auto& statistics = inputs[i]->statistics;
+
+        snprintf(row, sizeof(row), "%4u  %6lu  %7lu  %8lu  %11lu  %6lu  %s\n", i, statistics.frames,
+                 statistics.dropped, statistics.repeated, statistics.placeholder, statistics.stalls,
+                 inputs[i]->filename.c_str());
+        description << row;
+    }
+
+    return description.str();
+}
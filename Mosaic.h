@@ -0,0 +1,105 @@
+#ifndef _MOSAIC
+#define _MOSAIC
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "PipelineStages.h"
+#include "Placement.h"
+#include "TileDimensions.h"
+
+#define DEFAULT_MOSAIC_STALL 200  // ms an output frame waits for a late input before repeating its last frame
+#define MINIMUM_MOSAIC_CELL  16   // Width and height
+#define MOSAIC_LUMA          16   // Placeholder (black) for cells with nothing to show
+#define MOSAIC_CHROMA        128
+
+typedef struct MosaicStatistics
+{
+    size_t frames;       // Input frames shown in at least one output frame
+    size_t dropped;      // Input frames superseded before being shown (frame-rate matching or catching up)
+    size_t repeated;     // Output frames that repeated the last frame because the input was late
+    size_t placeholder;  // Output frames with nothing from the input (before its first frame and after its last)
+    size_t stalls;       // Times the input missed its deadline after keeping up
+} MosaicStatistics;
+
+// Reads one input per line; blank lines and those beginning with '#' are ignored
+int LoadMosaicInputs(const char* filename, std::vector<std::string>&);
+// A grid with at least count cells, as square as possible
+TileDimensions GetMosaicGrid(size_t count);
+
+// Composes many small inputs into one frame, cell by cell in row-major order, so that they share one encode
+// (and one encoder session per output tile) rather than opening an encoder each.  Every input has its own
+// CudaDecoder, frame queue and decode thread, and the decoder scales its frames to the cell size, so each
+// output frame is composed with device copies alone.
+//
+// Output frames are produced at the output rate.  Each cell shows the last frame of its input displayed at
+// or before the output frame's time, dropping and repeating frames as MatchFPS does for a single stream.  An
+// input that has not displayed that frame within the stall timeout of the output frame being started repeats
+// its last frame; while it stays behind it is polled rather than waited for, so that one stalled input
+// delays the others at most once.  Cells show a placeholder before the input's first frame and after its last,
+// and the mosaic ends with its last input.
+class MosaicFrameSource : public FrameSource
+{
+public:
+    MosaicFrameSource(CUvideoctxlock lock, const std::vector<std::string>& inputs, const TileDimensions& grid,
+                      int width, int height, unsigned int stallTimeout, const Placement& placement);
+    ~MosaicFrameSource();
+
+    // Opens every input, filling in the output rate from the first when it is unset, and starts decoding.
+    // Decoder depths are shared by the inputs.  Returns nonzero, having reported why, on failure.
+    int    Open(EncodeConfig& configuration, const PipelineDepths& depths);
+    bool   NextFrame(DecodedFrame&, bool& cut);
+    void   ReleaseFrame(DecodedFrame&);
+    void   Cancel() { cancelled = true; }
+
+    // Whether composing a frame failed (ending the mosaic early)
+    bool   HasFailed() const { return failed; }
+    size_t GetInputCount() const { return inputs.size(); }
+    int    GetCellWidth() const { return cellWidth; }
+    int    GetCellHeight() const { return cellHeight; }
+    const MosaicStatistics& GetStatistics(size_t input) const { return inputs.at(input)->statistics; }
+    std::string DescribeStatistics() const;
+
+private:
+    typedef struct Input
+    {
+        std::string      filename;
+        CudaDecoder      decoder;
+        CUVIDFrameQueue  queue;
+        float            fpsRatio;    // Output to input frame rate
+        DecodedFrame     held;        // The frame the cell shows; device is zero when there is none
+        bool             shown;       // Whether the held frame has been composed
+        int              pulled;      // Frames taken from the decoder
+        bool             started;     // The decode thread is running
+        bool             stalled;     // Behind its frame as of the last output frame
+        bool             ended;
+        pthread_t        thread;
+        const Placement* placement;
+        MosaicStatistics statistics;
+
+        Input(CUvideoctxlock lock) : queue(lock) { }
+    } Input;
+
+    CUvideoctxlock           lock;
+    std::vector<Input*>      inputs;
+    TileDimensions           grid;
+    int                      width, height;          // Of the output frame
+    int                      cellWidth, cellHeight;
+    unsigned int             stallTimeout;           // ms; zero waits for every input
+    Placement                placement;
+    std::vector<CUdeviceptr> surfaces;               // Every composite frame allocated
+    std::vector<CUdeviceptr> available;              // Those not held by the consumer
+    size_t                   pitch;
+    int                      next;                   // Index of the next output frame
+    volatile bool            cancelled;
+    bool                     failed;
+
+    static void* DecodeThread(void*);
+    void         Advance(Input&, int frame, unsigned long long deadline);
+    int          AcquireSurface(CUdeviceptr&);
+    int          Compose(CUdeviceptr surface);
+    void         Close();
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _PIPELINE_STAGES
+#define _PIPELINE_STAGES
+
+#include "VideoDecoder.h"
+#include "TileVideoEncoder.h"
+
+// Stages that an embedding application may substitute in the tiling pipeline (see TilerPipeline.h):
+//     source -> transform -> tile and encode (VideoEncoder) -> sinks (TileSink)
+
+// Delivers NV12 frames of the output size on the device, in the tiler's context, in display order.  Sources
+// other than the decoder set info.progressive_frame (or the field order) and may leave decoded at zero.
+class FrameSource
+{
+public:
+    virtual ~FrameSource() { }
+
+    // The next frame, and whether it must begin a GOP on every tile; false once every frame has been returned
+    virtual bool NextFrame(DecodedFrame&, bool& cut) = 0;
+    virtual void ReleaseFrame(DecodedFrame&) = 0;
+    // Asks the source to end early; frames already produced are still returned and must be released
+    virtual void Cancel() { }
+};
+
+// Frames decoded from the input by a CudaDecoder
+class DecoderFrameSource : public FrameSource
+{
+public:
+    DecoderFrameSource(CudaDecoder& decoder) : decoder(decoder) { }
+
+    bool NextFrame(DecodedFrame& frame, bool& cut) { cut = false; return decoder.NextFrame(frame); }
+    void ReleaseFrame(DecodedFrame& frame)         { decoder.ReleaseFrame(frame); }
+    // Parsing ends with the next chunk of input
+    void Cancel()                                  { decoder.m_bStop = true; }
+
+private:
+    CudaDecoder& decoder;
+};
+
+// Changes a frame before it is tiled, e.g. by pointing the encoder at a remapped or composited copy.  The
+// frame handed to the encoder must stay valid until the source frame is released.
+class FrameTransform
+{
+public:
+    virtual ~FrameTransform() { }
+
+    virtual int Apply(const DecodedFrame&, EncodeFrameConfig&) = 0;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "PipelineTuner.h"
+#include "TileDimensions.h"
+#include "FrameQueue.h"
+
+#define TUNER_WINDOW_FRAMES   30
+#define TUNER_STALL_FRACTION  0.05  // of a window's wall time before a hand-off is deepened
+#define TUNER_QUIET_FRACTION  0.01  // of a window's wall time below which a hand-off is idle
+#define TUNER_QUIET_WINDOWS   4     // idle windows before depths shrink
+#define TUNER_MINIMUM_QUEUE   4
+#define TUNER_MAXIMUM_ENCODE  32    // MAX_ENCODE_QUEUE
+
+int ParsePipelineDepths(const char* argument, PipelineDepths& depths)
+{
+    for(auto& assignment: split(argument, ','))
+    {
+        char name[16];
+        unsigned int value;
+        char trailing;
+
+        if(sscanf(assignment.c_str(), "%15[a-z]=%u%c", name, &value, &trailing) != 2)
+            return -1;
+        else if(!strcmp(name, "decode") && value <= FrameQueue::cnMaximumSize)
+            depths.decodeSurfaces = value;
+        else if(!strcmp(name, "output") && value > 0)
+            depths.outputSurfaces = value;
+        else if(!strcmp(name, "delay"))
+            depths.displayDelay = (int)value;
+        else if(!strcmp(name, "queue") && value > 0 && value <= FrameQueue::cnMaximumSize)
+            depths.queueSize = value;
+        else if(!strcmp(name, "encode") && value > 0 && value <= TUNER_MAXIMUM_ENCODE)
+            depths.encodeBuffers = value;
+        else
+            return -1;
+    }
+
+    return 0;
+}
+
+std::string DescribePipelineDepths(const PipelineDepths& depths)
+{
+    std::ostringstream description;
+
+    description << "decode=" << depths.decodeSurfaces
+                << ",output=" << depths.outputSurfaces
+                << ",delay=" << depths.displayDelay
+                << ",queue=" << depths.queueSize
+                << ",encode=" << depths.encodeBuffers;
+
+    return description.str();
+}
+
+unsigned long long PipelineTuner::Now()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+size_t PipelineTuner::GetFootprint(const PipelineDepths& depths) const
+{
+    return (depths.decodeSurfaces + depths.outputSurfaces) * surfaceBytes +
+           depths.encodeBuffers * encodeBufferBytes;
+}
+
+bool PipelineTuner::Update(const PipelineStalls& stalls, PipelineDepths& depths)
+{
+    auto now = Now();
+
+    if(windowStart == 0)
+    {
+        windowStart = now;
+        previous = stalls;
+        return false;
+    }
+    else if(++framesInWindow < TUNER_WINDOW_FRAMES)
+        return false;
+
+    double elapsed = now > windowStart ? now - windowStart : 1;
+    auto surface = (stalls.surface - previous.surface) / elapsed;
+    auto enqueue = (stalls.enqueue - previous.enqueue) / elapsed;
+    auto dequeue = (stalls.dequeue - previous.dequeue) / elapsed;
+    auto output  = (stalls.output - previous.output) / elapsed;
+    auto changed = false;
+
+    framesInWindow = 0;
+    windowStart = now;
+    previous = stalls;
+
+    // The decoder periodically outruns the encoder and at other times falls behind it
+    if(enqueue > TUNER_STALL_FRACTION && dequeue > TUNER_STALL_FRACTION &&
+       depths.queueSize + 2 <= depths.decodeSurfaces)
+    {
+        depths.queueSize += 2;
+        changed = true;
+    }
+
+    if(output > TUNER_STALL_FRACTION && encodeBuffersResizable && depths.encodeBuffers < TUNER_MAXIMUM_ENCODE)
+    {
+        depths.encodeBuffers++;
+        if(budget && GetFootprint(depths) > budget)
+            depths.encodeBuffers--;
+        else
+            changed = true;
+    }
+
+    // Surfaces are fixed once the decoder exists; remember what would have helped
+    if(surface > TUNER_STALL_FRACTION)
+    {
+        auto recommended = std::max(recommendedDecodeSurfaces, depths.decodeSurfaces) + 2;
+        auto candidate = depths;
+
+        candidate.decodeSurfaces = recommended;
+        if(recommended <= FrameQueue::cnMaximumSize && (!budget || GetFootprint(candidate) <= budget))
+            recommendedDecodeSurfaces = recommended;
+    }
+
+    // An encoder starved by a slower decoder gains nothing from depth, so only blocking counts here
+    if(surface < TUNER_QUIET_FRACTION && enqueue < TUNER_QUIET_FRACTION && output < TUNER_QUIET_FRACTION)
+        quietWindows++;
+    else
+        quietWindows = 0;
+
+    // Steady content does not need the slack; give back memory and latency
+    if(quietWindows >= TUNER_QUIET_WINDOWS && !changed)
+    {
+        quietWindows = 0;
+
+        if(encodeBuffersResizable && depths.encodeBuffers > minimumEncodeBuffers)
+        {
+            depths.encodeBuffers--;
+            changed = true;
+        }
+        if(depths.queueSize > TUNER_MINIMUM_QUEUE)
+        {
+            depths.queueSize--;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,74 @@
+#ifndef _PIPELINE_TUNER
+#define _PIPELINE_TUNER
+
+#include <stddef.h>
+#include <string>
+
+// Buffering depth at each hand-off in the pipeline; zero selects the default for the stream
+typedef struct PipelineDepths
+{
+    unsigned int decodeSurfaces;  // Decoder DPB plus surfaces held for display (codec-dependent default)
+    unsigned int outputSurfaces;  // Post-processed surfaces that may be mapped at once (2)
+    int          displayDelay;    // Frames the parser delays display to overlap decode (1); negative selects
+                                  // the default, since zero is meaningful
+    unsigned int queueSize;       // Decoded frames awaiting the encoder (FrameQueue::cnDefaultSize)
+    unsigned int encodeBuffers;   // Frames in flight in each tile encoder (numB + 4)
+} PipelineDepths;
+
+// Parses "decode=<n>,output=<n>,delay=<n>,queue=<n>,encode=<n>" (any subset) into the depths
+int         ParsePipelineDepths(const char* argument, PipelineDepths&);
+std::string DescribePipelineDepths(const PipelineDepths&);
+
+// Cumulative time (in microseconds) spent blocked at each hand-off
+typedef struct PipelineStalls
+{
+    unsigned long long surface;  // Decoder waiting for a surface still held for display
+    unsigned long long enqueue;  // Decoder waiting for room in the frame queue
+    unsigned long long dequeue;  // Encoder waiting for a decoded frame
+    unsigned long long output;   // Encoder waiting for a tile encoder to return a buffer
+} PipelineStalls;
+
+// Adjusts the frame queue and encode buffer depths from the stalls observed over a window of frames.
+// Bursty content (the decoder blocked on a full queue while the encoder also starves) deepens the queue;
+// time spent waiting for encoder output adds encode buffers, as long as the memory budget permits.
+// Depths shrink again after several windows without meaningful stalls.  Depths fixed at decoder creation
+// are not changed, but a recommendation is kept for the next run.
+class PipelineTuner
+{
+public:
+    PipelineTuner(const size_t budget, const size_t surfaceBytes, const size_t encodeBufferBytes,
+                  const unsigned int minimumEncodeBuffers, const bool encodeBuffersResizable) :
+        budget(budget),
+        surfaceBytes(surfaceBytes),
+        encodeBufferBytes(encodeBufferBytes),
+        minimumEncodeBuffers(minimumEncodeBuffers),
+        encodeBuffersResizable(encodeBuffersResizable),
+        framesInWindow(0),
+        quietWindows(0),
+        windowStart(0),
+        previous({0, 0, 0, 0}),
+        recommendedDecodeSurfaces(0)
+        { }
+
+    // Called once per frame with cumulative stalls; returns true when the depths were changed
+    bool         Update(const PipelineStalls&, PipelineDepths&);
+    // Largest number of decode surfaces that was found to be worthwhile (zero when no change is advised)
+    unsigned int GetRecommendedDecodeSurfaces() const { return recommendedDecodeSurfaces; }
+    size_t       GetFootprint(const PipelineDepths&) const;
+
+    static unsigned long long Now();  // microseconds on a monotonic clock
+
+private:
+    size_t             budget;            // bytes; zero is unbounded
+    size_t             surfaceBytes;      // per decode or output surface
+    size_t             encodeBufferBytes; // per unit of encode depth, across all tiles
+    unsigned int       minimumEncodeBuffers;
+    bool               encodeBuffersResizable;
+    unsigned int       framesInWindow;
+    unsigned int       quietWindows;
+    unsigned long long windowStart;
+    PipelineStalls     previous;
+    unsigned int       recommendedDecodeSurfaces;
+};
+
+#endif
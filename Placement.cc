@@ -0,0 +1,225 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <sstream>
+
+#include "Placement.h"
+#include "TileDimensions.h"
+
+#define NUMA_NODE_ROOT      "/sys/devices/system/node"
+#define PLACEMENT_LOCK_ROOT "/tmp/tiler-placement"
+#define MAX_JOBS_PER_NODE   256
+
+// From <numaif.h>; defined here to avoid a dependency on libnuma
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static const char* stageNames[STAGE_COUNT] = { "decoder", "encoder" };
+
+int ParseCpuList(const std::string& list, std::vector<int>& cpus)
+{
+    int first, last;
+    char trailing;
+
+    cpus.clear();
+
+    for(auto& range: split(list, ','))
+        if(sscanf(range.c_str(), "%d-%d%c", &first, &last, &trailing) == 2 && first <= last && first >= 0)
+            for(auto cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        else if(sscanf(range.c_str(), "%d%c", &first, &trailing) == 1 && first >= 0)
+            cpus.push_back(first);
+        else if(!range.empty())
+            return -1;
+
+    return cpus.empty() ? -1 : 0;
+}
+
+static int GetNodeCpus(const int node, std::vector<int>& cpus)
+{
+    char filename[256], list[4096];
+    FILE* file;
+
+    snprintf(filename, sizeof(filename), NUMA_NODE_ROOT "/node%d/cpulist", node);
+    if((file = fopen(filename, "r")) == NULL)
+        return -1;
+    else if(fgets(list, sizeof(list), file) == NULL)
+        return fclose(file), -1;
+
+    fclose(file);
+    list[strcspn(list, "\n")] = '\0';
+
+    return ParseCpuList(list, cpus);
+}
+
+int GetNumaNodeCount()
+{
+    char filename[256];
+    auto count = 0;
+
+    // Nodes are numbered contiguously on the hosts we support
+    do
+        snprintf(filename, sizeof(filename), NUMA_NODE_ROOT "/node%d", count);
+    while(access(filename, F_OK) == 0 && ++count);
+
+    return count > 0 ? count : 1;
+}
+
+int ParsePlacement(const char* argument, Placement& placement)
+{
+    std::string value(argument);
+    auto separator = value.find('=');
+
+    if(separator == std::string::npos)
+        return -1;
+
+    for(auto stage = 0; stage < STAGE_COUNT; stage++)
+        if(value.compare(0, separator, stageNames[stage]) == 0)
+            return ParseCpuList(value.substr(separator + 1), placement.cpus[stage]);
+
+    return -1;
+}
+
+int ParsePlacementNode(const char* argument, Placement& placement)
+{
+    char trailing;
+
+    if(!strcmp(argument, "auto"))
+        placement.node = PLACEMENT_AUTO_NODE;
+    else if(sscanf(argument, "%d%c", &placement.node, &trailing) != 1 || placement.node < 0)
+        return -1;
+
+    return 0;
+}
+
+// Concurrent jobs claim (node, slot) lock files in slot-major order, so that each node receives a job
+// before any node receives a second.  Locks are released by the kernel when a job exits.
+int ResolvePlacement(Placement& placement, int& claim)
+{
+    char filename[256];
+    auto nodes = GetNumaNodeCount();
+
+    claim = -1;
+
+    if(placement.node == PLACEMENT_AUTO_NODE && nodes == 1)
+        placement.node = 0;
+    else if(placement.node == PLACEMENT_AUTO_NODE)
+    {
+        if(mkdir(PLACEMENT_LOCK_ROOT, 01777) != 0 && errno != EEXIST)
+            return fprintf(stderr, "Unable to create %s\n", PLACEMENT_LOCK_ROOT), -1;
+
+        for(auto slot = 0; slot < MAX_JOBS_PER_NODE && placement.node == PLACEMENT_AUTO_NODE; slot++)
+            for(auto node = 0; node < nodes && placement.node == PLACEMENT_AUTO_NODE; node++)
+            {
+                int descriptor;
+
+                snprintf(filename, sizeof(filename), PLACEMENT_LOCK_ROOT "/node%d.%d", node, slot);
+                if((descriptor = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0666)) < 0)
+                    continue;
+                else if(flock(descriptor, LOCK_EX | LOCK_NB) == 0)
+                {
+                    placement.node = node;
+                    claim = descriptor;  // Remains open to hold the claim
+                }
+                else
+                    close(descriptor);
+            }
+
+        if(placement.node == PLACEMENT_AUTO_NODE)
+            placement.node = getpid() % nodes;
+    }
+    else if(placement.node >= nodes)
+        return fprintf(stderr, "NUMA node %d does not exist\n", placement.node), -1;
+
+    return 0;
+}
+
+void ReleasePlacement(const int claim)
+{
+    if(claim >= 0)
+        close(claim);
+}
+
+int ApplyPlacement(const Placement& placement, const PipelineStage stage)
+{
+    std::vector<int> cpus = placement.cpus[stage];
+    cpu_set_t set;
+
+    if(cpus.empty() && placement.node >= 0 && GetNodeCpus(placement.node, cpus) != 0)
+        return fprintf(stderr, "Unable to read CPUs of NUMA node %d\n", placement.node), -1;
+
+    if(!cpus.empty())
+    {
+        CPU_ZERO(&set);
+        for(auto cpu: cpus)
+            if(cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+
+        if((errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+            return fprintf(stderr, "Unable to set %s affinity: %s\n", stageNames[stage], strerror(errno)), -1;
+    }
+
+    // Host buffers allocated by this thread are preferentially placed on its node
+    if(placement.node >= 0)
+    {
+        unsigned long mask[(CPU_SETSIZE + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long))] = { 0 };
+
+        mask[placement.node / (8 * sizeof(unsigned long))] |= 1ul << (placement.node % (8 * sizeof(unsigned long)));
+        if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) != 0)
+            fprintf(stderr, "Unable to bind %s memory to NUMA node %d: %s\n",
+                    stageNames[stage], placement.node, strerror(errno));
+    }
+
+    return 0;
+}
+
+int SaveThreadPlacement(ThreadPlacement& saved)
+{
+    if((errno = pthread_getaffinity_np(pthread_self(), sizeof(saved.cpus), &saved.cpus)) != 0)
+        return fprintf(stderr, "Unable to read thread affinity: %s\n", strerror(errno)), -1;
+
+    memset(saved.nodes, 0, sizeof(saved.nodes));
+    saved.hasPolicy = syscall(SYS_get_mempolicy, &saved.policy, saved.nodes, sizeof(saved.nodes) * 8, NULL, 0) == 0;
+
+    return 0;
+}
+
+int RestoreThreadPlacement(const ThreadPlacement& saved)
+{
+    if((errno = pthread_setaffinity_np(pthread_self(), sizeof(saved.cpus), &saved.cpus)) != 0)
+        return fprintf(stderr, "Unable to restore thread affinity: %s\n", strerror(errno)), -1;
+    else if(saved.hasPolicy && syscall(SYS_set_mempolicy, saved.policy, saved.nodes, sizeof(saved.nodes) * 8) != 0)
+        return fprintf(stderr, "Unable to restore thread memory policy: %s\n", strerror(errno)), -1;
+
+    return 0;
+}
+
+std::string DescribePlacement(const Placement& placement, const PipelineStage stage)
+{
+    std::ostringstream description;
+    auto& cpus = placement.cpus[stage];
+
+    if(cpus.empty() && placement.node < 0)
+        return "any";
+    else if(cpus.empty())
+        description << "node " << placement.node;
+    else
+    {
+        description << "cpus ";
+        for(auto i = 0u; i < cpus.size(); i++)
+            description << (i ? "," : "") << cpus[i];
+        if(placement.node >= 0)
+            description << " (node " << placement.node << ")";
+    }
+
+    return description.str();
+}
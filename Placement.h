@@ -0,0 +1,54 @@
+#ifndef _PLACEMENT
+#define _PLACEMENT
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+
+// Pipeline threads whose CPU and memory placement can be configured.  Bitstream output is written by the
+// encoder thread, so it follows the encoder's placement.
+typedef enum PipelineStage
+{
+    STAGE_DECODER,
+    STAGE_ENCODER,
+    STAGE_COUNT
+} PipelineStage;
+
+#define PLACEMENT_NO_NODE   -1
+#define PLACEMENT_AUTO_NODE -2
+
+typedef struct Placement
+{
+    std::vector<int> cpus[STAGE_COUNT];  // Empty lets a stage run on any CPU of the node (or anywhere)
+    int              node;               // NUMA node for threads and their host allocations
+} Placement;
+
+// Parses "<stage>=<cpu list>" (e.g., "decoder=0-3,8") into the placement
+int         ParsePlacement(const char* argument, Placement&);
+// Parses "auto" or a node number
+int         ParsePlacementNode(const char* argument, Placement&);
+// Resolves an automatic node by claiming the least-occupied node among concurrently running jobs.
+// The claim (-1 when none was taken) is held until it is released, or the process exits.
+int         ResolvePlacement(Placement&, int& claim);
+void        ReleasePlacement(int claim);
+// Binds the calling thread (and its subsequent host allocations) according to the placement
+int         ApplyPlacement(const Placement&, PipelineStage);
+std::string DescribePlacement(const Placement&, PipelineStage);
+
+// The calling thread's affinity and memory policy, so that a thread placed for a while can be put back
+typedef struct ThreadPlacement
+{
+    cpu_set_t     cpus;
+    bool          hasPolicy;  // Unset when the kernel has no memory policy support
+    int           policy;
+    unsigned long nodes[CPU_SETSIZE / (8 * sizeof(unsigned long))];
+} ThreadPlacement;
+
+int         SaveThreadPlacement(ThreadPlacement&);
+int         RestoreThreadPlacement(const ThreadPlacement&);
+
+int         ParseCpuList(const std::string&, std::vector<int>& cpus);
+int         GetNumaNodeCount();
+
+#endif
@@ -0,0 +1,352 @@
+#include <string.h>
+
+#include <vector>
+
+#include "PlaneKernelsInternal.h"
+
+void ScalarDeinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+    {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+void ScalarInterleave(const uint8_t* u, const uint8_t* v, uint8_t* uv, const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+    {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+void ScalarDownscale2x(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+        output[i] = (row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) >> 2;
+}
+
+void ScalarDownscale2xInterleaved(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+        for(auto channel = 0u; channel < 2; channel++)
+            output[2 * i + channel] = (row0[4 * i + channel] + row0[4 * i + 2 + channel] +
+                                       row1[4 * i + channel] + row1[4 * i + 2 + channel] + 2) >> 2;
+}
+
+void ScalarBlendRows(const uint8_t* row0, const uint8_t* row1, const unsigned int weight, uint8_t* output,
+                     const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+        output[i] = (row0[i] * (256 - weight) + row1[i] * weight + 128) >> 8;
+}
+
+uint64_t ScalarSAD(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    uint64_t sum = 0;
+
+    for(auto i = 0u; i < count; i++)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+
+    return sum;
+}
+
+uint64_t ScalarSSE(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    uint64_t sum = 0;
+
+    for(auto i = 0u; i < count; i++)
+        sum += (a[i] - b[i]) * (a[i] - b[i]);
+
+    return sum;
+}
+
+void ScalarSSIM4x4(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch, const size_t count,
+                   uint32_t (*sums)[4])
+{
+    for(auto block = 0u; block < count; block++)
+    {
+        uint32_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+
+        for(auto y = 0u; y < 4; y++)
+            for(auto x = 4 * block; x < 4 * block + 4; x++)
+            {
+                uint32_t pa = a[y * aPitch + x], pb = b[y * bPitch + x];
+
+                s1 += pa;
+                s2 += pb;
+                ss += pa * pa + pb * pb;
+                s12 += pa * pb;
+            }
+
+        sums[block][0] = s1;
+        sums[block][1] = s2;
+        sums[block][2] = ss;
+        sums[block][3] = s12;
+    }
+}
+
+static inline uint8_t Bilinear(const unsigned int topLeft, const unsigned int topRight, const unsigned int bottomLeft,
+                               const unsigned int bottomRight, const unsigned int weight)
+{
+    auto horizontal = weight & 0xff, vertical = weight >> 8;
+    auto top = topLeft * (256 - horizontal) + topRight * horizontal;
+    auto bottom = bottomLeft * (256 - horizontal) + bottomRight * horizontal;
+
+    return (top * (256 - vertical) + bottom * vertical + 32768) >> 16;
+}
+
+void ScalarRemap(const uint8_t* plane, const size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                 uint8_t* output, const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+    {
+        auto* block = plane + offsets[i];
+
+        output[i] = Bilinear(block[0], block[1], block[pitch], block[pitch + 1], weights[i]);
+    }
+}
+
+void ScalarRemapInterleaved(const uint8_t* plane, const size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                            uint8_t* output, const size_t count)
+{
+    for(auto i = 0u; i < count; i++)
+    {
+        auto* block = plane + offsets[i];
+
+        for(auto channel = 0u; channel < 2; channel++)
+            output[2 * i + channel] = Bilinear(block[channel], block[2 + channel], block[pitch + channel],
+                                               block[pitch + 2 + channel], weights[i]);
+    }
+}
+
+static const PlaneKernels scalarPlaneKernels = {
+    "scalar",
+    ScalarDeinterleave,
+    ScalarInterleave,
+    ScalarDownscale2x,
+    ScalarDownscale2xInterleaved,
+    ScalarBlendRows,
+    ScalarSAD,
+    ScalarSSE,
+    ScalarSSIM4x4,
+    ScalarRemap,
+    ScalarRemapInterleaved
+};
+
+static const PlaneKernels* selectedPlaneKernels = NULL;
+
+static bool IsSupported(const char* name)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(!strcmp(name, "sse4"))
+        return __builtin_cpu_supports("sse4.1");
+    else if(!strcmp(name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    else if(!strcmp(name, "avx512"))
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+
+    // NEON is part of the baseline wherever its implementation is compiled
+    return true;
+}
+
+const PlaneKernels* FindPlaneKernels(const char* name)
+{
+    const PlaneKernels* candidates[] = { GetAvx512PlaneKernels(), GetAvx2PlaneKernels(), GetSse4PlaneKernels(),
+                                         GetNeonPlaneKernels(), &scalarPlaneKernels };
+
+    for(auto* candidate: candidates)
+        if(candidate != NULL && !strcmp(candidate->name, name))
+            return IsSupported(name) ? candidate : NULL;
+
+    return NULL;
+}
+
+const PlaneKernels& GetPlaneKernels()
+{
+    const char* preference[] = { "avx512", "avx2", "sse4", "neon", "scalar" };
+
+    for(auto i = 0u; selectedPlaneKernels == NULL; i++)
+        selectedPlaneKernels = FindPlaneKernels(preference[i]);
+
+    return *selectedPlaneKernels;
+}
+
+void SelectPlaneKernels(const PlaneKernels& kernels)
+{
+    selectedPlaneKernels = &kernels;
+}
+
+void CropPlane(const uint8_t* source, const size_t sourcePitch, const size_t sourceXInBytes, const size_t sourceY,
+               uint8_t* destination, const size_t destinationPitch, const size_t widthInBytes, const size_t height)
+{
+    source += sourceY * sourcePitch + sourceXInBytes;
+
+    for(auto y = 0u; y < height; y++)
+        memcpy(destination + y * destinationPitch, source + y * sourcePitch, widthInBytes);
+}
+
+void CropNV12Tile(const uint8_t* frame, const size_t framePitch, const size_t frameHeight,
+                  const size_t offsetX, const size_t offsetY,
+                  uint8_t* tile, const size_t tilePitch, const size_t tileWidth, const size_t tileHeight)
+{
+    CropPlane(frame, framePitch, offsetX, offsetY, tile, tilePitch, tileWidth, tileHeight);
+    CropPlane(frame, framePitch, offsetX, frameHeight + offsetY / 2,
+              tile + tileHeight * tilePitch, tilePitch, tileWidth, tileHeight / 2);
+}
+
+void DeinterleavePlane(const uint8_t* uv, const size_t uvPitch, uint8_t* u, const size_t uPitch,
+                       uint8_t* v, const size_t vPitch, const size_t chromaWidth, const size_t chromaHeight,
+                       const PlaneKernels& kernels)
+{
+    for(auto y = 0u; y < chromaHeight; y++)
+        kernels.deinterleave(uv + y * uvPitch, u + y * uPitch, v + y * vPitch, chromaWidth);
+}
+
+void InterleavePlane(const uint8_t* u, const size_t uPitch, const uint8_t* v, const size_t vPitch,
+                     uint8_t* uv, const size_t uvPitch, const size_t chromaWidth, const size_t chromaHeight,
+                     const PlaneKernels& kernels)
+{
+    for(auto y = 0u; y < chromaHeight; y++)
+        kernels.interleave(u + y * uPitch, v + y * vPitch, uv + y * uvPitch, chromaWidth);
+}
+
+void DownscalePlane2x(const uint8_t* source, const size_t sourcePitch, uint8_t* destination,
+                      const size_t destinationPitch, const size_t destinationWidth, const size_t destinationHeight,
+                      const bool interleaved, const PlaneKernels& kernels)
+{
+    auto* downscale = interleaved ? kernels.downscale2xInterleaved : kernels.downscale2x;
+
+    for(auto y = 0u; y < destinationHeight; y++)
+        downscale(source + 2 * y * sourcePitch, source + (2 * y + 1) * sourcePitch,
+                  destination + y * destinationPitch, destinationWidth);
+}
+
+// Maps destination sample centres onto the source in 24.8 fixed point, clamped to the source edges
+static void MapSamples(const size_t sourceSize, const size_t destinationSize, std::vector<size_t>& positions,
+                       std::vector<unsigned int>& weights)
+{
+    positions.resize(destinationSize);
+    weights.resize(destinationSize);
+
+    for(auto i = 0u; i < destinationSize; i++)
+    {
+        auto position = ((2 * (int64_t)i + 1) * (int64_t)sourceSize * 256) / (2 * (int64_t)destinationSize) - 128;
+
+        if(position < 0)
+            position = 0;
+        else if(position > ((int64_t)sourceSize - 1) * 256)
+            position = ((int64_t)sourceSize - 1) * 256;
+
+        positions[i] = position >> 8;
+        weights[i] = position & 0xff;
+    }
+}
+
+void ResizePlane(const uint8_t* source, const size_t sourcePitch, const size_t sourceWidth, const size_t sourceHeight,
+                 uint8_t* destination, const size_t destinationPitch, const size_t destinationWidth,
+                 const size_t destinationHeight, const bool interleaved, const PlaneKernels& kernels)
+{
+    const auto channels = interleaved ? 2u : 1u;
+    std::vector<size_t> rows, columns;
+    std::vector<unsigned int> rowWeights, columnWeights;
+    std::vector<uint8_t> blended(sourceWidth * channels);
+
+    MapSamples(sourceHeight, destinationHeight, rows, rowWeights);
+    MapSamples(sourceWidth, destinationWidth, columns, columnWeights);
+
+    // The vertical pass is vectorized; the horizontal pass gathers and is left scalar
+    for(auto y = 0u; y < destinationHeight; y++)
+    {
+        auto* row0 = source + rows[y] * sourcePitch;
+        auto* row1 = rows[y] + 1 < sourceHeight ? row0 + sourcePitch : row0;
+        auto* output = destination + y * destinationPitch;
+
+        kernels.blendRows(row0, row1, rowWeights[y], blended.data(), blended.size());
+
+        for(auto x = 0u; x < destinationWidth; x++)
+        {
+            auto left = columns[x] * channels;
+            auto right = columns[x] + 1 < sourceWidth ? left + channels : left;
+            auto weight = columnWeights[x];
+
+            for(auto channel = 0u; channel < channels; channel++)
+                output[x * channels + channel] =
+                    (blended[left + channel] * (256 - weight) + blended[right + channel] * weight + 128) >> 8;
+        }
+    }
+}
+
+void RemapPlane(const uint8_t* source, const size_t sourcePitch, const uint32_t* offsets, const uint16_t* weights,
+                uint8_t* destination, const size_t count, const bool interleaved, const PlaneKernels& kernels)
+{
+    if(interleaved)
+        kernels.remapInterleaved(source, sourcePitch, offsets, weights, destination, count);
+    else
+        kernels.remap(source, sourcePitch, offsets, weights, destination, count);
+}
+
+uint64_t PlaneSAD(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                  const size_t widthInBytes, const size_t height, const PlaneKernels& kernels)
+{
+    uint64_t sum = 0;
+
+    for(auto y = 0u; y < height; y++)
+        sum += kernels.sad(a + y * aPitch, b + y * bPitch, widthInBytes);
+
+    return sum;
+}
+
+uint64_t PlaneSSE(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                  const size_t widthInBytes, const size_t height, const PlaneKernels& kernels)
+{
+    uint64_t sum = 0;
+
+    for(auto y = 0u; y < height; y++)
+        sum += kernels.sse(a + y * aPitch, b + y * bPitch, widthInBytes);
+
+    return sum;
+}
+
+// SSIM of an 8x8 window from the sums of its four 4x4 blocks (as in x264)
+static double SSIMWindow(const uint32_t* s0, const uint32_t* s1, const uint32_t* s2, const uint32_t* s3)
+{
+    const double c1 = .01 * .01 * 255 * 255 * 64;
+    const double c2 = .03 * .03 * 255 * 255 * 64 * 63;
+    double sumA = (double)s0[0] + s1[0] + s2[0] + s3[0];
+    double sumB = (double)s0[1] + s1[1] + s2[1] + s3[1];
+    double squares = (double)s0[2] + s1[2] + s2[2] + s3[2];
+    double products = (double)s0[3] + s1[3] + s2[3] + s3[3];
+    double variance = squares * 64 - sumA * sumA - sumB * sumB;
+    double covariance = products * 64 - sumA * sumB;
+
+    return (2 * sumA * sumB + c1) * (2 * covariance + c2) / ((sumA * sumA + sumB * sumB + c1) * (variance + c2));
+}
+
+double PlaneSSIM(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                 const size_t width, const size_t height, const PlaneKernels& kernels)
+{
+    auto blocks = width / 4;
+    std::vector<uint32_t> previous(blocks * 4), current(blocks * 4);
+    double sum = 0;
+    size_t windows = 0;
+
+    if(blocks < 2 || height < 8)
+        return 0;
+
+    // Windows straddle two rows of 4x4 blocks and two adjacent blocks in each
+    for(auto row = 0u; row + 4 <= height; row += 4)
+    {
+        std::swap(previous, current);
+        kernels.ssim4x4(a + row * aPitch, aPitch, b + row * bPitch, bPitch, blocks, (uint32_t (*)[4])current.data());
+
+        for(auto x = 0u; row > 0 && x + 1 < blocks; x++, windows++)
+            sum += SSIMWindow(&previous[4 * x], &previous[4 * x + 4], &current[4 * x], &current[4 * x + 4]);
+    }
+
+    return windows ? sum / windows : 0;
+}
@@ -0,0 +1,81 @@
+#ifndef _PLANE_KERNELS
+#define _PLANE_KERNELS
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Row kernels for 8-bit planes, implemented for each supported instruction set.  Counts are in output
+// samples; interleaved kernels operate on NV12 chroma (UV pairs), where count is the number of pairs.
+typedef struct PlaneKernels
+{
+    const char* name;
+    void     (*deinterleave)(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t count);
+    void     (*interleave)(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count);
+    // Averages 2x2 blocks of two source rows (rounding to nearest)
+    void     (*downscale2x)(const uint8_t* row0, const uint8_t* row1, uint8_t* output, size_t count);
+    void     (*downscale2xInterleaved)(const uint8_t* row0, const uint8_t* row1, uint8_t* output, size_t count);
+    // output = (row0 * (256 - weight) + row1 * weight + 128) / 256, for weight in [0, 256]
+    void     (*blendRows)(const uint8_t* row0, const uint8_t* row1, unsigned int weight, uint8_t* output,
+                          size_t count);
+    uint64_t (*sad)(const uint8_t* a, const uint8_t* b, size_t count);
+    uint64_t (*sse)(const uint8_t* a, const uint8_t* b, size_t count);
+    // Sums over count horizontally adjacent 4x4 blocks: a, b, a * a + b * b and a * b
+    void     (*ssim4x4)(const uint8_t* a, size_t aPitch, const uint8_t* b, size_t bPitch, size_t count,
+                        uint32_t (*sums)[4]);
+    // Bilinear samples at arbitrary positions: output i blends the 2x2 block at plane + offsets[i] (its second
+    // row a pitch below) by weights[i], horizontally by the low byte and vertically by the high byte (in
+    // 256ths).  Up to two bytes past each row of the block are read.
+    void     (*remap)(const uint8_t* plane, size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                      uint8_t* output, size_t count);
+    // As remap, for UV pairs: offsets address the U of the top-left pair
+    void     (*remapInterleaved)(const uint8_t* plane, size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                                 uint8_t* output, size_t count);
+} PlaneKernels;
+
+// The fastest implementation supported by this CPU (selected once, on first use)
+const PlaneKernels& GetPlaneKernels();
+// Finds an implementation ("scalar", "sse4", "avx2", "avx512" or "neon"); NULL when unsupported here
+const PlaneKernels* FindPlaneKernels(const char* name);
+// Overrides the implementation returned by GetPlaneKernels
+void                SelectPlaneKernels(const PlaneKernels&);
+
+// Plane operations.  Offsets, pitches and widths are in bytes and follow the CUDA_MEMCPY2D arithmetic used
+// to crop tiles in VideoEncoder::EncodeFrame.
+
+void     CropPlane(const uint8_t* source, size_t sourcePitch, size_t sourceXInBytes, size_t sourceY,
+                   uint8_t* destination, size_t destinationPitch, size_t widthInBytes, size_t height);
+// Crops a tile from an NV12 frame whose chroma plane follows frameHeight luma rows, into an NV12 tile whose
+// chroma follows tileHeight luma rows
+void     CropNV12Tile(const uint8_t* frame, size_t framePitch, size_t frameHeight, size_t offsetX, size_t offsetY,
+                      uint8_t* tile, size_t tilePitch, size_t tileWidth, size_t tileHeight);
+
+void     DeinterleavePlane(const uint8_t* uv, size_t uvPitch, uint8_t* u, size_t uPitch, uint8_t* v, size_t vPitch,
+                           size_t chromaWidth, size_t chromaHeight,
+                           const PlaneKernels& kernels = GetPlaneKernels());
+void     InterleavePlane(const uint8_t* u, size_t uPitch, const uint8_t* v, size_t vPitch, uint8_t* uv, size_t uvPitch,
+                         size_t chromaWidth, size_t chromaHeight,
+                         const PlaneKernels& kernels = GetPlaneKernels());
+
+// Halves a plane in each dimension; the source holds at least twice the destination's samples
+void     DownscalePlane2x(const uint8_t* source, size_t sourcePitch, uint8_t* destination, size_t destinationPitch,
+                          size_t destinationWidth, size_t destinationHeight, bool interleaved,
+                          const PlaneKernels& kernels = GetPlaneKernels());
+// Bilinear resize by an arbitrary ratio; widths are in samples (UV pairs when interleaved)
+void     ResizePlane(const uint8_t* source, size_t sourcePitch, size_t sourceWidth, size_t sourceHeight,
+                     uint8_t* destination, size_t destinationPitch, size_t destinationWidth, size_t destinationHeight,
+                     bool interleaved, const PlaneKernels& kernels = GetPlaneKernels());
+// Samples a plane of count outputs (UV pairs when interleaved) through a lookup table (see remap)
+void     RemapPlane(const uint8_t* source, size_t sourcePitch, const uint32_t* offsets, const uint16_t* weights,
+                    uint8_t* destination, size_t count, bool interleaved,
+                    const PlaneKernels& kernels = GetPlaneKernels());
+
+uint64_t PlaneSAD(const uint8_t* a, size_t aPitch, const uint8_t* b, size_t bPitch, size_t widthInBytes,
+                  size_t height, const PlaneKernels& kernels = GetPlaneKernels());
+// Sum of squared differences
+uint64_t PlaneSSE(const uint8_t* a, size_t aPitch, const uint8_t* b, size_t bPitch, size_t widthInBytes,
+                  size_t height, const PlaneKernels& kernels = GetPlaneKernels());
+// Mean SSIM of a luma plane over 8x8 windows at a stride of four samples; zero when smaller than a window
+double   PlaneSSIM(const uint8_t* a, size_t aPitch, const uint8_t* b, size_t bPitch, size_t width, size_t height,
+                   const PlaneKernels& kernels = GetPlaneKernels());
+
+#endif
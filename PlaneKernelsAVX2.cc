@@ -0,0 +1,307 @@
+#include "PlaneKernelsInternal.h"
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+// Built with -mavx2; only reached after a runtime check for AVX2.  Byte shuffles and packs operate within
+// 128-bit lanes, so results are reordered across lanes where the output must be contiguous.
+
+static void Deinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, const size_t count)
+{
+    const __m256i split = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                                           0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        // Each becomes U(0-7) U(8-15) V(0-7) V(8-15) of its 32 bytes
+        auto first  = _mm256_permute4x64_epi64(
+            _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(uv + 2 * i)), split), 0xd8);
+        auto second = _mm256_permute4x64_epi64(
+            _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(uv + 2 * i + 32)), split), 0xd8);
+
+        _mm256_storeu_si256((__m256i*)(u + i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(v + i), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+
+    ScalarDeinterleave(uv + 2 * i, u + i, v + i, count - i);
+}
+
+static void Interleave(const uint8_t* u, const uint8_t* v, uint8_t* uv, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        auto us = _mm256_loadu_si256((const __m256i*)(u + i));
+        auto vs = _mm256_loadu_si256((const __m256i*)(v + i));
+        auto low = _mm256_unpacklo_epi8(us, vs);
+        auto high = _mm256_unpackhi_epi8(us, vs);
+
+        _mm256_storeu_si256((__m256i*)(uv + 2 * i), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256((__m256i*)(uv + 2 * i + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+
+    ScalarInterleave(u + i, v + i, uv + 2 * i, count - i);
+}
+
+static inline __m256i Average2x2(const __m256i row0, const __m256i row1)
+{
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    auto sum = _mm256_add_epi16(_mm256_maddubs_epi16(row0, ones), _mm256_maddubs_epi16(row1, ones));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+}
+
+static inline __m256i Pack(const __m256i low, const __m256i high)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8);
+}
+
+static void Downscale2x(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        auto low  = Average2x2(_mm256_loadu_si256((const __m256i*)(row0 + 2 * i)),
+                               _mm256_loadu_si256((const __m256i*)(row1 + 2 * i)));
+        auto high = Average2x2(_mm256_loadu_si256((const __m256i*)(row0 + 2 * i + 32)),
+                               _mm256_loadu_si256((const __m256i*)(row1 + 2 * i + 32)));
+
+        _mm256_storeu_si256((__m256i*)(output + i), Pack(low, high));
+    }
+
+    ScalarDownscale2x(row0 + 2 * i, row1 + 2 * i, output + i, count - i);
+}
+
+static void Downscale2xInterleaved(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    const __m256i pairs = _mm256_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15,
+                                           0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto low  = Average2x2(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(row0 + 4 * i)), pairs),
+                               _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(row1 + 4 * i)), pairs));
+        auto high = Average2x2(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(row0 + 4 * i + 32)), pairs),
+                               _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(row1 + 4 * i + 32)), pairs));
+
+        _mm256_storeu_si256((__m256i*)(output + 2 * i), Pack(low, high));
+    }
+
+    ScalarDownscale2xInterleaved(row0 + 4 * i, row1 + 4 * i, output + 2 * i, count - i);
+}
+
+static void BlendRows(const uint8_t* row0, const uint8_t* row1, const unsigned int weight, uint8_t* output,
+                      const size_t count)
+{
+    const __m256i weight0 = _mm256_set1_epi16(256 - weight);
+    const __m256i weight1 = _mm256_set1_epi16(weight);
+    const __m256i half = _mm256_set1_epi16(128);
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row0 + i)));
+        auto b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row1 + i)));
+        auto sum = _mm256_add_epi16(_mm256_mullo_epi16(a, weight0), _mm256_mullo_epi16(b, weight1));
+        auto result = _mm256_srli_epi16(_mm256_add_epi16(sum, half), 8);
+
+        _mm_storeu_si128((__m128i*)(output + i), _mm_packus_epi16(_mm256_castsi256_si128(result),
+                                                                  _mm256_extracti128_si256(result, 1)));
+    }
+
+    ScalarBlendRows(row0 + i, row1 + i, weight, output + i, count - i);
+}
+
+static uint64_t SAD(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    auto sum = _mm256_setzero_si256();
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                                    _mm256_loadu_si256((const __m256i*)(b + i))));
+
+    auto half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_extract_epi64(half, 1) +
+           ScalarSAD(a + i, b + i, count - i);
+}
+
+static uint64_t SSE(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    auto total = _mm256_setzero_si256();
+    auto i = 0u;
+
+    // 32-bit accumulators absorb at most 8192 * 4 * 255 * 255 before being widened
+    while(i + 32 <= count)
+    {
+        auto partial = _mm256_setzero_si256();
+
+        for(auto block = 0; block < 8192 && i + 32 <= count; block++, i += 32)
+        {
+            auto as = _mm256_loadu_si256((const __m256i*)(a + i));
+            auto bs = _mm256_loadu_si256((const __m256i*)(b + i));
+            auto low  = _mm256_sub_epi16(_mm256_unpacklo_epi8(as, zero), _mm256_unpacklo_epi8(bs, zero));
+            auto high = _mm256_sub_epi16(_mm256_unpackhi_epi8(as, zero), _mm256_unpackhi_epi8(bs, zero));
+
+            partial = _mm256_add_epi32(partial, _mm256_add_epi32(_mm256_madd_epi16(low, low),
+                                                                 _mm256_madd_epi16(high, high)));
+        }
+
+        total = _mm256_add_epi64(total, _mm256_add_epi64(_mm256_unpacklo_epi32(partial, zero),
+                                                         _mm256_unpackhi_epi32(partial, zero)));
+    }
+
+    auto half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    return (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_extract_epi64(half, 1) +
+           ScalarSSE(a + i, b + i, count - i);
+}
+
+// Sums of the products of two rows within each group of four samples
+static inline __m256i Products4(const __m256i a, const __m256i b)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    return _mm256_hadd_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)),
+                             _mm256_madd_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)));
+}
+
+static void SSIM4x4(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                    const size_t count, uint32_t (*sums)[4])
+{
+    const __m256i ones8 = _mm256_set1_epi8(1);
+    const __m256i ones16 = _mm256_set1_epi16(1);
+    auto block = 0u;
+
+    for(; block + 8 <= count; block += 8)
+    {
+        auto sumA = _mm256_setzero_si256(), sumB = sumA, squares = sumA, products = sumA;
+
+        for(auto y = 0u; y < 4; y++)
+        {
+            auto as = _mm256_loadu_si256((const __m256i*)(a + y * aPitch + 4 * block));
+            auto bs = _mm256_loadu_si256((const __m256i*)(b + y * bPitch + 4 * block));
+
+            sumA = _mm256_add_epi16(sumA, _mm256_maddubs_epi16(as, ones8));
+            sumB = _mm256_add_epi16(sumB, _mm256_maddubs_epi16(bs, ones8));
+            squares = _mm256_add_epi32(squares, _mm256_add_epi32(Products4(as, as), Products4(bs, bs)));
+            products = _mm256_add_epi32(products, Products4(as, bs));
+        }
+
+        sumA = _mm256_madd_epi16(sumA, ones16);
+        sumB = _mm256_madd_epi16(sumB, ones16);
+
+        // Transposes within each lane, which then holds the sums of blocks 0-3 and 4-7 respectively
+        auto low0  = _mm256_unpacklo_epi32(sumA, sumB), low1  = _mm256_unpacklo_epi32(squares, products);
+        auto high0 = _mm256_unpackhi_epi32(sumA, sumB), high1 = _mm256_unpackhi_epi32(squares, products);
+        auto first  = _mm256_unpacklo_epi64(low0, low1), second = _mm256_unpackhi_epi64(low0, low1);
+        auto third  = _mm256_unpacklo_epi64(high0, high1), fourth = _mm256_unpackhi_epi64(high0, high1);
+
+        _mm256_storeu_si256((__m256i*)sums[block], _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)sums[block + 2], _mm256_permute2x128_si256(third, fourth, 0x20));
+        _mm256_storeu_si256((__m256i*)sums[block + 4], _mm256_permute2x128_si256(first, second, 0x31));
+        _mm256_storeu_si256((__m256i*)sums[block + 6], _mm256_permute2x128_si256(third, fourth, 0x31));
+    }
+
+    ScalarSSIM4x4(a + 4 * block, aPitch, b + 4 * block, bPitch, count - block, sums + block);
+}
+
+// Blends the corners of each lane (one sample each, in the low byte) by its fractions (in 256ths)
+static inline __m256i Bilinear(const __m256i topLeft, const __m256i topRight, const __m256i bottomLeft,
+                               const __m256i bottomRight, const __m256i horizontal, const __m256i vertical)
+{
+    auto top = _mm256_add_epi32(_mm256_slli_epi32(topLeft, 8),
+                                _mm256_mullo_epi32(_mm256_sub_epi32(topRight, topLeft), horizontal));
+    auto bottom = _mm256_add_epi32(_mm256_slli_epi32(bottomLeft, 8),
+                                   _mm256_mullo_epi32(_mm256_sub_epi32(bottomRight, bottomLeft), horizontal));
+    auto blended = _mm256_add_epi32(_mm256_slli_epi32(top, 8),
+                                    _mm256_mullo_epi32(_mm256_sub_epi32(bottom, top), vertical));
+
+    return _mm256_srli_epi32(_mm256_add_epi32(blended, _mm256_set1_epi32(32768)), 16);
+}
+
+// Each 32-bit gather fetches a row of the 2x2 block (and, for luma, two bytes past it)
+static void Remap(const uint8_t* plane, const size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                  uint8_t* output, const size_t count)
+{
+    const auto bytes = _mm256_set1_epi32(0xff);
+    const auto below = _mm256_set1_epi32((int)pitch);
+    const auto gather = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    auto i = 0u;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        auto offset = _mm256_loadu_si256((const __m256i*)(offsets + i));
+        auto weight = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(weights + i)));
+        auto top = _mm256_i32gather_epi32((const int*)plane, offset, 1);
+        auto bottom = _mm256_i32gather_epi32((const int*)plane, _mm256_add_epi32(offset, below), 1);
+        auto result = Bilinear(_mm256_and_si256(top, bytes), _mm256_and_si256(_mm256_srli_epi32(top, 8), bytes),
+                               _mm256_and_si256(bottom, bytes), _mm256_and_si256(_mm256_srli_epi32(bottom, 8), bytes),
+                               _mm256_and_si256(weight, bytes), _mm256_srli_epi32(weight, 8));
+
+        // Packs within each lane, then brings the four samples of each lane together
+        result = _mm256_packus_epi16(_mm256_packus_epi32(result, result), result);
+        _mm_storel_epi64((__m128i*)(output + i),
+                         _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(result, gather)));
+    }
+
+    ScalarRemap(plane, pitch, offsets + i, weights + i, output + i, count - i);
+}
+
+static void RemapInterleaved(const uint8_t* plane, const size_t pitch, const uint32_t* offsets,
+                             const uint16_t* weights, uint8_t* output, const size_t count)
+{
+    const auto bytes = _mm256_set1_epi32(0xff);
+    const auto below = _mm256_set1_epi32((int)pitch);
+    auto i = 0u;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        auto offset = _mm256_loadu_si256((const __m256i*)(offsets + i));
+        auto weight = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(weights + i)));
+        auto horizontal = _mm256_and_si256(weight, bytes), vertical = _mm256_srli_epi32(weight, 8);
+        // U V U V of the top and bottom rows of the block
+        auto top = _mm256_i32gather_epi32((const int*)plane, offset, 1);
+        auto bottom = _mm256_i32gather_epi32((const int*)plane, _mm256_add_epi32(offset, below), 1);
+        auto u = Bilinear(_mm256_and_si256(top, bytes), _mm256_and_si256(_mm256_srli_epi32(top, 16), bytes),
+                          _mm256_and_si256(bottom, bytes), _mm256_and_si256(_mm256_srli_epi32(bottom, 16), bytes),
+                          horizontal, vertical);
+        auto v = Bilinear(_mm256_and_si256(_mm256_srli_epi32(top, 8), bytes), _mm256_srli_epi32(top, 24),
+                          _mm256_and_si256(_mm256_srli_epi32(bottom, 8), bytes), _mm256_srli_epi32(bottom, 24),
+                          horizontal, vertical);
+        auto pairs = _mm256_or_si256(u, _mm256_slli_epi32(v, 8));
+
+        pairs = _mm256_permute4x64_epi64(_mm256_packus_epi32(pairs, pairs), 0x08);
+        _mm_storeu_si128((__m128i*)(output + 2 * i), _mm256_castsi256_si128(pairs));
+    }
+
+    ScalarRemapInterleaved(plane, pitch, offsets + i, weights + i, output + 2 * i, count - i);
+}
+
+static const PlaneKernels avx2PlaneKernels = {
+    "avx2",
+    Deinterleave,
+    Interleave,
+    Downscale2x,
+    Downscale2xInterleaved,
+    BlendRows,
+    SAD,
+    SSE,
+    SSIM4x4,
+    Remap,
+    RemapInterleaved
+};
+
+const PlaneKernels* GetAvx2PlaneKernels() { return &avx2PlaneKernels; }
+
+#else
+
+const PlaneKernels* GetAvx2PlaneKernels() { return NULL; }
+
+#endif
@@ -0,0 +1,290 @@
+#include "PlaneKernelsInternal.h"
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+// Built with -mavx512f -mavx512bw; only reached after a runtime check for both.  Word-to-byte narrowing
+// (vpmovwb) keeps results in order, avoiding the cross-lane fix-ups that packs require.
+
+static void Deinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        auto pairs = _mm512_loadu_si512((const void*)(uv + 2 * i));
+
+        _mm256_storeu_si256((__m256i*)(u + i), _mm512_cvtepi16_epi8(pairs));
+        _mm256_storeu_si256((__m256i*)(v + i), _mm512_cvtepi16_epi8(_mm512_srli_epi16(pairs, 8)));
+    }
+
+    ScalarDeinterleave(uv + 2 * i, u + i, v + i, count - i);
+}
+
+static void Interleave(const uint8_t* u, const uint8_t* v, uint8_t* uv, const size_t count)
+{
+    const __m512i first  = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+    const __m512i second = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+    auto i = 0u;
+
+    for(; i + 64 <= count; i += 64)
+    {
+        auto us = _mm512_loadu_si512((const void*)(u + i));
+        auto vs = _mm512_loadu_si512((const void*)(v + i));
+        auto low = _mm512_unpacklo_epi8(us, vs);
+        auto high = _mm512_unpackhi_epi8(us, vs);
+
+        _mm512_storeu_si512((void*)(uv + 2 * i), _mm512_permutex2var_epi64(low, first, high));
+        _mm512_storeu_si512((void*)(uv + 2 * i + 64), _mm512_permutex2var_epi64(low, second, high));
+    }
+
+    ScalarInterleave(u + i, v + i, uv + 2 * i, count - i);
+}
+
+static inline __m256i Average2x2(const __m512i row0, const __m512i row1)
+{
+    const __m512i ones = _mm512_set1_epi8(1);
+    const __m512i two = _mm512_set1_epi16(2);
+    auto sum = _mm512_add_epi16(_mm512_maddubs_epi16(row0, ones), _mm512_maddubs_epi16(row1, ones));
+
+    return _mm512_cvtepi16_epi8(_mm512_srli_epi16(_mm512_add_epi16(sum, two), 2));
+}
+
+static void Downscale2x(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+        _mm256_storeu_si256((__m256i*)(output + i),
+                            Average2x2(_mm512_loadu_si512((const void*)(row0 + 2 * i)),
+                                       _mm512_loadu_si512((const void*)(row1 + 2 * i))));
+
+    ScalarDownscale2x(row0 + 2 * i, row1 + 2 * i, output + i, count - i);
+}
+
+static void Downscale2xInterleaved(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    const __m512i pairs = _mm512_broadcast_i32x4(
+        _mm_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15));
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+        _mm256_storeu_si256((__m256i*)(output + 2 * i),
+                            Average2x2(_mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(row0 + 4 * i)), pairs),
+                                       _mm512_shuffle_epi8(_mm512_loadu_si512((const void*)(row1 + 4 * i)), pairs)));
+
+    ScalarDownscale2xInterleaved(row0 + 4 * i, row1 + 4 * i, output + 2 * i, count - i);
+}
+
+static void BlendRows(const uint8_t* row0, const uint8_t* row1, const unsigned int weight, uint8_t* output,
+                      const size_t count)
+{
+    const __m512i weight0 = _mm512_set1_epi16(256 - weight);
+    const __m512i weight1 = _mm512_set1_epi16(weight);
+    const __m512i half = _mm512_set1_epi16(128);
+    auto i = 0u;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        auto a = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(row0 + i)));
+        auto b = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(row1 + i)));
+        auto sum = _mm512_add_epi16(_mm512_mullo_epi16(a, weight0), _mm512_mullo_epi16(b, weight1));
+
+        _mm256_storeu_si256((__m256i*)(output + i),
+                            _mm512_cvtepi16_epi8(_mm512_srli_epi16(_mm512_add_epi16(sum, half), 8)));
+    }
+
+    ScalarBlendRows(row0 + i, row1 + i, weight, output + i, count - i);
+}
+
+static uint64_t SAD(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    auto sum = _mm512_setzero_si512();
+    auto i = 0u;
+
+    for(; i + 64 <= count; i += 64)
+        sum = _mm512_add_epi64(sum, _mm512_sad_epu8(_mm512_loadu_si512((const void*)(a + i)),
+                                                    _mm512_loadu_si512((const void*)(b + i))));
+
+    return (uint64_t)_mm512_reduce_add_epi64(sum) + ScalarSAD(a + i, b + i, count - i);
+}
+
+static uint64_t SSE(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    auto total = _mm512_setzero_si512();
+    auto i = 0u;
+
+    // 32-bit accumulators absorb at most 8192 * 4 * 255 * 255 before being widened
+    while(i + 64 <= count)
+    {
+        auto partial = _mm512_setzero_si512();
+
+        for(auto block = 0; block < 8192 && i + 64 <= count; block++, i += 64)
+        {
+            auto as = _mm512_loadu_si512((const void*)(a + i));
+            auto bs = _mm512_loadu_si512((const void*)(b + i));
+            auto low  = _mm512_sub_epi16(_mm512_unpacklo_epi8(as, zero), _mm512_unpacklo_epi8(bs, zero));
+            auto high = _mm512_sub_epi16(_mm512_unpackhi_epi8(as, zero), _mm512_unpackhi_epi8(bs, zero));
+
+            partial = _mm512_add_epi32(partial, _mm512_add_epi32(_mm512_madd_epi16(low, low),
+                                                                 _mm512_madd_epi16(high, high)));
+        }
+
+        total = _mm512_add_epi64(total, _mm512_add_epi64(_mm512_unpacklo_epi32(partial, zero),
+                                                         _mm512_unpackhi_epi32(partial, zero)));
+    }
+
+    return (uint64_t)_mm512_reduce_add_epi64(total) + ScalarSSE(a + i, b + i, count - i);
+}
+
+// Sums of the products of two rows within each group of four samples.  AVX-512 has no horizontal add, so
+// the even and odd pair sums are gathered with a float shuffle and added.
+static inline __m512i Products4(const __m512i a, const __m512i b)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    auto low  = _mm512_castsi512_ps(_mm512_madd_epi16(_mm512_unpacklo_epi8(a, zero), _mm512_unpacklo_epi8(b, zero)));
+    auto high = _mm512_castsi512_ps(_mm512_madd_epi16(_mm512_unpackhi_epi8(a, zero), _mm512_unpackhi_epi8(b, zero)));
+
+    return _mm512_add_epi32(_mm512_castps_si512(_mm512_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0))),
+                            _mm512_castps_si512(_mm512_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+static void SSIM4x4(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                    const size_t count, uint32_t (*sums)[4])
+{
+    const __m512i ones8 = _mm512_set1_epi8(1);
+    const __m512i ones16 = _mm512_set1_epi16(1);
+    auto block = 0u;
+
+    for(; block + 16 <= count; block += 16)
+    {
+        auto sumA = _mm512_setzero_si512(), sumB = sumA, squares = sumA, products = sumA;
+
+        for(auto y = 0u; y < 4; y++)
+        {
+            auto as = _mm512_loadu_si512((const void*)(a + y * aPitch + 4 * block));
+            auto bs = _mm512_loadu_si512((const void*)(b + y * bPitch + 4 * block));
+
+            sumA = _mm512_add_epi16(sumA, _mm512_maddubs_epi16(as, ones8));
+            sumB = _mm512_add_epi16(sumB, _mm512_maddubs_epi16(bs, ones8));
+            squares = _mm512_add_epi32(squares, _mm512_add_epi32(Products4(as, as), Products4(bs, bs)));
+            products = _mm512_add_epi32(products, Products4(as, bs));
+        }
+
+        sumA = _mm512_madd_epi16(sumA, ones16);
+        sumB = _mm512_madd_epi16(sumB, ones16);
+
+        // Transposes within each lane; lane j of the k-th result then holds the sums of block 4j + k
+        auto low0  = _mm512_unpacklo_epi32(sumA, sumB), low1  = _mm512_unpacklo_epi32(squares, products);
+        auto high0 = _mm512_unpackhi_epi32(sumA, sumB), high1 = _mm512_unpackhi_epi32(squares, products);
+        __m512i transposed[4] = { _mm512_unpacklo_epi64(low0, low1), _mm512_unpackhi_epi64(low0, low1),
+                                  _mm512_unpacklo_epi64(high0, high1), _mm512_unpackhi_epi64(high0, high1) };
+        // Interleaves the lanes of pairs of results, then pairs of those, so that blocks are stored in order
+        const __m512i pairLow  = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+        const __m512i pairHigh = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+        const __m512i halfLow  = _mm512_setr_epi64(0, 1, 2, 3, 8, 9, 10, 11);
+        const __m512i halfHigh = _mm512_setr_epi64(4, 5, 6, 7, 12, 13, 14, 15);
+        auto first  = _mm512_permutex2var_epi64(transposed[0], pairLow, transposed[1]);   // 0 1 4 5
+        auto second = _mm512_permutex2var_epi64(transposed[2], pairLow, transposed[3]);   // 2 3 6 7
+        auto third  = _mm512_permutex2var_epi64(transposed[0], pairHigh, transposed[1]);  // 8 9 12 13
+        auto fourth = _mm512_permutex2var_epi64(transposed[2], pairHigh, transposed[3]);  // 10 11 14 15
+
+        _mm512_storeu_si512((void*)sums[block], _mm512_permutex2var_epi64(first, halfLow, second));
+        _mm512_storeu_si512((void*)sums[block + 4], _mm512_permutex2var_epi64(first, halfHigh, second));
+        _mm512_storeu_si512((void*)sums[block + 8], _mm512_permutex2var_epi64(third, halfLow, fourth));
+        _mm512_storeu_si512((void*)sums[block + 12], _mm512_permutex2var_epi64(third, halfHigh, fourth));
+    }
+
+    ScalarSSIM4x4(a + 4 * block, aPitch, b + 4 * block, bPitch, count - block, sums + block);
+}
+
+// Blends the corners of each lane (one sample each, in the low byte) by its fractions (in 256ths)
+static inline __m512i Bilinear(const __m512i topLeft, const __m512i topRight, const __m512i bottomLeft,
+                               const __m512i bottomRight, const __m512i horizontal, const __m512i vertical)
+{
+    auto top = _mm512_add_epi32(_mm512_slli_epi32(topLeft, 8),
+                                _mm512_mullo_epi32(_mm512_sub_epi32(topRight, topLeft), horizontal));
+    auto bottom = _mm512_add_epi32(_mm512_slli_epi32(bottomLeft, 8),
+                                   _mm512_mullo_epi32(_mm512_sub_epi32(bottomRight, bottomLeft), horizontal));
+    auto blended = _mm512_add_epi32(_mm512_slli_epi32(top, 8),
+                                    _mm512_mullo_epi32(_mm512_sub_epi32(bottom, top), vertical));
+
+    return _mm512_srli_epi32(_mm512_add_epi32(blended, _mm512_set1_epi32(32768)), 16);
+}
+
+// Each 32-bit gather fetches a row of the 2x2 block (and, for luma, two bytes past it)
+static void Remap(const uint8_t* plane, const size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                  uint8_t* output, const size_t count)
+{
+    const auto bytes = _mm512_set1_epi32(0xff);
+    const auto below = _mm512_set1_epi32((int)pitch);
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto offset = _mm512_loadu_si512((const void*)(offsets + i));
+        auto weight = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(weights + i)));
+        auto top = _mm512_i32gather_epi32(offset, (const void*)plane, 1);
+        auto bottom = _mm512_i32gather_epi32(_mm512_add_epi32(offset, below), (const void*)plane, 1);
+        auto result = Bilinear(_mm512_and_si512(top, bytes), _mm512_and_si512(_mm512_srli_epi32(top, 8), bytes),
+                               _mm512_and_si512(bottom, bytes), _mm512_and_si512(_mm512_srli_epi32(bottom, 8), bytes),
+                               _mm512_and_si512(weight, bytes), _mm512_srli_epi32(weight, 8));
+
+        _mm_storeu_si128((__m128i*)(output + i), _mm512_cvtepi32_epi8(result));
+    }
+
+    ScalarRemap(plane, pitch, offsets + i, weights + i, output + i, count - i);
+}
+
+static void RemapInterleaved(const uint8_t* plane, const size_t pitch, const uint32_t* offsets,
+                             const uint16_t* weights, uint8_t* output, const size_t count)
+{
+    const auto bytes = _mm512_set1_epi32(0xff);
+    const auto below = _mm512_set1_epi32((int)pitch);
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto offset = _mm512_loadu_si512((const void*)(offsets + i));
+        auto weight = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(weights + i)));
+        auto horizontal = _mm512_and_si512(weight, bytes), vertical = _mm512_srli_epi32(weight, 8);
+        // U V U V of the top and bottom rows of the block
+        auto top = _mm512_i32gather_epi32(offset, (const void*)plane, 1);
+        auto bottom = _mm512_i32gather_epi32(_mm512_add_epi32(offset, below), (const void*)plane, 1);
+        auto u = Bilinear(_mm512_and_si512(top, bytes), _mm512_and_si512(_mm512_srli_epi32(top, 16), bytes),
+                          _mm512_and_si512(bottom, bytes), _mm512_and_si512(_mm512_srli_epi32(bottom, 16), bytes),
+                          horizontal, vertical);
+        auto v = Bilinear(_mm512_and_si512(_mm512_srli_epi32(top, 8), bytes), _mm512_srli_epi32(top, 24),
+                          _mm512_and_si512(_mm512_srli_epi32(bottom, 8), bytes), _mm512_srli_epi32(bottom, 24),
+                          horizontal, vertical);
+        auto pairs = _mm512_or_si512(u, _mm512_slli_epi32(v, 8));
+
+        _mm256_storeu_si256((__m256i*)(output + 2 * i), _mm512_cvtepi32_epi16(pairs));
+    }
+
+    ScalarRemapInterleaved(plane, pitch, offsets + i, weights + i, output + 2 * i, count - i);
+}
+
+static const PlaneKernels avx512PlaneKernels = {
+    "avx512",
+    Deinterleave,
+    Interleave,
+    Downscale2x,
+    Downscale2xInterleaved,
+    BlendRows,
+    SAD,
+    SSE,
+    SSIM4x4,
+    Remap,
+    RemapInterleaved
+};
+
+const PlaneKernels* GetAvx512PlaneKernels() { return &avx512PlaneKernels; }
+
+#else
+
+const PlaneKernels* GetAvx512PlaneKernels() { return NULL; }
+
+#endif
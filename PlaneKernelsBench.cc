@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "PlaneKernels.h"
+
+// Reports the throughput of every kernel of each implementation supported here, over 1080p rows.
+// Throughput counts the bytes each kernel reads and writes (including remap's lookup tables), so that
+// implementations and kernels compare against memory bandwidth.  Needs no GPU.
+
+#define BENCH_WIDTH   1920
+#define BENCH_HEIGHT  1080
+#define BENCH_SECONDS 0.25  // Measured for each kernel, after one unmeasured pass
+
+static const char* implementations[] = { "scalar", "sse4", "avx2", "avx512", "neon" };
+
+// A luma-sized plane of each input and output, and remap tables for a mild zoom
+typedef struct BenchPlanes
+{
+    std::vector<uint8_t>  a, b, output;
+    std::vector<uint32_t> offsets, interleavedOffsets;
+    std::vector<uint16_t> weights;
+    std::vector<uint32_t> sums;
+} BenchPlanes;
+
+static volatile uint64_t sink;  // Keeps the sums from being optimized away
+
+// Each runs the kernel over one plane's worth of rows and returns the bytes read and written
+typedef size_t (*BenchPass)(const PlaneKernels&, BenchPlanes&);
+
+static size_t Deinterleave(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT / 2; y++)
+        kernels.deinterleave(&planes.a[y * BENCH_WIDTH], &planes.output[y * BENCH_WIDTH],
+                             &planes.output[y * BENCH_WIDTH + BENCH_WIDTH / 2], BENCH_WIDTH / 2);
+    return BENCH_HEIGHT / 2 * BENCH_WIDTH * 2;
+}
+
+static size_t Interleave(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT / 2; y++)
+        kernels.interleave(&planes.a[y * BENCH_WIDTH], &planes.b[y * BENCH_WIDTH], &planes.output[y * BENCH_WIDTH],
+                           BENCH_WIDTH / 2);
+    return BENCH_HEIGHT / 2 * BENCH_WIDTH * 2;
+}
+
+static size_t Downscale2x(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT / 2; y++)
+        kernels.downscale2x(&planes.a[2 * y * BENCH_WIDTH], &planes.a[(2 * y + 1) * BENCH_WIDTH],
+                            &planes.output[y * BENCH_WIDTH], BENCH_WIDTH / 2);
+    return BENCH_HEIGHT * BENCH_WIDTH + BENCH_HEIGHT / 2 * BENCH_WIDTH / 2;
+}
+
+static size_t Downscale2xInterleaved(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT / 2; y++)
+        kernels.downscale2xInterleaved(&planes.a[2 * y * BENCH_WIDTH], &planes.a[(2 * y + 1) * BENCH_WIDTH],
+                                       &planes.output[y * BENCH_WIDTH], BENCH_WIDTH / 4);
+    return BENCH_HEIGHT * BENCH_WIDTH + BENCH_HEIGHT / 2 * BENCH_WIDTH / 2;
+}
+
+static size_t BlendRows(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT; y++)
+        kernels.blendRows(&planes.a[y * BENCH_WIDTH], &planes.b[y * BENCH_WIDTH], y % 257,
+                          &planes.output[y * BENCH_WIDTH], BENCH_WIDTH);
+    return BENCH_HEIGHT * BENCH_WIDTH * 3;
+}
+
+static size_t SAD(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    uint64_t sum = 0;
+
+    for(auto y = 0u; y < BENCH_HEIGHT; y++)
+        sum += kernels.sad(&planes.a[y * BENCH_WIDTH], &planes.b[y * BENCH_WIDTH], BENCH_WIDTH);
+    sink = sum;
+    return BENCH_HEIGHT * BENCH_WIDTH * 2;
+}
+
+static size_t SSE(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    uint64_t sum = 0;
+
+    for(auto y = 0u; y < BENCH_HEIGHT; y++)
+        sum += kernels.sse(&planes.a[y * BENCH_WIDTH], &planes.b[y * BENCH_WIDTH], BENCH_WIDTH);
+    sink = sum;
+    return BENCH_HEIGHT * BENCH_WIDTH * 2;
+}
+
+// At the stride of four rows that PlaneSSIM samples windows at
+static size_t SSIM4x4(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y + 4 <= BENCH_HEIGHT; y += 4)
+        kernels.ssim4x4(&planes.a[y * BENCH_WIDTH], BENCH_WIDTH, &planes.b[y * BENCH_WIDTH], BENCH_WIDTH,
+                        BENCH_WIDTH / 4, (uint32_t (*)[4])planes.sums.data());
+    sink = planes.sums[0];
+    return BENCH_HEIGHT * BENCH_WIDTH * 2 + BENCH_HEIGHT / 4 * BENCH_WIDTH / 4 * sizeof(uint32_t[4]);
+}
+
+static size_t Remap(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT; y++)
+        kernels.remap(planes.a.data(), BENCH_WIDTH, &planes.offsets[y * BENCH_WIDTH],
+                      &planes.weights[y * BENCH_WIDTH], &planes.output[y * BENCH_WIDTH], BENCH_WIDTH);
+    return BENCH_HEIGHT * BENCH_WIDTH * (4 + sizeof(uint32_t) + sizeof(uint16_t) + 1);
+}
+
+static size_t RemapInterleaved(const PlaneKernels& kernels, BenchPlanes& planes)
+{
+    for(auto y = 0u; y < BENCH_HEIGHT / 2; y++)
+        kernels.remapInterleaved(planes.a.data(), BENCH_WIDTH, &planes.interleavedOffsets[y * BENCH_WIDTH / 2],
+                                 &planes.weights[y * BENCH_WIDTH / 2], &planes.output[y * BENCH_WIDTH],
+                                 BENCH_WIDTH / 2);
+    return BENCH_HEIGHT / 2 * BENCH_WIDTH / 2 * (8 + sizeof(uint32_t) + sizeof(uint16_t) + 2);
+}
+
+static const struct
+{
+    const char* name;
+    BenchPass   pass;
+} kernels[] = {
+    { "deinterleave", Deinterleave },
+    { "interleave", Interleave },
+    { "downscale2x", Downscale2x },
+    { "downscale2xInterleaved", Downscale2xInterleaved },
+    { "blendRows", BlendRows },
+    { "sad", SAD },
+    { "sse", SSE },
+    { "ssim4x4", SSIM4x4 },
+    { "remap", Remap },
+    { "remapInterleaved", RemapInterleaved },
+};
+
+static double Now()
+{
+    timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Samples the plane at 7/8 scale, so that neighbouring outputs read neighbouring blocks as a resize would
+static void InitializePlanes(BenchPlanes& planes)
+{
+    // Remap reads up to two bytes past the last row of its blocks
+    planes.a.resize(BENCH_WIDTH * BENCH_HEIGHT + 4);
+    planes.b.resize(BENCH_WIDTH * BENCH_HEIGHT);
+    planes.output.resize(BENCH_WIDTH * BENCH_HEIGHT);
+    planes.offsets.resize(BENCH_WIDTH * BENCH_HEIGHT);
+    planes.interleavedOffsets.resize(BENCH_WIDTH / 2 * BENCH_HEIGHT / 2);
+    planes.weights.resize(BENCH_WIDTH * BENCH_HEIGHT);
+    planes.sums.resize(4 * BENCH_WIDTH / 4);
+
+    for(auto i = 0u; i < planes.b.size(); i++)
+    {
+        planes.a[i] = (uint8_t)(i * 2654435761u >> 24);
+        planes.b[i] = (uint8_t)(i * 2246822519u >> 24);
+    }
+
+    for(auto y = 0u; y < BENCH_HEIGHT; y++)
+        for(auto x = 0u; x < BENCH_WIDTH; x++)
+        {
+            auto sourceX = x * 7 * 256 / 8, sourceY = y * 7 * 256 / 8;
+
+            planes.offsets[y * BENCH_WIDTH + x] = sourceY / 256 * BENCH_WIDTH + sourceX / 256;
+            planes.weights[y * BENCH_WIDTH + x] = (uint16_t)(sourceY % 256 << 8 | sourceX % 256);
+        }
+
+    for(auto y = 0u; y < BENCH_HEIGHT / 2; y++)
+        for(auto x = 0u; x < BENCH_WIDTH / 2; x++)
+            planes.interleavedOffsets[y * BENCH_WIDTH / 2 + x] = y * 7 / 8 * BENCH_WIDTH + x * 7 / 8 * 2;
+}
+
+int main(int argc, char*[])
+{
+    BenchPlanes planes;
+
+    if(argc > 1)
+        return fprintf(stderr, "Usage : planekernels_bench\n"), 1;
+
+    InitializePlanes(planes);
+
+    printf("%-24s", "GB/s");
+    for(auto* name: implementations)
+        printf("%10s", name);
+    printf("\n");
+
+    for(auto& kernel: kernels)
+    {
+        printf("%-24s", kernel.name);
+
+        for(auto* name: implementations)
+        {
+            const PlaneKernels* implementation = FindPlaneKernels(name);
+            size_t bytes = 0;
+            double start, elapsed;
+
+            if(implementation == NULL)
+            {
+                printf("%10s", "-");
+                continue;
+            }
+
+            kernel.pass(*implementation, planes);
+            for(start = Now(); (elapsed = Now() - start) < BENCH_SECONDS; )
+                bytes += kernel.pass(*implementation, planes);
+
+            printf("%10.2f", bytes / elapsed / 1e9);
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
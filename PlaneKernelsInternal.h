@@ -0,0 +1,27 @@
+#ifndef _PLANE_KERNELS_INTERNAL
+#define _PLANE_KERNELS_INTERNAL
+
+#include "PlaneKernels.h"
+
+// Scalar reference kernels, also used by the vector implementations for trailing samples
+void     ScalarDeinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t count);
+void     ScalarInterleave(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count);
+void     ScalarDownscale2x(const uint8_t* row0, const uint8_t* row1, uint8_t* output, size_t count);
+void     ScalarDownscale2xInterleaved(const uint8_t* row0, const uint8_t* row1, uint8_t* output, size_t count);
+void     ScalarBlendRows(const uint8_t* row0, const uint8_t* row1, unsigned int weight, uint8_t* output, size_t count);
+uint64_t ScalarSAD(const uint8_t* a, const uint8_t* b, size_t count);
+uint64_t ScalarSSE(const uint8_t* a, const uint8_t* b, size_t count);
+void     ScalarSSIM4x4(const uint8_t* a, size_t aPitch, const uint8_t* b, size_t bPitch, size_t count,
+                       uint32_t (*sums)[4]);
+void     ScalarRemap(const uint8_t* plane, size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                     uint8_t* output, size_t count);
+void     ScalarRemapInterleaved(const uint8_t* plane, size_t pitch, const uint32_t* offsets, const uint16_t* weights,
+                                uint8_t* output, size_t count);
+
+// Each returns NULL when the implementation was not compiled for this architecture
+const PlaneKernels* GetSse4PlaneKernels();
+const PlaneKernels* GetAvx2PlaneKernels();
+const PlaneKernels* GetAvx512PlaneKernels();
+const PlaneKernels* GetNeonPlaneKernels();
+
+#endif
@@ -0,0 +1,209 @@
+#include "PlaneKernelsInternal.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+// NEON is part of the AArch64 baseline; structured loads and stores do the (de)interleaving
+
+static void Deinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto pairs = vld2q_u8(uv + 2 * i);
+
+        vst1q_u8(u + i, pairs.val[0]);
+        vst1q_u8(v + i, pairs.val[1]);
+    }
+
+    ScalarDeinterleave(uv + 2 * i, u + i, v + i, count - i);
+}
+
+static void Interleave(const uint8_t* u, const uint8_t* v, uint8_t* uv, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        uint8x16x2_t pairs;
+
+        pairs.val[0] = vld1q_u8(u + i);
+        pairs.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, pairs);
+    }
+
+    ScalarInterleave(u + i, v + i, uv + 2 * i, count - i);
+}
+
+static void Downscale2x(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto top = vld2q_u8(row0 + 2 * i);
+        auto bottom = vld2q_u8(row1 + 2 * i);
+        auto low  = vaddq_u16(vaddl_u8(vget_low_u8(top.val[0]), vget_low_u8(top.val[1])),
+                              vaddl_u8(vget_low_u8(bottom.val[0]), vget_low_u8(bottom.val[1])));
+        auto high = vaddq_u16(vaddl_u8(vget_high_u8(top.val[0]), vget_high_u8(top.val[1])),
+                              vaddl_u8(vget_high_u8(bottom.val[0]), vget_high_u8(bottom.val[1])));
+
+        vst1q_u8(output + i, vcombine_u8(vrshrn_n_u16(low, 2), vrshrn_n_u16(high, 2)));
+    }
+
+    ScalarDownscale2x(row0 + 2 * i, row1 + 2 * i, output + i, count - i);
+}
+
+static void Downscale2xInterleaved(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    auto i = 0u;
+
+    // Lanes hold U0, V0, U1, V1 of consecutive source pairs
+    for(; i + 8 <= count; i += 8)
+    {
+        auto top = vld4_u8(row0 + 4 * i);
+        auto bottom = vld4_u8(row1 + 4 * i);
+        uint8x8x2_t result;
+
+        for(auto channel = 0; channel < 2; channel++)
+            result.val[channel] = vrshrn_n_u16(
+                vaddq_u16(vaddl_u8(top.val[channel], top.val[channel + 2]),
+                          vaddl_u8(bottom.val[channel], bottom.val[channel + 2])), 2);
+
+        vst2_u8(output + 2 * i, result);
+    }
+
+    ScalarDownscale2xInterleaved(row0 + 4 * i, row1 + 4 * i, output + 2 * i, count - i);
+}
+
+static void BlendRows(const uint8_t* row0, const uint8_t* row1, const unsigned int weight, uint8_t* output,
+                      const size_t count)
+{
+    auto weight0 = vdupq_n_u16(256 - weight);
+    auto weight1 = vdupq_n_u16(weight);
+    auto i = 0u;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        auto sum = vmlaq_u16(vmulq_u16(vmovl_u8(vld1_u8(row0 + i)), weight0), vmovl_u8(vld1_u8(row1 + i)), weight1);
+        vst1_u8(output + i, vrshrn_n_u16(sum, 8));
+    }
+
+    ScalarBlendRows(row0 + i, row1 + i, weight, output + i, count - i);
+}
+
+static uint64_t SAD(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    auto total = vdupq_n_u32(0);
+    auto i = 0u;
+
+    // 16-bit accumulators absorb at most 128 * 2 * 255 before being widened
+    while(i + 16 <= count)
+    {
+        auto partial = vdupq_n_u16(0);
+
+        for(auto block = 0; block < 128 && i + 16 <= count; block++, i += 16)
+        {
+            auto difference = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+            partial = vpadalq_u8(partial, difference);
+        }
+
+        total = vpadalq_u16(total, partial);
+    }
+
+    return (uint64_t)vgetq_lane_u32(total, 0) + vgetq_lane_u32(total, 1) + vgetq_lane_u32(total, 2) +
+           vgetq_lane_u32(total, 3) + ScalarSAD(a + i, b + i, count - i);
+}
+
+static uint64_t SSE(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    auto total = vdupq_n_u64(0);
+    auto i = 0u;
+
+    // 32-bit accumulators absorb at most 8192 * 4 * 255 * 255 before being widened
+    while(i + 16 <= count)
+    {
+        auto partial = vdupq_n_u32(0);
+
+        for(auto block = 0; block < 8192 && i + 16 <= count; block++, i += 16)
+        {
+            auto difference = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+            partial = vpadalq_u16(partial, vmull_u8(vget_low_u8(difference), vget_low_u8(difference)));
+            partial = vpadalq_u16(partial, vmull_u8(vget_high_u8(difference), vget_high_u8(difference)));
+        }
+
+        total = vpadalq_u32(total, partial);
+    }
+
+    return vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1) + ScalarSSE(a + i, b + i, count - i);
+}
+
+// Adds the pair sums of four-sample groups
+static inline uint32x4_t Blocks4(const uint32x4_t low, const uint32x4_t high)
+{
+    return vcombine_u32(vpadd_u32(vget_low_u32(low), vget_high_u32(low)),
+                        vpadd_u32(vget_low_u32(high), vget_high_u32(high)));
+}
+
+static void SSIM4x4(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                    const size_t count, uint32_t (*sums)[4])
+{
+    auto block = 0u;
+
+    for(; block + 4 <= count; block += 4)
+    {
+        auto sumA = vdupq_n_u16(0), sumB = sumA;
+        auto squaresLow = vdupq_n_u32(0), squaresHigh = squaresLow, productsLow = squaresLow, productsHigh = squaresLow;
+        uint32x4x4_t result;
+
+        for(auto y = 0u; y < 4; y++)
+        {
+            auto as = vld1q_u8(a + y * aPitch + 4 * block);
+            auto bs = vld1q_u8(b + y * bPitch + 4 * block);
+
+            sumA = vpadalq_u8(sumA, as);
+            sumB = vpadalq_u8(sumB, bs);
+            squaresLow  = vpadalq_u16(squaresLow, vmull_u8(vget_low_u8(as), vget_low_u8(as)));
+            squaresLow  = vpadalq_u16(squaresLow, vmull_u8(vget_low_u8(bs), vget_low_u8(bs)));
+            squaresHigh = vpadalq_u16(squaresHigh, vmull_u8(vget_high_u8(as), vget_high_u8(as)));
+            squaresHigh = vpadalq_u16(squaresHigh, vmull_u8(vget_high_u8(bs), vget_high_u8(bs)));
+            productsLow  = vpadalq_u16(productsLow, vmull_u8(vget_low_u8(as), vget_low_u8(bs)));
+            productsHigh = vpadalq_u16(productsHigh, vmull_u8(vget_high_u8(as), vget_high_u8(bs)));
+        }
+
+        result.val[0] = vpaddlq_u16(sumA);
+        result.val[1] = vpaddlq_u16(sumB);
+        result.val[2] = Blocks4(squaresLow, squaresHigh);
+        result.val[3] = Blocks4(productsLow, productsHigh);
+        // The interleaving store writes the four sums of each block in turn
+        vst4q_u32(sums[block], result);
+    }
+
+    ScalarSSIM4x4(a + 4 * block, aPitch, b + 4 * block, bPitch, count - block, sums + block);
+}
+
+static const PlaneKernels neonPlaneKernels = {
+    "neon",
+    Deinterleave,
+    Interleave,
+    Downscale2x,
+    Downscale2xInterleaved,
+    BlendRows,
+    SAD,
+    SSE,
+    SSIM4x4,
+    // Without a gather, the scalar kernels are as fast
+    ScalarRemap,
+    ScalarRemapInterleaved
+};
+
+const PlaneKernels* GetNeonPlaneKernels() { return &neonPlaneKernels; }
+
+#else
+
+const PlaneKernels* GetNeonPlaneKernels() { return NULL; }
+
+#endif
@@ -0,0 +1,224 @@
+#include "PlaneKernelsInternal.h"
+
+#if defined(__x86_64__)
+
+#include <smmintrin.h>
+
+// Built with -msse4.1; only reached after a runtime check for SSE4.1
+
+static void Deinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, const size_t count)
+{
+    const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto first  = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(uv + 2 * i)), split);
+        auto second = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(uv + 2 * i + 16)), split);
+
+        _mm_storeu_si128((__m128i*)(u + i), _mm_unpacklo_epi64(first, second));
+        _mm_storeu_si128((__m128i*)(v + i), _mm_unpackhi_epi64(first, second));
+    }
+
+    ScalarDeinterleave(uv + 2 * i, u + i, v + i, count - i);
+}
+
+static void Interleave(const uint8_t* u, const uint8_t* v, uint8_t* uv, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto us = _mm_loadu_si128((const __m128i*)(u + i));
+        auto vs = _mm_loadu_si128((const __m128i*)(v + i));
+
+        _mm_storeu_si128((__m128i*)(uv + 2 * i), _mm_unpacklo_epi8(us, vs));
+        _mm_storeu_si128((__m128i*)(uv + 2 * i + 16), _mm_unpackhi_epi8(us, vs));
+    }
+
+    ScalarInterleave(u + i, v + i, uv + 2 * i, count - i);
+}
+
+// Sums horizontally adjacent pairs of two rows and rounds the 2x2 averages
+static inline __m128i Average2x2(const __m128i row0, const __m128i row1)
+{
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi16(2);
+    auto sum = _mm_add_epi16(_mm_maddubs_epi16(row0, ones), _mm_maddubs_epi16(row1, ones));
+
+    return _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+}
+
+static void Downscale2x(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto low  = Average2x2(_mm_loadu_si128((const __m128i*)(row0 + 2 * i)),
+                               _mm_loadu_si128((const __m128i*)(row1 + 2 * i)));
+        auto high = Average2x2(_mm_loadu_si128((const __m128i*)(row0 + 2 * i + 16)),
+                               _mm_loadu_si128((const __m128i*)(row1 + 2 * i + 16)));
+
+        _mm_storeu_si128((__m128i*)(output + i), _mm_packus_epi16(low, high));
+    }
+
+    ScalarDownscale2x(row0 + 2 * i, row1 + 2 * i, output + i, count - i);
+}
+
+static void Downscale2xInterleaved(const uint8_t* row0, const uint8_t* row1, uint8_t* output, const size_t count)
+{
+    // Brings the two samples of each channel together: U0 U1 V0 V1 ...
+    const __m128i pairs = _mm_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+    auto i = 0u;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        auto low  = Average2x2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row0 + 4 * i)), pairs),
+                               _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row1 + 4 * i)), pairs));
+        auto high = Average2x2(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row0 + 4 * i + 16)), pairs),
+                               _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row1 + 4 * i + 16)), pairs));
+
+        _mm_storeu_si128((__m128i*)(output + 2 * i), _mm_packus_epi16(low, high));
+    }
+
+    ScalarDownscale2xInterleaved(row0 + 4 * i, row1 + 4 * i, output + 2 * i, count - i);
+}
+
+static void BlendRows(const uint8_t* row0, const uint8_t* row1, const unsigned int weight, uint8_t* output,
+                      const size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weight0 = _mm_set1_epi16(256 - weight);
+    const __m128i weight1 = _mm_set1_epi16(weight);
+    const __m128i half = _mm_set1_epi16(128);
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        auto a = _mm_loadu_si128((const __m128i*)(row0 + i));
+        auto b = _mm_loadu_si128((const __m128i*)(row1 + i));
+        auto low  = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weight0),
+                                  _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weight1));
+        auto high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weight0),
+                                  _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weight1));
+
+        low  = _mm_srli_epi16(_mm_add_epi16(low, half), 8);
+        high = _mm_srli_epi16(_mm_add_epi16(high, half), 8);
+        _mm_storeu_si128((__m128i*)(output + i), _mm_packus_epi16(low, high));
+    }
+
+    ScalarBlendRows(row0 + i, row1 + i, weight, output + i, count - i);
+}
+
+static uint64_t SAD(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    auto sum = _mm_setzero_si128();
+    auto i = 0u;
+
+    for(; i + 16 <= count; i += 16)
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                              _mm_loadu_si128((const __m128i*)(b + i))));
+
+    return (uint64_t)_mm_cvtsi128_si64(sum) + (uint64_t)_mm_extract_epi64(sum, 1) +
+           ScalarSAD(a + i, b + i, count - i);
+}
+
+static uint64_t SSE(const uint8_t* a, const uint8_t* b, const size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    auto total = _mm_setzero_si128();
+    auto i = 0u;
+
+    // 32-bit accumulators absorb at most 8192 * 4 * 255 * 255 before being widened
+    while(i + 16 <= count)
+    {
+        auto partial = _mm_setzero_si128();
+
+        for(auto block = 0; block < 8192 && i + 16 <= count; block++, i += 16)
+        {
+            auto as = _mm_loadu_si128((const __m128i*)(a + i));
+            auto bs = _mm_loadu_si128((const __m128i*)(b + i));
+            auto low  = _mm_sub_epi16(_mm_unpacklo_epi8(as, zero), _mm_unpacklo_epi8(bs, zero));
+            auto high = _mm_sub_epi16(_mm_unpackhi_epi8(as, zero), _mm_unpackhi_epi8(bs, zero));
+
+            partial = _mm_add_epi32(partial, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+        }
+
+        total = _mm_add_epi64(total, _mm_add_epi64(_mm_unpacklo_epi32(partial, zero),
+                                                   _mm_unpackhi_epi32(partial, zero)));
+    }
+
+    return (uint64_t)_mm_cvtsi128_si64(total) + (uint64_t)_mm_extract_epi64(total, 1) +
+           ScalarSSE(a + i, b + i, count - i);
+}
+
+// Sums of the products of two rows within each group of four samples
+static inline __m128i Products4(const __m128i a, const __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    return _mm_hadd_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                          _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+}
+
+static void SSIM4x4(const uint8_t* a, const size_t aPitch, const uint8_t* b, const size_t bPitch,
+                    const size_t count, uint32_t (*sums)[4])
+{
+    const __m128i ones8 = _mm_set1_epi8(1);
+    const __m128i ones16 = _mm_set1_epi16(1);
+    auto block = 0u;
+
+    for(; block + 4 <= count; block += 4)
+    {
+        auto sumA = _mm_setzero_si128(), sumB = sumA, squares = sumA, products = sumA;
+
+        for(auto y = 0u; y < 4; y++)
+        {
+            auto as = _mm_loadu_si128((const __m128i*)(a + y * aPitch + 4 * block));
+            auto bs = _mm_loadu_si128((const __m128i*)(b + y * bPitch + 4 * block));
+
+            sumA = _mm_add_epi16(sumA, _mm_maddubs_epi16(as, ones8));
+            sumB = _mm_add_epi16(sumB, _mm_maddubs_epi16(bs, ones8));
+            squares = _mm_add_epi32(squares, _mm_add_epi32(Products4(as, as), Products4(bs, bs)));
+            products = _mm_add_epi32(products, Products4(as, bs));
+        }
+
+        sumA = _mm_madd_epi16(sumA, ones16);
+        sumB = _mm_madd_epi16(sumB, ones16);
+
+        // Transposes the four sums of four blocks into the four sums of each block
+        auto low0  = _mm_unpacklo_epi32(sumA, sumB), low1  = _mm_unpacklo_epi32(squares, products);
+        auto high0 = _mm_unpackhi_epi32(sumA, sumB), high1 = _mm_unpackhi_epi32(squares, products);
+
+        _mm_storeu_si128((__m128i*)sums[block], _mm_unpacklo_epi64(low0, low1));
+        _mm_storeu_si128((__m128i*)sums[block + 1], _mm_unpackhi_epi64(low0, low1));
+        _mm_storeu_si128((__m128i*)sums[block + 2], _mm_unpacklo_epi64(high0, high1));
+        _mm_storeu_si128((__m128i*)sums[block + 3], _mm_unpackhi_epi64(high0, high1));
+    }
+
+    ScalarSSIM4x4(a + 4 * block, aPitch, b + 4 * block, bPitch, count - block, sums + block);
+}
+
+static const PlaneKernels sse4PlaneKernels = {
+    "sse4",
+    Deinterleave,
+    Interleave,
+    Downscale2x,
+    Downscale2xInterleaved,
+    BlendRows,
+    SAD,
+    SSE,
+    SSIM4x4,
+    // Without a gather, the scalar kernels are as fast
+    ScalarRemap,
+    ScalarRemapInterleaved
+};
+
+const PlaneKernels* GetSse4PlaneKernels() { return &sse4PlaneKernels; }
+
+#else
+
+const PlaneKernels* GetSse4PlaneKernels() { return NULL; }
+
+#endif
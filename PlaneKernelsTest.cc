@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "PlaneKernels.h"
+
+// Checks every kernel of each implementation supported here against the scalar kernels, over row lengths
+// that exercise the vector bodies and their tails, and over misaligned inputs and outputs.  Outputs are
+// surrounded by guard bytes to catch writes out of bounds.  Needs no GPU.
+
+#define GUARD_BYTES     64
+#define GUARD_VALUE     0xa5
+#define GUARD_SUM       0xa5a5a5a5u
+#define REPORTED_ERRORS 10  // Failures printed for each implementation
+
+static const char*  implementations[] = { "sse4", "avx2", "avx512", "neon" };
+static const size_t misalignments[] = { 0, 1, 3, 7, 16, 31, 63 };
+
+enum Pattern { PATTERN_RANDOM, PATTERN_EXTREMES, PATTERN_COUNT };
+
+static uint32_t state = 1;
+
+static uint32_t Random()
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Bytes that start the given distance past a 64-byte boundary, surrounded by guard bytes
+class TestBuffer
+{
+public:
+    TestBuffer(const size_t size, const size_t misalignment)
+        : size(size), storage(size + misalignment + 63 + 2 * GUARD_BYTES, GUARD_VALUE)
+    {
+        auto base = ((uintptr_t)storage.data() + GUARD_BYTES + 63) & ~(uintptr_t)63;
+
+        data = (uint8_t*)base + misalignment;
+    }
+
+    uint8_t* data;
+    size_t   size;
+
+    // Extremes alternate between 0 and 255, at random, to expose overflow in vector accumulators
+    void Fill(const Pattern pattern)
+    {
+        for(auto i = 0u; i < size; i++)
+            data[i] = pattern == PATTERN_EXTREMES ? (Random() & 1) * 255 : (uint8_t)Random();
+    }
+
+    // Whether every byte outside of the data still holds the guard value
+    bool IsIntact() const
+    {
+        for(auto i = 0u; i < storage.size(); i++)
+            if((storage.data() + i < data || storage.data() + i >= data + size) && storage[i] != GUARD_VALUE)
+                return false;
+        return true;
+    }
+
+    bool Matches(const TestBuffer& expected) const
+    {
+        return IsIntact() && !memcmp(data, expected.data, size);
+    }
+
+private:
+    std::vector<uint8_t> storage;
+};
+
+class KernelTest
+{
+public:
+    KernelTest(const PlaneKernels& scalar, const PlaneKernels& candidate)
+        : scalar(scalar), candidate(candidate), cases(0), failures(0) { }
+
+    size_t Run();
+    size_t GetCases() const { return cases; }
+
+private:
+    const PlaneKernels& scalar;
+    const PlaneKernels& candidate;
+    size_t              cases;
+    size_t              failures;
+
+    void Check(bool passed, const char* kernel, size_t count, size_t misalignment, Pattern);
+    void TestDeinterleave(size_t count, size_t misalignment, Pattern);
+    void TestInterleave(size_t count, size_t misalignment, Pattern);
+    void TestDownscale2x(size_t count, size_t misalignment, Pattern);
+    void TestBlendRows(size_t count, size_t misalignment, Pattern);
+    void TestDifferences(size_t count, size_t misalignment, Pattern);
+    void TestSSIM4x4(size_t count, size_t misalignment, Pattern);
+    void TestRemap(size_t count, size_t misalignment, Pattern);
+    void TestPlanes();
+};
+
+void KernelTest::Check(const bool passed, const char* kernel, const size_t count, const size_t misalignment,
+                       const Pattern pattern)
+{
+    cases++;
+
+    if(!passed && failures++ < REPORTED_ERRORS)
+        fprintf(stderr, "%s %s differs from scalar: count %lu, misalignment %lu, %s samples\n", candidate.name,
+                kernel, count, misalignment, pattern == PATTERN_EXTREMES ? "extreme" : "random");
+}
+
+// Outputs are misaligned differently from the inputs so that neither hides the other
+static size_t GetOutputMisalignment(const size_t misalignment)
+{
+    return (misalignment * 5 + 1) % 64;
+}
+
+void KernelTest::TestDeinterleave(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    auto outputMisalignment = GetOutputMisalignment(misalignment);
+    TestBuffer uv(2 * count, misalignment);
+    TestBuffer u(count, outputMisalignment), v(count, outputMisalignment);
+    TestBuffer expectedU(count, 0), expectedV(count, 0);
+
+    uv.Fill(pattern);
+    scalar.deinterleave(uv.data, expectedU.data, expectedV.data, count);
+    candidate.deinterleave(uv.data, u.data, v.data, count);
+
+    Check(u.Matches(expectedU) && v.Matches(expectedV) && uv.IsIntact(), "deinterleave", count, misalignment,
+          pattern);
+}
+
+void KernelTest::TestInterleave(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    TestBuffer u(count, misalignment), v(count, misalignment);
+    TestBuffer uv(2 * count, GetOutputMisalignment(misalignment)), expected(2 * count, 0);
+
+    u.Fill(pattern);
+    v.Fill(pattern);
+    scalar.interleave(u.data, v.data, expected.data, count);
+    candidate.interleave(u.data, v.data, uv.data, count);
+
+    Check(uv.Matches(expected), "interleave", count, misalignment, pattern);
+}
+
+void KernelTest::TestDownscale2x(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    auto outputMisalignment = GetOutputMisalignment(misalignment);
+    TestBuffer row0(4 * count, misalignment), row1(4 * count, misalignment);
+    TestBuffer output(count, outputMisalignment), expected(count, 0);
+    TestBuffer interleaved(2 * count, outputMisalignment), expectedInterleaved(2 * count, 0);
+
+    row0.Fill(pattern);
+    row1.Fill(pattern);
+
+    scalar.downscale2x(row0.data, row1.data, expected.data, count);
+    candidate.downscale2x(row0.data, row1.data, output.data, count);
+    Check(output.Matches(expected), "downscale2x", count, misalignment, pattern);
+
+    scalar.downscale2xInterleaved(row0.data, row1.data, expectedInterleaved.data, count);
+    candidate.downscale2xInterleaved(row0.data, row1.data, interleaved.data, count);
+    Check(interleaved.Matches(expectedInterleaved), "downscale2xInterleaved", count, misalignment, pattern);
+}
+
+void KernelTest::TestBlendRows(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    const unsigned int weights[] = { 0, 1, 127, 128, 255, 256, Random() % 257 };
+    TestBuffer row0(count, misalignment), row1(count, misalignment);
+
+    row0.Fill(pattern);
+    row1.Fill(pattern);
+
+    for(auto weight: weights)
+    {
+        TestBuffer output(count, GetOutputMisalignment(misalignment)), expected(count, 0);
+
+        scalar.blendRows(row0.data, row1.data, weight, expected.data, count);
+        candidate.blendRows(row0.data, row1.data, weight, output.data, count);
+        Check(output.Matches(expected), "blendRows", count, misalignment, pattern);
+    }
+}
+
+void KernelTest::TestDifferences(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    TestBuffer a(count, misalignment), b(count, GetOutputMisalignment(misalignment));
+
+    a.Fill(pattern);
+    b.Fill(pattern);
+
+    // Extremes are most severe when every sample differs by 255
+    if(pattern == PATTERN_EXTREMES)
+        for(auto i = 0u; i < count; i++)
+            b.data[i] = 255 - a.data[i];
+
+    Check(candidate.sad(a.data, b.data, count) == scalar.sad(a.data, b.data, count), "sad", count, misalignment,
+          pattern);
+    Check(candidate.sse(a.data, b.data, count) == scalar.sse(a.data, b.data, count), "sse", count, misalignment,
+          pattern);
+}
+
+void KernelTest::TestSSIM4x4(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    // Odd pitches keep the rows of a block from sharing an alignment
+    auto aPitch = 4 * count + 5, bPitch = 4 * count + 11;
+    TestBuffer a(4 * aPitch, misalignment), b(4 * bPitch, GetOutputMisalignment(misalignment));
+    std::vector<uint32_t> sums(4 * count + 4, GUARD_SUM), expected(4 * count + 4, GUARD_SUM);
+
+    a.Fill(pattern);
+    b.Fill(pattern);
+    scalar.ssim4x4(a.data, aPitch, b.data, bPitch, count, (uint32_t (*)[4])expected.data());
+    candidate.ssim4x4(a.data, aPitch, b.data, bPitch, count, (uint32_t (*)[4])sums.data());
+
+    Check(sums == expected, "ssim4x4", count, misalignment, pattern);
+}
+
+void KernelTest::TestRemap(const size_t count, const size_t misalignment, const Pattern pattern)
+{
+    // Blocks lie anywhere in the plane, leaving room for the bytes read past each of their rows
+    const size_t pitch = 67, rows = 19;
+    const uint16_t edges[] = { 0, 0x00ff, 0xff00, 0xffff };
+    TestBuffer plane(rows * pitch, misalignment);
+    std::vector<uint32_t> offsets(count), interleavedOffsets(count);
+    std::vector<uint16_t> weights(count);
+    auto outputMisalignment = GetOutputMisalignment(misalignment);
+    TestBuffer output(count, outputMisalignment), expected(count, 0);
+    TestBuffer interleaved(2 * count, outputMisalignment), expectedInterleaved(2 * count, 0);
+
+    plane.Fill(pattern);
+    for(auto i = 0u; i < count; i++)
+    {
+        auto y = Random() % (rows - 1);
+
+        offsets[i] = y * pitch + Random() % (pitch - 3);
+        interleavedOffsets[i] = y * pitch + Random() % ((pitch - 5) / 2) * 2;
+        weights[i] = i % 8 < 4 ? edges[i % 4] : (uint16_t)Random();
+    }
+
+    scalar.remap(plane.data, pitch, offsets.data(), weights.data(), expected.data, count);
+    candidate.remap(plane.data, pitch, offsets.data(), weights.data(), output.data, count);
+    Check(output.Matches(expected), "remap", count, misalignment, pattern);
+
+    scalar.remapInterleaved(plane.data, pitch, interleavedOffsets.data(), weights.data(), expectedInterleaved.data,
+                            count);
+    candidate.remapInterleaved(plane.data, pitch, interleavedOffsets.data(), weights.data(), interleaved.data,
+                               count);
+    Check(interleaved.Matches(expectedInterleaved), "remapInterleaved", count, misalignment, pattern);
+}
+
+// The plane operations reach the kernels through GetPlaneKernels once an implementation is selected
+void KernelTest::TestPlanes()
+{
+    const size_t width = 1283, height = 37, pitch = 1344;
+    TestBuffer a(height * pitch, 0), b(height * pitch, 0);
+    TestBuffer resized(height * pitch, 0), expected(height * pitch, 0);
+
+    a.Fill(PATTERN_RANDOM);
+    b.Fill(PATTERN_RANDOM);
+    SelectPlaneKernels(candidate);
+
+    Check(&GetPlaneKernels() == &candidate, "SelectPlaneKernels", 0, 0, PATTERN_RANDOM);
+    Check(PlaneSSIM(a.data, pitch, b.data, pitch, width, height) ==
+          PlaneSSIM(a.data, pitch, b.data, pitch, width, height, scalar), "PlaneSSIM", width, 0, PATTERN_RANDOM);
+
+    for(auto interleaved = 0; interleaved < 2; interleaved++)
+    {
+        auto samples = interleaved ? width / 2 : width;
+
+        ResizePlane(a.data, pitch, samples, height, resized.data, pitch, samples * 3 / 4, height - 7,
+                    interleaved != 0);
+        ResizePlane(a.data, pitch, samples, height, expected.data, pitch, samples * 3 / 4, height - 7,
+                    interleaved != 0, scalar);
+        Check(resized.Matches(expected), "ResizePlane", samples, 0, PATTERN_RANDOM);
+    }
+
+    SelectPlaneKernels(scalar);
+}
+
+size_t KernelTest::Run()
+{
+    std::vector<size_t> counts;
+
+    // Every length up to a few vectors, then lengths around larger vector multiples and whole rows
+    for(auto count = 0u; count <= 160; count++)
+        counts.push_back(count);
+    for(auto count: { 255, 256, 257, 1023, 1920, 4097 })
+        counts.push_back(count);
+
+    for(auto count: counts)
+        for(auto misalignment: misalignments)
+            for(auto pattern = 0; pattern < PATTERN_COUNT; pattern++)
+            {
+                TestDeinterleave(count, misalignment, (Pattern)pattern);
+                TestInterleave(count, misalignment, (Pattern)pattern);
+                TestDownscale2x(count, misalignment, (Pattern)pattern);
+                TestBlendRows(count, misalignment, (Pattern)pattern);
+                TestDifferences(count, misalignment, (Pattern)pattern);
+                TestSSIM4x4(count, misalignment, (Pattern)pattern);
+                TestRemap(count, misalignment, (Pattern)pattern);
+            }
+
+    TestPlanes();
+
+    return failures;
+}
+
+int main(int argc, char*[])
+{
+    const PlaneKernels* scalar = FindPlaneKernels("scalar");
+    auto failed = 0;
+
+    if(argc > 1)
+        return fprintf(stderr, "Usage : planekernels_test\n"), 1;
+
+    for(auto* name: implementations)
+    {
+        const PlaneKernels* candidate = FindPlaneKernels(name);
+
+        if(candidate == NULL)
+        {
+            printf("%-8s not supported here\n", name);
+            continue;
+        }
+
+        KernelTest test(*scalar, *candidate);
+        auto failures = test.Run();
+
+        printf("%-8s %s (%lu cases, %lu failed)\n", name, failures ? "FAILED" : "passed", test.GetCases(),
+               failures);
+        failed += failures ? 1 : 0;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+#include <math.h>
+#include <string.h>
+
+#include "Projection.h"
+#include "PlaneKernels.h"
+#include "Trace.h"
+
+int ParseProjection(const char* argument, ProjectionLayout& layout)
+{
+    if(!strcmp(argument, "cubemap"))
+        layout = PROJECTION_CUBEMAP;
+    else if(!strcmp(argument, "eac"))
+        layout = PROJECTION_EAC;
+    else
+        return -1;
+
+    return 0;
+}
+
+const char* DescribeProjection(const ProjectionLayout layout)
+{
+    return layout == PROJECTION_CUBEMAP ? "cubemap" : layout == PROJECTION_EAC ? "equi-angular cubemap" : "none";
+}
+
+CubemapProjection::CubemapProjection(CUvideoctxlock lock, const ProjectionLayout layout, const size_t sourceWidth,
+                                     const size_t sourceHeight, const size_t faceSize)
+    : lock(lock), layout(layout), sourceWidth(sourceWidth), sourceHeight(sourceHeight),
+      sourcePitch(sourceWidth + 4), faceSize(faceSize), source(NULL), output(NULL), device(0), pitch(0)
+{
+}
+
+CubemapProjection::~CubemapProjection()
+{
+    if(cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        if(source != NULL)
+            cuMemFreeHost(source);
+        if(output != NULL)
+            cuMemFreeHost(output);
+        if(device != 0)
+            cuMemFree(device);
+        cuvidCtxUnlock(lock, 0);
+    }
+}
+
+size_t CubemapProjection::GetDefaultFaceSize(const size_t sourceWidth)
+{
+    return sourceWidth / 4 & ~(size_t)7;
+}
+
+// Direction (x right, y up, z front) through a point of a face, given in [-1, 1] across and down it
+static void GetDirection(const size_t face, const double across, const double down, double (&direction)[3])
+{
+    // Forward, right and up of each face in layout order: left, front, right, down, back, up
+    static const double axes[6][3][3] = {
+        { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+        { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+        { { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+        { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+        { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } } };
+    auto& axis = axes[face];
+
+    for(auto i = 0u; i < 3; i++)
+        direction[i] = axis[0][i] + across * axis[1][i] - down * axis[2][i];
+}
+
+void CubemapProjection::BuildTable(Table& table, const size_t face, const size_t planeWidth,
+                                   const size_t planeHeight, const size_t channels) const
+{
+    auto width = 3 * face, height = 2 * face;
+    auto maximumRow = (int64_t)(planeHeight - 1) * 256;
+
+    table.offsets.resize(width * height);
+    table.weights.resize(width * height);
+
+    for(auto y = 0u; y < height; y++)
+        for(auto x = 0u; x < width; x++)
+        {
+            double direction[3];
+            auto across = 2 * ((x % face) + .5) / face - 1;
+            auto down = 2 * ((y % face) + .5) / face - 1;
+
+            // Equal steps in angle rather than in distance across the face
+            if(layout == PROJECTION_EAC)
+            {
+                across = tan(across * M_PI / 4);
+                down = tan(down * M_PI / 4);
+            }
+
+            GetDirection(y / face * 3 + x / face, across, down, direction);
+
+            auto longitude = atan2(direction[0], direction[2]);
+            auto latitude = atan2(direction[1], hypot(direction[0], direction[2]));
+            // Source position in 256ths of a sample, relative to the first sample's center
+            auto column = (int64_t)llround(((longitude / (2 * M_PI) + .5) * planeWidth - .5) * 256);
+            auto row = (int64_t)llround(((.5 - latitude / M_PI) * planeHeight - .5) * 256);
+            auto left = column >> 8;
+
+            // Longitude wraps (through the column copied past the last); latitude stops at the poles
+            row = row < 0 ? 0 : row > maximumRow ? maximumRow : row;
+            left = left < 0 ? left + planeWidth : left >= (int64_t)planeWidth ? left - planeWidth : left;
+
+            table.offsets[y * width + x] = (uint32_t)((row >> 8) * sourcePitch + left * channels);
+            table.weights[y * width + x] = (uint16_t)((column & 0xff) | (row & 0xff) << 8);
+        }
+}
+
+int CubemapProjection::Create()
+{
+    CUresult result;
+
+    BuildTable(luma, faceSize, sourceWidth, sourceHeight, 1);
+    BuildTable(chroma, faceSize / 2, sourceWidth / 2, sourceHeight / 2, 2);
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    // A padding row below the chroma plane is read (with no weight) when sampling its last row
+    if((result = cuMemAllocHost((void**)&source, sourcePitch * (sourceHeight * 3 / 2 + 1))) == CUDA_SUCCESS &&
+       (result = cuMemAllocHost((void**)&output, GetWidth() * GetHeight() * 3 / 2)) == CUDA_SUCCESS)
+        result = cuMemAllocPitch(&device, &pitch, GetWidth(), GetHeight() * 3 / 2, 16);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result == CUDA_SUCCESS)
+        memset(source + sourcePitch * sourceHeight * 3 / 2, 0, sourcePitch);
+
+    return result == CUDA_SUCCESS ? 0 : -1;
+}
+
+int CubemapProjection::Apply(const DecodedFrame& frame, EncodeFrameConfig& configuration)
+{
+    TraceSpan span("projection", frame.index);
+    CUDA_MEMCPY2D parameters;
+    CUresult result;
+    auto width = GetWidth(), height = GetHeight();
+    auto* chromaSource = source + sourceHeight * sourcePitch;
+
+    // The chroma plane follows the luma rows at the same pitch, so one copy takes both
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.srcDevice = frame.device;
+    parameters.srcPitch = frame.pitch;
+    parameters.dstMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.dstHost = source;
+    parameters.dstPitch = sourcePitch;
+    parameters.WidthInBytes = sourceWidth;
+    parameters.Height = sourceHeight * 3 / 2;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+
+    // Samples at the right edge blend with the left edge
+    for(auto y = 0u; y < sourceHeight; y++)
+        source[y * sourcePitch + sourceWidth] = source[y * sourcePitch];
+    for(auto y = 0u; y < sourceHeight / 2; y++)
+        memcpy(chromaSource + y * sourcePitch + sourceWidth, chromaSource + y * sourcePitch, 2);
+
+    RemapPlane(source, sourcePitch, luma.offsets.data(), luma.weights.data(), output, width * height, false);
+    RemapPlane(chromaSource, sourcePitch, chroma.offsets.data(), chroma.weights.data(), output + width * height,
+               width / 2 * height / 2, true);
+
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.srcHost = output;
+    parameters.srcPitch = width;
+    parameters.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.dstDevice = device;
+    parameters.dstPitch = pitch;
+    parameters.WidthInBytes = width;
+    parameters.Height = height * 3 / 2;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+
+    // The upload completes before returning, so the surface stays valid until the next frame
+    configuration.device_pointer = device;
+    configuration.pitch = pitch;
+    configuration.width = width;
+    configuration.height = height;
+
+    return 0;
+}
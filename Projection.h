@@ -0,0 +1,69 @@
+#ifndef _PROJECTION
+#define _PROJECTION
+
+#include <stdint.h>
+#include <vector>
+
+#include "PipelineStages.h"
+
+typedef enum ProjectionLayout
+{
+    PROJECTION_NONE,
+    PROJECTION_CUBEMAP,  // Faces sampled uniformly in the tangent of the view angle
+    PROJECTION_EAC       // Equi-angular: faces sampled uniformly in the view angle
+} ProjectionLayout;
+
+// Parses "cubemap" or "eac"
+int         ParseProjection(const char* argument, ProjectionLayout&);
+const char* DescribeProjection(ProjectionLayout);
+
+// Reprojects equirectangular frames to six cube faces, laid out as
+//     left  front right
+//     down  back  up
+// with the horizontal faces upright, the top of "down" facing the front and the top of "up" facing the back.
+// A face a quarter of the source width matches the source's sampling at the equator and encodes three
+// quarters of its pixels; the poles, which the source oversamples, account for the difference.  A grid with
+// a multiple of three columns and two rows keeps every tile within a face.
+//
+// Source positions are computed once into lookup tables of a 2x2 block offset and bilinear weights per
+// output sample (see PlaneKernels::remap).  Each frame is copied to the host, remapped and uploaded for the
+// encoder to crop tiles from, like the levels of a TilePyramid.
+class CubemapProjection : public FrameTransform
+{
+public:
+    CubemapProjection(CUvideoctxlock lock, ProjectionLayout layout, size_t sourceWidth, size_t sourceHeight,
+                      size_t faceSize);
+    ~CubemapProjection();
+
+    // A quarter of the source width, rounded down to a multiple of 8
+    static size_t GetDefaultFaceSize(size_t sourceWidth);
+
+    // Builds the lookup tables and allocates the frames; returns nonzero on failure
+    int    Create();
+    int    Apply(const DecodedFrame&, EncodeFrameConfig&);
+
+    size_t GetWidth() const { return 3 * faceSize; }
+    size_t GetHeight() const { return 2 * faceSize; }
+
+private:
+    typedef struct Table
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint16_t> weights;
+    } Table;
+
+    CUvideoctxlock   lock;
+    ProjectionLayout layout;
+    size_t           sourceWidth, sourceHeight;
+    size_t           sourcePitch;  // Leaves room for the wrapped column and the kernels' over-read
+    size_t           faceSize;
+    Table            luma, chroma;
+    uint8_t*         source;       // The equirectangular frame, NV12 at sourcePitch
+    uint8_t*         output;       // The cubemap, NV12 with a pitch of its width
+    CUdeviceptr      device;
+    size_t           pitch;
+
+    void BuildTable(Table&, size_t face, size_t planeWidth, size_t planeHeight, size_t channels) const;
+};
+
+#endif
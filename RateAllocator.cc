@@ -0,0 +1,137 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "RateAllocator.h"
+#include "PlaneKernels.h"
+
+RateAllocator::RateAllocator(CUvideoctxlock lock, const TileDimensions& dimensions, const size_t width,
+                             const size_t height, const uint64_t budget, const bool constantQP, const size_t interval)
+    : lock(lock), dimensions(dimensions), width(width), height(height), budget(budget), constantQP(constantQP),
+      interval(interval ? interval : DEFAULT_RATE_INTERVAL), hasPrevious(false),
+      measurements(dimensions.count), blockSums(width / RATE_BLOCK_SIZE), blockSquares(width / RATE_BLOCK_SIZE)
+{
+    auto rows = dimensions.rows * (height / dimensions.rows) / RATE_ROW_STEP;
+
+    current.resize(width * rows);
+    previous.resize(width * rows);
+    memset(measurements.data(), 0, measurements.size() * sizeof(TileMeasurement));
+}
+
+int RateAllocator::Measure(const CUdeviceptr frame, const size_t pitch)
+{
+    auto& kernels = GetPlaneKernels();
+    auto tileWidth = width / dimensions.columns;
+    auto tileHeight = height / dimensions.rows;
+    auto rows = current.size() / width;
+    auto band = RATE_BLOCK_SIZE / RATE_ROW_STEP;  // Sampled rows in each row of blocks
+    auto blockSamples = (double)RATE_BLOCK_SIZE * band;
+    CUDA_MEMCPY2D parameters;
+    CUresult result;
+
+    // Only every RATE_ROW_STEP-th row is transferred
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.srcDevice = frame;
+    parameters.srcPitch = pitch * RATE_ROW_STEP;
+    parameters.dstMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.dstHost = current.data();
+    parameters.dstPitch = width;
+    parameters.WidthInBytes = width;
+    parameters.Height = rows;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+
+    for(auto y = 0u; y < rows; y++)
+    {
+        auto* row = current.data() + y * width;
+        auto* tiles = measurements.data() + (y * RATE_ROW_STEP / tileHeight) * dimensions.columns;
+
+        for(auto column = 0u; hasPrevious && column < dimensions.columns; column++)
+        {
+            tiles[column].temporal += kernels.sad(row + column * tileWidth, previous.data() + y * width + column * tileWidth,
+                                                  tileWidth);
+            tiles[column].samples += tileWidth;
+        }
+
+        for(auto x = 0u; x < blockSums.size() * RATE_BLOCK_SIZE; x++)
+        {
+            blockSums[x / RATE_BLOCK_SIZE] += row[x];
+            blockSquares[x / RATE_BLOCK_SIZE] += row[x] * row[x];
+        }
+
+        // A block that straddles tiles is attributed to the tile holding its last row and first column
+        if((y + 1) % band == 0)
+            for(auto block = 0u; block < blockSums.size(); block++)
+            {
+                auto column = block * RATE_BLOCK_SIZE / tileWidth;
+                auto mean = blockSums[block] / blockSamples;
+
+                if(column < dimensions.columns)
+                {
+                    tiles[column].spatial += blockSquares[block] / blockSamples - mean * mean;
+                    tiles[column].blocks++;
+                }
+                blockSums[block] = blockSquares[block] = 0;
+            }
+    }
+
+    std::swap(current, previous);
+    hasPrevious = true;
+    return 0;
+}
+
+void RateAllocator::Allocate(const std::vector<bool>& enabled, std::vector<TileRate>& rates)
+{
+    std::vector<double> shares(dimensions.count, 0);
+    auto logMean = 0., weights = 0., total = 0.;
+    auto tiles = 0u;
+
+    rates.assign(dimensions.count, TileRate());
+
+    for(auto i = 0u; i < dimensions.count; i++)
+    {
+        auto& measurement = measurements[i];
+        auto spatial = measurement.blocks ? sqrt(measurement.spatial / measurement.blocks) : 0.;
+        auto temporal = measurement.samples ? measurement.temporal / measurement.samples : 0.;
+
+        if(!enabled[i])
+            continue;
+
+        rates[i].complexity = spatial + RATE_TEMPORAL_WEIGHT * temporal + 1;
+        shares[i] = pow(rates[i].complexity, RATE_EXPONENT);
+        logMean += log2(rates[i].complexity);
+        weights += shares[i];
+        tiles++;
+    }
+
+    memset(measurements.data(), 0, measurements.size() * sizeof(TileMeasurement));
+    if(tiles == 0)
+        return;
+
+    logMean /= tiles;
+    for(auto i = 0u; i < dimensions.count; i++)
+        if(enabled[i])
+        {
+            shares[i] = std::min(std::max(shares[i] / weights, RATE_MINIMUM_SHARE / tiles), RATE_MAXIMUM_SHARE / tiles);
+            total += shares[i];
+        }
+
+    for(auto i = 0u; i < dimensions.count; i++)
+        if(enabled[i])
+        {
+            // At constant QP a tile's bits grow with its complexity and halve every 6 QP, so these offsets
+            // give the same distribution as the bitrates
+            auto offset = (int)lround(6 * (1 - RATE_EXPONENT) * (log2(rates[i].complexity) - logMean));
+
+            rates[i].bitrate = (unsigned int)(budget * shares[i] / total);
+            rates[i].qpOffset = std::min(std::max(offset, -RATE_MAXIMUM_QP_OFFSET), RATE_MAXIMUM_QP_OFFSET);
+        }
+}
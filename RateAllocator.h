@@ -0,0 +1,71 @@
+#ifndef _RATE_ALLOCATOR
+#define _RATE_ALLOCATOR
+
+#include <stdint.h>
+#include <vector>
+
+#include "dynlink_cuda.h"    // <cuda.h>
+#include "dynlink_nvcuvid.h" // <nvcuvid.h>
+#include "TileDimensions.h"
+
+#define RATE_MEASURE_INTERVAL  4     // frames between complexity measurements
+#define DEFAULT_RATE_INTERVAL  60    // frames between allocations when the GOP is infinite
+#define RATE_ROW_STEP          4     // Every fourth luma row is measured
+#define RATE_BLOCK_SIZE        16    // Spatial variance is taken over blocks of this many luma samples square
+#define RATE_TEMPORAL_WEIGHT   2.    // Weight of the mean temporal difference relative to the spatial deviation
+#define RATE_EXPONENT          .5    // Bits are allocated in proportion to complexity raised to this power
+#define RATE_MINIMUM_SHARE     .25   // Bounds on a tile's allocation, relative to an equal split
+#define RATE_MAXIMUM_SHARE     4.
+#define RATE_MAXIMUM_QP_OFFSET 6
+
+typedef struct TileRate
+{
+    double       complexity;
+    unsigned int bitrate;   // bits/sec
+    int          qpOffset;  // Relative to the configured QP, for constant-QP encodes
+} TileRate;
+
+// Distributes rate across tiles by content.  The luma of the frames being encoded is sampled on the host and
+// each tile is given a complexity: the deviation of its luma within blocks plus the mean difference from the
+// previous measurement.  Bits are then allocated in proportion to complexity^RATE_EXPONENT, so that busy tiles
+// get more of the budget but less than their share of the raw complexity, and flat tiles give up what they
+// would otherwise waste.  For a constant-QP encode the same distribution is expressed as QP offsets, which
+// raise QP on busy tiles (where artifacts are masked) and lower it on flat ones.
+class RateAllocator
+{
+public:
+    // The budget is the total bitrate across every encoded tile; interval is in frames
+    RateAllocator(CUvideoctxlock lock, const TileDimensions&, size_t width, size_t height, uint64_t budget,
+                  bool constantQP, size_t interval);
+
+    bool IsConstantQP() const { return constantQP; }
+    bool IsMeasured(size_t frame) const { return frame % RATE_MEASURE_INTERVAL == 0; }
+    bool IsDue(size_t frame) const { return frame % interval == 0; }
+
+    // Samples an NV12 frame on the device; the caller does not hold the context lock
+    int  Measure(CUdeviceptr frame, size_t pitch);
+    // Allocates across the enabled tiles from the measurements since the last allocation, then resets them
+    void Allocate(const std::vector<bool>& enabled, std::vector<TileRate>&);
+
+private:
+    typedef struct TileMeasurement
+    {
+        double spatial;   // Sum of block variances
+        size_t blocks;
+        double temporal;  // Sum of absolute differences
+        size_t samples;
+    } TileMeasurement;
+
+    CUvideoctxlock               lock;
+    TileDimensions               dimensions;
+    size_t                       width, height;
+    uint64_t                     budget;
+    bool                         constantQP;
+    size_t                       interval;
+    std::vector<uint8_t>         current, previous;  // Sampled luma rows
+    bool                         hasPrevious;
+    std::vector<TileMeasurement> measurements;
+    std::vector<uint32_t>        blockSums, blockSquares;
+};
+
+#endif
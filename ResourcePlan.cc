@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "ResourcePlan.h"
+#include "VideoDecoder.h"
+#include "TileVideoEncoder.h"
+
+// Standard streams, the input (held by both the video source and the parser feed) and a placement slot
+#define BASELINE_FILE_HANDLES 6
+
+// Pitch-aligned NV12 surface; decoders pad the coded height to the largest coding block
+static size_t SurfaceBytes(const int width, const int height)
+{
+    return ((size_t)(width + 255) & ~255) * (((size_t)height + 63) & ~63) * 3 / 2;
+}
+
+int PlanResources(const EncodeConfig& configuration, const TileDimensions& dimensions, const size_t sessions,
+                  const PipelineDepths& depths, const bool inlineDecode, const size_t auxiliaryFiles,
+                  ResourcePlan& plan)
+{
+    if(configuration.width <= 0 || configuration.height <= 0)
+        return -1;
+
+    plan.decodeSurfaces = depths.decodeSurfaces ? depths.decodeSurfaces :
+        std::max(CudaDecoder::GetDefaultDecodeSurfaces(cudaVideoCodec_H264, configuration.width, configuration.height),
+                 CudaDecoder::GetDefaultDecodeSurfaces(cudaVideoCodec_HEVC, configuration.width, configuration.height));
+    plan.decodeSurfaces = std::min(plan.decodeSurfaces, (unsigned int)FrameQueue::cnMaximumSize);
+    plan.decodeSurfaceBytes = SurfaceBytes(configuration.width, configuration.height);
+    plan.outputSurfaces = depths.outputSurfaces ? depths.outputSurfaces : 2;
+    plan.outputSurfaceBytes = plan.decodeSurfaceBytes;
+    plan.queueSize = std::min(depths.queueSize ? depths.queueSize : FrameQueue::cnDefaultSize, plan.decodeSurfaces);
+
+    plan.sessions = sessions;
+    plan.encodeBuffers = depths.encodeBuffers ? depths.encodeBuffers : configuration.numB + 4;
+    plan.inputBufferBytes = VideoEncoder::GetInputBufferBytes(configuration, dimensions);
+    plan.bitstreamBufferBytes = BITSTREAM_BUFFER_SIZE;
+
+    plan.deviceBytes = plan.decodeSurfaces * plan.decodeSurfaceBytes +
+                       plan.outputSurfaces * plan.outputSurfaceBytes +
+                       sessions * plan.encodeBuffers * (plan.inputBufferBytes + plan.bitstreamBufferBytes);
+    // The parser feed and a stdio buffer for each tile output
+    plan.hostBytes = PARSE_CHUNK_SIZE + sessions * BUFSIZ;
+    plan.fileHandles = BASELINE_FILE_HANDLES + sessions + auxiliaryFiles;
+    plan.threads = inlineDecode ? 1 : 2;
+    plan.framesPerSecond = 0;
+
+    return 0;
+}
+
+std::string DescribeResourcePlan(const ResourcePlan& plan)
+{
+    std::ostringstream description;
+
+    description << "decode surfaces     : " << plan.decodeSurfaces << " x " << plan.decodeSurfaceBytes << " bytes\n"
+                << "output surfaces     : " << plan.outputSurfaces << " x " << plan.outputSurfaceBytes << " bytes\n"
+                << "frame queue         : " << plan.queueSize << " frames\n"
+                << "encoder sessions    : " << plan.sessions << "\n"
+                << "encode buffers      : " << plan.encodeBuffers << " per tile\n"
+                << "input buffers       : " << plan.sessions * plan.encodeBuffers << " x "
+                                            << plan.inputBufferBytes << " bytes\n"
+                << "bitstream buffers   : " << plan.sessions * plan.encodeBuffers << " x "
+                                            << plan.bitstreamBufferBytes << " bytes\n"
+                << "device memory       : " << plan.deviceBytes << " bytes ("
+                                            << (plan.deviceBytes + (1 << 20) - 1) / (1 << 20) << " MB)\n"
+                << "host memory         : " << plan.hostBytes << " bytes\n"
+                << "file handles        : " << plan.fileHandles << "\n"
+                << "pipeline threads    : " << plan.threads << "\n";
+
+    if(plan.framesPerSecond > 0)
+        description << "estimated fps       : " << plan.framesPerSecond << "\n";
+    else
+        description << "estimated fps       : unknown (no matching calibration)\n";
+
+    return description.str();
+}
+
+int LoadCalibration(const char* filename, std::vector<CalibrationEntry>& entries)
+{
+    FILE* file;
+    CalibrationEntry entry;
+    char preset[64];
+
+    if((file = fopen(filename, "r")) == NULL)
+        return -1;
+
+    while(fscanf(file, "%d %63s %dx%d %lu %lf",
+                 &entry.codec, preset, &entry.width, &entry.height, &entry.tiles, &entry.framesPerSecond) == 6)
+    {
+        entry.preset = preset;
+        entries.push_back(entry);
+    }
+
+    if(!feof(file))
+        fprintf(stderr, "Ignoring malformed calibration entries in %s\n", filename);
+
+    fclose(file);
+    return 0;
+}
+
+int SaveCalibration(const char* filename, const CalibrationEntry& entry)
+{
+    FILE* file;
+
+    if((file = fopen(filename, "a")) == NULL)
+        return -1;
+
+    fprintf(file, "%d %s %dx%d %lu %f\n",
+            entry.codec, entry.preset.c_str(), entry.width, entry.height, entry.tiles, entry.framesPerSecond);
+
+    return fclose(file) != 0 ? -1 : 0;
+}
+
+double EstimateFramesPerSecond(const std::vector<CalibrationEntry>& entries, const EncodeConfig& configuration,
+                               const size_t tiles)
+{
+    std::string preset = configuration.encoderPreset ? configuration.encoderPreset : "default";
+    const CalibrationEntry* nearest = NULL;
+
+    for(auto& entry: entries)
+        if(entry.codec == configuration.codec && entry.preset == preset && entry.width > 0 && entry.height > 0 &&
+           (nearest == NULL || llabs((long long)entry.tiles - (long long)tiles) <
+                               llabs((long long)nearest->tiles - (long long)tiles)))
+            nearest = &entry;
+
+    // Encoder throughput is roughly proportional to the pixel rate for a given tile count
+    return nearest == NULL ? 0 :
+        nearest->framesPerSecond * nearest->width * nearest->height / ((double)configuration.width * configuration.height);
+}
@@ -0,0 +1,54 @@
+#ifndef _RESOURCE_PLAN
+#define _RESOURCE_PLAN
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "../common/inc/NvHWEncoder.h"
+#include "TileDimensions.h"
+#include "PipelineTuner.h"
+
+// Resources a transcode will acquire, computed from its configuration without touching the device
+typedef struct ResourcePlan
+{
+    unsigned int decodeSurfaces;
+    size_t       decodeSurfaceBytes;    // per surface
+    unsigned int outputSurfaces;
+    size_t       outputSurfaceBytes;    // per surface
+    unsigned int queueSize;
+    size_t       sessions;              // One encoder session per encoded tile
+    unsigned int encodeBuffers;         // per tile
+    size_t       inputBufferBytes;      // per tile encode buffer
+    size_t       bitstreamBufferBytes;  // per tile encode buffer
+    size_t       deviceBytes;
+    size_t       hostBytes;
+    size_t       fileHandles;
+    size_t       threads;               // Pipeline threads; the driver adds its own
+    double       framesPerSecond;       // Estimated throughput; zero without a matching calibration
+} ResourcePlan;
+
+// Throughput measured by a completed transcode
+typedef struct CalibrationEntry
+{
+    int         codec;
+    std::string preset;
+    int         width, height;
+    size_t      tiles;
+    double      framesPerSecond;
+} CalibrationEntry;
+
+// Plans a transcode of sessions tiles from the pinned depths (zero selects the default).  The input is
+// assumed to have the output size, and the decoder is sized for the worst case of either input codec.
+int         PlanResources(const EncodeConfig&, const TileDimensions&, size_t sessions, const PipelineDepths&,
+                          bool inlineDecode, size_t auxiliaryFiles, ResourcePlan&);
+std::string DescribeResourcePlan(const ResourcePlan&);
+
+int         LoadCalibration(const char* filename, std::vector<CalibrationEntry>&);
+// Appends an entry, so that a profile accumulates measurements across grids and sizes
+int         SaveCalibration(const char* filename, const CalibrationEntry&);
+// Scales the measurement with the same codec and preset and the nearest tile count by pixel rate;
+// returns zero when there is none
+double      EstimateFramesPerSecond(const std::vector<CalibrationEntry>&, const EncodeConfig&, size_t tiles);
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "SceneDetector.h"
+#include "Trace.h"
+
+SceneDetector::SceneDetector(FrameSource& upstream, CUvideoctxlock lock, const size_t width, const size_t height,
+                             const size_t lookahead, const double threshold)
+    : upstream(upstream), lock(lock), width(width), height(height), lookahead(lookahead), threshold(threshold),
+      sinceCut(0), cuts(0), inputDone(false), rows(width * (height / SCENE_ROW_STEP))
+{
+}
+
+int SceneDetector::Measure(const DecodedFrame& frame, Histogram& histogram)
+{
+    TraceSpan span("scene histogram", frame.index);
+    CUDA_MEMCPY2D parameters;
+    CUresult result;
+
+    // Only every SCENE_ROW_STEP-th luma row is transferred
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.srcDevice = frame.device;
+    parameters.srcPitch = (size_t)frame.pitch * SCENE_ROW_STEP;
+    parameters.dstMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.dstHost = rows.data();
+    parameters.dstPitch = width;
+    parameters.WidthInBytes = width;
+    parameters.Height = height / SCENE_ROW_STEP;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+
+    histogram.assign(SCENE_BINS, 0);
+    for(auto i = 0u; i < rows.size(); i += SCENE_COLUMN_STEP)
+        histogram[rows[i] * SCENE_BINS / 256]++;
+
+    return 0;
+}
+
+// Half the sum of absolute differences between normalized histograms: zero when identical, one when disjoint
+double SceneDetector::Distance(const Histogram& a, const Histogram& b) const
+{
+    auto samples = 0lu, difference = 0lu;
+
+    if(a.empty() || b.empty())
+        return 0;
+
+    for(auto i = 0u; i < SCENE_BINS; i++)
+    {
+        samples += a[i];
+        difference += labs((long)a[i] - (long)b[i]);
+    }
+    if(samples == 0)
+        return 0;
+
+    return difference / (2. * samples);
+}
+
+bool SceneDetector::NextFrame(DecodedFrame& frame, bool& cut)
+{
+    Entry entry;
+
+    // Keep the frame to return and the lookahead behind it
+    while(!inputDone && pending.size() <= lookahead)
+        if(!upstream.NextFrame(entry.frame, entry.cut))
+            inputDone = true;
+        else
+        {
+            if(Measure(entry.frame, entry.histogram) != 0)
+                entry.histogram.clear();
+            pending.push_back(entry);
+        }
+
+    if(pending.empty())
+        return false;
+
+    auto& next = pending.front();
+    frame = next.frame;
+    cut = sinceCut >= SCENE_MINIMUM_LENGTH && Distance(previous, next.histogram) > threshold;
+
+    // A flash, after which the previous scene returns within the lookahead, is not a cut
+    for(auto i = 1u; cut && i < pending.size(); i++)
+        cut = Distance(previous, pending[i].histogram) > threshold;
+    cut = cut || next.cut;
+
+    sinceCut = cut ? 0 : sinceCut + 1;
+    cuts += cut ? 1 : 0;
+    previous.swap(next.histogram);
+    pending.pop_front();
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef _SCENE_DETECTOR
+#define _SCENE_DETECTOR
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "PipelineStages.h"
+
+#define DEFAULT_SCENE_LOOKAHEAD  4     // frames held back to confirm a cut
+#define MAXIMUM_SCENE_LOOKAHEAD  16
+#define DEFAULT_SCENE_THRESHOLD  .4    // Histogram distance (0-1) that marks a cut
+#define SCENE_MINIMUM_LENGTH     8     // frames between cuts
+#define SCENE_ROW_STEP           8     // Luma is sampled every this many rows and columns
+#define SCENE_COLUMN_STEP        8
+#define SCENE_BINS               64
+
+// Lookahead between the decoder and the encoder that finds scene cuts.  A luma histogram is taken from a
+// subsample of each decoded frame; a frame begins a new scene when its histogram differs from that of the
+// preceding frame by more than the threshold, and the frames that follow it (up to the lookahead) still
+// differ from the preceding frame, so that flashes are not mistaken for cuts.  Cuts marked by the upstream
+// source are kept.
+//
+// Frames stay mapped while they are held, so a decoder upstream needs an output surface for each (see
+// GetRequiredOutputSurfaces).
+class SceneDetector : public FrameSource
+{
+public:
+    SceneDetector(FrameSource& upstream, CUvideoctxlock lock, size_t width, size_t height,
+                  size_t lookahead = DEFAULT_SCENE_LOOKAHEAD, double threshold = DEFAULT_SCENE_THRESHOLD);
+
+    // The next frame in display order, and whether it begins a scene; false at the end of the input
+    bool   NextFrame(DecodedFrame&, bool& cut);
+    void   ReleaseFrame(DecodedFrame& frame) { upstream.ReleaseFrame(frame); }
+    void   Cancel() { upstream.Cancel(); }
+    size_t GetCuts() const { return cuts; }
+
+    // The frame returned and those held behind it
+    static unsigned int GetRequiredOutputSurfaces(size_t lookahead) { return lookahead + 1; }
+
+private:
+    typedef std::vector<uint32_t> Histogram;
+
+    typedef struct Entry
+    {
+        DecodedFrame frame;
+        Histogram    histogram;  // Empty when the frame could not be measured
+        bool         cut;        // Marked by the upstream source
+    } Entry;
+
+    FrameSource&         upstream;
+    CUvideoctxlock       lock;
+    size_t               width, height;
+    size_t               lookahead;
+    double               threshold;
+    std::deque<Entry>    pending;
+    Histogram            previous;     // Of the last frame returned
+    size_t               sinceCut;     // Frames returned since the last cut (or the first frame)
+    size_t               cuts;
+    bool                 inputDone;
+    std::vector<uint8_t> rows;         // Sampled luma rows
+
+    int    Measure(const DecodedFrame&, Histogram&);
+    double Distance(const Histogram&, const Histogram&) const;
+};
+
+#endif
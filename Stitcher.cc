@@ -0,0 +1,77 @@
+#include <iostream>
+#include <string.h>
+
+#include "HevcStitcher.h"
+
+int error(const char* message, const int exitCode)
+{
+    std::cerr << message;
+    return exitCode;
+}
+
+int PrintHelp()
+{
+    std::cout << "Usage : stitcher \n"
+                    "-i <string>                  Specify tiled HEVC input (e.g., '4,8,%d.h265')\n"
+                    "-o <string>                  Specify stitched output bitstream file\n"
+                    "\n### Optional parameters ###\n"
+                    "-select <int,int,int,int>    Stitch only the tiles in <row,column,rows,columns>\n"
+                    "-help                        Prints Help Information\n\n";
+    return 1;
+}
+
+int ParseSelection(const char* argument, size_t selection[4])
+{
+    auto values = split(argument, ',');
+
+    if(values.size() != 4)
+        return error("Expected four values in tile selection (e.g., '0,2,2,4')\n", -1);
+
+    for(auto i = 0; i < 4; i++)
+        selection[i] = stoi(values.at(i));
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const char *input = NULL, *output = NULL;
+    size_t selection[4] = { 0 };
+    bool selected = false;
+    TileDimensions tileDimensions;
+    std::string filenameTemplate;
+    FILE* file;
+
+    for(auto i = 1; i < argc; i++)
+        if(!strcmp(argv[i], "-i") && i + 1 < argc)
+            input = argv[++i];
+        else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+            output = argv[++i];
+        else if(!strcmp(argv[i], "-select") && i + 1 < argc)
+        {
+            if(ParseSelection(argv[++i], selection) != 0)
+                return PrintHelp();
+            selected = true;
+        }
+        else
+            return PrintHelp();
+
+    if(!input || !output)
+        return PrintHelp();
+    else if(ParseTileDimensions(input, tileDimensions, filenameTemplate) != 0)
+        return error("ParseTileDimensions\n", -1);
+
+    HevcStitcher stitcher(tileDimensions, filenameTemplate);
+
+    if(selected && stitcher.Select(selection[0], selection[1], selection[2], selection[3]) != 0)
+        return error("Select\n", -1);
+    else if((file = fopen(output, "wb")) == NULL)
+        return error("Error opening output file\n", -1);
+    else if(stitcher.Stitch(file) != 0)
+        return fclose(file), error("Stitch\n", -1);
+    else if(fclose(file) != 0)
+        return error("Error closing output file\n", -1);
+
+    printf("Stitched Frames: %lu\n", stitcher.GetStitchedFrames());
+    return 0;
+}
@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "StreamScheduler.h"
+#include "ResourcePlan.h"
+#include "Transcode.h"
+#include "Trace.h"
+
+int LoadStreamDefinitions(const char* filename, std::vector<StreamDefinition>& definitions)
+{
+    std::ifstream file(filename);
+    std::string line;
+
+    if(!file)
+        return -1;
+
+    while(std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        StreamDefinition definition = { "", "", DEFAULT_STREAM_PRIORITY, DEFAULT_STREAM_WEIGHT };
+        std::string field;
+
+        if(!(fields >> definition.input) || definition.input[0] == '#')
+            continue;
+        else if(!(fields >> definition.output))
+        {
+            fprintf(stderr, "Expected a tile specification after %s\n", definition.input.c_str());
+            return -1;
+        }
+
+        while(fields >> field)
+            if(field.compare(0, 9, "priority=") == 0)
+                definition.priority = atoi(field.c_str() + 9);
+            else if(field.compare(0, 7, "weight=") == 0 && atoi(field.c_str() + 7) > 0)
+                definition.weight = atoi(field.c_str() + 7);
+            else
+            {
+                fprintf(stderr, "Unexpected stream attribute '%s'\n", field.c_str());
+                return -1;
+            }
+
+        definitions.push_back(definition);
+    }
+
+    return 0;
+}
+
+StreamScheduler::StreamScheduler(void* device, CUvideoctxlock lock, const EncodeConfig& configuration,
+                                 const SchedulerLimits& limits)
+    : device(device), lock(lock), configuration(configuration), limits(limits),
+      activeSessions(0), activeDeviceBytes(0), remaining(0), runStarted(0), failed(false)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&changed, NULL);
+}
+
+StreamScheduler::~StreamScheduler()
+{
+    for(auto* stream: streams)
+        delete stream;
+
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+int StreamScheduler::Add(const StreamDefinition& definition)
+{
+    auto* stream = new Stream();
+    ResourcePlan plan;
+    PipelineDepths depths = { 0, 0, -1, 0, 0 };
+    EncodeConfig planned;
+
+    stream->definition = definition;
+    stream->state = STREAM_PENDING;
+    stream->configuration = configuration;
+    stream->decoder = NULL;
+    stream->queue = NULL;
+    stream->encoder = NULL;
+    stream->input = definition.input;
+
+    if(ParseTileDimensions(definition.output, stream->dimensions, stream->outputTemplate) != 0)
+        return delete stream, -1;
+
+    // The encoder configuration refers to (and CreateEncoders expands) the stream's own filenames
+    stream->configuration.inputFileName = &stream->input[0];
+    stream->configuration.outputFileName = &stream->outputTemplate[0];
+    stream->sessions = stream->dimensions.count;
+
+    // Without -size the output has the source's size, which is read from its headers so that the stream is
+    // admitted by the memory it will actually use
+    planned = stream->configuration;
+    if((planned.width <= 0 || planned.height <= 0) &&
+       !CudaDecoder::ProbeDisplaySize(planned.inputFileName, planned.width, planned.height))
+    {
+        fprintf(stderr, "Unable to read the video format of %s\n", definition.input.c_str());
+        return delete stream, -1;
+    }
+    else if(PlanResources(planned, stream->dimensions, stream->sessions, depths, true, 0, plan) != 0)
+        return delete stream, -1;
+
+    stream->deviceBytes = plan.deviceBytes;
+
+    if(limits.sessions && stream->sessions > limits.sessions)
+    {
+        fprintf(stderr, "Stream %s needs %lu encoder sessions, more than the limit of %lu\n",
+                definition.input.c_str(), stream->sessions, limits.sessions);
+        return delete stream, -1;
+    }
+    else if(limits.deviceBytes && stream->deviceBytes > limits.deviceBytes)
+    {
+        fprintf(stderr, "Stream %s needs %lu bytes of device memory, more than the limit of %lu\n",
+                definition.input.c_str(), stream->deviceBytes, limits.deviceBytes);
+        return delete stream, -1;
+    }
+
+    streams.push_back(stream);
+    remaining++;
+    return 0;
+}
+
+int StreamScheduler::Run()
+{
+    std::vector<pthread_t> workers(std::max(limits.workers, (size_t)1));
+
+    runStarted = PipelineTuner::Now();
+
+    for(auto& worker: workers)
+        pthread_create(&worker, NULL, Worker, this);
+    for(auto& worker: workers)
+        pthread_join(worker, NULL);
+
+    return failed ? -1 : 0;
+}
+
+void* StreamScheduler::Worker(void* scheduler)
+{
+    TraceSetThreadName("worker");
+    ((StreamScheduler*)scheduler)->Work();
+
+    return NULL;
+}
+
+void StreamScheduler::Work()
+{
+    Stream* stream;
+    size_t tile;
+
+    pthread_mutex_lock(&mutex);
+
+    while(remaining > 0)
+    {
+        switch(SelectTask(stream, tile))
+        {
+            case TASK_NONE:
+                pthread_cond_wait(&changed, &mutex);
+                continue;
+
+            case TASK_START:
+            {
+                pthread_mutex_unlock(&mutex);
+                auto result = Start(*stream);
+                pthread_mutex_lock(&mutex);
+
+                if(result != 0)
+                {
+                    fprintf(stderr, "Unable to start stream %s\n", stream->definition.input.c_str());
+                    stream->error = true;
+                }
+
+                stream->state = STREAM_RUNNING;
+                stream->started = PipelineTuner::Now();
+                stream->statistics.admissionWait = stream->started - runStarted;
+                break;
+            }
+
+            case TASK_PULL:
+            {
+                FrameSlot slot;
+
+                pthread_mutex_unlock(&mutex);
+                auto pulled = Pull(*stream, slot);
+                pthread_mutex_lock(&mutex);
+
+                stream->pulling = false;
+                if(!pulled)
+                    stream->inputDone = true;
+                else if(!slot.valid)
+                    stream->decoder->ReleaseFrame(slot.frame);
+                else if(!stream->current.valid)
+                    stream->current = slot;
+                else
+                    stream->next = slot;
+                break;
+            }
+
+            case TASK_ENCODE:
+            {
+                pthread_mutex_unlock(&mutex);
+                auto status = stream->encoder->EncodeTile(tile, &stream->current.encodeConfig, stream->current.type);
+                pthread_mutex_lock(&mutex);
+
+                if(status != NV_ENC_SUCCESS)
+                {
+                    fprintf(stderr, "Encoding tile %lu of stream %s failed\n", tile, stream->definition.input.c_str());
+                    stream->error = true;
+                }
+
+                Complete(*stream);
+                break;
+            }
+
+            case TASK_FINISH:
+            {
+                pthread_mutex_unlock(&mutex);
+                auto result = Finish(*stream);
+                pthread_mutex_lock(&mutex);
+
+                Release(*stream, result != 0 || stream->error);
+                break;
+            }
+        }
+
+        pthread_cond_broadcast(&changed);
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+StreamScheduler::TaskType StreamScheduler::SelectTask(Stream*& selected, size_t& tile)
+{
+    Stream* pending = NULL;
+
+    selected = NULL;
+
+    for(auto* stream: streams)
+        if(stream->state == STREAM_PENDING && (pending == NULL || stream->definition.priority > pending->definition.priority))
+            pending = stream;
+        // Finishing releases sessions and memory, so it comes first
+        else if(stream->state == STREAM_RUNNING && !stream->pulling && stream->current.activeTiles == 0 &&
+                (stream->error || (stream->inputDone && !stream->current.valid)))
+        {
+            stream->state = STREAM_FINISHING;
+            selected = stream;
+            return TASK_FINISH;
+        }
+
+    // Streams start in order, so a large stream at the head is not starved by smaller ones behind it
+    if(pending != NULL && CanStart(*pending))
+    {
+        double virtualTime = -1;
+
+        for(auto* stream: streams)
+            if(stream->state == STREAM_RUNNING && stream->definition.priority == pending->definition.priority &&
+               (virtualTime < 0 || stream->virtualTime < virtualTime))
+                virtualTime = stream->virtualTime;
+
+        // A newly started stream shares from now on rather than catching up on the past
+        pending->virtualTime = std::max(virtualTime, 0.);
+        pending->state = STREAM_STARTING;
+        activeSessions += pending->sessions;
+        activeDeviceBytes += pending->deviceBytes;
+        selected = pending;
+        return TASK_START;
+    }
+
+    for(auto* stream: streams)
+    {
+        auto canEncode = stream->current.valid && stream->current.nextTile < stream->dimensions.count;
+        auto canPull = !stream->pulling && !stream->next.valid && !stream->inputDone;
+
+        if(stream->state != STREAM_RUNNING || stream->error || (!canEncode && !canPull))
+            continue;
+        else if(selected == NULL || stream->definition.priority > selected->definition.priority ||
+                (stream->definition.priority == selected->definition.priority &&
+                 stream->virtualTime < selected->virtualTime))
+            selected = stream;
+    }
+
+    if(selected == NULL)
+        return TASK_NONE;
+    // Encoding the frame in flight takes precedence over decoding ahead
+    else if(selected->current.valid && selected->current.nextTile < selected->dimensions.count)
+    {
+        tile = selected->current.nextTile++;
+        selected->current.activeTiles++;
+        selected->virtualTime += 1. / selected->definition.weight;
+        return TASK_ENCODE;
+    }
+
+    selected->pulling = true;
+    return TASK_PULL;
+}
+
+bool StreamScheduler::CanStart(const Stream& stream) const
+{
+    return (limits.sessions == 0 || activeSessions + stream.sessions <= limits.sessions) &&
+           (limits.deviceBytes == 0 || activeDeviceBytes + stream.deviceBytes <= limits.deviceBytes);
+}
+
+int StreamScheduler::Start(Stream& stream)
+{
+    PipelineDepths depths = { 0, 0, -1, 0, 0 };
+
+    TraceSpan span("start stream");
+
+    stream.decoder = new CudaDecoder();
+    stream.queue = new CUVIDFrameQueue(lock);
+    stream.encoder = new VideoEncoder(lock, stream.dimensions.columns, stream.dimensions.rows);
+
+    if((stream.fpsRatio = InitializeDecoder(*stream.decoder, *stream.queue, lock, stream.configuration, depths)) < 0)
+        return -1;
+    else if(stream.encoder->Initialize(device, NV_ENC_DEVICE_TYPE_CUDA) != NV_ENC_SUCCESS)
+        return -1;
+    else if(stream.encoder->CreateEncoders(stream.configuration) != NV_ENC_SUCCESS)
+        return -1;
+    else if(stream.encoder->AllocateIOBuffers(&stream.configuration) != NV_ENC_SUCCESS)
+        return -1;
+
+    stream.encoderReady = true;
+    return 0;
+}
+
+bool StreamScheduler::Pull(Stream& stream, FrameSlot& slot)
+{
+    slot.pulled = PipelineTuner::Now();
+
+    if(!stream.decoder->NextFrame(slot.frame))
+        return false;
+
+    pthread_mutex_lock(&mutex);
+    auto dropOrDuplicate = MatchFPS(stream.fpsRatio, stream.framesPulled++, stream.framesScheduled);
+    stream.framesScheduled += dropOrDuplicate + 1;
+    pthread_mutex_unlock(&mutex);
+
+    memset(&slot.encodeConfig, 0, sizeof(slot.encodeConfig));
+    slot.encodeConfig.device_pointer = slot.frame.device;
+    slot.encodeConfig.pitch = slot.frame.pitch;
+    slot.encodeConfig.width = stream.configuration.width;
+    slot.encodeConfig.height = stream.configuration.height;
+    slot.encodeConfig.frame = slot.frame.index;
+    slot.type = GetPictureStruct(slot.frame.info);
+    slot.repeats = dropOrDuplicate + 1;
+    slot.nextTile = 0;
+    slot.activeTiles = 0;
+    slot.valid = dropOrDuplicate >= 0;
+
+    return true;
+}
+
+void StreamScheduler::Complete(Stream& stream)
+{
+    auto& frame = stream.current;
+
+    if(--frame.activeTiles > 0 || frame.nextTile < stream.dimensions.count)
+        return;
+
+    stream.encoder->CompleteFrame();
+
+    // Every tile of the frame was submitted; repeat it, or move on to the frame decoded ahead
+    if(--frame.repeats > 0 && !stream.error)
+        frame.nextTile = 0;
+    else
+    {
+        auto latency = PipelineTuner::Now() - frame.pulled;
+
+        stream.statistics.latencyTotal += latency;
+        stream.statistics.latencyMaximum = std::max(stream.statistics.latencyMaximum, latency);
+        stream.statistics.latencySamples++;
+        stream.decoder->ReleaseFrame(frame.frame);
+
+        frame = stream.next;
+        stream.next.valid = false;
+    }
+}
+
+int StreamScheduler::Finish(Stream& stream)
+{
+    auto result = 0;
+
+    TraceSpan span("finish stream");
+
+    for(auto* slot: { &stream.current, &stream.next })
+        if(slot->valid)
+            stream.decoder->ReleaseFrame(slot->frame);
+
+    if(stream.encoderReady)
+    {
+        if(stream.encoder->EncodeFrame(NULL, NV_ENC_PIC_STRUCT_FRAME, true) != NV_ENC_SUCCESS)
+            result = -1;
+        stream.statistics.frames = stream.encoder->GetEncodedFrames();
+    }
+
+    if(stream.decoder != NULL && stream.decoder->HasFailed())
+        result = -1;
+
+    if(stream.encoder != NULL && stream.encoder->Deinitialize() != NV_ENC_SUCCESS)
+        result = -1;
+
+    delete stream.encoder;
+    delete stream.decoder;
+    delete stream.queue;
+    stream.encoder = NULL;
+    stream.decoder = NULL;
+    stream.queue = NULL;
+
+    return result;
+}
+
+void StreamScheduler::Release(Stream& stream, const bool failed)
+{
+    stream.state = STREAM_FINISHED;
+    stream.statistics.elapsed = PipelineTuner::Now() - stream.started;
+    stream.statistics.failed = failed;
+
+    activeSessions -= stream.sessions;
+    activeDeviceBytes -= stream.deviceBytes;
+    remaining--;
+    this->failed |= failed;
+}
+
+std::string StreamScheduler::DescribeStatistics() const
+{
+    std::ostringstream description;
+    char line[512];
+
+    for(auto* stream: streams)
+    {
+        auto& statistics = stream->statistics;
+        auto seconds = statistics.elapsed / 1e6;
+        auto samples = std::max(statistics.latencySamples, (size_t)1);
+
+        snprintf(line, sizeof(line),
+                 "%s (priority %d, weight %u): %lu frames in %.2fs (%.1f fps), latency %.1fms mean, %.1fms max, "
+                 "started after %.2fs%s\n",
+                 stream->definition.input.c_str(), stream->definition.priority, stream->definition.weight,
+                 statistics.frames, seconds, seconds > 0 ? statistics.frames / seconds : 0.,
+                 statistics.latencyTotal / 1e3 / samples, statistics.latencyMaximum / 1e3,
+                 statistics.admissionWait / 1e6, statistics.failed ? " (failed)" : "");
+        description << line;
+    }
+
+    return description.str();
+}
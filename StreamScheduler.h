@@ -0,0 +1,140 @@
+#ifndef _STREAM_SCHEDULER
+#define _STREAM_SCHEDULER
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "VideoDecoder.h"
+#include "TileVideoEncoder.h"
+
+#define DEFAULT_STREAM_PRIORITY 0
+#define DEFAULT_STREAM_WEIGHT   1
+
+// An input stream and the tiles it produces
+typedef struct StreamDefinition
+{
+    std::string  input;
+    std::string  output;    // Tile specification, as given to -o (e.g., '2,2,out%d.h264')
+    int          priority;  // Streams with work at a higher priority always run first
+    unsigned int weight;    // Share of the workers relative to other streams of equal priority
+} StreamDefinition;
+
+// Reads one stream per line: <input> <tile specification> [priority=<int>] [weight=<int>].  Blank lines and
+// those beginning with '#' are ignored.
+int LoadStreamDefinitions(const char* filename, std::vector<StreamDefinition>&);
+
+typedef struct SchedulerLimits
+{
+    size_t workers;      // Threads that decode and encode on behalf of every stream
+    size_t sessions;     // Encoder sessions open at once across streams; zero is unbounded
+    size_t deviceBytes;  // Planned device memory across running streams; zero is unbounded
+} SchedulerLimits;
+
+typedef struct StreamStatistics
+{
+    size_t             frames;         // Frames encoded (after frame-rate matching)
+    unsigned long long admissionWait;  // Microseconds between Run and the stream starting
+    unsigned long long elapsed;        // Microseconds between the stream starting and finishing
+    unsigned long long latencyTotal;   // Microseconds from pulling each frame to submitting its last tile
+    unsigned long long latencyMaximum;
+    size_t             latencySamples; // Frames encoded at least once
+    bool               failed;
+} StreamStatistics;
+
+// Runs several streams over one pool of workers.  A worker either decodes the next frame of a stream or
+// encodes one tile of the frame in flight, so the tiles of a frame are spread across workers while each
+// tile's frames stay in order.  Work is chosen by strict priority, then by weighted fair share (the stream
+// with the least tile encodes per unit of weight runs next).  Streams start in priority order once their
+// encoder sessions and planned device memory fit within the limits, and release both when they finish.
+class StreamScheduler
+{
+public:
+    StreamScheduler(void* device, CUvideoctxlock lock, const EncodeConfig& configuration, const SchedulerLimits& limits);
+    ~StreamScheduler();
+
+    int  Add(const StreamDefinition&);
+    // Returns once every stream has finished; nonzero when any stream failed
+    int  Run();
+
+    size_t                  GetStreamCount() const { return streams.size(); }
+    const StreamDefinition& GetDefinition(size_t stream) const { return streams.at(stream)->definition; }
+    const StreamStatistics& GetStatistics(size_t stream) const { return streams.at(stream)->statistics; }
+    std::string             DescribeStatistics() const;
+
+private:
+    typedef enum StreamState
+    {
+        STREAM_PENDING,
+        STREAM_STARTING,
+        STREAM_RUNNING,
+        STREAM_FINISHING,
+        STREAM_FINISHED
+    } StreamState;
+
+    // A decoded frame and the progress of its tile encodes
+    typedef struct FrameSlot
+    {
+        bool               valid;
+        DecodedFrame       frame;
+        EncodeFrameConfig  encodeConfig;
+        NV_ENC_PIC_STRUCT  type;
+        int                repeats;     // Remaining encodes of the frame (frame-rate matching)
+        size_t             nextTile;    // Next tile to be claimed
+        size_t             activeTiles; // Tiles claimed but not yet submitted
+        unsigned long long pulled;      // When decoding of the frame began
+    } FrameSlot;
+
+    typedef struct Stream
+    {
+        StreamDefinition   definition;
+        StreamState        state;
+        std::string        input, outputTemplate;  // Storage for the encoder configuration's filenames
+        EncodeConfig       configuration;
+        TileDimensions     dimensions;
+        CudaDecoder*       decoder;
+        CUVIDFrameQueue*   queue;
+        VideoEncoder*      encoder;
+        float              fpsRatio;
+        int                framesPulled;     // Decoded frames, including those dropped
+        int                framesScheduled;  // Encodes assigned to pulled frames
+        bool               encoderReady;     // Buffers are allocated, so the encoder must be flushed
+        bool               inputDone;
+        bool               error;
+        size_t             sessions;
+        size_t             deviceBytes;  // Planned before admission, from the source's size without -size
+        double             virtualTime;  // Tile encodes per unit of weight
+        bool               pulling;      // A worker is decoding the next frame
+        FrameSlot          current, next;
+        unsigned long long started;
+        StreamStatistics   statistics;
+    } Stream;
+
+    typedef enum TaskType { TASK_NONE, TASK_START, TASK_PULL, TASK_ENCODE, TASK_FINISH } TaskType;
+
+    void*                 device;
+    CUvideoctxlock        lock;
+    EncodeConfig          configuration;
+    SchedulerLimits       limits;
+    std::vector<Stream*>  streams;
+    size_t                activeSessions, activeDeviceBytes, remaining;
+    unsigned long long    runStarted;
+    bool                  failed;
+    pthread_mutex_t       mutex;
+    pthread_cond_t        changed;
+
+    static void* Worker(void*);
+    void         Work();
+    // Chooses the next task while the mutex is held
+    TaskType     SelectTask(Stream*&, size_t& tile);
+    bool         CanStart(const Stream&) const;
+    int          Start(Stream&);
+    // Decodes the next frame; false at the end of the input.  A dropped frame is returned as invalid.
+    bool         Pull(Stream&, FrameSlot&);
+    // Accounts for a submitted tile while the mutex is held, retiring the frame after its last tile
+    void         Complete(Stream&);
+    int          Finish(Stream&);
+    void         Release(Stream&, bool failed);
+};
+
+#endif
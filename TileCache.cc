@@ -0,0 +1,246 @@
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+#include "TileCache.h"
+
+#define FINGERPRINT_SPAN 1024*1024
+#define COPY_BUFFER_SIZE 1024*1024
+#define FNV_PRIME        1099511628211ull
+
+static uint64_t Hash(uint64_t hash, const void* data, const size_t size)
+{
+    for(auto i = 0u; i < size; i++)
+        hash = (hash ^ ((const uint8_t*)data)[i]) * FNV_PRIME;
+
+    return hash;
+}
+
+template<typename T>
+static uint64_t Hash(const uint64_t hash, const T& value)
+{
+    return Hash(hash, &value, sizeof(T));
+}
+
+static uint64_t Hash(const uint64_t hash, const char* value)
+{
+    return value ? Hash(hash, value, strlen(value) + 1) : Hash(hash, '\0');
+}
+
+// Fingerprints a source by its size and the bytes at its head and tail, which is enough to tell
+// apart distinct encodes without reading the whole (potentially very large) input.  Each span is read
+// once and hashed from both seeds.
+std::string FingerprintSource(const char* filename)
+{
+    std::vector<uint8_t> buffer(FINGERPRINT_SPAN);
+    uint64_t hashes[2] = { 14695981039346656037ull, 0x6c62272e07bb0142ull };
+    char fingerprint[33];
+    struct stat status;
+    size_t count;
+    FILE* file;
+
+    if(stat(filename, &status) != 0 || (file = fopen(filename, "rb")) == NULL)
+        for(auto& hash: hashes)
+            hash = Hash(hash, filename);
+    else
+    {
+        for(auto& hash: hashes)
+            hash = Hash(hash, (uint64_t)status.st_size);
+
+        count = fread(buffer.data(), 1, buffer.size(), file);
+        for(auto& hash: hashes)
+            hash = Hash(hash, buffer.data(), count);
+
+        if(status.st_size > FINGERPRINT_SPAN && fseeko(file, -FINGERPRINT_SPAN, SEEK_END) == 0)
+        {
+            count = fread(buffer.data(), 1, buffer.size(), file);
+            for(auto& hash: hashes)
+                hash = Hash(hash, buffer.data(), count);
+        }
+
+        fclose(file);
+    }
+
+    snprintf(fingerprint, sizeof(fingerprint), "%016llx%016llx", (unsigned long long)hashes[0],
+             (unsigned long long)hashes[1]);
+    return fingerprint;
+}
+
+static int CopyFile(const std::string& source, const std::string& destination)
+{
+    std::vector<char> buffer(COPY_BUFFER_SIZE);
+    FILE *input, *output;
+    size_t count;
+    auto result = 0;
+
+    if((input = fopen(source.c_str(), "rb")) == NULL)
+        return -1;
+    else if((output = fopen(destination.c_str(), "wb")) == NULL)
+        return fclose(input), -1;
+
+    while(result == 0 && (count = fread(buffer.data(), 1, buffer.size(), input)) > 0)
+        if(fwrite(buffer.data(), 1, count, output) != count)
+            result = -1;
+
+    if(ferror(input))
+        result = -1;
+    fclose(input);
+    if(fclose(output) != 0)
+        result = -1;
+
+    return result;
+}
+
+int TileCache::Open()
+{
+    DIR* handle;
+    struct dirent* entry;
+    struct stat status;
+    const std::string extension = ".tile";
+
+    if(mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        return fprintf(stderr, "Unable to create tile cache %s\n", directory.c_str()), -1;
+    else if((handle = opendir(directory.c_str())) == NULL)
+        return fprintf(stderr, "Unable to open tile cache %s\n", directory.c_str()), -1;
+
+    entries.clear();
+    statistics.occupancy = 0;
+
+    while((entry = readdir(handle)) != NULL)
+    {
+        std::string filename = entry->d_name;
+
+        if(filename.size() > extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0 &&
+           stat((directory + "/" + filename).c_str(), &status) == 0)
+        {
+            entries[filename.substr(0, filename.size() - extension.size())] = { (size_t)status.st_size, status.st_mtime };
+            statistics.occupancy += status.st_size;
+        }
+    }
+
+    closedir(handle);
+
+    // The capacity may have been lowered since the cache was last used
+    return Evict(0), 0;
+}
+
+std::string TileCache::Key(const std::string& sourceFingerprint, const EncodeConfig& configuration,
+                           const TileRect& rect, const int firstFrame, const int lastFrame,
+                           const double sceneThreshold, const size_t sceneLookahead) const
+{
+    char key[33];
+    uint64_t hashes[2] = { 14695981039346656037ull, 0x6c62272e07bb0142ull };
+
+    for(auto& hash: hashes)
+    {
+        hash = Hash(hash, sourceFingerprint.c_str());
+        hash = Hash(hash, rect.x);
+        hash = Hash(hash, rect.y);
+        hash = Hash(hash, rect.width);
+        hash = Hash(hash, rect.height);
+        hash = Hash(hash, firstFrame);
+        hash = Hash(hash, lastFrame);
+        hash = Hash(hash, configuration.width);
+        hash = Hash(hash, configuration.height);
+        hash = Hash(hash, configuration.codec);
+        hash = Hash(hash, configuration.fps);
+        hash = Hash(hash, configuration.bitrate);
+        hash = Hash(hash, configuration.vbvMaxBitrate);
+        hash = Hash(hash, configuration.vbvSize);
+        hash = Hash(hash, configuration.rcMode);
+        hash = Hash(hash, configuration.qp);
+        hash = Hash(hash, configuration.i_quant_factor);
+        hash = Hash(hash, configuration.b_quant_factor);
+        hash = Hash(hash, configuration.i_quant_offset);
+        hash = Hash(hash, configuration.b_quant_offset);
+        hash = Hash(hash, configuration.presetGUID);
+        hash = Hash(hash, configuration.encoderPreset);
+        hash = Hash(hash, configuration.gopLength);
+        hash = Hash(hash, configuration.numB);
+        hash = Hash(hash, configuration.pictureStruct);
+        hash = Hash(hash, configuration.intraRefreshEnableFlag);
+        hash = Hash(hash, configuration.intraRefreshPeriod);
+        hash = Hash(hash, configuration.intraRefreshDuration);
+        hash = Hash(hash, configuration.enableTemporalAQ);
+
+        // Left out when disabled, so that keys without scene cuts are unchanged
+        if(sceneThreshold > 0)
+        {
+            hash = Hash(hash, sceneThreshold);
+            hash = Hash(hash, sceneLookahead);
+        }
+    }
+
+    snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)hashes[0], (unsigned long long)hashes[1]);
+    return key;
+}
+
+bool TileCache::Fetch(const std::string& key, const std::string& destination)
+{
+    auto entry = entries.find(key);
+
+    if(entry == entries.end())
+        return statistics.misses++, false;
+    else if(CopyFile(EntryFilename(key), destination) != 0)
+    {
+        // Entry was removed or damaged outside of this process
+        statistics.occupancy -= entry->second.size;
+        entries.erase(entry);
+        return statistics.misses++, false;
+    }
+
+    entry->second.lastAccess = time(NULL);
+    utime(EntryFilename(key).c_str(), NULL);
+    statistics.hits++;
+
+    return true;
+}
+
+int TileCache::Store(const std::string& key, const std::string& source)
+{
+    struct stat status;
+    auto filename = EntryFilename(key);
+    auto temporary = filename + ".tmp";
+
+    if(stat(source.c_str(), &status) != 0)
+        return -1;
+    else if(Evict(status.st_size) != 0)
+        return -1;
+    else if(CopyFile(source, temporary) != 0 || rename(temporary.c_str(), filename.c_str()) != 0)
+        return unlink(temporary.c_str()), -1;
+
+    if(entries.count(key))
+        statistics.occupancy -= entries[key].size;
+    entries[key] = { (size_t)status.st_size, time(NULL) };
+    statistics.occupancy += status.st_size;
+    statistics.stores++;
+
+    return 0;
+}
+
+int TileCache::Evict(const size_t required)
+{
+    if(statistics.capacity && required > statistics.capacity)
+        return -1;
+
+    while(statistics.capacity && statistics.occupancy + required > statistics.capacity && !entries.empty())
+    {
+        auto victim = entries.begin();
+        for(auto entry = entries.begin(); entry != entries.end(); entry++)
+            if(entry->second.lastAccess < victim->second.lastAccess)
+                victim = entry;
+
+        unlink(EntryFilename(victim->first).c_str());
+        statistics.occupancy -= victim->second.size;
+        statistics.evictions++;
+        entries.erase(victim);
+    }
+
+    return 0;
+}
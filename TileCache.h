@@ -0,0 +1,68 @@
+#ifndef _TILE_CACHE
+#define _TILE_CACHE
+
+#include <map>
+#include <string>
+#include <time.h>
+
+#include "../common/inc/NvHWEncoder.h"
+
+typedef struct TileRect
+{
+    size_t x, y;
+    size_t width, height;
+} TileRect;
+
+typedef struct TileCacheStatistics
+{
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+    size_t occupancy;  // bytes
+    size_t capacity;   // bytes; zero is unbounded
+} TileCacheStatistics;
+
+// Identifies a source by its size and the bytes at its head and tail (32 hexadecimal digits).  Reads up to
+// 2MB of the source, so it is taken once per run and passed to the cache keys.
+std::string FingerprintSource(const char* filename);
+
+// A content-addressed store of encoded tiles.  Entries are keyed by a fingerprint of the source,
+// the tile rectangle, the frame range and every encode parameter that affects the bitstream, so
+// that a tile requested again (alone or as part of an overlapping tile set) is served without
+// being encoded.  When a store would exceed the capacity, least recently used entries are evicted.
+class TileCache
+{
+public:
+    TileCache(const std::string& directory, const size_t capacity) :
+        directory(directory),
+        statistics({0, 0, 0, 0, 0, capacity})
+        { }
+
+    // Scans the cache directory for existing entries; returns nonzero on failure
+    int         Open();
+    // Scene cuts force IDRs, so a positive threshold and its lookahead are keyed too
+    std::string Key(const std::string& sourceFingerprint, const EncodeConfig&, const TileRect&,
+                    int firstFrame, int lastFrame, double sceneThreshold, size_t sceneLookahead) const;
+    // Copies a cached tile to destination; returns false (and records a miss) when absent
+    bool        Fetch(const std::string& key, const std::string& destination);
+    int         Store(const std::string& key, const std::string& source);
+
+    const TileCacheStatistics& GetStatistics() const { return statistics; }
+
+private:
+    typedef struct Entry
+    {
+        size_t size;
+        time_t lastAccess;
+    } Entry;
+
+    std::string EntryFilename(const std::string& key) const { return directory + "/" + key + ".tile"; }
+    int         Evict(size_t required);
+
+    std::string                  directory;
+    std::map<std::string, Entry> entries;
+    TileCacheStatistics          statistics;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <sstream>
+
+#include "TileDimensions.h"
+
+std::vector<std::string> split(const std::string &input, char delimiter) {
+    std::vector<std::string> elements;
+    std::stringstream stream(input);
+    std::string value;
+
+    while (std::getline(stream, value, delimiter))
+        elements.push_back(value);
+
+    return elements;
+}
+
+int ParseTileDimensions(const std::string &specification, TileDimensions &dimensions, std::string &filenameTemplate)
+{
+    auto values = split(specification, ',');
+
+    if(values.size() != 3)
+    {
+        std::cerr << "Expected three arguments in tile specification (e.g., '4,8,%d.h265')\n";
+        return -1;
+    }
+    else if(values.at(2).find('%') == std::string::npos)
+    {
+        std::cerr << "Expected a '%d' placeholder in tile filename template\n";
+        return -1;
+    }
+
+    dimensions.rows = stoi(values.at(0));
+    dimensions.columns = stoi(values.at(1));
+    dimensions.count = dimensions.rows * dimensions.columns;
+    filenameTemplate = values.at(2);
+
+    return dimensions.count > 0 ? 0 : -1;
+}
+
+std::string TileFilename(const std::string &filenameTemplate, const size_t index)
+{
+    return std::string(filenameTemplate).replace(filenameTemplate.find('%'), 2, std::to_string(index));
+}
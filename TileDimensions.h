@@ -0,0 +1,23 @@
+#ifndef _TILE_DIMENSIONS
+#define _TILE_DIMENSIONS
+
+#include <string>
+#include <vector>
+
+typedef struct TileDimensions
+{
+    size_t rows;
+    size_t columns;
+    size_t count;
+} TileDimensions;
+
+std::vector<std::string> split(const std::string &input, char delimiter);
+
+// Parses a tile specification of the form "rows,columns,template" (e.g., '4,8,%d.h265')
+// Returns zero on success; on failure, writes a message to stderr and returns nonzero
+int ParseTileDimensions(const std::string &specification, TileDimensions &dimensions, std::string &filenameTemplate);
+
+// Expands the '%d' placeholder in a tile filename template with the given tile index
+std::string TileFilename(const std::string &filenameTemplate, size_t index);
+
+#endif
@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "TileIndex.h"
+#include "TileRates.h"
+
+int TileIndexWriter::Open(const std::string& filename, const long long resumeOffset)
+{
+    TileIndexHeader header = { TILE_INDEX_MAGIC, TILE_INDEX_VERSION, sizeof(TileIndexEntry), 0 };
+    TileIndexEntry entry;
+
+    Close();
+    frames = gopStart = 0;
+    ptsBase = 0;
+
+    if(resumeOffset >= 0 && (file = fopen(filename.c_str(), "r+b")) != NULL)
+    {
+        TileIndexHeader existing;
+
+        if(fread(&existing, sizeof(existing), 1, file) != 1 || memcmp(&existing, &header, sizeof(header)) != 0)
+            return fclose(file), file = NULL, -1;
+
+        // Entries are written in output order, so those for frames before the offset are a prefix
+        while(fread(&entry, sizeof(entry), 1, file) == 1 && entry.offset < (uint64_t)resumeOffset)
+        {
+            frames++;
+            gopStart = entry.gopStart;
+            ptsBase = std::max(ptsBase, entry.pts + 1);
+        }
+
+        if(ftruncate(fileno(file), sizeof(header) + (off_t)frames * sizeof(entry)) != 0 ||
+           fseeko(file, 0, SEEK_END) != 0)
+            return fclose(file), file = NULL, -1;
+
+        return 0;
+    }
+
+    if((file = fopen(filename.c_str(), "wb")) == NULL)
+        return -1;
+    else if(fwrite(&header, sizeof(header), 1, file) != 1)
+        return fclose(file), file = NULL, -1;
+
+    return 0;
+}
+
+int TileIndexWriter::Append(const uint64_t offset, const uint32_t size, const uint64_t timestamp,
+                            const TileIndexPictureType type)
+{
+    TileIndexEntry entry;
+
+    if(type == TILE_PICTURE_IDR)
+        gopStart = frames;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.offset = offset;
+    entry.pts = ptsBase + timestamp;
+    entry.frame = frames++;
+    entry.size = size;
+    entry.gopStart = gopStart;
+    entry.pictureType = type;
+
+    return fwrite(&entry, sizeof(entry), 1, file) == 1 ? 0 : -1;
+}
+
+int TileIndexWriter::Sync()
+{
+    return file == NULL || (fflush(file) == 0 && fsync(fileno(file)) == 0) ? 0 : -1;
+}
+
+int TileIndexWriter::Close()
+{
+    auto result = file != NULL && fclose(file) != 0 ? -1 : 0;
+
+    file = NULL;
+    return result;
+}
+
+int TileIndexReader::Open(const char* filename)
+{
+    struct stat status;
+    int descriptor;
+
+    Close();
+
+    if((descriptor = open(filename, O_RDONLY)) < 0)
+        return -1;
+    else if(fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(TileIndexHeader))
+        return close(descriptor), -1;
+    else if((data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0)) == MAP_FAILED)
+        return data = NULL, close(descriptor), -1;
+
+    close(descriptor);
+    length = status.st_size;
+
+    auto* header = (const TileIndexHeader*)data;
+    if(header->magic != TILE_INDEX_MAGIC || header->version != TILE_INDEX_VERSION ||
+       header->entrySize != sizeof(TileIndexEntry))
+        return Close(), -1;
+
+    // A partially-written trailing entry is ignored
+    entries = (const TileIndexEntry*)(header + 1);
+    count = (length - sizeof(TileIndexHeader)) / sizeof(TileIndexEntry);
+
+    // Decimated tiles (see TileRates.h) skip presentation indexes, so the table spans the largest of them
+    auto presentations = 0lu;
+    for(auto i = 0u; i < count; i++)
+        if(entries[i].pts < count * MAXIMUM_RATE_DIVISOR)
+            presentations = std::max(presentations, (size_t)entries[i].pts + 1);
+
+    presentation.assign(presentations, UINT32_MAX);
+    gopEnd.assign(count, count);
+    for(auto i = 0u; i < count; i++)
+    {
+        if(entries[i].pts < presentations)
+            presentation[entries[i].pts] = i;
+        if(i > 0 && entries[i].gopStart != entries[i - 1].gopStart && entries[i - 1].gopStart < count)
+            gopEnd[entries[i - 1].gopStart] = i;
+    }
+
+    return 0;
+}
+
+void TileIndexReader::Close()
+{
+    if(data != NULL)
+        munmap(data, length);
+
+    data = NULL;
+    length = 0;
+    entries = NULL;
+    count = 0;
+    presentation.clear();
+    gopEnd.clear();
+}
+
+const TileIndexEntry* TileIndexReader::FindPresentation(const uint64_t pts) const
+{
+    return pts < presentation.size() && presentation[pts] != UINT32_MAX ? &entries[presentation[pts]] : NULL;
+}
+
+bool TileIndexReader::GetFrameRange(const size_t frame, TileByteRange& range) const
+{
+    if(frame >= count)
+        return false;
+
+    range.offset = entries[frame].offset;
+    range.size = entries[frame].size;
+    return true;
+}
+
+bool TileIndexReader::GetGopRange(const size_t frame, TileByteRange& range) const
+{
+    if(frame >= count || entries[frame].gopStart >= count)
+        return false;
+
+    auto start = entries[frame].gopStart;
+    auto& last = entries[gopEnd[start] - 1];
+
+    range.offset = entries[start].offset;
+    range.size = last.offset + last.size - range.offset;
+    return true;
+}
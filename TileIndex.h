@@ -0,0 +1,104 @@
+#ifndef _TILE_INDEX
+#define _TILE_INDEX
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Sidecar index written next to each tile output (<tile output>.idx).  A 16-byte header is followed by
+// fixed-size entries in decode order, in host byte order, so that a mapped index is addressed directly.
+#define TILE_INDEX_SUFFIX  ".idx"
+#define TILE_INDEX_MAGIC   0x58444954  // "TIDX"
+#define TILE_INDEX_VERSION 1
+
+typedef enum TileIndexPictureType
+{
+    TILE_PICTURE_IDR,
+    TILE_PICTURE_I,
+    TILE_PICTURE_P,
+    TILE_PICTURE_B,
+    TILE_PICTURE_OTHER
+} TileIndexPictureType;
+
+typedef struct TileIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t reserved;
+} TileIndexHeader;
+
+typedef struct TileIndexEntry
+{
+    uint64_t offset;       // Byte offset of the frame in the tile output
+    uint64_t pts;          // Presentation index of the frame
+    uint32_t frame;        // Decode-order index of the frame (and of this entry)
+    uint32_t size;         // bytes
+    uint32_t gopStart;     // Decode-order index of the IDR that begins the frame's GOP
+    uint8_t  pictureType;  // TileIndexPictureType
+    uint8_t  reserved[3];
+} TileIndexEntry;
+
+typedef struct TileByteRange
+{
+    uint64_t offset;
+    uint64_t size;
+} TileByteRange;
+
+class TileIndexWriter
+{
+public:
+    TileIndexWriter() : file(NULL), frames(0), gopStart(0), ptsBase(0)
+        { }
+    ~TileIndexWriter()
+        { Close(); }
+
+    // Creates the index; when resuming, keeps only the entries for frames before the output offset
+    int  Open(const std::string& filename, long long resumeOffset = -1);
+    // Timestamps are output frames relative to the encoder session, which restarts at zero when resuming
+    int  Append(uint64_t offset, uint32_t size, uint64_t timestamp, TileIndexPictureType);
+    // Makes the entries written so far durable
+    int  Sync();
+    int  Close();
+    bool IsOpen() const { return file != NULL; }
+
+private:
+    FILE*    file;
+    uint32_t frames;
+    uint32_t gopStart;
+    uint64_t ptsBase;
+};
+
+// Maps an index for reading.  Open scans the entries once to tabulate GOPs and presentation order; every
+// lookup is then constant time.
+class TileIndexReader
+{
+public:
+    TileIndexReader() : data(NULL), length(0), entries(NULL), count(0)
+        { }
+    ~TileIndexReader()
+        { Close(); }
+
+    int    Open(const char* filename);
+    void   Close();
+
+    size_t GetFrameCount() const { return count; }
+    // Entry for the given decode-order frame, or NULL when out of range
+    const TileIndexEntry* GetFrame(size_t frame) const { return frame < count ? &entries[frame] : NULL; }
+    // Entry for the given presentation index, or NULL when out of range (or skipped by a decimated tile)
+    const TileIndexEntry* FindPresentation(uint64_t pts) const;
+    bool   GetFrameRange(size_t frame, TileByteRange&) const;
+    // Bytes from the IDR that begins the frame's GOP up to the next IDR (or the end of the stream)
+    bool   GetGopRange(size_t frame, TileByteRange&) const;
+
+private:
+    void*                 data;
+    size_t                length;
+    const TileIndexEntry* entries;
+    size_t                count;
+    std::vector<uint32_t> presentation;  // Decode-order frame of each presentation index
+    std::vector<uint32_t> gopEnd;        // Decode-order frame that follows each GOP, indexed by its start
+};
+
+#endif
@@ -0,0 +1,278 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "TileMetrics.h"
+#include "PlaneKernels.h"
+
+// Copies a pitch-linear NV12 frame (chroma immediately below luma) to tightly-packed host memory
+static CUresult CopyToHost(const CUdeviceptr source, const size_t pitch, uint8_t* destination,
+                           const size_t width, const size_t height)
+{
+    CUDA_MEMCPY2D parameters;
+
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.srcDevice = source;
+    parameters.srcPitch = pitch;
+    parameters.dstMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.dstHost = destination;
+    parameters.dstPitch = width;
+    parameters.WidthInBytes = width;
+    parameters.Height = height * 3 / 2;
+
+    return cuMemcpy2D(&parameters);
+}
+
+static double PSNR(const uint64_t sse, const uint64_t samples)
+{
+    return sse == 0 ? METRICS_MAXIMUM_PSNR :
+        std::min(10 * log10(255. * 255. * samples / sse), (double)METRICS_MAXIMUM_PSNR);
+}
+
+TileMetrics::TileMetrics(CUvideoctxlock lock, const size_t tiles, const size_t interval, const size_t segmentLength)
+    : lock(lock), tiles(tiles), interval(interval ? interval : 1), segmentLength(segmentLength ? segmentLength : 1),
+      width(0), height(0), codec(cudaVideoCodec_H264), file(NULL)
+{
+    for(auto i = 0u; i < tiles; i++)
+    {
+        auto& state = this->tiles[i];
+
+        state.owner = this;
+        state.tile = i;
+        state.enabled = true;
+        state.parser = NULL;
+        state.decoder = NULL;
+        state.displayed = 0;
+        memset(&state.segment, 0, sizeof(state.segment));
+    }
+}
+
+TileMetrics::~TileMetrics()
+{
+    for(auto& state: tiles)
+    {
+        if(state.parser != NULL)
+            cuvidDestroyVideoParser(state.parser);
+        if(state.decoder != NULL && cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+        {
+            cuvidDestroyDecoder(state.decoder);
+            cuvidCtxUnlock(lock, 0);
+        }
+    }
+
+    if(file != NULL)
+        fclose(file);
+}
+
+int TileMetrics::Open(const char* filename, const cudaVideoCodec codec, const size_t tileWidth,
+                      const size_t tileHeight)
+{
+    CUVIDPARSERPARAMS parameters;
+
+    this->codec = codec;
+    width = tileWidth;
+    height = tileHeight;
+    decoded.resize(width * height * 3 / 2);
+    chroma.resize(2 * width);
+
+    if((file = fopen(filename, "w")) == NULL)
+        return -1;
+
+    fprintf(file, "tile,segment,first,last,samples,psnr_y,psnr_u,psnr_v,psnr,ssim_y\n");
+
+    for(auto& state: tiles)
+    {
+        if(!state.enabled)
+            continue;
+
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.CodecType = codec;
+        parameters.ulMaxNumDecodeSurfaces = METRICS_DECODE_SURFACES;
+        parameters.ulMaxDisplayDelay = 0;
+        parameters.pUserData = &state;
+        parameters.pfnSequenceCallback = HandleSequence;
+        parameters.pfnDecodePicture = HandleDecode;
+        parameters.pfnDisplayPicture = HandleDisplay;
+
+        if(cuvidCreateVideoParser(&state.parser, &parameters) != CUDA_SUCCESS)
+            return -1;
+    }
+
+    return 0;
+}
+
+int TileMetrics::Sample(const size_t tile, const uint64_t timestamp, const CUdeviceptr source, const size_t pitch)
+{
+    auto& buffer = tiles.at(tile).sources[timestamp];
+
+    buffer.resize(width * height * 3 / 2);
+    return CopyToHost(source, pitch, buffer.data(), width, height) == CUDA_SUCCESS ? 0 : -1;
+}
+
+int TileMetrics::Decode(const size_t tile, const void* data, const size_t size)
+{
+    CUVIDSOURCEDATAPACKET packet;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.payload = (const unsigned char*)data;
+    packet.payload_size = size;
+
+    return cuvidParseVideoData(tiles.at(tile).parser, &packet) == CUDA_SUCCESS ? 0 : -1;
+}
+
+int TileMetrics::Flush()
+{
+    CUVIDSOURCEDATAPACKET packet;
+    auto result = 0;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.flags = CUVID_PKT_ENDOFSTREAM;
+
+    for(auto& state: tiles)
+        if(state.parser != NULL && cuvidParseVideoData(state.parser, &packet) != CUDA_SUCCESS)
+            result = -1;
+        else if(state.parser != NULL && Report(state) != 0)
+            result = -1;
+
+    return file != NULL && fflush(file) != 0 ? -1 : result;
+}
+
+int CUDAAPI TileMetrics::HandleSequence(void* userData, CUVIDEOFORMAT* format)
+{
+    auto& state = *(TileState*)userData;
+    auto& owner = *state.owner;
+    CUVIDDECODECREATEINFO parameters;
+    CUresult result;
+
+    if(state.decoder != NULL)
+        return 1;
+
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.CodecType = format->codec;
+    parameters.ulWidth = format->coded_width;
+    parameters.ulHeight = format->coded_height;
+    parameters.ulNumDecodeSurfaces = METRICS_DECODE_SURFACES;
+    parameters.ChromaFormat = format->chroma_format;
+    parameters.OutputFormat = cudaVideoSurfaceFormat_NV12;
+    parameters.DeinterlaceMode = cudaVideoDeinterlaceMode_Weave;
+    parameters.ulTargetWidth = owner.width;
+    parameters.ulTargetHeight = owner.height;
+    parameters.display_area.left = format->display_area.left;
+    parameters.display_area.top = format->display_area.top;
+    parameters.display_area.right = format->display_area.right;
+    parameters.display_area.bottom = format->display_area.bottom;
+    parameters.ulNumOutputSurfaces = 1;
+    parameters.ulCreationFlags = cudaVideoCreate_PreferCUVID;
+    parameters.vidLock = owner.lock;
+
+    if(cuvidCtxLock(owner.lock, 0) != CUDA_SUCCESS)
+        return 0;
+    result = cuvidCreateDecoder(&state.decoder, &parameters);
+    cuvidCtxUnlock(owner.lock, 0);
+
+    if(result != CUDA_SUCCESS)
+    {
+        fprintf(stderr, "Unable to create the metrics decoder for tile %lu (error %d)\n", state.tile, result);
+        return 0;
+    }
+
+    return 1;
+}
+
+int CUDAAPI TileMetrics::HandleDecode(void* userData, CUVIDPICPARAMS* picture)
+{
+    auto& state = *(TileState*)userData;
+
+    return state.decoder != NULL && cuvidDecodePicture(state.decoder, picture) == CUDA_SUCCESS ? 1 : 0;
+}
+
+int CUDAAPI TileMetrics::HandleDisplay(void* userData, CUVIDPARSERDISPINFO* display)
+{
+    auto& state = *(TileState*)userData;
+    auto& owner = *state.owner;
+    auto timestamp = state.displayed++;
+    auto source = state.sources.find(timestamp);
+    CUVIDPROCPARAMS parameters;
+    CUdeviceptr frame = 0;
+    unsigned int pitch;
+    CUresult result;
+
+    if(source == state.sources.end())
+        return 1;
+
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.progressive_frame = display->progressive_frame;
+    parameters.top_field_first = display->top_field_first;
+    parameters.unpaired_field = display->progressive_frame == 1 || display->repeat_first_field <= 1;
+
+    if(cuvidCtxLock(owner.lock, 0) != CUDA_SUCCESS)
+        return 0;
+    else if((result = cuvidMapVideoFrame(state.decoder, display->picture_index, &frame, &pitch, &parameters)) ==
+            CUDA_SUCCESS)
+    {
+        result = CopyToHost(frame, pitch, owner.decoded.data(), owner.width, owner.height);
+        cuvidUnmapVideoFrame(state.decoder, frame);
+    }
+    cuvidCtxUnlock(owner.lock, 0);
+
+    auto status = result == CUDA_SUCCESS ? owner.Compare(state, timestamp, source->second) : -1;
+    state.sources.erase(source);
+
+    return status == 0 ? 1 : 0;
+}
+
+int TileMetrics::Compare(TileState& state, const uint64_t timestamp, const std::vector<uint8_t>& source)
+{
+    auto& kernels = GetPlaneKernels();
+    auto& segment = state.segment;
+    auto index = timestamp / segmentLength;
+    auto chromaWidth = width / 2;
+    auto* sourceChroma = source.data() + width * height;
+    auto* decodedChroma = decoded.data() + width * height;
+
+    if(segment.samples > 0 && segment.index != index && Report(state) != 0)
+        return -1;
+    if(segment.samples == 0)
+    {
+        segment.index = index;
+        segment.first = timestamp;
+    }
+
+    segment.last = timestamp;
+    segment.samples++;
+    segment.sse[0] += PlaneSSE(source.data(), width, decoded.data(), width, width, height, kernels);
+    segment.ssim += PlaneSSIM(source.data(), width, decoded.data(), width, width, height, kernels);
+
+    // Chroma is interleaved; each row is split into U and V before comparing
+    for(auto y = 0u; y < height / 2; y++)
+    {
+        kernels.deinterleave(sourceChroma + y * width, chroma.data(), chroma.data() + chromaWidth, chromaWidth);
+        kernels.deinterleave(decodedChroma + y * width, chroma.data() + width, chroma.data() + width + chromaWidth,
+                             chromaWidth);
+        segment.sse[1] += kernels.sse(chroma.data(), chroma.data() + width, chromaWidth);
+        segment.sse[2] += kernels.sse(chroma.data() + chromaWidth, chroma.data() + width + chromaWidth, chromaWidth);
+    }
+
+    return 0;
+}
+
+int TileMetrics::Report(TileState& state)
+{
+    auto& segment = state.segment;
+    uint64_t lumaSamples = (uint64_t)width * height * segment.samples;
+    uint64_t chromaSamples = (uint64_t)(width / 2) * (height / 2) * segment.samples;
+
+    if(segment.samples == 0)
+        return 0;
+
+    fprintf(file, "%lu,%lu,%lu,%lu,%lu,%.3f,%.3f,%.3f,%.3f,%.5f\n",
+            state.tile, segment.index, segment.first, segment.last, segment.samples,
+            PSNR(segment.sse[0], lumaSamples), PSNR(segment.sse[1], chromaSamples), PSNR(segment.sse[2], chromaSamples),
+            PSNR(segment.sse[0] + segment.sse[1] + segment.sse[2], lumaSamples + 2 * chromaSamples),
+            segment.ssim / segment.samples);
+
+    memset(&segment, 0, sizeof(segment));
+    return ferror(file) ? -1 : 0;
+}
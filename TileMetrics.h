@@ -0,0 +1,82 @@
+#ifndef _TILE_METRICS
+#define _TILE_METRICS
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include "dynlink_cuda.h"    // <cuda.h>
+#include "dynlink_nvcuvid.h" // <nvcuvid.h>
+
+#define DEFAULT_METRICS_INTERVAL 30   // frames between samples
+#define DEFAULT_METRICS_SEGMENT  300  // frames aggregated into each reported row
+#define METRICS_DECODE_SURFACES  8
+#define METRICS_MAXIMUM_PSNR     100  // dB reported for a sample that matches its source exactly
+
+// Measures the quality of each tile as it is encoded.  The tile bitstream is decoded as it is written, and
+// every sampled frame is compared against the source copy made when it was submitted; frames that are not
+// sampled are decoded (so that references stay valid) but never leave the device.
+//
+// Results are appended to a CSV file, one row per tile and segment of frames:
+//     tile,segment,first,last,samples,psnr_y,psnr_u,psnr_v,psnr,ssim_y
+// PSNR is computed from the squared error summed over the samples of a segment; SSIM is their mean.
+class TileMetrics
+{
+public:
+    TileMetrics(CUvideoctxlock lock, size_t tiles, size_t interval = DEFAULT_METRICS_INTERVAL,
+                size_t segmentLength = DEFAULT_METRICS_SEGMENT);
+    ~TileMetrics();
+
+    int  Open(const char* filename, cudaVideoCodec codec, size_t tileWidth, size_t tileHeight);
+    // Only enabled tiles create a decoder
+    void SetTileEnabled(size_t tile, bool enabled) { tiles.at(tile).enabled = enabled; }
+
+    bool IsSampled(uint64_t timestamp) const { return timestamp % interval == 0; }
+    // Copies the NV12 source of a sampled frame to the host; the caller holds the context lock
+    int  Sample(size_t tile, uint64_t timestamp, CUdeviceptr source, size_t pitch);
+    // Decodes the next access unit of a tile output, in output order
+    int  Decode(size_t tile, const void* data, size_t size);
+    // Drains every decoder and reports the final segment of each tile
+    int  Flush();
+
+private:
+    typedef struct Segment
+    {
+        uint64_t index;
+        uint64_t first, last;
+        size_t   samples;
+        uint64_t sse[3];   // Y, U, V
+        double   ssim;     // Sum over samples
+    } Segment;
+
+    typedef struct TileState
+    {
+        TileMetrics*    owner;
+        size_t          tile;
+        bool            enabled;
+        CUvideoparser   parser;
+        CUvideodecoder  decoder;
+        uint64_t        displayed;  // Presentation index of the next decoded frame
+        std::map<uint64_t, std::vector<uint8_t> > sources;  // Tightly-packed NV12, by timestamp
+        Segment         segment;
+    } TileState;
+
+    CUvideoctxlock         lock;
+    std::vector<TileState> tiles;
+    size_t                 interval, segmentLength;
+    size_t                 width, height;
+    cudaVideoCodec         codec;
+    FILE*                  file;
+    std::vector<uint8_t>   decoded;
+    std::vector<uint8_t>   chroma;   // Deinterleaved U and V rows of the source and decoded frames
+
+    static int CUDAAPI HandleSequence(void*, CUVIDEOFORMAT*);
+    static int CUDAAPI HandleDecode(void*, CUVIDPICPARAMS*);
+    static int CUDAAPI HandleDisplay(void*, CUVIDPARSERDISPINFO*);
+
+    int  Compare(TileState&, uint64_t timestamp, const std::vector<uint8_t>& source);
+    int  Report(TileState&);
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include <string.h>
+
+#include "TilePyramid.h"
+#include "PlaneKernels.h"
+#include "Trace.h"
+
+TilePyramid::TilePyramid(CUvideoctxlock lock, const TileDimensions& finest, const size_t width, const size_t height,
+                         const size_t levels)
+    : lock(lock), width(width), height(height), levels(levels), frame(NULL)
+{
+    for(auto i = 0u; i < levels; i++)
+    {
+        auto& level = this->levels[i];
+
+        level.dimensions.rows = finest.rows >> (i + 1);
+        level.dimensions.columns = finest.columns >> (i + 1);
+        level.dimensions.count = level.dimensions.rows * level.dimensions.columns;
+        level.width = width >> (i + 1);
+        level.height = height >> (i + 1);
+        level.encoder = NULL;
+        level.created = false;
+        level.host = NULL;
+        level.device = 0;
+        level.pitch = 0;
+    }
+}
+
+TilePyramid::~TilePyramid()
+{
+    if(cuvidCtxLock(lock, 0) == CUDA_SUCCESS)
+    {
+        for(auto& level: levels)
+        {
+            if(level.host != NULL)
+                cuMemFreeHost(level.host);
+            if(level.device != 0)
+                cuMemFree(level.device);
+        }
+        if(frame != NULL)
+            cuMemFreeHost(frame);
+        cuvidCtxUnlock(lock, 0);
+    }
+
+    for(auto& level: levels)
+        delete level.encoder;
+}
+
+bool TilePyramid::IsDivisible(const TileDimensions& dimensions, const size_t width, const size_t height,
+                              const size_t levels)
+{
+    auto scale = 1u << levels;
+
+    // Chroma halves once more than luma
+    return dimensions.rows % scale == 0 && dimensions.columns % scale == 0 &&
+           width % (2 * scale) == 0 && height % (2 * scale) == 0;
+}
+
+std::string TilePyramid::LevelTemplate(const std::string& filenameTemplate, const size_t level)
+{
+    auto placeholder = filenameTemplate.find('%');
+
+    return std::string(filenameTemplate).insert(placeholder, "L" + std::to_string(level) + "-");
+}
+
+size_t TilePyramid::GetSessions(const TileDimensions& dimensions, const size_t levels)
+{
+    auto sessions = 0lu;
+
+    for(auto i = 1u; i <= levels; i++)
+        sessions += (dimensions.rows >> i) * (dimensions.columns >> i);
+
+    return sessions;
+}
+
+size_t TilePyramid::GetFrameBytes(const size_t width, const size_t height, const size_t levels)
+{
+    auto bytes = 0lu;
+
+    for(auto i = 1u; i <= levels; i++)
+        bytes += (width >> i) * (height >> i) * 3 / 2;
+
+    return bytes;
+}
+
+int TilePyramid::Create(CUcontext context, const EncodeConfig& configuration, const size_t encodeBuffers,
+                        const bool frameIndex)
+{
+    CUresult result;
+
+    if((result = cuvidCtxLock(lock, 0)) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemAllocHost((void**)&frame, width * height * 3 / 2);
+    for(auto i = 0u; i < levels.size() && result == CUDA_SUCCESS; i++)
+    {
+        auto& level = levels[i];
+
+        if((result = cuMemAllocHost((void**)&level.host, level.width * level.height * 3 / 2)) == CUDA_SUCCESS)
+            result = cuMemAllocPitch(&level.device, &level.pitch, level.width, level.height * 3 / 2, 16);
+    }
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+
+    for(auto i = 0u; i < levels.size(); i++)
+    {
+        auto& level = levels[i];
+        auto levelConfiguration = configuration;
+
+        // CreateEncoders expands (and so must see) this level's own template
+        level.outputTemplate = LevelTemplate(configuration.outputFileName, i + 1);
+        levelConfiguration.outputFileName = &level.outputTemplate[0];
+        levelConfiguration.width = level.width;
+        levelConfiguration.height = level.height;
+        level.encoder = new VideoEncoder(lock, level.dimensions.columns, level.dimensions.rows);
+
+        if(frameIndex)
+            level.encoder->EnableFrameIndex();
+
+        if(level.encoder->Initialize(context, NV_ENC_DEVICE_TYPE_CUDA) != NV_ENC_SUCCESS)
+            return -1;
+        else if(!(level.created = level.encoder->CreateEncoders(levelConfiguration) == NV_ENC_SUCCESS))
+            return -1;
+        else if(level.encoder->AllocateIOBuffers(&levelConfiguration, encodeBuffers) != NV_ENC_SUCCESS)
+            return -1;
+    }
+
+    return 0;
+}
+
+int TilePyramid::Upload(const Level& level)
+{
+    CUDA_MEMCPY2D parameters;
+    CUresult result;
+
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.srcHost = level.host;
+    parameters.srcPitch = level.width;
+    parameters.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.dstDevice = level.device;
+    parameters.dstPitch = level.pitch;
+    parameters.WidthInBytes = level.width;
+    parameters.Height = level.height * 3 / 2;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    return result == CUDA_SUCCESS ? 0 : -1;
+}
+
+int TilePyramid::EncodeFrame(const EncodeFrameConfig& input, const NV_ENC_PIC_STRUCT type)
+{
+    TraceSpan span("pyramid", input.frame);
+    CUDA_MEMCPY2D parameters;
+    CUresult result;
+    auto* source = frame;
+    auto sourcePitch = width, sourceHeight = height;
+
+    // The chroma plane follows the luma rows at the same pitch, so one copy takes both
+    memset(&parameters, 0, sizeof(parameters));
+    parameters.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+    parameters.srcDevice = input.device_pointer;
+    parameters.srcPitch = input.pitch;
+    parameters.dstMemoryType = CU_MEMORYTYPE_HOST;
+    parameters.dstHost = frame;
+    parameters.dstPitch = width;
+    parameters.WidthInBytes = width;
+    parameters.Height = height * 3 / 2;
+
+    if(cuvidCtxLock(lock, 0) != CUDA_SUCCESS)
+        return -1;
+    result = cuMemcpy2D(&parameters);
+    cuvidCtxUnlock(lock, 0);
+
+    if(result != CUDA_SUCCESS)
+        return -1;
+
+    for(auto& level: levels)
+    {
+        auto levelFrame = input;
+
+        DownscalePlane2x(source, sourcePitch, level.host, level.width, level.width, level.height, false);
+        DownscalePlane2x(source + sourceHeight * sourcePitch, sourcePitch, level.host + level.height * level.width,
+                         level.width, level.width / 2, level.height / 2, true);
+
+        levelFrame.device_pointer = level.device;
+        levelFrame.pitch = level.pitch;
+        levelFrame.width = level.width;
+        levelFrame.height = level.height;
+        levelFrame.checkpoint = NULL;
+
+        if(Upload(level) != 0)
+            return -1;
+        else if(level.encoder->EncodeFrame(&levelFrame, type) != NV_ENC_SUCCESS)
+            return -1;
+
+        source = level.host;
+        sourcePitch = level.width;
+        sourceHeight = level.height;
+    }
+
+    return 0;
+}
+
+int TilePyramid::Flush()
+{
+    for(auto& level: levels)
+        if(level.created && level.encoder->EncodeFrame(NULL, NV_ENC_PIC_STRUCT_FRAME, true) != NV_ENC_SUCCESS)
+            return -1;
+
+    return 0;
+}
+
+int TilePyramid::Deinitialize()
+{
+    auto status = 0;
+
+    for(auto& level: levels)
+        if(level.created && level.encoder->Deinitialize() != NV_ENC_SUCCESS)
+            status = -1;
+
+    return status;
+}
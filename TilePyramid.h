@@ -0,0 +1,63 @@
+#ifndef _TILE_PYRAMID
+#define _TILE_PYRAMID
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "TileVideoEncoder.h"
+
+#define MAXIMUM_PYRAMID_LEVELS 4
+
+// Coarser tile grids encoded alongside the finest (level 0, the grid given with -o) from the same decoded
+// frame.  Each level halves the rows, columns and resolution of the one above it, so tiles are the same size
+// at every level.  A frame is copied to the host once; each level is then downscaled (2x2 box, see
+// DownscalePlane2x) from the level above it rather than from the frame, and uploaded once for its encoder to
+// crop tiles from.
+//
+// Level outputs are named after the finest template with the level inserted before the index, e.g.
+// "tile-%d.h265" becomes "tile-L1-%d.h265".  Tile selection, rate allocation, live deadlines, rings and
+// sinks apply to the finest level only.
+class TilePyramid
+{
+public:
+    TilePyramid(CUvideoctxlock lock, const TileDimensions& finest, size_t width, size_t height, size_t levels);
+    ~TilePyramid();
+
+    // Whether the grid and frame halve evenly (in luma and chroma) at every level
+    static bool        IsDivisible(const TileDimensions&, size_t width, size_t height, size_t levels);
+    static std::string LevelTemplate(const std::string& filenameTemplate, size_t level);
+    // Encoder sessions, and the bytes of the downscaled frames (on the host and again on the device)
+    static size_t      GetSessions(const TileDimensions&, size_t levels);
+    static size_t      GetFrameBytes(size_t width, size_t height, size_t levels);
+
+    // Opens an encoder per level, configured as the finest apart from its size and outputs
+    int    Create(CUcontext, const EncodeConfig&, size_t encodeBuffers, bool frameIndex);
+    int    EncodeFrame(const EncodeFrameConfig&, NV_ENC_PIC_STRUCT type);
+    int    Flush();
+    int    Deinitialize();
+
+    size_t GetLevelCount() const { return levels.size(); }
+
+private:
+    typedef struct Level
+    {
+        TileDimensions dimensions;
+        size_t         width, height;
+        std::string    outputTemplate;
+        VideoEncoder*  encoder;
+        bool           created;  // Its encoders exist, and must be destroyed
+        uint8_t*       host;     // NV12 with a pitch of width
+        CUdeviceptr    device;
+        size_t         pitch;
+    } Level;
+
+    CUvideoctxlock     lock;
+    size_t             width, height;
+    std::vector<Level> levels;
+    uint8_t*           frame;    // The finest level, copied from the decoded surface
+
+    int Upload(const Level&);
+};
+
+#endif
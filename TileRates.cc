@@ -0,0 +1,80 @@
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include "TileRates.h"
+#include "TileDimensions.h"
+
+static bool IsValidDivisor(const unsigned int divisor)
+{
+    return divisor > 0 && divisor <= MAXIMUM_RATE_DIVISOR && (divisor & (divisor - 1)) == 0;
+}
+
+int ParseTileRates(const char* argument, std::vector<TileRateDivisor>& rates)
+{
+    unsigned int tile, divisor;
+    char trailing;
+
+    rates.clear();
+
+    for(auto& value: split(argument, ','))
+        if(sscanf(value.c_str(), "%u=%u%c", &tile, &divisor, &trailing) == 2 && IsValidDivisor(divisor))
+            rates.push_back({ tile, divisor });
+        else
+            return -1;
+
+    return rates.empty() ? -1 : 0;
+}
+
+int LoadViewMap(const char* filename, const size_t tiles, std::vector<double>& probabilities)
+{
+    FILE* file;
+    double probability;
+    char trailing;
+
+    if((file = fopen(filename, "r")) == NULL)
+        return -1;
+
+    probabilities.clear();
+    while(fscanf(file, "%lf", &probability) == 1)
+        if(probability < 0)
+            return fclose(file), -1;
+        else
+            probabilities.push_back(probability);
+
+    // Anything other than whitespace after the last probability is malformed
+    auto complete = fscanf(file, " %c", &trailing) == EOF;
+
+    fclose(file);
+    return complete && probabilities.size() == tiles ? 0 : -1;
+}
+
+void GetViewMapDivisors(const std::vector<double>& probabilities, const unsigned int maximum,
+                        std::vector<unsigned int>& divisors)
+{
+    auto mean = std::accumulate(probabilities.begin(), probabilities.end(), 0.) / probabilities.size();
+
+    divisors.assign(probabilities.size(), 1);
+
+    for(auto i = 0u; i < probabilities.size() && mean > 0; i++)
+        if(probabilities[i] <= 0)
+            divisors[i] = maximum;
+        else if(probabilities[i] < mean)
+            divisors[i] = std::min(maximum, 1u << (unsigned int)floor(log2(mean / probabilities[i])));
+}
+
+double GetEncodedFraction(const std::vector<unsigned int>& divisors, const std::vector<bool>& enabled)
+{
+    auto encoded = 0., total = 0.;
+
+    for(auto i = 0u; i < divisors.size(); i++)
+        if(enabled[i])
+        {
+            encoded += 1. / divisors[i];
+            total++;
+        }
+
+    return total > 0 ? encoded / total : 1;
+}
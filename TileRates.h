@@ -0,0 +1,30 @@
+#ifndef _TILE_RATES
+#define _TILE_RATES
+
+#include <string>
+#include <vector>
+
+// Temporal decimation of rarely-viewed tiles (e.g., the poles and rear of a 360° frame).  A tile with a
+// divisor of d is encoded on every d-th output frame, at 1/d of the frame rate and bitrate, and is neither
+// copied nor encoded in between.  Its outputs carry the presentation index of each frame on the full-rate
+// timeline, so a player holds each decimated frame for d frames.
+#define MAXIMUM_RATE_DIVISOR 8
+
+typedef struct TileRateDivisor
+{
+    size_t       tile;
+    unsigned int divisor;  // A power of two, up to MAXIMUM_RATE_DIVISOR
+} TileRateDivisor;
+
+// Parses "<tile>=<divisor>,..." (e.g., "0=4,1=4,6=2")
+int    ParseTileRates(const char* argument, std::vector<TileRateDivisor>&);
+// Reads a view probability for each tile in raster order, separated by whitespace (e.g., one grid row per
+// line); the probabilities are relative and need not sum to one
+int    LoadViewMap(const char* filename, size_t tiles, std::vector<double>& probabilities);
+// Halves the rate of a tile for every halving of its probability below the mean, up to the given divisor
+void   GetViewMapDivisors(const std::vector<double>& probabilities, unsigned int maximum,
+                          std::vector<unsigned int>& divisors);
+// Fraction of the full-rate tile frames that remain to be encoded
+double GetEncodedFraction(const std::vector<unsigned int>& divisors, const std::vector<bool>& enabled);
+
+#endif
@@ -0,0 +1,229 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "TileRing.h"
+
+// Shared between processes, so the futex operations are not FUTEX_PRIVATE_FLAG
+static long Futex(volatile uint32_t* word, const int operation, const uint32_t value, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, word, operation, value, timeout, NULL, 0);
+}
+
+static uint64_t MonotonicMicroseconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+std::string TileRingName(const std::string& name, const size_t tile)
+{
+    return "/" + name + "-" + std::to_string(tile);
+}
+
+int TileRingWriter::Open(const std::string& name, const size_t capacity, const size_t tile)
+{
+    int descriptor;
+
+    Close();
+    frames = position = 0;
+    length = sizeof(TileRingHeader) + capacity;
+
+    shm_unlink(name.c_str());
+    if((descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644)) < 0)
+        return -1;
+    else if(ftruncate(descriptor, length) != 0)
+        return close(descriptor), shm_unlink(name.c_str()), -1;
+    else if((header = (TileRingHeader*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0)) ==
+            MAP_FAILED)
+        return header = NULL, close(descriptor), shm_unlink(name.c_str()), -1;
+
+    close(descriptor);
+    this->name = name;
+
+    header->version = TILE_RING_VERSION;
+    header->capacity = capacity;
+    header->slots = TILE_RING_SLOTS;
+    header->tile = tile;
+    for(auto& slot: header->descriptors)
+        slot.sequence = UINT64_MAX;
+    // Readers check the magic before anything else
+    __atomic_store_n(&header->magic, TILE_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int TileRingWriter::Publish(const void* data, const uint32_t size, const uint64_t pts, const TileIndexPictureType type)
+{
+    auto capacity = header->capacity;
+    auto& descriptor = header->descriptors[frames & (TILE_RING_SLOTS - 1)];
+
+    if(size > capacity)
+        return -1;
+
+    // Payloads are contiguous; one that would wrap starts at the beginning of the ring instead
+    if(position % capacity + size > capacity)
+        position += capacity - position % capacity;
+
+    // Retire the bytes and descriptor about to be reused before either is touched
+    if(position + size > capacity)
+        __atomic_store_n(&header->floor, position + size - capacity, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&descriptor.sequence, UINT64_MAX, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy((uint8_t*)(header + 1) + position % capacity, data, size);
+    descriptor.position = position;
+    descriptor.pts = pts;
+    descriptor.published = MonotonicMicroseconds();
+    descriptor.size = size;
+    descriptor.pictureType = type;
+    __atomic_store_n(&descriptor.sequence, frames, __ATOMIC_RELEASE);
+
+    position += size;
+    __atomic_store_n(&header->head, ++frames, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->notify, (uint32_t)frames, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&header->waiters, __ATOMIC_SEQ_CST) > 0)
+        Futex(&header->notify, FUTEX_WAKE, INT_MAX, NULL);
+
+    return 0;
+}
+
+int TileRingWriter::Close()
+{
+    if(header == NULL)
+        return 0;
+
+    // Changing the futex word keeps a reader that is about to wait from sleeping through the close
+    __atomic_store_n(&header->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&header->notify, 1, __ATOMIC_SEQ_CST);
+    Futex(&header->notify, FUTEX_WAKE, INT_MAX, NULL);
+
+    auto result = munmap(header, length) == 0 && shm_unlink(name.c_str()) == 0 ? 0 : -1;
+    header = NULL;
+    return result;
+}
+
+int TileRingReader::Open(const std::string& name)
+{
+    struct stat status;
+    int descriptor;
+
+    Close();
+
+    // Waiting registers in the header, so the mapping is writable
+    if((descriptor = shm_open(name.c_str(), O_RDWR, 0)) < 0)
+        return -1;
+    else if(fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(TileRingHeader))
+        return close(descriptor), -1;
+    else if((header = (TileRingHeader*)mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor,
+                                            0)) == MAP_FAILED)
+        return header = NULL, close(descriptor), -1;
+
+    close(descriptor);
+    length = status.st_size;
+
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != TILE_RING_MAGIC ||
+       header->version != TILE_RING_VERSION || header->slots != TILE_RING_SLOTS ||
+       sizeof(TileRingHeader) + header->capacity > length)
+        return Close(), -1;
+
+    Resume(TILE_RING_RESUME_OLDEST);
+    return 0;
+}
+
+void TileRingReader::Close()
+{
+    if(header != NULL)
+        munmap(header, length);
+
+    header = NULL;
+    length = 0;
+    cursor = 0;
+}
+
+bool TileRingReader::Read(const uint64_t sequence, TileRingFrame& frame) const
+{
+    auto& descriptor = header->descriptors[sequence & (TILE_RING_SLOTS - 1)];
+
+    if(__atomic_load_n(&descriptor.sequence, __ATOMIC_ACQUIRE) != sequence)
+        return false;
+
+    frame.sequence = sequence;
+    frame.position = descriptor.position;
+    frame.pts = descriptor.pts;
+    frame.published = descriptor.published;
+    frame.pictureType = (TileIndexPictureType)descriptor.pictureType;
+    frame.size = descriptor.size;
+    frame.data = GetData() + frame.position % header->capacity;
+
+    // The descriptor was not rewritten while it was copied, and its payload is intact
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&descriptor.sequence, __ATOMIC_RELAXED) == sequence && Validate(frame);
+}
+
+bool TileRingReader::Validate(const TileRingFrame& frame) const
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return frame.position >= __atomic_load_n(&header->floor, __ATOMIC_ACQUIRE);
+}
+
+void TileRingReader::Resume(const TileRingOverrunPolicy policy)
+{
+    auto head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    TileRingFrame frame;
+
+    if(policy == TILE_RING_RESUME_LATEST)
+        cursor = head > 0 ? head - 1 : 0;
+    else
+        for(cursor = head > TILE_RING_SLOTS ? head - TILE_RING_SLOTS : 0; cursor < head && !Read(cursor, frame);)
+            cursor++;
+}
+
+TileRingStatus TileRingReader::Next(TileRingFrame& frame, const int timeout)
+{
+    struct timespec interval = { timeout / 1000, (timeout % 1000) * 1000000l };
+
+    if(header == NULL)
+        return TILE_RING_ERROR;
+
+    while(true)
+    {
+        auto head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+        if(cursor < head)
+        {
+            if(head - cursor > TILE_RING_SLOTS || !Read(cursor, frame))
+                return Resume(policy), TILE_RING_OVERRUN;
+
+            cursor++;
+            return TILE_RING_OK;
+        }
+        else if(__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE))
+            return TILE_RING_END;
+        else if(timeout == 0)
+            return TILE_RING_TIMEOUT;
+
+        // The kernel sleeps only while the futex word still matches the head observed above
+        __atomic_add_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+        auto result = Futex(&header->notify, FUTEX_WAIT, (uint32_t)head, timeout < 0 ? NULL : &interval);
+        auto timedOut = result != 0 && errno == ETIMEDOUT;
+        __atomic_sub_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+
+        if(timedOut)
+            return TILE_RING_TIMEOUT;
+    }
+}
+
+uint64_t TileRingReader::GetBacklog() const
+{
+    return header != NULL ? __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) - cursor : 0;
+}
@@ -0,0 +1,138 @@
+#ifndef _TILE_RING
+#define _TILE_RING
+
+#include <stdint.h>
+#include <string>
+
+#include "TileIndex.h"
+
+// Shared-memory ring through which a tile's encoded frames are published to co-located consumers
+// (shm_open("/<name>-<tile>")).  The object holds a header, a ring of frame descriptors and a ring of
+// payload bytes; each payload is contiguous, so a reader addresses it in place.  The writer never waits:
+// it overwrites the oldest frames, and a reader that falls behind is told that it was overrun and resumes
+// according to its policy.  Readers block on a futex in the header until the next frame is published.
+//
+// Link TileRing.o (or libtilering.a) and use TileRingReader:
+//     TileRingReader reader;
+//     TileRingFrame frame;
+//     reader.Open(TileRingName("tiles", 3));
+//     while((status = reader.Next(frame, 1000)) != TILE_RING_END)
+//         if(status == TILE_RING_OK && reader.Validate(frame))  // Validate once finished with frame.data
+//             ...
+#define TILE_RING_MAGIC         0x474E5254  // "TRNG"
+#define TILE_RING_VERSION       1
+#define TILE_RING_SLOTS         1024        // Frame descriptors; a power of two
+#define DEFAULT_TILE_RING_BYTES (8 << 20)   // Payload bytes per tile
+
+typedef struct TileRingDescriptor
+{
+    volatile uint64_t sequence;     // Frame number, written last; all ones while the descriptor is rewritten
+    uint64_t          position;     // Ring byte position of the payload (offset is position % capacity)
+    uint64_t          pts;          // Presentation index of the frame
+    uint64_t          published;    // CLOCK_MONOTONIC microseconds when the frame was published
+    uint32_t          size;         // bytes
+    uint8_t           pictureType;  // TileIndexPictureType
+    uint8_t           reserved[3];
+} TileRingDescriptor;
+
+typedef struct TileRingHeader
+{
+    uint32_t           magic;
+    uint32_t           version;
+    uint64_t           capacity;      // Payload bytes
+    uint32_t           slots;
+    uint32_t           tile;
+    volatile uint64_t  head;          // Frames published
+    volatile uint64_t  floor;         // Lowest ring byte position that has not been (or is not being) overwritten
+    volatile uint32_t  notify;        // Futex word: the low bits of head
+    volatile uint32_t  waiters;
+    volatile uint32_t  closed;        // The writer has published its last frame
+    uint32_t           reserved;
+    TileRingDescriptor descriptors[TILE_RING_SLOTS];
+} TileRingHeader;
+
+// A published frame, addressed in the reader's mapping
+typedef struct TileRingFrame
+{
+    uint64_t             sequence;
+    uint64_t             position;
+    uint64_t             pts;
+    uint64_t             published;
+    TileIndexPictureType pictureType;
+    const uint8_t*       data;
+    uint32_t             size;
+} TileRingFrame;
+
+typedef enum TileRingStatus
+{
+    TILE_RING_OK,
+    TILE_RING_TIMEOUT,
+    TILE_RING_OVERRUN,  // Frames were overwritten before they were read; the next call resumes per policy
+    TILE_RING_END,      // The writer closed the ring and every remaining frame has been read
+    TILE_RING_ERROR
+} TileRingStatus;
+
+typedef enum TileRingOverrunPolicy
+{
+    TILE_RING_RESUME_OLDEST,  // Continue from the oldest frame still in the ring
+    TILE_RING_RESUME_LATEST   // Skip to the most recent frame
+} TileRingOverrunPolicy;
+
+std::string TileRingName(const std::string& name, size_t tile);
+
+class TileRingWriter
+{
+public:
+    TileRingWriter() : header(NULL), length(0), frames(0), position(0)
+        { }
+    ~TileRingWriter()
+        { Close(); }
+
+    // Replaces any ring of the same name
+    int  Open(const std::string& name, size_t capacity, size_t tile);
+    // Fails only when the frame exceeds the ring
+    int  Publish(const void* data, uint32_t size, uint64_t pts, TileIndexPictureType);
+    // Marks the ring closed and removes its name; attached readers drain what remains
+    int  Close();
+    bool IsOpen() const { return header != NULL; }
+
+private:
+    TileRingHeader* header;
+    size_t          length;
+    uint64_t        frames;
+    uint64_t        position;  // Ring byte position of the next payload
+    std::string     name;
+};
+
+class TileRingReader
+{
+public:
+    TileRingReader(TileRingOverrunPolicy policy = TILE_RING_RESUME_OLDEST)
+        : header(NULL), length(0), cursor(0), policy(policy)
+        { }
+    ~TileRingReader()
+        { Close(); }
+
+    // Starts from the oldest frame in the ring
+    int            Open(const std::string& name);
+    void           Close();
+
+    // Waits up to the given milliseconds (negative waits indefinitely) for the next frame
+    TileRingStatus Next(TileRingFrame&, int timeout);
+    // True when the frame's payload was not overwritten while it was in use
+    bool           Validate(const TileRingFrame&) const;
+    // Frames published but not yet read
+    uint64_t       GetBacklog() const;
+
+private:
+    TileRingHeader*       header;
+    size_t                length;
+    uint64_t              cursor;  // Next frame to read
+    TileRingOverrunPolicy policy;
+
+    const uint8_t* GetData() const { return (const uint8_t*)(header + 1); }
+    bool           Read(uint64_t sequence, TileRingFrame&) const;
+    void           Resume(TileRingOverrunPolicy);
+};
+
+#endif
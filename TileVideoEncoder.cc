@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <string>
-#include "VideoEncoder.h"
+#include <string.h>
+#include <unistd.h>
+#include "TileVideoEncoder.h"
+#include "LiveMode.h"
+#include "RateAllocator.h"
+#include "Trace.h"
+#include "PipelineTuner.h"
 #include "dynlink_cuda.h" // <cuda.h>
 
-#define BITSTREAM_BUFFER_SIZE 2*1024*1024
-
 template<typename TCode, typename TReturn>
 TReturn error(const char* component, const TCode code, const TReturn result)
 {
@@ -22,12 +27,39 @@ NVENCSTATUS VideoEncoder::Initialize(void* device, const NV_ENC_DEVICE_TYPE devi
     NVENCSTATUS status;
 
     for(TileEncodeContext& context: tileEncodeContext)
-        if((status = context.hardwareEncoder.Initialize(device, deviceType)) != NV_ENC_SUCCESS)
+        if(context.enabled && (status = context.hardwareEncoder.Initialize(device, deviceType)) != NV_ENC_SUCCESS)
             return status;
 
     return NV_ENC_SUCCESS;
 }
 
+size_t VideoEncoder::GetEnabledTileCount() const
+{
+    size_t count = 0;
+
+    for(const TileEncodeContext& context: tileEncodeContext)
+        count += context.enabled ? 1 : 0;
+
+    return count;
+}
+
+int VideoEncoder::EnableRing(const char* name, const size_t bytes)
+{
+    if(bytes < BITSTREAM_BUFFER_SIZE)
+        return -1;
+
+    ringName = name;
+    ringBytes = bytes;
+    return 0;
+}
+
+bool VideoEncoder::IsTileDue(const size_t index) const
+{
+    auto& context = tileEncodeContext.at(index);
+
+    return context.enabled && (framesEncoded - context.ratePhase) % context.rateDivisor == 0;
+}
+
 NVENCSTATUS VideoEncoder::CreateEncoders(EncodeConfig& rootConfiguration)
 {
     NVENCSTATUS status;
@@ -38,13 +70,46 @@ NVENCSTATUS VideoEncoder::CreateEncoders(EncodeConfig& rootConfiguration)
     for(int i = 0; i < tileDimensions.count; i++)
         {
         auto tileConfiguration = rootConfiguration;
-        auto tileFilename = std::string(filenameTemplate).replace(filenameTemplate.find('%'), 2, std::to_string(i));
+        auto tileFilename = TileFilename(filenameTemplate, i);
 
         tileConfiguration.width = rootConfiguration.width / tileDimensions.columns;
         tileConfiguration.height = rootConfiguration.height / tileDimensions.rows;
 
-        if((tileConfiguration.fOutput = fopen(tileFilename.c_str(), "wb")) == NULL)
+        // A decimated tile is rate controlled at its own frame rate, with GOPs spanning the same time as the
+        // others so that their IDRs stay aligned (the caller ensures that the frame rate and GOP divide evenly)
+        if(tileEncodeContext[i].rateDivisor > 1)
+        {
+            auto divisor = (int)tileEncodeContext[i].rateDivisor;
+
+            tileConfiguration.fps = rootConfiguration.fps / divisor;
+            tileConfiguration.bitrate = rootConfiguration.bitrate / divisor;
+            tileConfiguration.vbvMaxBitrate = rootConfiguration.vbvMaxBitrate / divisor;
+            tileConfiguration.vbvSize = rootConfiguration.vbvSize / divisor;
+            if(rootConfiguration.gopLength != NVENC_INFINITE_GOPLENGTH)
+                tileConfiguration.gopLength = rootConfiguration.gopLength / divisor;
+        }
+
+        // CNvHWEncoder accepts external QP delta maps whenever a map file is named; the maps come from allocation
+        if(allocator != NULL && allocator->IsConstantQP())
+            tileConfiguration.qpDeltaMapFile = (char*)"rate allocation";
+
+        if(!tileEncodeContext[i].enabled)
+            continue;
+        else if(!fileOutput && (frameIndexEnabled || checkpointFilename != NULL))
+            return error("Frame indexes and checkpoints need file output", -1, NV_ENC_ERR_INVALID_PARAM);
+        else if(fileOutput &&
+                (tileConfiguration.fOutput = fopen(tileFilename.c_str(), resumeOffsets.empty() ? "wb" : "r+b")) == NULL)
             return error(tileFilename.c_str(), errno, NV_ENC_ERR_GENERIC);
+        else if(!resumeOffsets.empty() &&
+                (ftruncate(fileno(tileConfiguration.fOutput), resumeOffsets.at(i)) != 0 ||
+                 fseeko(tileConfiguration.fOutput, 0, SEEK_END) != 0))
+            return error(tileFilename.c_str(), errno, NV_ENC_ERR_GENERIC);
+        else if(frameIndexEnabled &&
+                tileEncodeContext[i].index.Open(tileFilename + TILE_INDEX_SUFFIX,
+                                                resumeOffsets.empty() ? -1 : resumeOffsets.at(i)) != 0)
+            return error((tileFilename + TILE_INDEX_SUFFIX).c_str(), errno, NV_ENC_ERR_GENERIC);
+        else if(ringName != NULL && tileEncodeContext[i].ring.Open(TileRingName(ringName, i), ringBytes, i) != 0)
+            return error(TileRingName(ringName, i).c_str(), errno, NV_ENC_ERR_GENERIC);
         else if((status = tileEncodeContext[i].hardwareEncoder.CreateEncoder(&tileConfiguration)))
             return status;
         }
@@ -55,27 +120,95 @@ NVENCSTATUS VideoEncoder::CreateEncoders(EncodeConfig& rootConfiguration)
     return NV_ENC_SUCCESS;
 }
 
-NVENCSTATUS VideoEncoder::AllocateIOBuffers(const EncodeConfig* configuration)
+NVENCSTATUS VideoEncoder::AllocateIOBuffers(const EncodeConfig* configuration, const size_t bufferCount)
 {
-    encodeBufferSize = configuration->numB + 4;
+    NVENCSTATUS status;
+
+    encodeBufferSize = bufferCount ? bufferCount : configuration->numB + 4;
+    assert(encodeBufferSize <= MAX_ENCODE_QUEUE);
 
     for(TileEncodeContext& context: tileEncodeContext)
     {
+        if(!context.enabled)
+            continue;
+
         context.encodeBufferQueue.Initialize(context.encodeBuffer, encodeBufferSize);
-        AllocateIOBuffer(context, *configuration);
+        if((status = AllocateIOBuffer(context, *configuration, 0, encodeBufferSize)) != NV_ENC_SUCCESS)
+            return status;
+    }
+
+    return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS VideoEncoder::ResizeIOBuffers(const EncodeConfig& configuration, const size_t bufferCount)
+{
+    NVENCSTATUS status;
+
+    assert(configuration.numB == 0);
+    assert(bufferCount > 0 && bufferCount <= MAX_ENCODE_QUEUE);
+
+    if(bufferCount == encodeBufferSize)
+        return NV_ENC_SUCCESS;
+
+    for(auto i = 0u; i < tileDimensions.count; i++)
+    {
+        auto& context = tileEncodeContext[i];
+        EncodeBuffer* encodeBuffer;
+
+        if(!context.enabled)
+            continue;
+
+        while((encodeBuffer = context.encodeBufferQueue.GetPending()) != NULL)
+        {
+            if((status = ProcessOutput(i, encodeBuffer)) != NV_ENC_SUCCESS)
+                return status;
+            else if(encodeBuffer->stInputBfr.hInputSurface)
+            {
+                context.hardwareEncoder.NvEncUnmapInputResource(encodeBuffer->stInputBfr.hInputSurface);
+                encodeBuffer->stInputBfr.hInputSurface = NULL;
+            }
+        }
+
+        if(bufferCount > encodeBufferSize)
+            status = AllocateIOBuffer(context, configuration, encodeBufferSize, bufferCount);
+        else
+            status = ReleaseIOBuffer(context, bufferCount, encodeBufferSize);
+
+        if(status != NV_ENC_SUCCESS)
+            return status;
+
+        // Restarts the ring at the first buffer, now that every pending frame has been written out
+        context.encodeBufferQueue.Initialize(context.encodeBuffer, bufferCount);
     }
 
+    encodeBufferSize = bufferCount;
     return NV_ENC_SUCCESS;
 }
 
-NVENCSTATUS VideoEncoder::AllocateIOBuffer(TileEncodeContext& context, const EncodeConfig& configuration)
+size_t VideoEncoder::GetInputBufferBytes(const EncodeConfig& configuration, const TileDimensions& dimensions)
+{
+    auto tileWidth  = configuration.width / dimensions.columns;
+    auto tileHeight = configuration.height / dimensions.rows;
+
+    // Pitch-aligned NV12 input, allocated at twice the luma height
+    return ((tileWidth + 255) & ~255) * tileHeight * 2;
+}
+
+size_t VideoEncoder::GetIOBufferBytes(const EncodeConfig& configuration) const
+{
+    // An input and a bitstream buffer per tile
+    return GetEnabledTileCount() * (GetInputBufferBytes(configuration, tileDimensions) + BITSTREAM_BUFFER_SIZE);
+}
+
+NVENCSTATUS VideoEncoder::AllocateIOBuffer(TileEncodeContext& context, const EncodeConfig& configuration,
+                                           const size_t first, const size_t last)
 {
     NVENCSTATUS status;
     CUresult result;
     auto tileWidth  = configuration.width / tileDimensions.columns;
     auto tileHeight = configuration.height / tileDimensions.rows;
 
-    for (auto i = 0; i < encodeBufferSize; i++) {
+    for (auto i = first; i < last; i++) {
         auto& buffer = context.encodeBuffer[i];
 
         if((result = cuvidCtxLock(lock, 0)) != CUDA_SUCCESS)
@@ -108,46 +241,66 @@ NVENCSTATUS VideoEncoder::AllocateIOBuffer(TileEncodeContext& context, const Enc
             buffer.stOutputBfr.hOutputEvent = NULL;
         }
     }
+
+    return NV_ENC_SUCCESS;
 }
 
-NVENCSTATUS VideoEncoder::ReleaseIOBuffers()
+NVENCSTATUS VideoEncoder::ReleaseIOBuffer(TileEncodeContext& context, const size_t first, const size_t last)
 {
     CUresult result;
 
-    for(TileEncodeContext& context: tileEncodeContext)
-        for (auto i = 0; i < encodeBufferSize; i++)
+    for (auto i = first; i < last; i++)
+    {
+        auto& buffer = context.encodeBuffer[i];
+
+        context.hardwareEncoder.NvEncUnregisterResource(buffer.stInputBfr.nvRegisteredResource);
+        buffer.stInputBfr.nvRegisteredResource = NULL;
+
+        if((result = cuvidCtxLock(lock, 0)) != CUDA_SUCCESS)
+            return error("cuvidCtxLock", result, NV_ENC_ERR_GENERIC);
+        else if((result = cuMemFree(buffer.stInputBfr.pNV12devPtr)) != CUDA_SUCCESS)
+            return error("cuMemFree", result, NV_ENC_ERR_GENERIC);
+        else if((result = cuvidCtxUnlock(lock, 0)) != CUDA_SUCCESS)
+            return error("cuvidCtxUnlock", result, NV_ENC_ERR_GENERIC);
+        else
         {
-            auto& buffer = context.encodeBuffer[i];
-
-            if((result = cuvidCtxLock(lock, 0)) != CUDA_SUCCESS)
-                return error("cuvidCtxLock", result, NV_ENC_ERR_GENERIC);
-            else if((result = cuMemFree(buffer.stInputBfr.pNV12devPtr)) != CUDA_SUCCESS)
-                return error("cuMemFree", result, NV_ENC_ERR_GENERIC);
-            else if((result = cuvidCtxUnlock(lock, 0)) != CUDA_SUCCESS)
-                return error("cuvidCtxUnlock", result, NV_ENC_ERR_GENERIC);
-            else
-            {
-                context.hardwareEncoder.NvEncDestroyBitstreamBuffer(buffer.stOutputBfr.hBitstreamBuffer);
-                buffer.stOutputBfr.hBitstreamBuffer = NULL;
-            }
+            context.hardwareEncoder.NvEncDestroyBitstreamBuffer(buffer.stOutputBfr.hBitstreamBuffer);
+            buffer.stOutputBfr.hBitstreamBuffer = NULL;
         }
+    }
 
     return NV_ENC_SUCCESS;
 }
 
-NVENCSTATUS VideoEncoder::FlushEncoder()
+NVENCSTATUS VideoEncoder::ReleaseIOBuffers()
 {
     NVENCSTATUS status;
 
     for(TileEncodeContext& context: tileEncodeContext)
+        if(context.enabled && (status = ReleaseIOBuffer(context, 0, encodeBufferSize)) != NV_ENC_SUCCESS)
+            return status;
+
+    return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS VideoEncoder::FlushEncoder()
+{
+    NVENCSTATUS status = NV_ENC_SUCCESS;
+
+    for(auto i = 0u; i < tileDimensions.count; i++)
     {
-        if((status = context.hardwareEncoder.NvEncFlushEncoderQueue(NULL)) != NV_ENC_SUCCESS)
+        auto& context = tileEncodeContext[i];
+
+        if(!context.enabled)
+            continue;
+        else if((status = context.hardwareEncoder.NvEncFlushEncoderQueue(NULL)) != NV_ENC_SUCCESS)
             return status;
 
         EncodeBuffer *encodeBuffer = context.encodeBufferQueue.GetPending();
         while (encodeBuffer)
         {
-            context.hardwareEncoder.ProcessOutput(encodeBuffer);
+            if((status = ProcessOutput(i, encodeBuffer)) != NV_ENC_SUCCESS)
+                return status;
             encodeBuffer = context.encodeBufferQueue.GetPending();
 
             if (encodeBuffer && encodeBuffer->stInputBfr.hInputSurface)
@@ -158,29 +311,170 @@ NVENCSTATUS VideoEncoder::FlushEncoder()
         }
     }
 
+    if(status == NV_ENC_SUCCESS && metrics != NULL && metrics->Flush() != 0)
+        return error("TileMetrics::Flush", -1, NV_ENC_ERR_GENERIC);
+
     return status;
 }
 
 NVENCSTATUS VideoEncoder::Deinitialize()
 {
-    NVENCSTATUS status;
+    NVENCSTATUS status, first = NV_ENC_SUCCESS;
 
     ReleaseIOBuffers();
 
+    // Every sink, session and file is torn down even after a failure; the first failure is returned
+    for(auto* sink: sinks)
+        if(sink->Close() != 0 && first == NV_ENC_SUCCESS)
+            first = error("TileSink::Close", -1, NV_ENC_ERR_GENERIC);
+
     for(TileEncodeContext& context: tileEncodeContext)
-        if((status = context.hardwareEncoder.NvEncDestroyEncoder()) != NV_ENC_SUCCESS)
-            return status;
+    {
+        if(!context.enabled)
+            continue;
+
+        if((status = context.hardwareEncoder.NvEncDestroyEncoder()) != NV_ENC_SUCCESS && first == NV_ENC_SUCCESS)
+            first = status;
+        if(context.index.Close() != 0 && first == NV_ENC_SUCCESS)
+            first = error("fclose", errno, NV_ENC_ERR_GENERIC);
+        if(context.ring.Close() != 0 && first == NV_ENC_SUCCESS)
+            first = error("TileRingWriter::Close", errno, NV_ENC_ERR_GENERIC);
+        if(context.hardwareEncoder.m_fOutput && fclose(context.hardwareEncoder.m_fOutput) != 0 &&
+           first == NV_ENC_SUCCESS)
+            first = error("fclose", errno, NV_ENC_ERR_GENERIC);
+        context.hardwareEncoder.m_fOutput = NULL;
+    }
+
+    return first;
+}
+
+static TileIndexPictureType GetTilePictureType(const NV_ENC_PIC_TYPE type)
+{
+    switch(type)
+    {
+        case NV_ENC_PIC_TYPE_IDR:       return TILE_PICTURE_IDR;
+        case NV_ENC_PIC_TYPE_I:         return TILE_PICTURE_I;
+        case NV_ENC_PIC_TYPE_P:         return TILE_PICTURE_P;
+        case NV_ENC_PIC_TYPE_B:         return TILE_PICTURE_B;
+        default:                        return TILE_PICTURE_OTHER;
+    }
+}
+
+NVENCSTATUS VideoEncoder::ProcessOutput(const size_t tile, const EncodeBuffer* encodeBuffer)
+{
+    NVENCSTATUS status;
+    NV_ENC_LOCK_BITSTREAM bitstream;
+    auto& context = tileEncodeContext[tile];
+    auto* output = context.hardwareEncoder.m_fOutput;
+    uint64_t presented;
+
+    if(encodeBuffer->stOutputBfr.hBitstreamBuffer == NULL)
+        return NV_ENC_ERR_INVALID_PARAM;
+
+    memset(&bitstream, 0, sizeof(bitstream));
+    bitstream.version = NV_ENC_LOCK_BITSTREAM_VER;
+    bitstream.outputBitstream = encodeBuffer->stOutputBfr.hBitstreamBuffer;
+    bitstream.doNotWait = false;
+
+    auto traceStart = TraceEnabled() ? TraceNow() : 0;
+    if((status = context.hardwareEncoder.NvEncLockBitstream(&bitstream)) != NV_ENC_SUCCESS)
+        return error("NvEncLockBitstream", status);
+    TraceComplete("retrieve output", traceStart, (int)bitstream.outputTimeStamp, (int)tile);
+
+    // The input index counts this tile's frames; outputs are stamped with the frame's place among all frames
+    presented = context.presentedAt[bitstream.outputTimeStamp % MAX_ENCODE_QUEUE];
+
+    // Record where a requested checkpoint IDR begins in this tile's output
+    if(bitstream.pictureType == NV_ENC_PIC_TYPE_IDR)
+        for(PendingCheckpoint& pending: pendingCheckpoints)
+            if(pending.checkpoint.offsets[tile] < 0 && pending.encodeIndex[tile] == bitstream.outputTimeStamp)
+                pending.checkpoint.offsets[tile] = ftello(output);
+
+    traceStart = TraceEnabled() ? TraceNow() : 0;
+    auto offset = context.index.IsOpen() ? ftello(output) : 0;
+    if(output != NULL &&
+       fwrite(bitstream.bitstreamBufferPtr, 1, bitstream.bitstreamSizeInBytes, output) != bitstream.bitstreamSizeInBytes)
+        status = error("fwrite", errno, NV_ENC_ERR_GENERIC);
+    else if(context.index.IsOpen() &&
+            context.index.Append(offset, bitstream.bitstreamSizeInBytes, presented,
+                                 GetTilePictureType(bitstream.pictureType)) != 0)
+        status = error("TileIndexWriter::Append", errno, NV_ENC_ERR_GENERIC);
+    else if(context.ring.IsOpen() &&
+            context.ring.Publish(bitstream.bitstreamBufferPtr, bitstream.bitstreamSizeInBytes, presented,
+                                 GetTilePictureType(bitstream.pictureType)) != 0)
+        status = error("TileRingWriter::Publish", -1, NV_ENC_ERR_GENERIC);
+    else if(metrics != NULL &&
+            metrics->Decode(tile, bitstream.bitstreamBufferPtr, bitstream.bitstreamSizeInBytes) != 0)
+        status = error("TileMetrics::Decode", -1, NV_ENC_ERR_GENERIC);
+    for(auto i = 0u; status == NV_ENC_SUCCESS && i < sinks.size(); i++)
+        if(sinks[i]->Write(tile, bitstream.bitstreamBufferPtr, bitstream.bitstreamSizeInBytes, presented,
+                           GetTilePictureType(bitstream.pictureType)) != 0)
+            status = error("TileSink::Write", -1, NV_ENC_ERR_GENERIC);
+    TraceComplete("write", traceStart, (int)bitstream.outputTimeStamp, (int)tile);
+
+    auto decoded = context.decodedAt[bitstream.outputTimeStamp % MAX_ENCODE_QUEUE];
+    if(live != NULL && decoded != 0)
+        live->RecordOutput(tile, PipelineTuner::Now() - decoded);
+
+    context.hardwareEncoder.NvEncUnlockBitstream(encodeBuffer->stOutputBfr.hBitstreamBuffer);
+
+    return status != NV_ENC_SUCCESS ? status : CommitCheckpoints();
+}
+
+// A failed commit fails the transcode, leaving the last committed checkpoint to resume from.  It is never
+// retried: once fsync has reported an error, a later fsync may succeed without the data being durable.
+NVENCSTATUS VideoEncoder::CommitCheckpoints()
+{
+    while(!pendingCheckpoints.empty())
+    {
+        auto& pending = pendingCheckpoints.front();
+
+        for(auto offset: pending.checkpoint.offsets)
+            if(offset < 0)
+                return NV_ENC_SUCCESS;
+
+        if(checkpointFailed)
+            return NV_ENC_ERR_GENERIC;
+
+        // Everything preceding the IDR must be durable before the checkpoint refers to it
+        for(TileEncodeContext& context: tileEncodeContext)
+            if(context.enabled && (fflush(context.hardwareEncoder.m_fOutput) != 0 ||
+                                   fsync(fileno(context.hardwareEncoder.m_fOutput)) != 0 ||
+                                   context.index.Sync() != 0))
+            {
+                checkpointFailed = true;
+                fprintf(stderr, "Unable to sync tile output for checkpoint at frame %d: %s\n",
+                        pending.checkpoint.frame, strerror(errno));
+                return NV_ENC_ERR_GENERIC;
+            }
+
+        if(SaveCheckpoint(checkpointFilename, pending.checkpoint) != 0)
+        {
+            checkpointFailed = true;
+            fprintf(stderr, "Unable to save checkpoint %s: %s\n", checkpointFilename, strerror(errno));
+            return NV_ENC_ERR_GENERIC;
+        }
+
+        pendingCheckpoints.pop_front();
+    }
 
     return NV_ENC_SUCCESS;
 }
 
-EncodeBuffer* GetEncodeBuffer(TileEncodeContext& context)
+NVENCSTATUS VideoEncoder::GetEncodeBuffer(const size_t tile, EncodeBuffer*& encodeBuffer)
 {
-    EncodeBuffer *encodeBuffer = context.encodeBufferQueue.GetAvailable();
+    NVENCSTATUS status = NV_ENC_SUCCESS;
+    auto& context = tileEncodeContext[tile];
+
+    encodeBuffer = context.encodeBufferQueue.GetAvailable();
     if (!encodeBuffer)
     {
+        auto start = PipelineTuner::Now();
+
         encodeBuffer = context.encodeBufferQueue.GetPending();
-        context.hardwareEncoder.ProcessOutput(encodeBuffer);
+        status = ProcessOutput(tile, encodeBuffer);
+        // Tiles may be encoded on several threads (see EncodeTile)
+        __sync_fetch_and_add(&outputStall, PipelineTuner::Now() - start);
 
         // UnMap the input buffer after frame done
         if (encodeBuffer->stInputBfr.hInputSurface)
@@ -191,94 +485,197 @@ EncodeBuffer* GetEncodeBuffer(TileEncodeContext& context)
         encodeBuffer = context.encodeBufferQueue.GetAvailable();
     }
 
-    return encodeBuffer;
+    return status;
 }
 
 NVENCSTATUS VideoEncoder::EncodeFrame(EncodeFrameConfig *inputFrame,
                                       const NV_ENC_PIC_STRUCT inputFrameType, const bool flush)
 {
     NVENCSTATUS status;
-    CUresult result;
 
     if (flush)
         return FlushEncoder();
 
     assert(inputFrame);
-    auto screenWidth = inputFrame->width;
-    auto screenHeight = inputFrame->height;
-    auto tileWidth = screenWidth / tileDimensions.columns;
-    auto tileHeight = screenHeight / tileDimensions.rows;
+    NvEncPictureCommand command = { 0 };
+
+    if((status = AdaptRate(inputFrame)) != NV_ENC_SUCCESS)
+        return status;
 
-    for(auto i = 0; i < tileDimensions.count; i++)
+    if(inputFrame->checkpoint && checkpointFilename)
     {
-        auto& context = tileEncodeContext[i];
-        auto* encodeBuffer = GetEncodeBuffer(context);
-
-        auto row = i / tileDimensions.columns;
-        auto column = i % tileDimensions.columns;
-
-        auto offsetX = column * tileWidth;
-        auto offsetY = row * tileHeight;
-
-        CUDA_MEMCPY2D lumaPlaneParameters = {
-            srcXInBytes:   offsetX,
-            srcY:          offsetY,
-            srcMemoryType: CU_MEMORYTYPE_DEVICE,
-            srcHost:       NULL,
-            srcDevice:     inputFrame->device_pointer,
-            srcArray:      NULL,
-            srcPitch:      inputFrame->pitch,
-
-            dstXInBytes:   0,
-            dstY:          0,
-            dstMemoryType: CU_MEMORYTYPE_DEVICE,
-            dstHost:       NULL,
-            dstDevice:     (CUdeviceptr)encodeBuffer->stInputBfr.pNV12devPtr,
-            dstArray:      NULL,
-            dstPitch:      encodeBuffer->stInputBfr.uNV12Stride,
-
-            WidthInBytes:  tileWidth,
-            Height:        tileHeight,
-            };
-
-        CUDA_MEMCPY2D chromaPlaneParameters = {
-            srcXInBytes:   offsetX,
-            srcY:          screenHeight + offsetY/2,
-            srcMemoryType: CU_MEMORYTYPE_DEVICE,
-            srcHost:       NULL,
-            srcDevice:     inputFrame->device_pointer,
-            srcArray:      NULL,
-            srcPitch:      inputFrame->pitch,
-
-            dstXInBytes:   0,
-            dstY:          tileHeight,
-            dstMemoryType: CU_MEMORYTYPE_DEVICE,
-            dstHost:       NULL,
-            dstDevice:     (CUdeviceptr)encodeBuffer->stInputBfr.pNV12devPtr,
-            dstArray:      NULL,
-            dstPitch:      encodeBuffer->stInputBfr.uNV12Stride,
-
-            WidthInBytes:  tileWidth,
-            Height:        tileHeight/2
-            };
+        PendingCheckpoint pending = { *inputFrame->checkpoint, std::vector<uint32_t>(tileDimensions.count) };
 
-        if((result = cuvidCtxLock(lock, 0)) != CUDA_SUCCESS)
-            return error("cuvidCtxLock", result, NV_ENC_ERR_GENERIC);
-        else if((result = cuMemcpy2D(&lumaPlaneParameters)) != CUDA_SUCCESS)
-            return error("cuMemcpy2D", result, NV_ENC_ERR_GENERIC);
-        else if((result = cuMemcpy2D(&chromaPlaneParameters)) != CUDA_SUCCESS)
-            return error("cuMemcpy2D", result, NV_ENC_ERR_GENERIC);
-        else if((result = cuvidCtxUnlock(lock, 0)) != CUDA_SUCCESS)
-            return error("cuvidCtxUnlock", result, NV_ENC_ERR_GENERIC);
-        else if((status = context.hardwareEncoder.NvEncMapInputResource(
-                encodeBuffer->stInputBfr.nvRegisteredResource,
-                &encodeBuffer->stInputBfr.hInputSurface)) != NV_ENC_SUCCESS)
-            return status;
-        else
-            context.hardwareEncoder.NvEncEncodeFrame(encodeBuffer, NULL, tileWidth, tileHeight, inputFrameType);
+        pending.checkpoint.offsets.assign(tileDimensions.count, -1);
+        for(auto i = 0u; i < tileDimensions.count; i++)
+            if(tileEncodeContext[i].enabled)
+                pending.encodeIndex[i] = tileEncodeContext[i].hardwareEncoder.m_EncodeIdx;
+            else
+                pending.checkpoint.offsets[i] = 0;
+
+        pendingCheckpoints.push_back(pending);
+        command.bForceIDR = true;
     }
+    if(inputFrame->idr)
+        command.bForceIDR = true;
+
+    for(auto i = 0u; i < tileDimensions.count; i++)
+        if((command.bForceIDR ? tileEncodeContext[i].enabled : IsTileDue(i)) &&
+           (status = EncodeTile(i, inputFrame, inputFrameType, command.bForceIDR ? &command : NULL)) != NV_ENC_SUCCESS)
+            return status;
 
     framesEncoded++;
 
     return NV_ENC_SUCCESS;
 }
+
+NVENCSTATUS VideoEncoder::AdaptRate(const EncodeFrameConfig* inputFrame)
+{
+    NVENCSTATUS status;
+    std::vector<TileRate> rates;
+    std::vector<bool> enabled;
+
+    if(allocator == NULL)
+        return NV_ENC_SUCCESS;
+    else if(allocator->IsMeasured(framesEncoded) &&
+            allocator->Measure(inputFrame->device_pointer, inputFrame->pitch) != 0)
+        return error("RateAllocator::Measure", -1, NV_ENC_ERR_GENERIC);
+    else if(!allocator->IsDue(framesEncoded))
+        return NV_ENC_SUCCESS;
+
+    for(const TileEncodeContext& context: tileEncodeContext)
+        enabled.push_back(context.enabled);
+    allocator->Allocate(enabled, rates);
+
+    for(auto i = 0u; i < tileDimensions.count; i++)
+    {
+        auto& context = tileEncodeContext[i];
+        NvEncPictureCommand command = { 0 };
+
+        if(!context.enabled)
+            continue;
+        else if(allocator->IsConstantQP())
+        {
+            auto tileWidth = inputFrame->width / tileDimensions.columns;
+            auto tileHeight = inputFrame->height / tileDimensions.rows;
+
+            context.qpDeltaMap.assign(((tileWidth + 15) / 16) * ((tileHeight + 15) / 16), rates[i].qpOffset);
+            continue;
+        }
+
+        // The VBV buffer holds one second at the new rate
+        command.bBitrateChangePending = true;
+        command.newBitrate = rates[i].bitrate / context.rateDivisor;
+        command.newVBVSize = rates[i].bitrate / context.rateDivisor;
+        if((status = context.hardwareEncoder.NvEncReconfigureEncoder(&command)) != NV_ENC_SUCCESS)
+            return error("NvEncReconfigureEncoder", status);
+    }
+
+    return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS VideoEncoder::EncodeTile(const size_t tile, const EncodeFrameConfig* inputFrame,
+                                     const NV_ENC_PIC_STRUCT inputFrameType, NvEncPictureCommand* command)
+{
+    NVENCSTATUS status;
+    CUresult result;
+    auto& context = tileEncodeContext[tile];
+    auto screenWidth = inputFrame->width;
+    auto screenHeight = inputFrame->height;
+    auto tileWidth = screenWidth / tileDimensions.columns;
+    auto tileHeight = screenHeight / tileDimensions.rows;
+
+    EncodeBuffer* encodeBuffer;
+
+    auto traceStart = TraceEnabled() ? TraceNow() : 0;
+    if((status = GetEncodeBuffer(tile, encodeBuffer)) != NV_ENC_SUCCESS)
+        return status;
+    TraceComplete("wait buffer", traceStart, inputFrame->frame, (int)tile);
+
+    auto row = tile / tileDimensions.columns;
+    auto column = tile % tileDimensions.columns;
+
+    auto offsetX = column * tileWidth;
+    auto offsetY = row * tileHeight;
+
+    CUDA_MEMCPY2D lumaPlaneParameters = {
+        srcXInBytes:   offsetX,
+        srcY:          offsetY,
+        srcMemoryType: CU_MEMORYTYPE_DEVICE,
+        srcHost:       NULL,
+        srcDevice:     inputFrame->device_pointer,
+        srcArray:      NULL,
+        srcPitch:      inputFrame->pitch,
+
+        dstXInBytes:   0,
+        dstY:          0,
+        dstMemoryType: CU_MEMORYTYPE_DEVICE,
+        dstHost:       NULL,
+        dstDevice:     (CUdeviceptr)encodeBuffer->stInputBfr.pNV12devPtr,
+        dstArray:      NULL,
+        dstPitch:      encodeBuffer->stInputBfr.uNV12Stride,
+
+        WidthInBytes:  tileWidth,
+        Height:        tileHeight,
+        };
+
+    CUDA_MEMCPY2D chromaPlaneParameters = {
+        srcXInBytes:   offsetX,
+        srcY:          screenHeight + offsetY/2,
+        srcMemoryType: CU_MEMORYTYPE_DEVICE,
+        srcHost:       NULL,
+        srcDevice:     inputFrame->device_pointer,
+        srcArray:      NULL,
+        srcPitch:      inputFrame->pitch,
+
+        dstXInBytes:   0,
+        dstY:          tileHeight,
+        dstMemoryType: CU_MEMORYTYPE_DEVICE,
+        dstHost:       NULL,
+        dstDevice:     (CUdeviceptr)encodeBuffer->stInputBfr.pNV12devPtr,
+        dstArray:      NULL,
+        dstPitch:      encodeBuffer->stInputBfr.uNV12Stride,
+
+        WidthInBytes:  tileWidth,
+        Height:        tileHeight/2
+        };
+
+    traceStart = TraceEnabled() ? TraceNow() : 0;
+    if((result = cuvidCtxLock(lock, 0)) != CUDA_SUCCESS)
+        return error("cuvidCtxLock", result, NV_ENC_ERR_GENERIC);
+    else if((result = cuMemcpy2D(&lumaPlaneParameters)) != CUDA_SUCCESS ||
+            (result = cuMemcpy2D(&chromaPlaneParameters)) != CUDA_SUCCESS)
+        status = error("cuMemcpy2D", result, NV_ENC_ERR_GENERIC);
+    else if(metrics != NULL && metrics->IsSampled(context.hardwareEncoder.m_EncodeIdx) &&
+            metrics->Sample(tile, context.hardwareEncoder.m_EncodeIdx, encodeBuffer->stInputBfr.pNV12devPtr,
+                            encodeBuffer->stInputBfr.uNV12Stride) != 0)
+        status = error("TileMetrics::Sample", -1, NV_ENC_ERR_GENERIC);
+    else
+        status = NV_ENC_SUCCESS;
+
+    // The context is released even when the copy failed, so that other threads are not left waiting on it
+    if((result = cuvidCtxUnlock(lock, 0)) != CUDA_SUCCESS)
+        return error("cuvidCtxUnlock", result, NV_ENC_ERR_GENERIC);
+    else if(status != NV_ENC_SUCCESS)
+        return status;
+
+    TraceComplete("copy", traceStart, inputFrame->frame, (int)tile);
+    traceStart = TraceEnabled() ? TraceNow() : 0;
+
+    if((status = context.hardwareEncoder.NvEncMapInputResource(
+            encodeBuffer->stInputBfr.nvRegisteredResource,
+            &encodeBuffer->stInputBfr.hInputSurface)) != NV_ENC_SUCCESS)
+        return status;
+
+    context.decodedAt[context.hardwareEncoder.m_EncodeIdx % MAX_ENCODE_QUEUE] = inputFrame->decoded;
+    context.presentedAt[context.hardwareEncoder.m_EncodeIdx % MAX_ENCODE_QUEUE] = framesEncoded;
+    if(command != NULL && command->bForceIDR)
+        context.ratePhase = framesEncoded;
+    context.hardwareEncoder.NvEncEncodeFrame(encodeBuffer, command, tileWidth, tileHeight, inputFrameType,
+                                             context.qpDeltaMap.empty() ? NULL : context.qpDeltaMap.data(),
+                                             context.qpDeltaMap.size());
+
+    TraceComplete("submit", traceStart, inputFrame->frame, (int)tile);
+
+    return NV_ENC_SUCCESS;
+}
@@ -1,13 +1,23 @@
 #ifndef _VIDEO_ENCODER
 #define _VIDEO_ENCODER
 
+#include <deque>
 #include <vector>
 
 #include "../common/inc/NvHWEncoder.h"
+#include "TileDimensions.h"
+#include "Checkpoint.h"
+#include "TileIndex.h"
+#include "TileMetrics.h"
+#include "TileRing.h"
 #include "dynlink_nvcuvid.h" // <nvcuvid.h>
 
 #define MAX_ENCODE_QUEUE 32
 
+class LiveSchedule;
+class RateAllocator;
+#define BITSTREAM_BUFFER_SIZE 2*1024*1024
+
 template<class T>
 class BufferQueue {
     T** buffer;
@@ -29,12 +39,14 @@ public:
         delete[] buffer;
     }
 
+    // May be called again to resize the queue, which must then be empty
     bool Initialize(T *items, unsigned int size)
     {
         this->size = size;
         pending = 0;
         available_index = 0;
         pending_index = 0;
+        delete[] buffer;
         buffer = new T *[size];
 
         for (unsigned int i = 0; i < size; i++)
@@ -73,6 +85,11 @@ typedef struct EncodeFrameConfig
     unsigned int pitch;
     unsigned int width;
     unsigned int height;
+    int frame;                     // Source frame index, used to label trace events
+    const Checkpoint* checkpoint;  // When set, the frame is an IDR on every tile and the checkpoint is
+                                   // committed once each tile has written it
+    unsigned long long decoded;    // When the source frame was decoded (see DecodedFrame), or zero
+    bool idr;                      // Begins a GOP on every tile (e.g., at a scene cut)
 } EncodeFrameConfig;
 
 typedef struct TileEncodeContext
@@ -81,14 +98,26 @@ typedef struct TileEncodeContext
     EncodeBuffer              encodeBuffer[MAX_ENCODE_QUEUE];
     BufferQueue<EncodeBuffer> encodeBufferQueue;
     size_t                    offsetX, offsetY;
+    bool                      enabled;
+    TileIndexWriter           index;
+    TileRingWriter            ring;
+    unsigned long long        decodedAt[MAX_ENCODE_QUEUE];  // Decode time of each frame in flight, by input index
+    size_t                    presentedAt[MAX_ENCODE_QUEUE];  // Output frame of each frame in flight, by input index
+    unsigned int              rateDivisor;  // Encoded on every rateDivisor-th output frame (see TileRates.h)
+    size_t                    ratePhase;    // Output frame that the tile's cadence counts from
+    std::vector<int8_t>       qpDeltaMap;  // Per-macroblock QP offsets (uniform) set by rate allocation
 } TileEncodeContext;
 
-typedef struct TileDimensions
+// Receives each tile's encoded output, in encode order, from the thread that retrieves it
+class TileSink
 {
-    size_t rows;
-    size_t columns;
-    size_t count;
-} TileDimensions;
+public:
+    virtual ~TileSink() { }
+
+    virtual int Write(size_t tile, const void* data, size_t size, uint64_t timestamp, TileIndexPictureType) = 0;
+    // Called once the encoders have been flushed
+    virtual int Close() { return 0; }
+};
 
 class VideoEncoder
 {
@@ -98,8 +127,26 @@ public:
         tileDimensions({tileRows, tileColumns, tileColumns * tileRows}),
         tileEncodeContext(tileDimensions.count),
         encodeBufferSize(0),
-        framesEncoded(0)
-        { assert(tileColumns > 0 && tileRows > 0); }
+        framesEncoded(0),
+        outputStall(0),
+        checkpointFilename(NULL),
+        checkpointFailed(false),
+        frameIndexEnabled(false),
+        ringName(NULL),
+        ringBytes(DEFAULT_TILE_RING_BYTES),
+        fileOutput(true),
+        metrics(NULL),
+        live(NULL),
+        allocator(NULL)
+        {
+        assert(tileColumns > 0 && tileRows > 0);
+        for(TileEncodeContext& context: tileEncodeContext)
+        {
+            context.enabled = true;
+            context.rateDivisor = 1;
+            context.ratePhase = 0;
+        }
+        }
     virtual ~VideoEncoder()
         { }
 
@@ -108,10 +155,61 @@ public:
     NVENCSTATUS Deinitialize();
     NVENCSTATUS EncodeFrame(
         EncodeFrameConfig*, const NV_ENC_PIC_STRUCT type = NV_ENC_PIC_STRUCT_FRAME, const bool flush = false);
-    NVENCSTATUS AllocateIOBuffers(const EncodeConfig*);
+    // Encodes one tile of a frame, without checkpointing, and CompleteFrame then counts the frame.  Each tile
+    // is an independent session, so distinct tiles may be encoded concurrently provided that the frames of
+    // any one tile are submitted in order.
+    NVENCSTATUS EncodeTile(size_t tile, const EncodeFrameConfig*, NV_ENC_PIC_STRUCT type = NV_ENC_PIC_STRUCT_FRAME,
+                           NvEncPictureCommand* command = NULL);
+    void        CompleteFrame() { framesEncoded++; }
+    // Measures the frame and, when an allocation is due, redistributes rate across the tiles.  EncodeFrame
+    // calls it; callers of EncodeTile call it once per frame before the first tile.
+    NVENCSTATUS AdaptRate(const EncodeFrameConfig*);
+    NVENCSTATUS AllocateIOBuffers(const EncodeConfig*, size_t bufferCount = 0);
+    // Changes the number of frames in flight per tile, draining outstanding output first.  Only valid
+    // without B-frames, where every submitted frame completes without further input.
+    NVENCSTATUS ResizeIOBuffers(const EncodeConfig&, size_t bufferCount);
+    size_t      GetIOBufferCount() const { return encodeBufferSize; }
+    // Device memory used by one unit of encode depth across every enabled tile
+    size_t      GetIOBufferBytes(const EncodeConfig&) const;
+    // Device memory allocated for the NV12 input of one tile encode buffer
+    static size_t GetInputBufferBytes(const EncodeConfig&, const TileDimensions&);
+    // Microseconds spent waiting for a tile encoder to return a buffer
+    unsigned long long GetOutputStall() const { return outputStall; }
     size_t      GetEncodedFrames() const { return framesEncoded; }
     GUID        GetPresetGUID()  const { return presetGUID; }
 
+    // Tiles that are disabled before Initialize have no encoder session, buffers or output
+    void        SetTileEnabled(const size_t index, const bool enabled) { tileEncodeContext.at(index).enabled = enabled; }
+    bool        IsTileEnabled(const size_t index) const { return tileEncodeContext.at(index).enabled; }
+    size_t      GetEnabledTileCount() const;
+    // Encodes a tile at a fraction of the frame rate (see TileRates.h); must precede CreateEncoders
+    void        SetTileRateDivisor(const size_t index, const unsigned int divisor)
+                    { tileEncodeContext.at(index).rateDivisor = divisor; }
+    unsigned int GetTileRateDivisor(const size_t index) const { return tileEncodeContext.at(index).rateDivisor; }
+    // Whether the tile is encoded on the next frame; a forced IDR encodes every enabled tile and restarts
+    // the cadence of those that were not due
+    bool        IsTileDue(size_t index) const;
+
+    // Commits checkpoints requested through EncodeFrameConfig to the given file
+    void        EnableCheckpoints(const char* filename) { checkpointFilename = filename; }
+    // Reopens existing tile outputs truncated to the given offsets instead of recreating them
+    void        SetResumeOffsets(const std::vector<long long>& offsets) { resumeOffsets = offsets; }
+    // Writes a sidecar frame index (see TileIndex.h) next to each tile output
+    void        EnableFrameIndex() { frameIndexEnabled = true; }
+    // Also publishes each tile's output to a shared-memory ring (see TileRing.h).  Publish rejects a frame
+    // larger than the ring, so a ring smaller than the bitstream buffer is refused (returning nonzero).
+    int         EnableRing(const char* name, size_t bytes);
+    // Samples each tile's source and decodes its output to measure quality (see TileMetrics.h)
+    void        EnableMetrics(TileMetrics* metrics) { this->metrics = metrics; }
+    // Distributes rate across tiles by content (see RateAllocator.h); must precede CreateEncoders
+    void        EnableRateAllocation(RateAllocator* allocator) { this->allocator = allocator; }
+    // Reports the latency from decode to output of each tile frame (see LiveMode.h)
+    void        EnableLatency(LiveSchedule* live) { this->live = live; }
+    // Also hands each tile's output to the given sink; the sink is closed by Deinitialize
+    void        AddSink(TileSink* sink) { sinks.push_back(sink); }
+    // Sends output only to the sinks (and rings); checkpoints and frame indexes need the files
+    void        DisableFileOutput() { fileOutput = false; }
+
 protected:
     GUID                           presetGUID;
     TileDimensions                 tileDimensions;
@@ -120,9 +218,34 @@ protected:
 
     size_t                         encodeBufferSize;
     size_t                         framesEncoded;
+    unsigned long long             outputStall;
 
 private:
-    NVENCSTATUS AllocateIOBuffer(TileEncodeContext&, const EncodeConfig&);
+    typedef struct PendingCheckpoint
+    {
+        Checkpoint            checkpoint;
+        std::vector<uint32_t> encodeIndex;  // Per-tile input timestamp of the IDR frame
+    } PendingCheckpoint;
+
+    const char*                    checkpointFilename;
+    bool                           checkpointFailed;  // No later checkpoint may be committed
+    std::deque<PendingCheckpoint>  pendingCheckpoints;
+    std::vector<long long>         resumeOffsets;
+    bool                           frameIndexEnabled;
+    const char*                    ringName;
+    size_t                         ringBytes;
+    bool                           fileOutput;
+    std::vector<TileSink*>         sinks;
+    TileMetrics*                   metrics;
+    LiveSchedule*                  live;
+    RateAllocator*                 allocator;
+
+    // Waits for a free buffer, writing out the oldest pending frame when there is none
+    NVENCSTATUS GetEncodeBuffer(size_t tile, EncodeBuffer*&);
+    NVENCSTATUS ProcessOutput(size_t tile, const EncodeBuffer*);
+    NVENCSTATUS CommitCheckpoints();
+    NVENCSTATUS AllocateIOBuffer(TileEncodeContext&, const EncodeConfig&, size_t first, size_t last);
+    NVENCSTATUS ReleaseIOBuffer(TileEncodeContext&, size_t first, size_t last);
     NVENCSTATUS ReleaseIOBuffers();
     NVENCSTATUS FlushEncoder();
 };
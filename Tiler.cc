@@ -1,62 +1,16 @@
-#include <pthread.h>
-
 #include <iostream>
 #include <string.h>
-#include <sstream>
-
-#include "VideoDecoder.h"
-#include "TileVideoEncoder.h"
-
-typedef struct Statistics
-{
-    unsigned long long start, end, frequency;
-} Statistics;
-
-std::vector<std::string> split(const std::string &input, char delimiter) {
-    std::vector<std::string> elements;
-    std::stringstream stream(input);
-    std::string value;
 
-    while (std::getline(stream, value, delimiter))
-        elements.push_back(value);
+#include "TilerPipeline.h"
+#include "SceneDetector.h"
+#include "TilePyramid.h"
 
-    return elements;
-}
 int error(const char* message, const int exitCode)
 {
     std::cerr << message;
     return exitCode;
 }
 
-void* DecodeWorker(void *arg)
-{
-    auto* decoder = (CudaDecoder*)arg;
-    decoder->Start();
-
-    return NULL;
-}
-
-int MatchFPS(const float fpsRatio, const int decodedFrames, const int encodedFrames)
-{
-    if (fpsRatio < 1.f)
-    {
-        // need to drop frame
-        if (decodedFrames * fpsRatio < (encodedFrames + 1))
-            return -1;
-    }
-    else if (fpsRatio > 1.f)
-    {
-        // need to duplicate frame	 
-        auto duplicate = 0;
-        while (decodedFrames*fpsRatio > encodedFrames + duplicate + 1)
-            duplicate++;
-
-        return duplicate;
-    }
-
-    return 0;
-}
-
 int PrintHelp()
 {
     std::cout << "Usage : NvTranscoder \n"
@@ -93,253 +47,270 @@ int PrintHelp()
                     "-i_qoffset <float>           Specify qscale offset between I-frames and P-frames\n"
                     "-b_qoffset <float>           Specify qscale offset between P-frames and B-frames\n"
                     "-deviceID <integer>          Specify the GPU device on which encoding will take place\n"
+                    "-tiles <int,int,...>         Encode only the listed tile indices\n"
+                    "-frames <int,int>            Encode only frames <first,last> (inclusive), seeking to the first\n"
+                    "-keyframeIndex <string>      Load (or build and save) the input keyframe index used for seeking\n"
+                    "-cache <string>              Serve and store encoded tiles in the given cache directory\n"
+                    "-cacheSize <integer>         Limit the tile cache to the given size in MB (LRU eviction)\n"
+                    "-frameCache <string>         Serve decoded frames from (and spill them to) the given directory\n"
+                    "-frameCacheSize <integer>    Limit the frame cache to the given size in MB (LRU eviction)\n"
+                    "-checkpoint <string>         Periodically checkpoint progress to (and resume from) the given file\n"
+                    "-checkpointInterval <int>    Specify the number of frames between checkpoints\n"
+                    "-affinity <stage>=<cpus>     Pin the decoder or encoder thread to CPUs (e.g., encoder=4-7)\n"
+                    "-numa <integer|auto>         Run on (and allocate from) a NUMA node; auto spreads concurrent jobs\n"
+                    "-inlineDecode                Decode on demand on the encoder thread (no decode thread)\n"
+                    "-depths <name>=<int>,...     Pin buffering depths (decode, output, delay, queue, encode)\n"
+                    "-adaptiveDepths <integer>    Tune queue and encode depths within a budget in MB (0: unbounded)\n"
+                    "-frameIndex                  Write a binary frame index (<tile output>.idx) for each tile\n"
+                    "-pyramid <integer>           Also encode this many coarser levels, each halving the grid and size\n"
+                    "                                 (outputs named <template> with L<level>- before the index)\n"
+                    "-projection <string>         Reproject an equirectangular input to cube faces (cubemap or eac),\n"
+                    "                                 laid out 3x2 (left, front, right / down, back, up) for the grid\n"
+                    "-faceSize <integer>          Specify the cube face size (default a quarter of the source width)\n"
+                    "-mosaic <string>             Compose the inputs listed in the given file (one per line) into a grid\n"
+                    "                                 of cells, in place of -i, and encode the composite (needs -size;\n"
+                    "                                 -o 1,1,<template> encodes it in a single session)\n"
+                    "-mosaicGrid <int,int>        Specify the mosaic cells <rows,columns> (default as square as possible)\n"
+                    "-mosaicStall <integer>       Repeat a mosaic input's last frame once it is late by the given ms\n"
+                    "                                 (default 200; 0 waits for every input)\n"
+                    "-tileRates <tile>=<int>,...  Encode the listed tiles at 1/2, 1/4 or 1/8 of the frame rate (which\n"
+                    "                                 must divide evenly, as must the GOP length)\n"
+                    "-viewMap <string>            Lower the rate of rarely-viewed tiles (halved per halving of view\n"
+                    "                                 probability below the mean) from per-tile probabilities\n"
+                    "-sceneCut <float>            Force an IDR on every tile at scene cuts (histogram distance, e.g. 0.4)\n"
+                    "-lookahead <integer>         Specify the frames held back to confirm a scene cut (default 4)\n"
+                    "-allocateRate <integer>      Split a total bitrate across tiles by content (0: -bitrate per tile);\n"
+                    "                                 with -rcmode 0, offset each tile's QP instead\n"
+                    "-ring <string>               Also publish each tile to shared memory (/dev/shm/<string>-<tile>)\n"
+                    "-ringSize <integer>          Specify the size of each tile's shared-memory ring in MB (default 8,\n"
+                    "                                 at least 2)\n"
+                    "-metrics <string>            Write sampled per-tile PSNR/SSIM (CSV) to the given file\n"
+                    "-metricsSchedule <int,int>   Sample every <n> frames and report every <m> frames (default 30,300)\n"
+                    "-streams <string>            Run the streams listed in the given file concurrently, one per line:\n"
+                    "                                 <input> <rows,columns,template> [priority=<int>] [weight=<int>]\n"
+                    "-workers <integer>           Specify the number of decode/encode workers shared by -streams\n"
+                    "-maxSessions <integer>       Limit the encoder sessions open at once across -streams\n"
+                    "-streamMemory <integer>      Limit the planned device memory across -streams in MB\n"
+                    "-live <integer>              Encode against a deadline in ms per frame, skipping late tiles\n"
+                    "                                 (defaults to lowLatencyHP, no B-frames and minimal buffering)\n"
+                    "-importantTiles <int,...>    Encode the listed tiles first and skip them last in -live mode\n"
+                    "-latencyReport <string>      Write per-tile decode-to-output latency percentiles (CSV) in -live mode\n"
+                    "-push <string>               Stream each tile to an HTTP origin with chunked PUTs, to a URL\n"
+                    "                                 containing %d for the tile index (http://host:port/live/%d.hevc)\n"
+                    "-pushBuffer <integer>        Limit each pushed tile's unconfirmed output to the given size in MB\n"
+                    "-pushReport <string>         Write per-tile push throughput, reconnects and latency (CSV)\n"
+                    "-trace <string>              Write a per-frame, per-tile timeline (Chrome trace-event JSON)\n"
+                    "-plan                        Report the memory, sessions, files and threads needed, then exit\n"
+                    "-calibration <string>        Estimate throughput when planning from (and record runs to) a profile\n"
+                    "-autotune <string>           Search the pipeline depths and decode thread on a sample of the input\n"
+                    "                                 (or on synthetic frames without -i, given -size and -fps), and\n"
+                    "                                 record the fastest for this host and grid in a tuned profile\n"
+                    "-autotuneFrames <integer>    Frames measured by each autotune trial (300)\n"
+                    "-profile <string>            Use the tuned settings for this host and grid from a profile\n"
                     "-help                        Prints Help Information\n\n";
     return 1;
 }
 
-int DisplayConfiguration(const EncodeConfig& configuration, TileDimensions& dimensions)
-{
-    printf("Encoding input           : \"%s\"\n", configuration.inputFileName);
-    printf("         output          : \"%s\"\n", configuration.outputFileName);
-    printf("         codec           : \"%s\"\n", configuration.codec == NV_ENC_HEVC ? "HEVC" : "H264");
-    printf("         size            : %dx%d\n", configuration.width, configuration.height);
-    printf("         bitrate         : %d bits/sec\n", configuration.bitrate);
-    printf("         vbvMaxBitrate   : %d bits/sec\n", configuration.vbvMaxBitrate);
-    printf("         vbvSize         : %d bits\n", configuration.vbvSize);
-    printf("         fps             : %d frames/sec\n", configuration.fps);
-    printf("         rcMode          : %s\n", configuration.rcMode == NV_ENC_PARAMS_RC_CONSTQP ? "CONSTQP" :
-        configuration.rcMode == NV_ENC_PARAMS_RC_VBR ? "VBR" :
-        configuration.rcMode == NV_ENC_PARAMS_RC_CBR ? "CBR" :
-        configuration.rcMode == NV_ENC_PARAMS_RC_VBR_MINQP ? "VBR MINQP" :
-        configuration.rcMode == NV_ENC_PARAMS_RC_2_PASS_QUALITY ? "TWO_PASS_QUALITY" :
-        configuration.rcMode == NV_ENC_PARAMS_RC_2_PASS_FRAMESIZE_CAP ? "TWO_PASS_FRAMESIZE_CAP" :
-        configuration.rcMode == NV_ENC_PARAMS_RC_2_PASS_VBR ? "TWO_PASS_VBR" : "UNKNOWN");
-    if (configuration.gopLength == NVENC_INFINITE_GOPLENGTH)
-        printf("         goplength       : INFINITE GOP \n");
-    else
-        printf("         goplength       : %d \n", configuration.gopLength);
-    printf("         B frames        : %d \n", configuration.numB);
-    printf("         QP              : %d \n", configuration.qp);
-    printf("         preset          : %s\n", (configuration.presetGUID == NV_ENC_PRESET_LOW_LATENCY_HQ_GUID) ? "LOW_LATENCY_HQ" :
-        (configuration.presetGUID == NV_ENC_PRESET_LOW_LATENCY_HP_GUID) ? "LOW_LATENCY_HP" :
-        (configuration.presetGUID == NV_ENC_PRESET_HQ_GUID) ? "HQ_PRESET" :
-        (configuration.presetGUID == NV_ENC_PRESET_HP_GUID) ? "HP_PRESET" :
-        (configuration.presetGUID == NV_ENC_PRESET_LOSSLESS_HP_GUID) ? "LOSSLESS_HP" : "LOW_LATENCY_DEFAULT");
-    printf("         Tiles           : %lu, %lu\n", dimensions.rows, dimensions.columns);
-    printf("\n");
-
-    return 0;
-}
-
-float InitializeDecoder(CudaDecoder& decoder, CUVIDFrameQueue& queue, CUvideoctxlock& lock, EncodeConfig& configuration)
+// Consumes the arguments understood by Tiler (but not by CNvHWEncoder::ParseArguments), compacting argv
+int ParseTilerArguments(TilerOptions& options, EncodeConfig& configuration, int& argc, char* argv[])
 {
-    int decodedW, decodedH, decodedFRN, decodedFRD, isProgressive;
+    auto remaining = 1;
 
-    decoder.InitVideoDecoder(configuration.inputFileName, lock, &queue, configuration.width, configuration.height);
-
-    decoder.GetCodecParam(&decodedW, &decodedH, &decodedFRN, &decodedFRD, &isProgressive);
-    if (decodedFRN <= 0 || decodedFRD <= 0) {
-        decodedFRN = 30;
-        decodedFRD = 1;
-    }
-
-    if(configuration.width <= 0 || configuration.height <= 0) {
-        configuration.width  = decodedW;
-        configuration.height = decodedH;
-    }
-
-    float fpsRatio = 1.f;
-    if (configuration.fps <= 0)
-        configuration.fps = decodedFRN / decodedFRD;
-    else
-        fpsRatio = (float)configuration.fps * decodedFRD / decodedFRN;
-
-    configuration.pictureStruct = isProgressive ? NV_ENC_PIC_STRUCT_FRAME : 0;
-    queue.init(configuration.width, configuration.height);
-
-    return fpsRatio;
-}
-
-void EncodeWorker(CudaDecoder& decoder, VideoEncoder& encoder, CUVIDFrameQueue& queue, EncodeConfig& configuration,
-                  float fpsRatio)
-{
-    auto frmProcessed = 0;
-    auto frmActual = 0;
-
-    while(!(queue.isEndOfDecode() && queue.isEmpty()) )
-    {
-        CUVIDPARSERDISPINFO frame;
-
-        if(queue.dequeue(&frame))
+    for(auto i = 1; i < argc; i++)
+        if(!strcmp(argv[i], "-tiles") && i + 1 < argc)
+            for(auto& value: split(argv[++i], ','))
+                options.tiles.push_back(stoi(value));
+        else if(!strcmp(argv[i], "-frames") && i + 1 < argc)
         {
-            CUdeviceptr mappedFrame = 0;
-            CUVIDPROCPARAMS oVPP = { 0 };
-            unsigned int pitch;
-
-            oVPP.progressive_frame = frame.progressive_frame;
-            oVPP.second_field = 0;
-            oVPP.top_field_first = frame.top_field_first;
-            oVPP.unpaired_field = (frame.progressive_frame == 1 || frame.repeat_first_field <= 1);
-
-            cuvidMapVideoFrame(decoder.GetDecoder(), frame.picture_index, &mappedFrame, &pitch, &oVPP);
-
-            EncodeFrameConfig stEncodeConfig = { 0 };
-            auto pictureType = (frame.progressive_frame || frame.repeat_first_field >= 2 ? NV_ENC_PIC_STRUCT_FRAME :
-                (frame.top_field_first ? NV_ENC_PIC_STRUCT_FIELD_TOP_BOTTOM : NV_ENC_PIC_STRUCT_FIELD_BOTTOM_TOP));
-
-            stEncodeConfig.device_pointer = mappedFrame;
-            stEncodeConfig.pitch = pitch;
-            stEncodeConfig.width = configuration.width;
-            stEncodeConfig.height = configuration.height;
-
-            auto dropOrDuplicate = MatchFPS(fpsRatio, frmProcessed, frmActual);
-            for (auto i = 0; i <= dropOrDuplicate; i++) {
-                encoder.EncodeFrame(&stEncodeConfig, pictureType);
-                frmActual++;
-            }
-            frmProcessed++;
-
-            cuvidUnmapVideoFrame(decoder.GetDecoder(), mappedFrame);
-            queue.releaseFrame(&frame);
-       }
-    }
-
-    encoder.EncodeFrame(NULL, NV_ENC_PIC_STRUCT_FRAME, true);
-}
-
-int ExecuteWorkers(CudaDecoder& decoder, VideoEncoder& encoder, CUVIDFrameQueue& frameQueue,
-                   EncodeConfig& configuration, float fpsRatio, Statistics& statistics)
-{
-    pthread_t decode_pid;
-
-    NvQueryPerformanceCounter(&statistics.start);
-
-    // Start decoding thread
-    pthread_create(&decode_pid, NULL, DecodeWorker, (void*)&decoder);
-
-    // Execute encoder in main thread
-    EncodeWorker(decoder, encoder, frameQueue, configuration, fpsRatio);
-
-    pthread_join(decode_pid, NULL);
-
-    return 0;
-}
-
-int DisplayStatistics(CudaDecoder& decoder, VideoEncoder& encoder, Statistics& statistics)
-{
-    if (encoder.GetEncodedFrames() > 0)
-    {
-        NvQueryPerformanceCounter(&statistics.end);
-        NvQueryPerformanceFrequency(&statistics.frequency);
-
-        auto elapsedTime = (double)(statistics.end - statistics.start)/(double)statistics.frequency;
-        printf("Total time: %fms, Decoded Frames: %d, Encoded Frames: %ld, Average FPS: %f\n",
-            elapsedTime * 1000,
-            decoder.m_decodedFrames,
-            encoder.GetEncodedFrames(),
-            (float)encoder.GetEncodedFrames() / elapsedTime);
-    }
-
-    return 0;
-}
-
-
-int ParseTileParameters(EncodeConfig& configuration, TileDimensions& tileDimensions)
-{
-    auto values = split(configuration.outputFileName, ',');
-
-    if(values.size() != 3)
-        return error("Expected three arguments in output filename (e.g., '4,8,%d.h265')\n", -1);
-    else
-    {
-        tileDimensions.rows = stoi(values.at(0));
-        tileDimensions.columns = stoi(values.at(1));
-        tileDimensions.count = tileDimensions.rows * tileDimensions.columns;
-        strcpy(configuration.outputFileName, values.at(2).c_str());
-    }
+            auto values = split(argv[++i], ',');
+            if(values.size() != 2)
+                return error("Expected first and last frame (e.g., '300,599')\n", -1);
+            configuration.startFrameIdx = stoi(values.at(0));
+            configuration.endFrameIdx = stoi(values.at(1));
+        }
+        else if(!strcmp(argv[i], "-keyframeIndex") && i + 1 < argc)
+            options.keyframeIndexFilename = argv[++i];
+        else if(!strcmp(argv[i], "-cache") && i + 1 < argc)
+            options.cacheDirectory = argv[++i];
+        else if(!strcmp(argv[i], "-frameCache") && i + 1 < argc)
+            options.frameCacheDirectory = argv[++i];
+        else if(!strcmp(argv[i], "-frameCacheSize") && i + 1 < argc)
+            options.frameCacheCapacity = (size_t)atoll(argv[++i]) * 1024 * 1024;
+        else if(!strcmp(argv[i], "-cacheSize") && i + 1 < argc)
+            options.cacheCapacity = (size_t)atoll(argv[++i]) * 1024 * 1024;
+        else if(!strcmp(argv[i], "-affinity") && i + 1 < argc)
+        {
+            if(ParsePlacement(argv[++i], options.placement) != 0)
+                return error("Expected <decoder|encoder>=<cpu list> (e.g., 'decoder=0-3,8')\n", -1);
+        }
+        else if(!strcmp(argv[i], "-numa") && i + 1 < argc)
+        {
+            if(ParsePlacementNode(argv[++i], options.placement) != 0)
+                return error("Expected a NUMA node or 'auto'\n", -1);
+        }
+        else if(!strcmp(argv[i], "-inlineDecode"))
+            options.inlineDecode = true;
+        else if(!strcmp(argv[i], "-depths") && i + 1 < argc)
+        {
+            if(ParsePipelineDepths(argv[++i], options.depths) != 0)
+                return error("Expected <decode|output|delay|queue|encode>=<integer>,...\n", -1);
+        }
+        else if(!strcmp(argv[i], "-adaptiveDepths") && i + 1 < argc)
+        {
+            options.adaptiveDepths = true;
+            options.depthBudget = (size_t)atoll(argv[++i]) * 1024 * 1024;
+        }
+        else if(!strcmp(argv[i], "-trace") && i + 1 < argc)
+            options.traceFilename = argv[++i];
+        else if(!strcmp(argv[i], "-frameIndex"))
+            options.frameIndex = true;
+        else if(!strcmp(argv[i], "-metrics") && i + 1 < argc)
+            options.metricsFilename = argv[++i];
+        else if(!strcmp(argv[i], "-metricsSchedule") && i + 1 < argc)
+        {
+            auto values = split(argv[++i], ',');
+            if(values.size() != 2 || stoi(values.at(0)) <= 0 || stoi(values.at(1)) <= 0)
+                return error("Expected positive sample and report intervals (e.g., '30,300')\n", -1);
+            options.metricsInterval = stoi(values.at(0));
+            options.metricsSegment = stoi(values.at(1));
+        }
+        else if(!strcmp(argv[i], "-live") && i + 1 < argc)
+        {
+            auto deadline = atoi(argv[++i]);
+
+            if(deadline <= 0)
+                return error("Live deadline must be positive\n", -1);
+            options.liveDeadline = deadline;
+        }
+        else if(!strcmp(argv[i], "-importantTiles") && i + 1 < argc)
+            for(auto& value: split(argv[++i], ','))
+                options.importantTiles.push_back(stoi(value));
+        else if(!strcmp(argv[i], "-latencyReport") && i + 1 < argc)
+            options.latencyFilename = argv[++i];
+        else if(!strcmp(argv[i], "-push") && i + 1 < argc)
+            options.pushUrl = argv[++i];
+        else if(!strcmp(argv[i], "-pushBuffer") && i + 1 < argc)
+        {
+            if((options.pushBufferBytes = (size_t)atoll(argv[++i]) * 1024 * 1024) == 0)
+                return error("Push buffer must be at least 1MB\n", -1);
+        }
+        else if(!strcmp(argv[i], "-pushReport") && i + 1 < argc)
+            options.pushReportFilename = argv[++i];
+        else if(!strcmp(argv[i], "-pyramid") && i + 1 < argc)
+        {
+            if((options.pyramidLevels = atoi(argv[++i])) == 0 || options.pyramidLevels > MAXIMUM_PYRAMID_LEVELS)
+                return error("Pyramid levels must lie between 1 and 4\n", -1);
+        }
+        else if(!strcmp(argv[i], "-tileRates") && i + 1 < argc)
+        {
+            if(ParseTileRates(argv[++i], options.tileRates) != 0)
+                return error("Expected <tile>=<1|2|4|8>,... (e.g., '0=4,1=4,6=2')\n", -1);
+        }
+        else if(!strcmp(argv[i], "-projection") && i + 1 < argc)
+        {
+            if(ParseProjection(argv[++i], options.projection) != 0)
+                return error("Expected a projection of cubemap or eac\n", -1);
+        }
+        else if(!strcmp(argv[i], "-faceSize") && i + 1 < argc)
+            options.faceSize = (size_t)atoll(argv[++i]);
+        else if(!strcmp(argv[i], "-mosaic") && i + 1 < argc)
+            options.mosaicFilename = argv[++i];
+        else if(!strcmp(argv[i], "-mosaicGrid") && i + 1 < argc)
+        {
+            auto values = split(argv[++i], ',');
+            if(values.size() != 2 || stoi(values.at(0)) <= 0 || stoi(values.at(1)) <= 0)
+                return error("Expected positive mosaic rows and columns (e.g., '3,4')\n", -1);
+            options.mosaicGrid.rows = stoi(values.at(0));
+            options.mosaicGrid.columns = stoi(values.at(1));
+            options.mosaicGrid.count = options.mosaicGrid.rows * options.mosaicGrid.columns;
+        }
+        else if(!strcmp(argv[i], "-mosaicStall") && i + 1 < argc)
+            options.mosaicStall = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-viewMap") && i + 1 < argc)
+            options.viewMapFilename = argv[++i];
+        else if(!strcmp(argv[i], "-sceneCut") && i + 1 < argc)
+        {
+            if((options.sceneThreshold = atof(argv[++i])) <= 0 || options.sceneThreshold >= 1)
+                return error("Scene cut threshold must lie between 0 and 1 (e.g., 0.4)\n", -1);
+        }
+        else if(!strcmp(argv[i], "-lookahead") && i + 1 < argc)
+        {
+            if((options.sceneLookahead = atoi(argv[++i])) > MAXIMUM_SCENE_LOOKAHEAD)
+                return error("Lookahead exceeds the maximum of 16 frames\n", -1);
+        }
+        else if(!strcmp(argv[i], "-allocateRate") && i + 1 < argc)
+        {
+            options.rateAllocation = true;
+            options.rateBudget = (uint64_t)atoll(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-ring") && i + 1 < argc)
+            options.ringName = argv[++i];
+        else if(!strcmp(argv[i], "-ringSize") && i + 1 < argc)
+        {
+            auto megabytes = atoll(argv[++i]);
+
+            // Each ring must hold the largest bitstream buffer
+            if(megabytes <= 0 || (size_t)megabytes * 1024 * 1024 < BITSTREAM_BUFFER_SIZE)
+                return error("Ring size must be at least the 2MB bitstream buffer\n", -1);
+            options.ringBytes = (size_t)megabytes * 1024 * 1024;
+        }
+        else if(!strcmp(argv[i], "-streams") && i + 1 < argc)
+            options.streamsFilename = argv[++i];
+        else if(!strcmp(argv[i], "-workers") && i + 1 < argc)
+        {
+            // Checked before it is stored, as a negative count would wrap to a huge unsigned one
+            auto workers = atoi(argv[++i]);
+
+            if(workers <= 0)
+                return error("Worker count must be positive\n", -1);
+            options.streamLimits.workers = workers;
+        }
+        else if(!strcmp(argv[i], "-maxSessions") && i + 1 < argc)
+            options.streamLimits.sessions = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-streamMemory") && i + 1 < argc)
+            options.streamLimits.deviceBytes = (size_t)atoll(argv[++i]) * 1024 * 1024;
+        else if(!strcmp(argv[i], "-plan"))
+            options.plan = true;
+        else if(!strcmp(argv[i], "-calibration") && i + 1 < argc)
+            options.calibrationFilename = argv[++i];
+        else if(!strcmp(argv[i], "-autotune") && i + 1 < argc)
+            options.autotuneFilename = argv[++i];
+        else if(!strcmp(argv[i], "-autotuneFrames") && i + 1 < argc)
+            options.autotuneFrames = (size_t)atoll(argv[++i]);
+        else if(!strcmp(argv[i], "-profile") && i + 1 < argc)
+            options.profileFilename = argv[++i];
+        else if(!strcmp(argv[i], "-checkpoint") && i + 1 < argc)
+            options.checkpointFilename = argv[++i];
+        else if(!strcmp(argv[i], "-checkpointInterval") && i + 1 < argc)
+        {
+            if((options.checkpointInterval = atoi(argv[++i])) <= 0)
+                return error("Checkpoint interval must be positive\n", -1);
+        }
+        else
+            argv[remaining++] = argv[i];
 
+    argc = remaining;
     return 0;
 }
 
 int main(int argc, char* argv[])
 {
-    typedef void *CUDADRIVER;
-    CUDADRIVER hHandleDriver = 0;
-    CUcontext cudaCtx;
-    CUdevice device;
-    CUcontext curCtx;
-    CUvideoctxlock lock;
-    CUresult result;
-    NVENCSTATUS status;
-    CudaDecoder decoder;
-    CUVIDFrameQueue frameQueue(lock);
-    TileDimensions tileDimensions;
-    Statistics statistics;
-    float fpsRatio = 1.f;
-
-
-    if((result = cuInit(0, __CUDA_API_VERSION, hHandleDriver)) != CUDA_SUCCESS)
-        return error("Error in cuInit", result);
-	else if((result = cuvidInit(0)) != CUDA_SUCCESS)
-        return error("Error in cuInit", result);
+    TilerOptions options;
+    EncodeConfig encodeConfig;
 
-    EncodeConfig encodeConfig = { 0 };
-    encodeConfig.endFrameIdx = INT_MAX;
-    encodeConfig.bitrate = 5000000;
-    encodeConfig.rcMode = NV_ENC_PARAMS_RC_CONSTQP;
-    encodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
-    encodeConfig.codec = NV_ENC_H264;
-    encodeConfig.fps = 0;
-    encodeConfig.qp = 28;
-    encodeConfig.i_quant_factor = DEFAULT_I_QFACTOR;
-    encodeConfig.b_quant_factor = DEFAULT_B_QFACTOR;  
-    encodeConfig.i_quant_offset = DEFAULT_I_QOFFSET;
-    encodeConfig.b_quant_offset = DEFAULT_B_QOFFSET;   
-    encodeConfig.presetGUID = NV_ENC_PRESET_DEFAULT_GUID;
-    encodeConfig.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
+    GetDefaultTilerOptions(options, encodeConfig);
 
     // Verify arguments
-    if((status = CNvHWEncoder::ParseArguments(&encodeConfig, argc, argv)) != NV_ENC_SUCCESS)
+    if(ParseTilerArguments(options, encodeConfig, argc, argv) != 0)
         return PrintHelp();
-    else if (!encodeConfig.inputFileName || !encodeConfig.outputFileName)
+    else if(CNvHWEncoder::ParseArguments(&encodeConfig, argc, argv) != NV_ENC_SUCCESS)
+        return PrintHelp();
+    else if(options.streamsFilename == NULL && !encodeConfig.outputFileName)
+        return PrintHelp();
+    // Autotuning substitutes synthetic frames for a missing input, and a mosaic its composite
+    else if(options.streamsFilename == NULL && options.autotuneFilename == NULL && options.mosaicFilename == NULL &&
+            !encodeConfig.inputFileName)
         return PrintHelp();
-    else if (ParseTileParameters(encodeConfig, tileDimensions) != 0)
-        return error("ParseTileParameters", result);
-
-    // Initialize CUDA
-    else if((result = cuDeviceGet(&device, encodeConfig.deviceID)) != CUDA_SUCCESS)
-        return error("cuDeviceGet", result);
-    else if((result = cuCtxCreate(&cudaCtx, CU_CTX_SCHED_AUTO, device)) != CUDA_SUCCESS)
-        return error("cuCtxCreate", result);
-    else if((result = cuCtxPopCurrent(&curCtx)) != CUDA_SUCCESS)
-        return error("cuCtxPopCurrent", result);
-    else if((result = cuvidCtxLockCreate(&lock, curCtx)) != CUDA_SUCCESS)
-        return error("cuvidCtxLockCreate", result);
-    else if((fpsRatio = InitializeDecoder(decoder, frameQueue, lock, encodeConfig)) < 0)
-        return error("InitializeDecoder", -1);
-
-    // Initialize encoder
-    VideoEncoder encoder(lock, tileDimensions.columns, tileDimensions.rows);
-    if((status = encoder.Initialize(cudaCtx, NV_ENC_DEVICE_TYPE_CUDA)) != NV_ENC_SUCCESS)
-        return error("encoder.Initialize", -1);
-
-//    encodeConfig.presetGUID = NV_ENC_PRESET_DEFAULT_GUID; //encoder->GetPresetGUID();
-    else if(DisplayConfiguration(encodeConfig, tileDimensions) != 0)
-        return error("DisplayConfiguration", -1);
-    else if((status = encoder.CreateEncoders(encodeConfig)) != NV_ENC_SUCCESS)
-        return error("CreateEncoders", -1);
-    else if((status = encoder.AllocateIOBuffers(&encodeConfig)) != NV_ENC_SUCCESS)
-        return error("encoder.AllocateIOBuffers", -1);
-    else if(ExecuteWorkers(decoder, encoder, frameQueue, encodeConfig, fpsRatio, statistics) != 0)
-        return error("ExecuteWorkers", -1);
-    else if(DisplayStatistics(decoder, encoder, statistics) != 0)
-        return error("DisplayStatistics", -1);
-    else if((status = encoder.Deinitialize()) != NV_ENC_SUCCESS)
-        return error("encoder.Deinitialize", result);
-    if((result = cuvidCtxLockDestroy(lock)) != CUDA_SUCCESS)
-        return error("cuvidCtxLockDestroy", result);
-    else if((result = cuCtxDestroy(cudaCtx)) != CUDA_SUCCESS)
-        return error("cuCtxDestroy", result);
     else
-        return 0;
+        return RunTiler(options, encodeConfig);
 }
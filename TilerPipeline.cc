@@ -0,0 +1,1415 @@
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <sstream>
+
+#include "TilerPipeline.h"
+#include "TileCache.h"
+#include "FrameCache.h"
+#include "HttpSink.h"
+#include "Autotune.h"
+#include "ResourcePlan.h"
+#include "KeyframeIndex.h"
+#include "TileMetrics.h"
+#include "Transcode.h"
+#include "LiveMode.h"
+#include "RateAllocator.h"
+#include "SceneDetector.h"
+#include "TilePyramid.h"
+#include "Trace.h"
+typedef struct Statistics
+{
+    unsigned long long start, end, frequency;
+} Statistics;
+
+static int error(const char* message, const int exitCode)
+{
+    std::cerr << message;
+    return exitCode;
+}
+
+// Failures are reported as negative values, which never collide with TILER_CANCELLED
+static int cudaError(const char* component, const CUresult result)
+{
+    fprintf(stderr, "CUDA error %d in %s\n", result, component);
+    return -1;
+}
+
+typedef struct DecodeWorkerArguments
+{
+    CudaDecoder*     decoder;
+    const Placement* placement;
+} DecodeWorkerArguments;
+
+static void* DecodeWorker(void *arg)
+{
+    auto* arguments = (DecodeWorkerArguments*)arg;
+    TraceSetThreadName("decoder");
+    ApplyPlacement(*arguments->placement, STAGE_DECODER);
+    arguments->decoder->Start();
+
+    return NULL;
+}
+
+static int DisplayConfiguration(const EncodeConfig& configuration, TileDimensions& dimensions,
+                                const Placement& placement)
+{
+    printf("Encoding input           : \"%s\"\n", configuration.inputFileName);
+    printf("         output          : \"%s\"\n", configuration.outputFileName);
+    printf("         codec           : \"%s\"\n", configuration.codec == NV_ENC_HEVC ? "HEVC" : "H264");
+    printf("         size            : %dx%d\n", configuration.width, configuration.height);
+    printf("         bitrate         : %d bits/sec\n", configuration.bitrate);
+    printf("         vbvMaxBitrate   : %d bits/sec\n", configuration.vbvMaxBitrate);
+    printf("         vbvSize         : %d bits\n", configuration.vbvSize);
+    printf("         fps             : %d frames/sec\n", configuration.fps);
+    printf("         rcMode          : %s\n", configuration.rcMode == NV_ENC_PARAMS_RC_CONSTQP ? "CONSTQP" :
+        configuration.rcMode == NV_ENC_PARAMS_RC_VBR ? "VBR" :
+        configuration.rcMode == NV_ENC_PARAMS_RC_CBR ? "CBR" :
+        configuration.rcMode == NV_ENC_PARAMS_RC_VBR_MINQP ? "VBR MINQP" :
+        configuration.rcMode == NV_ENC_PARAMS_RC_2_PASS_QUALITY ? "TWO_PASS_QUALITY" :
+        configuration.rcMode == NV_ENC_PARAMS_RC_2_PASS_FRAMESIZE_CAP ? "TWO_PASS_FRAMESIZE_CAP" :
+        configuration.rcMode == NV_ENC_PARAMS_RC_2_PASS_VBR ? "TWO_PASS_VBR" : "UNKNOWN");
+    if (configuration.gopLength == NVENC_INFINITE_GOPLENGTH)
+        printf("         goplength       : INFINITE GOP \n");
+    else
+        printf("         goplength       : %d \n", configuration.gopLength);
+    printf("         B frames        : %d \n", configuration.numB);
+    printf("         QP              : %d \n", configuration.qp);
+    printf("         preset          : %s\n", (configuration.presetGUID == NV_ENC_PRESET_LOW_LATENCY_HQ_GUID) ? "LOW_LATENCY_HQ" :
+        (configuration.presetGUID == NV_ENC_PRESET_LOW_LATENCY_HP_GUID) ? "LOW_LATENCY_HP" :
+        (configuration.presetGUID == NV_ENC_PRESET_HQ_GUID) ? "HQ_PRESET" :
+        (configuration.presetGUID == NV_ENC_PRESET_HP_GUID) ? "HP_PRESET" :
+        (configuration.presetGUID == NV_ENC_PRESET_LOSSLESS_HP_GUID) ? "LOSSLESS_HP" : "LOW_LATENCY_DEFAULT");
+    printf("         Tiles           : %lu, %lu\n", dimensions.rows, dimensions.columns);
+    printf("         decoder threads : %s\n", DescribePlacement(placement, STAGE_DECODER).c_str());
+    printf("         encoder threads : %s\n", DescribePlacement(placement, STAGE_ENCODER).c_str());
+    printf("\n");
+
+    return 0;
+}
+
+// Applies depths chosen by the tuner to the frame queue and tile encoders.  Resizing writes out every
+// pending frame, so a failure leaves the outputs incomplete and ends the transcode.
+static int AdjustDepths(PipelineTuner* tuner, VideoEncoder& encoder, CUVIDFrameQueue& queue,
+                         const EncodeConfig& configuration, PipelineDepths& depths,
+                         const unsigned long long dequeueStall)
+{
+    PipelineStalls stalls = { queue.getSurfaceStall() * 1000, queue.getEnqueueStall() * 1000,
+                              dequeueStall, encoder.GetOutputStall() };
+
+    if(tuner == NULL || !tuner->Update(stalls, depths))
+        return 0;
+
+    queue.setCapacity(depths.queueSize);
+    if(encoder.ResizeIOBuffers(configuration, depths.encodeBuffers) != NV_ENC_SUCCESS)
+        return error("VideoEncoder::ResizeIOBuffers\n", -1);
+
+    printf("Pipeline depths adjusted: %s\n", DescribePipelineDepths(depths).c_str());
+    return 0;
+}
+
+// Encodes every frame of the source (through the scene-cut lookahead when there is one).  Once cancelled or
+// failed, the remaining frames are released without being encoded.
+static int EncodeWorker(FrameSource& source, CudaDecoder& decoder, VideoEncoder& encoder, CUVIDFrameQueue& queue,
+                        EncodeConfig& configuration, float fpsRatio, const TilerOptions& options,
+                        const TilerStages& stages, const Checkpoint* resume, PipelineTuner* tuner,
+                        PipelineDepths& depths, LiveSchedule* live, TilePyramid* pyramid)
+{
+    auto frmProcessed = resume ? resume->frmProcessed : 0;
+    auto frmActual = resume ? resume->frmActual : 0;
+    auto checkpointDue = false, cutDue = false, cut = false;
+    auto start = PipelineTuner::Now();
+    auto status = 0;
+    Checkpoint checkpoint;
+    DecodedFrame frame;
+
+    while(source.NextFrame(frame, cut))
+    {
+        EncodeFrameConfig stEncodeConfig = { 0 };
+        auto pictureType = GetPictureStruct(frame.info);
+
+        if(status != 0)
+        {
+            source.ReleaseFrame(frame);
+            continue;
+        }
+
+        stEncodeConfig.device_pointer = frame.device;
+        stEncodeConfig.pitch = frame.pitch;
+        stEncodeConfig.width = configuration.width;
+        stEncodeConfig.height = configuration.height;
+        stEncodeConfig.frame = frame.index;
+        stEncodeConfig.decoded = frame.decoded;
+
+        if(stages.transform != NULL && stages.transform->Apply(frame, stEncodeConfig) != 0)
+        {
+            status = error("FrameTransform::Apply\n", -1);
+            source.ReleaseFrame(frame);
+            source.Cancel();
+            continue;
+        }
+
+        auto dropOrDuplicate = MatchFPS(fpsRatio, frmProcessed, frmActual);
+
+        // Checkpoint at the first frame that is actually encoded once the interval has elapsed
+        if(options.checkpointFilename != NULL &&
+           (frame.index - configuration.startFrameIdx) % options.checkpointInterval == 0 &&
+           frame.index > configuration.startFrameIdx)
+            checkpointDue = true;
+        if(checkpointDue && dropOrDuplicate >= 0)
+        {
+            checkpoint.frame = frame.index;
+            checkpoint.frmProcessed = frmProcessed;
+            checkpoint.frmActual = frmActual;
+            stEncodeConfig.checkpoint = &checkpoint;
+            checkpointDue = false;
+        }
+        // A cut on a dropped frame moves to the next frame encoded
+        if((cutDue = cutDue || cut) && dropOrDuplicate >= 0)
+        {
+            stEncodeConfig.idr = true;
+            cutDue = false;
+        }
+
+        for (auto i = 0; i <= dropOrDuplicate && status == 0; i++) {
+            NVENCSTATUS encoded;
+
+            // Checkpoints and cuts need every tile, so they are never subject to the deadline
+            if (live != NULL && stEncodeConfig.checkpoint == NULL && !stEncodeConfig.idr)
+                encoded = live->EncodeFrame(encoder, stEncodeConfig, pictureType);
+            else
+                encoded = encoder.EncodeFrame(&stEncodeConfig, pictureType);
+            // Output that could not be written (or a checkpoint that could not be committed) fails the transcode
+            if (encoded != NV_ENC_SUCCESS)
+            {
+                status = error("VideoEncoder::EncodeFrame\n", -1);
+                source.Cancel();
+            }
+            // Every level is encoded from the same frame, so levels stay aligned with the finest
+            if (pyramid != NULL && status == 0 && pyramid->EncodeFrame(stEncodeConfig, pictureType) != 0)
+            {
+                status = error("TilePyramid::EncodeFrame\n", -1);
+                source.Cancel();
+            }
+            stEncodeConfig.checkpoint = NULL;
+            stEncodeConfig.idr = false;
+            frmActual++;
+        }
+        frmProcessed++;
+
+        source.ReleaseFrame(frame);
+
+        if(status == 0 && AdjustDepths(tuner, encoder, queue, configuration, depths, decoder.GetWaitTime()) != 0)
+        {
+            status = -1;
+            source.Cancel();
+        }
+
+        if(stages.progress != NULL)
+        {
+            TilerProgress progress = { frame.index, encoder.GetEncodedFrames(), PipelineTuner::Now() - start };
+
+            if(stages.progress(progress, stages.progressContext) != 0)
+            {
+                status = TILER_CANCELLED;
+                source.Cancel();
+            }
+        }
+    }
+
+    if(encoder.EncodeFrame(NULL, NV_ENC_PIC_STRUCT_FRAME, true) != NV_ENC_SUCCESS && status == 0)
+        status = error("VideoEncoder::EncodeFrame (flush)\n", -1);
+    if(pyramid != NULL && pyramid->Flush() != 0 && status == 0)
+        status = error("TilePyramid::Flush\n", -1);
+    if(decoder.HasFailed() && status == 0)
+        status = error("CudaDecoder: decoding failed\n", -1);
+    return status;
+}
+
+// Runs the decode thread (when frames come from the decoder on their own thread) alongside the encoder
+static int ExecuteWorkers(FrameSource& source, CudaDecoder& decoder, bool decodeThread, VideoEncoder& encoder,
+                          CUVIDFrameQueue& frameQueue, EncodeConfig& configuration, float fpsRatio,
+                          Statistics& statistics, TilerOptions& options, const TilerStages& stages,
+                          const Checkpoint* resume, PipelineTuner* tuner, LiveSchedule* live,
+                          TilePyramid* pyramid)
+{
+    pthread_t decode_pid;
+    DecodeWorkerArguments arguments = { &decoder, &options.placement };
+    int status;
+
+    NvQueryPerformanceCounter(&statistics.start);
+
+    // Every requested tile was served from the cache
+    if(encoder.GetEnabledTileCount() == 0)
+        return 0;
+
+    if(options.traceFilename != NULL)
+    {
+        TraceStart();
+        TraceSetThreadName("encoder");
+    }
+
+    // Start decoding thread, unless frames are decoded on demand by (and placed with) the encoder
+    if(decodeThread)
+    {
+        decoder.SetThreaded();
+        pthread_create(&decode_pid, NULL, DecodeWorker, (void*)&arguments);
+    }
+
+    // Execute encoder in the calling thread
+    status = EncodeWorker(source, decoder, encoder, frameQueue, configuration, fpsRatio, options, stages, resume, tuner,
+                          options.depths, live, pyramid);
+
+    if(decodeThread)
+        pthread_join(decode_pid, NULL);
+
+    if(options.traceFilename != NULL && TraceWrite(options.traceFilename) != 0)
+        return -1;
+    return status;
+}
+
+static int DisplayStatistics(CudaDecoder& decoder, VideoEncoder& encoder, Statistics& statistics,
+                             const TileCache* cache, const FrameCache* frameCache)
+{
+    if (frameCache != NULL)
+    {
+        auto& cacheStatistics = frameCache->GetStatistics();
+
+        printf("Frame cache: %lu hits, %lu misses, %lu stored, %lu evicted, %lu/%lu bytes\n",
+            cacheStatistics.hits,
+            cacheStatistics.misses,
+            cacheStatistics.stores,
+            cacheStatistics.evictions,
+            cacheStatistics.occupancy,
+            cacheStatistics.capacity);
+    }
+
+    if (cache != NULL)
+    {
+        auto& cacheStatistics = cache->GetStatistics();
+        auto lookups = cacheStatistics.hits + cacheStatistics.misses;
+
+        printf("Tile cache: %lu hits, %lu misses (%.1f%% hit rate), %lu stored, %lu evicted, %lu/%lu bytes\n",
+            cacheStatistics.hits,
+            cacheStatistics.misses,
+            lookups ? 100.f * cacheStatistics.hits / lookups : 0.f,
+            cacheStatistics.stores,
+            cacheStatistics.evictions,
+            cacheStatistics.occupancy,
+            cacheStatistics.capacity);
+    }
+
+    if (encoder.GetEncodedFrames() > 0)
+    {
+        NvQueryPerformanceCounter(&statistics.end);
+        NvQueryPerformanceFrequency(&statistics.frequency);
+
+        auto elapsedTime = (double)(statistics.end - statistics.start)/(double)statistics.frequency;
+        printf("Total time: %fms, Decoded Frames: %d, Encoded Frames: %ld, Average FPS: %f\n",
+            elapsedTime * 1000,
+            decoder.m_decodedFrames,
+            encoder.GetEncodedFrames(),
+            (float)encoder.GetEncodedFrames() / elapsedTime);
+    }
+
+    return 0;
+}
+
+
+// Points the output name at the filename template, held in templateStorage
+static int ParseTileParameters(EncodeConfig& configuration, TileDimensions& tileDimensions,
+                               std::vector<char>& templateStorage)
+{
+    std::string filenameTemplate;
+
+    if(ParseTileDimensions(configuration.outputFileName, tileDimensions, filenameTemplate) != 0)
+        return -1;
+
+    templateStorage.assign(filenameTemplate.c_str(), filenameTemplate.c_str() + filenameTemplate.size() + 1);
+    configuration.outputFileName = templateStorage.data();
+
+    return 0;
+}
+
+// Disables tiles that were not requested or that are served from the cache
+static int SelectTiles(VideoEncoder& encoder, TileCache* cache, std::vector<std::string>& cacheKeys,
+                       const std::string& fingerprint, const TilerOptions& options, const EncodeConfig& configuration,
+                       const TileDimensions& dimensions)
+{
+    auto tileWidth = configuration.width / dimensions.columns;
+    auto tileHeight = configuration.height / dimensions.rows;
+
+    cacheKeys.assign(dimensions.count, std::string());
+
+    if(!options.tiles.empty())
+    {
+        for(auto i = 0u; i < dimensions.count; i++)
+            encoder.SetTileEnabled(i, false);
+        for(auto tile: options.tiles)
+            if(tile >= dimensions.count)
+                return error("Requested tile lies outside of the tile grid\n", -1);
+            else
+                encoder.SetTileEnabled(tile, true);
+    }
+
+    for(auto i = 0u; cache != NULL && i < dimensions.count; i++)
+    {
+        TileRect rect = { (i % dimensions.columns) * tileWidth, (i / dimensions.columns) * tileHeight,
+                          tileWidth, tileHeight };
+
+        if(!encoder.IsTileEnabled(i))
+            continue;
+
+        cacheKeys[i] = cache->Key(fingerprint, configuration, rect, configuration.startFrameIdx,
+                                  configuration.endFrameIdx, options.sceneThreshold, options.sceneLookahead);
+        if(cache->Fetch(cacheKeys[i], TileFilename(configuration.outputFileName, i)))
+            encoder.SetTileEnabled(i, false);
+    }
+
+    return 0;
+}
+
+// Decimates the tiles named by -tileRates, and those that -viewMap shows to be rarely viewed.  A decimated
+// tile's cadence restarts at every forced IDR, so its output neither resumes from a checkpoint nor matches
+// a cached tile.
+static int ApplyTileRates(VideoEncoder& encoder, const TilerOptions& options, const EncodeConfig& configuration,
+                          const TileDimensions& dimensions)
+{
+    std::vector<unsigned int> divisors(dimensions.count, 1);
+    std::vector<double> probabilities;
+    std::vector<bool> enabled;
+    auto decimated = 0lu;
+
+    if(options.tileRates.empty() && options.viewMapFilename == NULL)
+        return 0;
+    else if(options.checkpointFilename != NULL || options.cacheDirectory != NULL)
+        return error("Decimated tiles are neither checkpointed nor cached\n", -1);
+    else if(options.viewMapFilename != NULL &&
+            LoadViewMap(options.viewMapFilename, dimensions.count, probabilities) != 0)
+        return error("Expected a non-negative view probability for each tile in the view map\n", -1);
+    else if(options.viewMapFilename != NULL)
+        GetViewMapDivisors(probabilities, MAXIMUM_RATE_DIVISOR, divisors);
+
+    // Explicit rates take precedence over those of the view map
+    for(auto& rate: options.tileRates)
+        if(rate.tile >= dimensions.count)
+            return error("Decimated tile lies outside of the tile grid\n", -1);
+        else
+            divisors[rate.tile] = rate.divisor;
+
+    // NVENC sessions take an integral frame rate, so a decimated tile's rate must be exact
+    for(auto i = 0u; i < dimensions.count; i++)
+        if(configuration.gopLength != NVENC_INFINITE_GOPLENGTH && configuration.gopLength % (int)divisors[i] != 0)
+            return error("The GOP length must be a multiple of every rate divisor\n", -1);
+        else if(configuration.fps % (int)divisors[i] != 0)
+            return error("The frame rate must be a multiple of every rate divisor\n", -1);
+        else
+        {
+            encoder.SetTileRateDivisor(i, divisors[i]);
+            enabled.push_back(encoder.IsTileEnabled(i));
+            decimated += enabled.back() && divisors[i] > 1;
+        }
+
+    printf("Temporal decimation: %lu tiles below full rate, %.0f%% of tile frames encoded\n", decimated,
+           100 * GetEncodedFraction(divisors, enabled));
+    return 0;
+}
+
+// Adds newly-encoded tiles to the cache; failing to cache a tile is not fatal
+static int StoreTiles(VideoEncoder& encoder, TileCache* cache, const std::vector<std::string>& cacheKeys,
+                      const EncodeConfig& configuration, const TileDimensions& dimensions)
+{
+    for(auto i = 0u; cache != NULL && i < dimensions.count; i++)
+        if(encoder.IsTileEnabled(i) && cache->Store(cacheKeys[i], TileFilename(configuration.outputFileName, i)) != 0)
+            fprintf(stderr, "Unable to cache tile %u\n", i);
+
+    return 0;
+}
+
+// Arranges for encoding to continue from the last checkpoint: outputs are truncated to the aligned IDR
+// and frames preceding it are skipped
+static int ResumeFromCheckpoint(VideoEncoder& encoder, const Checkpoint* resume, const TilerOptions& options,
+                                EncodeConfig& configuration)
+{
+    if(options.checkpointFilename != NULL)
+        encoder.EnableCheckpoints(options.checkpointFilename);
+
+    if(resume != NULL)
+    {
+        printf("Resuming from checkpoint at frame %d\n", resume->frame);
+        encoder.SetResumeOffsets(resume->offsets);
+        configuration.startFrameIdx = std::max(configuration.startFrameIdx, resume->frame);
+    }
+
+    return 0;
+}
+
+// Looks up the decoded frames of -frameCache.  A hit replaces the decoder as the source, supplying the source
+// format that the decoder would have.  Frames are cached only for whole runs of the decoder, so neither a
+// custom source nor a resumed checkpoint is combined with the cache.
+static int OpenFrameCache(FrameCache*& frameCache, FrameCacheReader*& cached, std::string& key, FrameSource*& source,
+                          float& fpsRatio, CUvideoctxlock lock, const std::string& fingerprint,
+                          const TilerOptions& options, EncodeConfig& configuration, const TilerStages& stages)
+{
+    if(options.frameCacheDirectory == NULL)
+        return 0;
+    else if(stages.source != NULL || options.checkpointFilename != NULL)
+        return error("Decoded frames are cached only for whole, unresumed runs of the decoder\n", -1);
+    else if((frameCache = new FrameCache(options.frameCacheDirectory, options.frameCacheCapacity))->Open() != 0)
+        return error("Unable to open the frame cache\n", -1);
+
+    key = frameCache->Key(fingerprint, configuration.width, configuration.height,
+                          std::max(configuration.startFrameIdx, 0), configuration.endFrameIdx);
+    if((cached = frameCache->Fetch(key, lock)) == NULL)
+        return 0;
+
+    auto& header = cached->GetHeader();
+    fpsRatio = MatchSourceFormat(configuration, header.width, header.height, header.frameRateNumerator,
+                                 header.frameRateDenominator, header.progressive);
+    source = cached;
+
+    printf("Reading %u decoded frames from the frame cache\n", header.frames);
+    return 0;
+}
+
+// Spills the frames of a frame cache miss as the decoder produces them
+static int CreateFrameSpill(FrameCacheWriter*& spill, FrameSource*& source, FrameCache* frameCache,
+                            const std::string& key, CudaDecoder& decoder, CUvideoctxlock lock,
+                            const EncodeConfig& configuration)
+{
+    FrameCacheHeader header = { FRAME_CACHE_MAGIC, FRAME_CACHE_VERSION,
+                                (uint32_t)configuration.width, (uint32_t)configuration.height };
+    int width, height, progressive;
+
+    decoder.GetCodecParam(&width, &height, &header.frameRateNumerator, &header.frameRateDenominator, &progressive);
+    header.progressive = progressive;
+
+    spill = frameCache->Spill(key, *source, lock, header);
+    source = spill;
+
+    if(!spill->IsSpilling())
+        fprintf(stderr, "Unable to spill decoded frames to the frame cache\n");
+    return 0;
+}
+
+// Limits decoding to the requested frames, starting from the IDR that precedes the first of them
+static int SeekDecoder(CudaDecoder& decoder, const TilerOptions& options, const EncodeConfig& configuration)
+{
+    auto first = std::max(configuration.startFrameIdx, 0);
+    auto hevc = decoder.m_oVideoDecodeCreateInfo.CodecType == cudaVideoCodec_HEVC;
+    const Keyframe* keyframe = NULL;
+    KeyframeIndex index;
+
+    if(first > configuration.endFrameIdx)
+        return error("The first frame follows the last\n", -1);
+    else if(first > 0 && (options.keyframeIndexFilename == NULL ||
+                          LoadKeyframeIndex(options.keyframeIndexFilename, configuration.inputFileName, index) != 0))
+    {
+        if(BuildKeyframeIndex(configuration.inputFileName, hevc, index) != 0)
+            return error("Unable to index the input keyframes\n", -1);
+        // Seeking still works without a saved index
+        else if(options.keyframeIndexFilename != NULL && SaveKeyframeIndex(options.keyframeIndexFilename, index) != 0)
+            fprintf(stderr, "Unable to save keyframe index %s\n", options.keyframeIndexFilename);
+    }
+
+    if(first > 0 && (keyframe = FindKeyframe(index, first)) != NULL && keyframe->frame > 0)
+    {
+        printf("Seeking to the keyframe at frame %d\n", keyframe->frame);
+        decoder.SetFrameRange(first, configuration.endFrameIdx, index.headerBytes, keyframe->offset, keyframe->frame);
+    }
+    else
+        decoder.SetFrameRange(first, configuration.endFrameIdx);
+
+    return 0;
+}
+
+// Starts tuning from the depths in effect once the decoder and encoders exist
+static int CreateTuner(PipelineTuner*& tuner, VideoEncoder& encoder, TilerOptions& options,
+                       const EncodeConfig& configuration)
+{
+    auto& depths = options.depths;
+
+    depths.encodeBuffers = encoder.GetIOBufferCount();
+
+    if(options.adaptiveDepths)
+    {
+        tuner = new PipelineTuner(options.depthBudget,
+                                  (size_t)configuration.width * configuration.height * 3 / 2,
+                                  encoder.GetIOBufferBytes(configuration),
+                                  configuration.numB + 2,
+                                  configuration.numB == 0);
+
+        if(options.depthBudget && tuner->GetFootprint(depths) > options.depthBudget)
+            fprintf(stderr, "Initial pipeline depths (%lu bytes) exceed the budget; they will not grow\n",
+                    tuner->GetFootprint(depths));
+    }
+
+    printf("Pipeline depths: %s\n", DescribePipelineDepths(depths).c_str());
+    return 0;
+}
+
+// Measures the quality of every enabled tile as its output is written
+static int CreateMetrics(TileMetrics*& metrics, VideoEncoder& encoder, CUvideoctxlock lock, const TilerOptions& options,
+                         const EncodeConfig& configuration, const TileDimensions& dimensions)
+{
+    if(options.metricsFilename == NULL)
+        return 0;
+
+    metrics = new TileMetrics(lock, dimensions.count, options.metricsInterval, options.metricsSegment);
+    for(auto i = 0u; i < dimensions.count; i++)
+        metrics->SetTileEnabled(i, encoder.IsTileEnabled(i));
+
+    if(metrics->Open(options.metricsFilename,
+                     configuration.codec == NV_ENC_HEVC ? cudaVideoCodec_HEVC : cudaVideoCodec_H264,
+                     configuration.width / dimensions.columns, configuration.height / dimensions.rows) != 0)
+        return error("Unable to open metrics output\n", -1);
+
+    encoder.EnableMetrics(metrics);
+    return 0;
+}
+
+// Favours latency over throughput in live mode: the low-latency preset, no B-frames (which hold frames back
+// until a later reference arrives) and the least buffering.  Explicit choices are left alone.
+static int ApplyLiveDefaults(TilerOptions& options, EncodeConfig& configuration)
+{
+    static char preset[] = "lowLatencyHP";
+    auto& depths = options.depths;
+
+    if(options.liveDeadline == 0)
+        return 0;
+    // A tile that falls behind the deadline omits frames, which the cache key cannot know of
+    else if(options.cacheDirectory != NULL)
+        return error("Live tiles are not cached\n", -1);
+
+    if(configuration.encoderPreset == NULL)
+    {
+        configuration.encoderPreset = preset;
+        configuration.presetGUID = NV_ENC_PRESET_LOW_LATENCY_HP_GUID;
+    }
+    if(configuration.numB > 0)
+        fprintf(stderr, "B-frames add %d frames of latency in live mode\n", configuration.numB);
+
+    if(depths.displayDelay < 0)
+        depths.displayDelay = 0;
+    if(depths.queueSize == 0)
+        depths.queueSize = LIVE_QUEUE_SIZE;
+    if(depths.encodeBuffers == 0)
+        depths.encodeBuffers = LIVE_ENCODE_BUFFERS;
+
+    return 0;
+}
+
+// Holds decoded frames mapped for the scene-cut lookahead
+static int ReserveLookahead(TilerOptions& options)
+{
+    auto& depths = options.depths;
+    auto required = SceneDetector::GetRequiredOutputSurfaces(options.sceneLookahead);
+
+    if(options.sceneThreshold <= 0)
+        return 0;
+    else if(depths.outputSurfaces != 0 && depths.outputSurfaces < required)
+        return error("The scene-cut lookahead needs an output surface per frame held\n", -1);
+
+    depths.outputSurfaces = std::max(depths.outputSurfaces, required);
+    return 0;
+}
+
+// Finds scene cuts ahead of the encoder once the source (and the size of its frames) is known
+static int CreateSceneDetector(SceneDetector*& detector, FrameSource& upstream, const bool decoded,
+                               CUvideoctxlock lock, const TilerOptions& options, const EncodeConfig& configuration)
+{
+    if(options.sceneThreshold <= 0)
+        return 0;
+    // Held frames keep their decode surfaces, and the decoder needs at least one more
+    else if(decoded && options.depths.decodeSurfaces <= SceneDetector::GetRequiredOutputSurfaces(options.sceneLookahead))
+        return error("Too few decode surfaces for the scene-cut lookahead\n", -1);
+
+    detector = new SceneDetector(upstream, lock, configuration.width, configuration.height, options.sceneLookahead,
+                                 options.sceneThreshold);
+    return 0;
+}
+
+// Reprojects each frame to the cube faces of -projection before it is tiled.  Everything downstream of the
+// transform (tile selection, encoders, pyramid levels) sees the cubemap size.
+static int CreateProjection(CubemapProjection*& projection, CUvideoctxlock lock, const TilerOptions& options,
+                            EncodeConfig& configuration, const TileDimensions& dimensions, TilerStages& projected)
+{
+    auto faceSize = options.faceSize ? options.faceSize : CubemapProjection::GetDefaultFaceSize(configuration.width);
+    auto sourcePixels = (size_t)configuration.width * configuration.height;
+
+    if(options.projection == PROJECTION_NONE)
+        return 0;
+    else if(projected.transform != NULL)
+        return error("A projection cannot be combined with a frame transform\n", -1);
+    // The cache key does not distinguish a projected tile from one of the same size cut from the source
+    else if(options.cacheDirectory != NULL)
+        return error("Projected tiles are not cached\n", -1);
+    else if(faceSize == 0 || faceSize % 8 != 0)
+        return error("The face size must be a positive multiple of 8\n", -1);
+    else if(dimensions.columns % 3 != 0 || dimensions.rows % 2 != 0)
+        fprintf(stderr, "Tiles straddle cube faces unless the grid has a multiple of 3 columns and 2 rows\n");
+
+    projection = new CubemapProjection(lock, options.projection, configuration.width, configuration.height, faceSize);
+    if(projection->Create() != 0)
+        return error("Unable to create the projection\n", -1);
+
+    configuration.width = projection->GetWidth();
+    configuration.height = projection->GetHeight();
+    projected.transform = projection;
+
+    printf("Projection: %s, faces of %lux%lu, %.0f%% of the source pixels\n", DescribeProjection(options.projection),
+           faceSize, faceSize, 100. * configuration.width * configuration.height / sourcePixels);
+    return 0;
+}
+
+// Encodes the coarser grids of -pyramid from the frames the finest is encoded from.  Only the finest level
+// is truncated on resume or stored in the cache, so neither is combined with a pyramid.
+static int CreatePyramid(TilePyramid*& pyramid, CUcontext context, CUvideoctxlock lock, const TilerOptions& options,
+                         const EncodeConfig& configuration, const TileDimensions& dimensions, const TilerStages& stages)
+{
+    if(options.pyramidLevels == 0)
+        return 0;
+    else if(options.checkpointFilename != NULL || options.cacheDirectory != NULL || stages.noFiles)
+        return error("Pyramid levels are written to files, and neither checkpointed nor cached\n", -1);
+    else if(!TilePyramid::IsDivisible(dimensions, configuration.width, configuration.height, options.pyramidLevels))
+        return error("The tile grid and frame size must halve evenly at every pyramid level\n", -1);
+
+    pyramid = new TilePyramid(lock, dimensions, configuration.width, configuration.height, options.pyramidLevels);
+    if(pyramid->Create(context, configuration, options.depths.encodeBuffers, options.frameIndex) != 0)
+        return error("Unable to create the pyramid encoders\n", -1);
+
+    printf("Pyramid: %lu coarser levels, %lu tiles\n", pyramid->GetLevelCount(),
+           TilePyramid::GetSessions(dimensions, options.pyramidLevels));
+    return 0;
+}
+
+// Encodes against the -live deadline, recording the latency of every tile frame
+static int CreateLiveSchedule(LiveSchedule*& live, VideoEncoder& encoder, const TilerOptions& options,
+                              const TileDimensions& dimensions)
+{
+    if(options.liveDeadline == 0)
+        return 0;
+
+    for(auto tile: options.importantTiles)
+        if(tile >= dimensions.count)
+            return error("Important tile lies outside of the tile grid\n", -1);
+
+    live = new LiveSchedule(options.liveDeadline * 1000ull, dimensions.count, options.importantTiles);
+    encoder.EnableLatency(live);
+    return 0;
+}
+
+// Reports live latency percentiles, and writes them per tile when requested
+static int ReportLatency(const LiveSchedule* live, const TilerOptions& options)
+{
+    if(live == NULL)
+        return 0;
+
+    printf("%s", live->Describe().c_str());
+    return options.latencyFilename != NULL ? live->WriteReport(options.latencyFilename) : 0;
+}
+
+// Distributes the bitrate budget (or, at constant QP, the QP) across the encoded tiles by content,
+// reallocating at GOP boundaries
+static int CreateRateAllocator(RateAllocator*& allocator, VideoEncoder& encoder, CUvideoctxlock lock,
+                               const TilerOptions& options, const EncodeConfig& configuration,
+                               const TileDimensions& dimensions)
+{
+    auto budget = options.rateBudget ? options.rateBudget : (uint64_t)configuration.bitrate * encoder.GetEnabledTileCount();
+    auto interval = configuration.gopLength == NVENC_INFINITE_GOPLENGTH ? DEFAULT_RATE_INTERVAL : configuration.gopLength;
+
+    if(!options.rateAllocation)
+        return 0;
+    // A tile's share of the budget depends on the content of every other tile encoded with it
+    else if(options.cacheDirectory != NULL)
+        return error("Tiles encoded with rate allocation are not cached\n", -1);
+
+    allocator = new RateAllocator(lock, dimensions, configuration.width, configuration.height, budget,
+                                  configuration.rcMode == NV_ENC_PARAMS_RC_CONSTQP, interval);
+    encoder.EnableRateAllocation(allocator);
+    return 0;
+}
+
+// Reports the depths that tuning settled on so that they can be pinned with -depths
+static void ReportDepths(const PipelineTuner* tuner, PipelineDepths depths)
+{
+    if(tuner == NULL)
+        return;
+
+    if(tuner->GetRecommendedDecodeSurfaces() > depths.decodeSurfaces)
+        depths.decodeSurfaces = tuner->GetRecommendedDecodeSurfaces();
+
+    printf("Tuned pipeline depths: -depths %s\n", DescribePipelineDepths(depths).c_str());
+}
+
+// Reports the resources the transcode would acquire; neither the device nor the outputs are touched
+static int PlanTranscode(const TilerOptions& options, const EncodeConfig& configuration,
+                         const TileDimensions& dimensions)
+{
+    std::vector<bool> selected(dimensions.count, options.tiles.empty());
+    std::vector<CalibrationEntry> calibration;
+    ResourcePlan plan;
+
+    for(auto tile: options.tiles)
+        if(tile >= dimensions.count)
+            return error("Requested tile lies outside of the tile grid\n", -1);
+        else
+            selected[tile] = true;
+
+    auto sessions = (size_t)std::count(selected.begin(), selected.end(), true);
+    // Files opened alongside the tile outputs: checkpoint, trace, cache index and entry, calibration, metrics,
+    // latency report
+    auto auxiliaryFiles = (options.checkpointFilename != NULL) + (options.traceFilename != NULL) +
+                          2 * (options.cacheDirectory != NULL) + (options.calibrationFilename != NULL) +
+                          (options.metricsFilename != NULL) + (options.latencyFilename != NULL);
+
+    if(PlanResources(configuration, dimensions, sessions, options.depths, options.inlineDecode, auxiliaryFiles,
+                     plan) != 0)
+        return error("Planning requires the output size (-size)\n", -1);
+    else if(options.calibrationFilename != NULL && LoadCalibration(options.calibrationFilename, calibration) == 0)
+        plan.framesPerSecond = EstimateFramesPerSecond(calibration, configuration, sessions);
+
+    if(options.ringName != NULL)
+        plan.hostBytes += sessions * (sizeof(TileRingHeader) + options.ringBytes);
+    // Pyramid tiles are the size of the finest, and each level's frame is held on the host and the device
+    if(options.pyramidLevels > 0)
+    {
+        auto levelSessions = TilePyramid::GetSessions(dimensions, options.pyramidLevels);
+        auto frameBytes = TilePyramid::GetFrameBytes(configuration.width, configuration.height, options.pyramidLevels);
+
+        plan.sessions += levelSessions;
+        plan.deviceBytes += levelSessions * plan.encodeBuffers * (plan.inputBufferBytes + plan.bitstreamBufferBytes) +
+                            frameBytes;
+        plan.hostBytes += (size_t)configuration.width * configuration.height * 3 / 2 + frameBytes;
+        plan.fileHandles += levelSessions;
+    }
+
+    printf("Resource plan for %dx%d in %lux%lu tiles (no device was used)\n",
+           configuration.width, configuration.height, dimensions.rows, dimensions.columns);
+    printf("%s", DescribeResourcePlan(plan).c_str());
+    if(plan.framesPerSecond > 0 && configuration.fps > 0 && plan.framesPerSecond < configuration.fps)
+        printf("Estimated throughput is below the requested %d frames/sec\n", configuration.fps);
+
+    return 0;
+}
+
+// Appends the throughput of a completed transcode to the calibration profile
+static int RecordCalibration(const TilerOptions& options, VideoEncoder& encoder, const EncodeConfig& configuration,
+                             Statistics& statistics)
+{
+    if(options.calibrationFilename == NULL || encoder.GetEncodedFrames() == 0)
+        return 0;
+
+    NvQueryPerformanceCounter(&statistics.end);
+    NvQueryPerformanceFrequency(&statistics.frequency);
+
+    auto elapsedTime = (double)(statistics.end - statistics.start)/(double)statistics.frequency;
+    CalibrationEntry entry = { configuration.codec,
+                               configuration.encoderPreset ? configuration.encoderPreset : "default",
+                               configuration.width, configuration.height,
+                               encoder.GetEnabledTileCount(),
+                               encoder.GetEncodedFrames() / elapsedTime };
+
+    return SaveCalibration(options.calibrationFilename, entry);
+}
+
+// Runs every stream listed in the -streams file on one context and a shared pool of workers.  Options that
+// apply to a single input (tile selection, seeking, checkpoints, caching, metrics) are not used.
+static int TranscodeStreams(const TilerOptions& options, const EncodeConfig& configuration)
+{
+    typedef void *CUDADRIVER;
+    std::vector<StreamDefinition> definitions;
+    CUDADRIVER hHandleDriver = 0;
+    CUcontext context, current;
+    CUdevice device;
+    CUvideoctxlock lock;
+    CUresult result;
+
+    if(LoadStreamDefinitions(options.streamsFilename, definitions) != 0)
+        return error("Unable to read the stream list\n", -1);
+    else if(definitions.empty())
+        return error("The stream list is empty\n", -1);
+    else if((result = cuInit(0, __CUDA_API_VERSION, hHandleDriver)) != CUDA_SUCCESS)
+        return cudaError("Error in cuInit", result);
+    else if((result = cuvidInit(0)) != CUDA_SUCCESS)
+        return cudaError("Error in cuvidInit", result);
+    else if((result = cuDeviceGet(&device, configuration.deviceID)) != CUDA_SUCCESS)
+        return cudaError("cuDeviceGet", result);
+    else if((result = cuCtxCreate(&context, CU_CTX_SCHED_AUTO, device)) != CUDA_SUCCESS)
+        return cudaError("cuCtxCreate", result);
+    else if((result = cuCtxPopCurrent(&current)) != CUDA_SUCCESS)
+        return cudaError("cuCtxPopCurrent", result);
+    else if((result = cuvidCtxLockCreate(&lock, current)) != CUDA_SUCCESS)
+        return cudaError("cuvidCtxLockCreate", result);
+
+    auto* scheduler = new StreamScheduler(context, lock, configuration, options.streamLimits);
+    auto status = 0;
+
+    for(auto& definition: definitions)
+        if(scheduler->Add(definition) != 0)
+            status = error("Unable to schedule stream\n", -1);
+
+    if(status == 0)
+    {
+        if(options.traceFilename != NULL)
+            TraceStart();
+
+        printf("Running %lu streams on %lu workers\n", scheduler->GetStreamCount(), options.streamLimits.workers);
+        status = scheduler->Run();
+        printf("%s", scheduler->DescribeStatistics().c_str());
+
+        if(options.traceFilename != NULL && TraceWrite(options.traceFilename) != 0)
+            status = error("TraceWrite", -1);
+    }
+
+    delete scheduler;
+
+    if((result = cuvidCtxLockDestroy(lock)) != CUDA_SUCCESS)
+        return cudaError("cuvidCtxLockDestroy", result);
+    else if((result = cuCtxDestroy(context)) != CUDA_SUCCESS)
+        return cudaError("cuCtxDestroy", result);
+
+    return status;
+}
+
+// A source other than the decoder has no input file to seek in, cache by or resume, and no stream to take the
+// output size and rate from
+static int CheckStages(const TilerOptions& options, const EncodeConfig& configuration, const TilerStages& stages)
+{
+    if(stages.noFiles && (options.checkpointFilename != NULL || options.frameIndex || options.cacheDirectory != NULL))
+        return error("Checkpoints, frame indexes and caching need file output\n", -1);
+    else if(stages.source == NULL)
+        return 0;
+    else if(stages.context == NULL)
+        return error("A frame source needs the context it allocates from\n", -1);
+    else if(configuration.width <= 0 || configuration.height <= 0 || configuration.fps <= 0)
+        return error("A frame source needs the output size and rate (-size, -fps)\n", -1);
+    else if(options.checkpointFilename != NULL || options.cacheDirectory != NULL || options.adaptiveDepths ||
+            configuration.startFrameIdx > 0 || configuration.endFrameIdx != INT_MAX)
+        return error("Checkpoints, caching, adaptive depths and frame ranges need the decoder source\n", -1);
+
+    return 0;
+}
+
+// Hands tile outputs to the sink stages, in place of the files when asked
+static int ConnectSinks(VideoEncoder& encoder, const TilerStages& stages)
+{
+    for(auto* sink: stages.sinks)
+        encoder.AddSink(sink);
+    if(stages.noFiles)
+        encoder.DisableFileOutput();
+
+    return 0;
+}
+
+// Adds the frame index and ring that accompany each tile's output when requested
+static int EnableOutputs(VideoEncoder& encoder, const TilerOptions& options)
+{
+    if(options.frameIndex)
+        encoder.EnableFrameIndex();
+    if(options.ringName != NULL && encoder.EnableRing(options.ringName, options.ringBytes) != 0)
+        return error("A tile ring must hold the largest bitstream buffer\n", -1);
+
+    return 0;
+}
+
+// Streams each encoded tile to the -push origin as it is produced
+static int CreatePushSink(HttpTileSink*& push, VideoEncoder& encoder, const TilerOptions& options,
+                          const TileDimensions& dimensions)
+{
+    std::vector<bool> enabled;
+
+    if(options.pushUrl == NULL)
+        return 0;
+
+    for(auto i = 0u; i < dimensions.count; i++)
+        enabled.push_back(encoder.IsTileEnabled(i));
+
+    if((push = new HttpTileSink(options.pushUrl, dimensions.count, options.pushBufferBytes))->Open(enabled) != 0)
+        return -1;
+
+    encoder.AddSink(push);
+    return 0;
+}
+
+// Reports how the push kept up, and writes it per tile when requested
+static int ReportPush(const HttpTileSink* push, const TilerOptions& options)
+{
+    if(push == NULL)
+        return 0;
+
+    printf("%s", push->Describe().c_str());
+    return options.pushReportFilename != NULL ? push->WriteReport(options.pushReportFilename) : 0;
+}
+
+// Records the throughput and stalls of an autotune trial, along with the settings it resolved to
+static void MeasureTrial(AutotuneTrial& trial, VideoEncoder& encoder, CUVIDFrameQueue& frameQueue,
+                         CudaDecoder& decoder, Statistics& statistics, const TilerOptions& options)
+{
+    unsigned long long end, frequency;
+
+    NvQueryPerformanceCounter(&end);
+    NvQueryPerformanceFrequency(&frequency);
+
+    trial.settings.inlineDecode = options.inlineDecode;
+    trial.settings.depths = options.depths;
+    trial.frames = encoder.GetEncodedFrames();
+    trial.seconds = (double)(end - statistics.start) / frequency;
+    trial.stalls = { frameQueue.getSurfaceStall() * 1000, frameQueue.getEnqueueStall() * 1000,
+                     decoder.GetWaitTime(), encoder.GetOutputStall() };
+}
+
+// Runs a single transcode in an existing context.  Everything acquired here is released on every path.
+static int Transcode(CUcontext context, CUvideoctxlock lock, TilerOptions& options, EncodeConfig& configuration,
+                     TileDimensions& dimensions, const TilerStages& stages, AutotuneTrial* trial = NULL)
+{
+    CudaDecoder decoder;
+    CUVIDFrameQueue frameQueue(lock);
+    DecoderFrameSource decoded(decoder);
+    FrameSource* source = stages.source != NULL ? stages.source : &decoded;
+    VideoEncoder encoder(lock, dimensions.columns, dimensions.rows);
+    Statistics statistics;
+    PipelineTuner* tuner = NULL;
+    TileMetrics* metrics = NULL;
+    RateAllocator* allocator = NULL;
+    SceneDetector* detector = NULL;
+    LiveSchedule* live = NULL;
+    TilePyramid* pyramid = NULL;
+    Checkpoint checkpoint;
+    Checkpoint* resume = NULL;
+    TileCache* cache = NULL;
+    std::vector<std::string> cacheKeys;
+    FrameCache* frameCache = NULL;
+    FrameCacheReader* cached = NULL;
+    FrameCacheWriter* spill = NULL;
+    HttpTileSink* push = NULL;
+    CubemapProjection* projection = NULL;
+    TilerStages projected = stages;
+    std::string fingerprint, frameKey;
+    float fpsRatio = 1.f;
+    auto created = false;
+    auto status = 0;
+
+    // Both caches key by the source's fingerprint, which reads the source and so is taken once
+    if(configuration.inputFileName != NULL && (options.cacheDirectory != NULL || options.frameCacheDirectory != NULL))
+        fingerprint = FingerprintSource(configuration.inputFileName);
+
+    if(options.checkpointFilename != NULL && access(options.checkpointFilename, F_OK) == 0 &&
+       LoadCheckpoint(options.checkpointFilename, dimensions, *(resume = &checkpoint)) != 0)
+        status = error("LoadCheckpoint", -1);
+    else if(options.cacheDirectory != NULL &&
+            (cache = new TileCache(options.cacheDirectory, options.cacheCapacity))->Open() != 0)
+        status = error("TileCache::Open", -1);
+    else if(OpenFrameCache(frameCache, cached, frameKey, source, fpsRatio, lock, fingerprint, options, configuration,
+                           stages) != 0)
+        status = error("OpenFrameCache", -1);
+    else if(stages.source == NULL && cached == NULL &&
+            (fpsRatio = InitializeDecoder(decoder, frameQueue, lock, configuration, options.depths)) < 0)
+        status = error("InitializeDecoder", -1);
+    else if(frameCache != NULL && cached == NULL &&
+            CreateFrameSpill(spill, source, frameCache, frameKey, decoder, lock, configuration) != 0)
+        status = error("CreateFrameSpill", -1);
+    else if(CreateSceneDetector(detector, *source, stages.source == NULL && cached == NULL, lock, options,
+                                configuration) != 0)
+        status = error("CreateSceneDetector", -1);
+    else if(CreateProjection(projection, lock, options, configuration, dimensions, projected) != 0)
+        status = error("CreateProjection", -1);
+    else if(EnableOutputs(encoder, options) != 0)
+        status = error("EnableOutputs", -1);
+    else if(SelectTiles(encoder, cache, cacheKeys, fingerprint, options, configuration, dimensions) != 0)
+        status = error("SelectTiles", -1);
+    else if(ApplyTileRates(encoder, options, configuration, dimensions) != 0)
+        status = error("ApplyTileRates", -1);
+    else if(ResumeFromCheckpoint(encoder, resume, options, configuration) != 0)
+        status = error("ResumeFromCheckpoint", -1);
+    else if(ConnectSinks(encoder, stages) != 0)
+        status = error("ConnectSinks", -1);
+    else if(CreatePushSink(push, encoder, options, dimensions) != 0)
+        status = error("CreatePushSink", -1);
+    else if(stages.source == NULL && cached == NULL && SeekDecoder(decoder, options, configuration) != 0)
+        status = error("SeekDecoder", -1);
+    else if(encoder.Initialize(context, NV_ENC_DEVICE_TYPE_CUDA) != NV_ENC_SUCCESS)
+        status = error("encoder.Initialize", -1);
+    else if(DisplayConfiguration(configuration, dimensions, options.placement) != 0)
+        status = error("DisplayConfiguration", -1);
+    else if(CreateRateAllocator(allocator, encoder, lock, options, configuration, dimensions) != 0)
+        status = error("CreateRateAllocator", -1);
+    else if(!(created = encoder.CreateEncoders(configuration) == NV_ENC_SUCCESS))
+        status = error("CreateEncoders", -1);
+    else if(encoder.AllocateIOBuffers(&configuration, options.depths.encodeBuffers) != NV_ENC_SUCCESS)
+        status = error("encoder.AllocateIOBuffers", -1);
+    else if(CreateTuner(tuner, encoder, options, configuration) != 0)
+        status = error("CreateTuner", -1);
+    else if(CreateMetrics(metrics, encoder, lock, options, configuration, dimensions) != 0)
+        status = error("CreateMetrics", -1);
+    else if(CreateLiveSchedule(live, encoder, options, dimensions) != 0)
+        status = error("CreateLiveSchedule", -1);
+    else if(CreatePyramid(pyramid, context, lock, options, configuration, dimensions, stages) != 0)
+        status = error("CreatePyramid", -1);
+    else if((status = ExecuteWorkers(detector != NULL ? *detector : *source, decoder,
+                                     stages.source == NULL && cached == NULL && !options.inlineDecode, encoder,
+                                     frameQueue, configuration, fpsRatio, statistics, options, projected, resume,
+                                     tuner, live, pyramid)) < 0)
+        error("ExecuteWorkers", status);
+    else if(cached != NULL && cached->HasFailed())
+        status = error("Unable to read the frame cache\n", -1);
+
+    if(created && encoder.Deinitialize() != NV_ENC_SUCCESS && status >= 0)
+        status = error("encoder.Deinitialize", -1);
+    if(pyramid != NULL && pyramid->Deinitialize() != 0 && status >= 0)
+        status = error("TilePyramid::Deinitialize", -1);
+    if(trial != NULL && status == 0)
+        MeasureTrial(*trial, encoder, frameQueue, decoder, statistics, options);
+
+    // Only a complete decode is cached, and failing to cache it is not fatal
+    if(status == 0 && spill != NULL && frameCache->Store(*spill) != 0)
+        fprintf(stderr, "Unable to cache the decoded frames\n");
+
+    // A cancelled transcode keeps its checkpoint and stays out of the cache and calibration
+    if(status == 0 && StoreTiles(encoder, cache, cacheKeys, configuration, dimensions) != 0)
+        status = error("StoreTiles", -1);
+    // A completed transcode has nothing to resume
+    else if(status == 0 && options.checkpointFilename != NULL && unlink(options.checkpointFilename) != 0 &&
+            errno != ENOENT)
+        status = error("unlink checkpoint", -1);
+    else if(status >= 0 && DisplayStatistics(decoder, encoder, statistics, cache, frameCache) != 0)
+        status = error("DisplayStatistics", -1);
+    else if(status >= 0 && ReportLatency(live, options) != 0)
+        status = error("ReportLatency", -1);
+    else if(status >= 0 && ReportPush(push, options) != 0)
+        status = error("ReportPush", -1);
+    else if(status == 0 && RecordCalibration(options, encoder, configuration, statistics) != 0)
+        status = error("RecordCalibration", -1);
+
+    if(status >= 0)
+        ReportDepths(tuner, options.depths);
+    if(status >= 0 && detector != NULL)
+        printf("Scene cuts: %lu (an IDR on every tile at each)\n", detector->GetCuts());
+
+    delete cache;
+    delete tuner;
+    delete metrics;
+    delete live;
+    delete pyramid;
+    delete allocator;
+    delete detector;
+    delete spill;
+    delete cached;
+    delete frameCache;
+    delete push;
+    delete projection;
+
+    return status;
+}
+
+// Measures transcodes of a sample of the input (or of synthetic frames when there is none) with each setting
+// tried by the search, and records the fastest in the -autotune profile.  Each trial writes the tile outputs.
+static int Autotune(CUcontext context, CUvideoctxlock lock, const TilerOptions& options,
+                    const EncodeConfig& configuration, const TileDimensions& dimensions, const TilerStages& stages)
+{
+    AutotuneSettings requested = { options.inlineDecode, options.depths }, settings;
+    SyntheticFrameSource* synthetic = NULL;
+    TilerStages trialStages = stages;
+    auto status = 0;
+
+    if(configuration.inputFileName == NULL)
+    {
+        synthetic = new SyntheticFrameSource(lock, configuration.width, configuration.height, options.autotuneFrames);
+        trialStages.source = synthetic;
+        trialStages.context = context;
+
+        if(synthetic->Open() != 0)
+            return delete synthetic, error("SyntheticFrameSource::Open", -1);
+    }
+
+    AutotuneSearch search(requested, options.inlineDecode, synthetic == NULL, configuration.numB + 2);
+
+    while(status == 0 && search.Next(settings))
+    {
+        auto trialOptions = options;
+        auto trialConfiguration = configuration;
+        auto trialDimensions = dimensions;
+        AutotuneTrial trial;
+
+        trialOptions.inlineDecode = settings.inlineDecode;
+        trialOptions.depths = settings.depths;
+        if(synthetic != NULL)
+            synthetic->Rewind();
+        else
+            trialConfiguration.endFrameIdx = (int)std::min((size_t)configuration.endFrameIdx,
+                                                           std::max(configuration.startFrameIdx, 0) +
+                                                           options.autotuneFrames - 1);
+
+        printf("Autotune trial: inline decode %s, depths %s\n", settings.inlineDecode ? "yes" : "no",
+               DescribePipelineDepths(settings.depths).c_str());
+
+        if((status = Transcode(context, lock, trialOptions, trialConfiguration, trialDimensions, trialStages,
+                               &trial)) == 0)
+            search.Report(trial);
+    }
+
+    delete synthetic;
+
+    if(status != 0)
+        return status;
+
+    printf("\n%s", search.Describe().c_str());
+    printf("Tuned for %s: inline decode %s, depths %s (%.1f fps)\n", GetHostName().c_str(),
+           search.GetBest().settings.inlineDecode ? "yes" : "no",
+           DescribePipelineDepths(search.GetBest().settings.depths).c_str(), search.GetBest().GetFramesPerSecond());
+
+    if(SaveTunedProfile(options.autotuneFilename, MakeTunedProfile(configuration, dimensions, search.GetBest())) != 0)
+        return error("Unable to write the tuned profile\n", -1);
+
+    return 0;
+}
+
+// Settings that autotuning leaves to the search, or that each trial cannot repeat
+static int CheckAutotune(const TilerOptions& options, const EncodeConfig& configuration, const TilerStages& stages)
+{
+    if(options.autotuneFilename == NULL)
+        return 0;
+    else if(options.streamsFilename != NULL || options.plan || options.adaptiveDepths ||
+            options.profileFilename != NULL)
+        return error("Autotuning cannot be combined with -streams, -plan, -adaptiveDepths or -profile\n", -1);
+    else if(options.checkpointFilename != NULL || options.cacheDirectory != NULL ||
+            options.frameCacheDirectory != NULL || options.pushUrl != NULL)
+        return error("Autotuning cannot be combined with checkpoints, caches or -push\n", -1);
+    else if(stages.source != NULL)
+        return error("Autotuning needs an input file (or synthetic frames), not a frame source\n", -1);
+    else if(options.autotuneFrames == 0)
+        return error("Autotuning needs at least one frame per trial\n", -1);
+    else if(configuration.inputFileName == NULL &&
+            (configuration.width <= 0 || configuration.height <= 0 || configuration.fps <= 0))
+        return error("Autotuning on synthetic frames needs -size and -fps\n", -1);
+
+    return 0;
+}
+
+// Fills the settings not given on the command line from the -profile entry for this host and grid
+static int ApplyTunedProfile(TilerOptions& options, const EncodeConfig& configuration,
+                             const TileDimensions& dimensions)
+{
+    std::vector<TunedProfile> profiles;
+    const TunedProfile* profile;
+    auto& depths = options.depths;
+
+    if(options.profileFilename == NULL)
+        return 0;
+    else if(LoadTunedProfiles(options.profileFilename, profiles) != 0)
+        return error("Unable to read the tuned profile\n", -1);
+    else if((profile = FindTunedProfile(profiles, GetHostName(), configuration, dimensions)) == NULL)
+        return printf("No tuned profile for this host and grid; using the defaults\n"), 0;
+
+    auto& tuned = profile->settings.depths;
+
+    depths.decodeSurfaces = depths.decodeSurfaces ? depths.decodeSurfaces : tuned.decodeSurfaces;
+    depths.outputSurfaces = depths.outputSurfaces ? depths.outputSurfaces : tuned.outputSurfaces;
+    depths.displayDelay = depths.displayDelay >= 0 ? depths.displayDelay : tuned.displayDelay;
+    depths.queueSize = depths.queueSize ? depths.queueSize : tuned.queueSize;
+    depths.encodeBuffers = depths.encodeBuffers ? depths.encodeBuffers : tuned.encodeBuffers;
+    options.inlineDecode = options.inlineDecode || profile->settings.inlineDecode;
+
+    printf("Tuned profile (%.1f fps): inline decode %s, depths %s\n", profile->framesPerSecond,
+           options.inlineDecode ? "yes" : "no", DescribePipelineDepths(depths).c_str());
+    return 0;
+}
+
+// Composes the -mosaic inputs into each frame, and tiles and encodes the composite as the input
+static int Mosaic(CUcontext context, CUvideoctxlock lock, TilerOptions& options, const EncodeConfig& configuration,
+                  TileDimensions& dimensions, const TilerStages& stages)
+{
+    std::vector<std::string> inputs;
+    auto grid = options.mosaicGrid;
+    auto mosaicConfiguration = configuration;
+    TilerStages mosaicStages = stages;
+    int status;
+
+    if(LoadMosaicInputs(options.mosaicFilename, inputs) != 0 || inputs.empty())
+        return error("Unable to read the mosaic inputs\n", -1);
+    else if(grid.count == 0)
+        grid = GetMosaicGrid(inputs.size());
+    else if(grid.count < inputs.size())
+        return error("The mosaic grid has fewer cells than inputs\n", -1);
+
+    if(configuration.width / (int)grid.columns < MINIMUM_MOSAIC_CELL ||
+       configuration.height / (int)grid.rows < MINIMUM_MOSAIC_CELL)
+        return error("Mosaic cells must be at least 16x16\n", -1);
+
+    MosaicFrameSource mosaic(lock, inputs, grid, configuration.width, configuration.height, options.mosaicStall,
+                             options.placement);
+
+    mosaicStages.source = &mosaic;
+    mosaicStages.context = context;
+    // Displayed in place of an input
+    mosaicConfiguration.inputFileName = (char*)options.mosaicFilename;
+
+    if(mosaic.Open(mosaicConfiguration, options.depths) != 0)
+        return error("MosaicFrameSource::Open\n", -1);
+
+    printf("Mosaic: %lu inputs in %lux%lu cells of %dx%d\n", inputs.size(), grid.rows, grid.columns,
+           mosaic.GetCellWidth(), mosaic.GetCellHeight());
+
+    if((status = Transcode(context, lock, options, mosaicConfiguration, dimensions, mosaicStages)) == 0 &&
+       mosaic.HasFailed())
+        status = error("Unable to compose the mosaic\n", -1);
+    if(status >= 0)
+        printf("\n%s", mosaic.DescribeStatistics().c_str());
+
+    return status;
+}
+
+// A mosaic replaces the input, and so rules out what needs a single decoded input
+static int CheckMosaic(const TilerOptions& options, const EncodeConfig& configuration, const TilerStages& stages)
+{
+    if(options.mosaicFilename == NULL)
+        return 0;
+    else if(configuration.inputFileName != NULL || stages.source != NULL || options.streamsFilename != NULL ||
+            options.autotuneFilename != NULL || options.plan)
+        return error("A mosaic cannot be combined with -i, a frame source, -streams, -autotune or -plan\n", -1);
+    else if(configuration.width <= 0 || configuration.height <= 0)
+        return error("A mosaic needs the output size (-size)\n", -1);
+    else if(options.checkpointFilename != NULL || options.cacheDirectory != NULL ||
+            options.frameCacheDirectory != NULL || options.adaptiveDepths ||
+            configuration.startFrameIdx > 0 || configuration.endFrameIdx != INT_MAX)
+        return error("Checkpoints, caching, adaptive depths and frame ranges need a single input\n", -1);
+
+    return 0;
+}
+
+void GetDefaultTilerOptions(TilerOptions& options, EncodeConfig& configuration)
+{
+    // Every option not named here is zero, false, NULL or empty
+    TilerOptions defaults = TilerOptions();
+    EncodeConfig encodeConfig = { 0 };
+
+    defaults.checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    defaults.placement.node = PLACEMENT_NO_NODE;
+    defaults.depths.displayDelay = -1;
+    defaults.metricsInterval = DEFAULT_METRICS_INTERVAL;
+    defaults.metricsSegment = DEFAULT_METRICS_SEGMENT;
+    defaults.streamLimits.workers = DEFAULT_STREAM_WORKERS;
+    defaults.ringBytes = DEFAULT_TILE_RING_BYTES;
+    defaults.sceneLookahead = DEFAULT_SCENE_LOOKAHEAD;
+    defaults.pushBufferBytes = DEFAULT_PUSH_BUFFER_BYTES;
+    defaults.autotuneFrames = DEFAULT_AUTOTUNE_FRAMES;
+    defaults.projection = PROJECTION_NONE;
+    defaults.mosaicStall = DEFAULT_MOSAIC_STALL;
+
+    encodeConfig.endFrameIdx = INT_MAX;
+    encodeConfig.bitrate = 5000000;
+    encodeConfig.rcMode = NV_ENC_PARAMS_RC_CONSTQP;
+    encodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
+    encodeConfig.codec = NV_ENC_H264;
+    encodeConfig.fps = 0;
+    encodeConfig.qp = 28;
+    encodeConfig.i_quant_factor = DEFAULT_I_QFACTOR;
+    encodeConfig.b_quant_factor = DEFAULT_B_QFACTOR;
+    encodeConfig.i_quant_offset = DEFAULT_I_QOFFSET;
+    encodeConfig.b_quant_offset = DEFAULT_B_QOFFSET;
+    encodeConfig.presetGUID = NV_ENC_PRESET_DEFAULT_GUID;
+    encodeConfig.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
+
+    options = defaults;
+    configuration = encodeConfig;
+}
+
+// Runs the autotune, mosaic or transcode in the caller's context, or in one created on -deviceID
+static int RunInContext(TilerOptions& options, EncodeConfig& configuration, TileDimensions& dimensions,
+                        const TilerStages& stages)
+{
+    CUcontext context = (CUcontext)stages.context, current;
+    CUdevice device;
+    CUvideoctxlock lock;
+    CUresult result;
+    int status;
+
+    if(stages.context == NULL && (result = cuDeviceGet(&device, configuration.deviceID)) != CUDA_SUCCESS)
+        return cudaError("cuDeviceGet", result);
+    else if(stages.context == NULL && (result = cuCtxCreate(&context, CU_CTX_SCHED_AUTO, device)) != CUDA_SUCCESS)
+        return cudaError("cuCtxCreate", result);
+    else if(stages.context == NULL && (result = cuCtxPopCurrent(&current)) != CUDA_SUCCESS)
+        status = cudaError("cuCtxPopCurrent", result);
+    else if((result = cuvidCtxLockCreate(&lock, context)) != CUDA_SUCCESS)
+        status = cudaError("cuvidCtxLockCreate", result);
+    else
+    {
+        status = options.autotuneFilename != NULL ?
+                 Autotune(context, lock, options, configuration, dimensions, stages) :
+                 options.mosaicFilename != NULL ?
+                 Mosaic(context, lock, options, configuration, dimensions, stages) :
+                 Transcode(context, lock, options, configuration, dimensions, stages);
+
+        if((result = cuvidCtxLockDestroy(lock)) != CUDA_SUCCESS && status >= 0)
+            status = cudaError("cuvidCtxLockDestroy", result);
+    }
+
+    if(stages.context == NULL && (result = cuCtxDestroy(context)) != CUDA_SUCCESS && status >= 0)
+        status = cudaError("cuCtxDestroy", result);
+
+    return status;
+}
+
+int RunTiler(const TilerOptions& tilerOptions, const EncodeConfig& encodeConfiguration, const TilerStages& stages)
+{
+    typedef void *CUDADRIVER;
+    CUDADRIVER hHandleDriver = 0;
+    CUresult result;
+    TileDimensions dimensions;
+    ThreadPlacement calling;
+    // Defaults, tuned profiles and the source's own size are applied to copies, leaving the caller's as passed
+    TilerOptions options = tilerOptions;
+    EncodeConfig configuration = encodeConfiguration;
+    std::vector<char> filenameTemplate;
+    int status, claim;
+
+    if(CheckAutotune(options, configuration, stages) != 0)
+        return error("CheckAutotune", -1);
+    else if(CheckMosaic(options, configuration, stages) != 0)
+        return error("CheckMosaic", -1);
+    else if(options.streamsFilename != NULL)
+        return TranscodeStreams(options, configuration);
+    // Autotuning without an input measures synthetic frames
+    else if((configuration.inputFileName == NULL && stages.source == NULL && options.autotuneFilename == NULL &&
+             options.mosaicFilename == NULL) ||
+            configuration.outputFileName == NULL)
+        return error("An input and a tile output specification are needed\n", -1);
+    else if(ParseTileParameters(configuration, dimensions, filenameTemplate) != 0)
+        return error("ParseTileParameters", -1);
+    else if(ApplyTunedProfile(options, configuration, dimensions) != 0)
+        return error("ApplyTunedProfile", -1);
+    else if(CheckStages(options, configuration, stages) != 0)
+        return error("CheckStages", -1);
+    else if(ApplyLiveDefaults(options, configuration) != 0)
+        return error("ApplyLiveDefaults", -1);
+    else if(ReserveLookahead(options) != 0)
+        return error("ReserveLookahead", -1);
+    // Planning happens before the driver is loaded
+    else if(options.plan)
+        return PlanTranscode(options, configuration, dimensions);
+    else if((result = cuInit(0, __CUDA_API_VERSION, hHandleDriver)) != CUDA_SUCCESS)
+        return cudaError("Error in cuInit", result);
+    else if((result = cuvidInit(0)) != CUDA_SUCCESS)
+        return cudaError("Error in cuvidInit", result);
+    else if(ResolvePlacement(options.placement, claim) != 0)
+        return error("ResolvePlacement", -1);
+
+    // The encoding (calling) thread is placed before anything it allocates, and put back as it was on return
+    if(SaveThreadPlacement(calling) != 0)
+        status = error("SaveThreadPlacement", -1);
+    else
+    {
+        status = ApplyPlacement(options.placement, STAGE_ENCODER) != 0 ? error("ApplyPlacement", -1) :
+                 RunInContext(options, configuration, dimensions, stages);
+
+        if(RestoreThreadPlacement(calling) != 0 && status >= 0)
+            status = error("RestoreThreadPlacement", -1);
+    }
+
+    ReleasePlacement(claim);
+    return status;
+}
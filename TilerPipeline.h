@@ -0,0 +1,106 @@
+#ifndef _TILER_PIPELINE
+#define _TILER_PIPELINE
+
+#include <stdint.h>
+#include <vector>
+
+#include "PipelineStages.h"
+#include "Placement.h"
+#include "PipelineTuner.h"
+#include "StreamScheduler.h"
+#include "TileRates.h"
+#include "Projection.h"
+#include "Mosaic.h"
+
+// In-process entry point to the tiler (libtiler.a); the tiler executable is a thin client of it
+
+typedef struct TilerOptions
+{
+    std::vector<size_t> tiles;           // Subset of tiles to produce; empty produces every tile
+    const char*         cacheDirectory;  // Encoded tile cache; NULL disables caching
+    size_t              cacheCapacity;   // bytes; zero is unbounded
+    const char*         checkpointFilename;
+    int                 checkpointInterval;  // frames between aligned IDR checkpoints
+    const char*         traceFilename;       // Chrome trace-event output; NULL disables tracing
+    Placement           placement;
+    bool                inlineDecode;        // Decode on the encoder thread instead of a decode thread
+    PipelineDepths      depths;              // Pinned depths (zero selects the default)
+    bool                adaptiveDepths;      // Tune the queue and encode depths while encoding
+    size_t              depthBudget;         // bytes available to pipeline buffers; zero is unbounded
+    bool                plan;                // Report the resources a transcode would use, without running it
+    const char*         calibrationFilename; // Throughput profile read when planning and extended by each run
+    const char*         keyframeIndexFilename; // Keyframe index of the input, built when missing or stale
+    bool                frameIndex;          // Write a sidecar frame index next to each tile output
+    const char*         metricsFilename;     // Per-tile PSNR/SSIM report; NULL disables quality metrics
+    size_t              metricsInterval;     // frames between quality samples
+    size_t              metricsSegment;      // frames aggregated into each reported row
+    const char*         streamsFilename;     // Streams to run concurrently in place of -i and -o
+    SchedulerLimits     streamLimits;
+    unsigned int        liveDeadline;        // ms each frame has to be encoded; zero disables live mode
+    std::vector<size_t> importantTiles;      // Tiles encoded first and skipped last in live mode
+    const char*         latencyFilename;     // Per-tile latency percentiles (CSV) written in live mode
+    const char*         ringName;            // Shared-memory rings the tile outputs are also published to
+    size_t              ringBytes;           // Payload bytes of each tile's ring
+    bool                rateAllocation;      // Distribute rate across tiles by content
+    uint64_t            rateBudget;          // Total bits/sec across tiles; zero gives each tile -bitrate on average
+    double              sceneThreshold;      // Histogram distance that forces an IDR on every tile; zero disables
+    size_t              sceneLookahead;      // frames held back to confirm a scene cut
+    size_t              pyramidLevels;       // Coarser grids encoded alongside the finest, each halving the last
+    std::vector<TileRateDivisor> tileRates;  // Tiles encoded at a fraction of the frame rate
+    const char*         viewMapFilename;     // Per-tile view probabilities from which the other tiles' rates follow
+    const char*         frameCacheDirectory; // Decoded frames spilled by (and served to) runs on the same source
+    size_t              frameCacheCapacity;  // bytes; zero is unbounded
+    const char*         pushUrl;             // HTTP origin the tile outputs are streamed to, expanded per tile
+    size_t              pushBufferBytes;     // Bytes each pushed tile may have in flight before the encoder waits
+    const char*         pushReportFilename;  // Per-tile push statistics (CSV)
+    const char*         autotuneFilename;    // Search the depths and decode placement, and record them in a profile
+    size_t              autotuneFrames;      // frames measured by each autotune trial
+    const char*         profileFilename;     // Tuned profile whose entry for this host and grid fills the defaults
+    ProjectionLayout    projection;          // Cube layout that equirectangular frames are reprojected to
+    size_t              faceSize;            // Cube face size; zero is a quarter of the source width
+    const char*         mosaicFilename;      // Inputs composed into each frame in place of -i, one per line
+    TileDimensions      mosaicGrid;          // Cells of the mosaic; zero rows fits the inputs as squarely as possible
+    unsigned int        mosaicStall;         // ms a mosaic frame waits for a late input; zero waits indefinitely
+} TilerOptions;
+
+#define DEFAULT_STREAM_WORKERS 4
+
+#define DEFAULT_CHECKPOINT_INTERVAL 600
+
+// Returned by RunTiler when the progress callback ends the transcode early
+#define TILER_CANCELLED 1
+
+typedef struct TilerProgress
+{
+    int                frame;           // Source frame just encoded
+    size_t             framesEncoded;   // Frames submitted to the encoders so far
+    unsigned long long elapsed;         // Microseconds since encoding began
+} TilerProgress;
+
+// Called on the encoding thread after each source frame; a nonzero return cancels the transcode
+typedef int (*TilerProgressCallback)(const TilerProgress&, void* context);
+
+// Stages substituted for the defaults; every field may be left zero
+typedef struct TilerStages
+{
+    FrameSource*           source;     // Replaces decoding the input file; needs the output size and context
+    FrameTransform*        transform;  // Applied to each frame before it is tiled
+    std::vector<TileSink*> sinks;      // Receive each tile's output in addition to (or in place of) files
+    bool                   noFiles;    // Output goes only to the sinks and rings; the template only names the grid
+    TilerProgressCallback  progress;
+    void*                  progressContext;
+    void*                  context;    // CUcontext to encode in (and that a custom source allocates from);
+                                       // NULL creates one on -deviceID
+} TilerStages;
+
+// Fills in the defaults that the tiler executable starts from before parsing its arguments
+void GetDefaultTilerOptions(TilerOptions&, EncodeConfig&);
+
+// Tiles and encodes configuration.inputFileName (or the source stage) into the tiles named by
+// configuration.outputFileName ("<rows>,<columns>,<template>"), or runs the streams in options.streamsFilename.
+// Returns zero on success, TILER_CANCELLED when cancelled through the progress callback, and a negative value
+// on failure; errors are reported on stderr and never end the process.  The options and configuration passed
+// are left unchanged, so they may be reused for another run.
+int RunTiler(const TilerOptions&, const EncodeConfig&, const TilerStages& = TilerStages());
+
+#endif
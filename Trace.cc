@@ -0,0 +1,166 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Trace.h"
+
+#define TRACE_RESERVE 64*1024
+
+volatile bool traceEnabled = false;
+
+typedef struct TraceEvent
+{
+    const char* name;
+    char        phase;     // 'X' complete, 'b'/'e' async begin/end
+    uint64_t    timestamp;
+    uint64_t    duration;  // or async id
+    int         frame, tile;
+} TraceEvent;
+
+typedef struct TraceBuffer
+{
+    long                    threadId;
+    std::string             threadName;
+    std::vector<TraceEvent> events;
+} TraceBuffer;
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<std::unique_ptr<TraceBuffer>> registry;
+static uint64_t epoch;
+
+static __thread TraceBuffer* threadBuffer = NULL;
+
+// Buffers are owned by the registry so that they outlive the threads that recorded them
+static TraceBuffer& GetThreadBuffer()
+{
+    if(threadBuffer == NULL)
+    {
+        auto* buffer = new TraceBuffer();
+        buffer->threadId = syscall(SYS_gettid);
+        buffer->events.reserve(TRACE_RESERVE);
+
+        pthread_mutex_lock(&registryLock);
+        registry.emplace_back(buffer);
+        pthread_mutex_unlock(&registryLock);
+
+        threadBuffer = buffer;
+    }
+
+    return *threadBuffer;
+}
+
+static void Record(const char* name, const char phase, const uint64_t timestamp, const uint64_t duration,
+                   const int frame, const int tile)
+{
+    GetThreadBuffer().events.push_back({name, phase, timestamp, duration, frame, tile});
+}
+
+uint64_t TraceNow()
+{
+    struct timespec now;
+
+    // Offset by one so that a valid timestamp is never zero, which TraceSpan uses to mean disabled
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000 + 1;
+}
+
+void TraceStart()
+{
+    pthread_mutex_lock(&registryLock);
+    for(auto& buffer: registry)
+        buffer->events.clear();
+    epoch = TraceNow();
+    pthread_mutex_unlock(&registryLock);
+
+    traceEnabled = true;
+}
+
+void TraceSetThreadName(const char* name)
+{
+    if(TraceEnabled())
+        GetThreadBuffer().threadName = name;
+}
+
+void TraceComplete(const char* name, const uint64_t start, const int frame, const int tile)
+{
+    if(TraceEnabled())
+        Record(name, 'X', start, TraceNow() - start, frame, tile);
+}
+
+void TraceAsyncBegin(const char* name, const uint64_t id, const int frame)
+{
+    if(TraceEnabled())
+        Record(name, 'b', TraceNow(), id, frame, -1);
+}
+
+void TraceAsyncEnd(const char* name, const uint64_t id, const int frame)
+{
+    if(TraceEnabled())
+        Record(name, 'e', TraceNow(), id, frame, -1);
+}
+
+static void WriteArguments(FILE* file, const TraceEvent& event)
+{
+    if(event.frame < 0 && event.tile < 0)
+        return;
+
+    fprintf(file, ",\"args\":{");
+    if(event.frame >= 0)
+        fprintf(file, "\"frame\":%d%s", event.frame, event.tile >= 0 ? "," : "");
+    if(event.tile >= 0)
+        fprintf(file, "\"tile\":%d", event.tile);
+    fprintf(file, "}");
+}
+
+int TraceWrite(const char* filename)
+{
+    FILE* file;
+    auto pid = (long)getpid();
+    auto separator = "";
+
+    traceEnabled = false;
+
+    if((file = fopen(filename, "w")) == NULL)
+        return fprintf(stderr, "Unable to create trace %s\n", filename), -1;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    pthread_mutex_lock(&registryLock);
+    for(auto& buffer: registry)
+    {
+        if(!buffer->threadName.empty())
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                    separator, pid, buffer->threadId, buffer->threadName.c_str());
+            separator = ",\n";
+        }
+
+        for(auto& event: buffer->events)
+        {
+            if(event.timestamp < epoch)
+                continue;
+
+            fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"tiler\",\"ph\":\"%c\",\"pid\":%ld,\"tid\":%ld,\"ts\":%llu",
+                    separator, event.name, event.phase, pid, buffer->threadId,
+                    (unsigned long long)(event.timestamp - epoch));
+            if(event.phase == 'X')
+                fprintf(file, ",\"dur\":%llu", (unsigned long long)event.duration);
+            else
+                fprintf(file, ",\"id\":\"0x%llx\"", (unsigned long long)event.duration);
+            WriteArguments(file, event);
+            fprintf(file, "}");
+            separator = ",\n";
+        }
+    }
+    pthread_mutex_unlock(&registryLock);
+
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) != 0 ? -1 : 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _TRACE
+#define _TRACE
+
+#include <stdint.h>
+
+// Timeline tracing in the Chrome trace-event format (viewable in chrome://tracing or Perfetto).
+//
+// Each thread records into its own buffer, so recording never takes a lock; a thread's buffer is
+// registered once, the first time it records.  Buffers are only read by TraceWrite, which must be
+// called after the recording threads have finished.  While tracing is disabled every entry point
+// reduces to a test of a single flag.
+
+extern volatile bool traceEnabled;
+
+inline bool TraceEnabled() { return traceEnabled; }
+
+// Begins recording; events recorded before this call are discarded
+void     TraceStart();
+// Stops recording and writes all events as a JSON trace; returns nonzero on failure
+int      TraceWrite(const char* filename);
+
+uint64_t TraceNow();  // microseconds on a monotonic clock
+void     TraceSetThreadName(const char* name);
+
+// Records a completed span; frame and tile are attached as arguments unless negative.
+// Names must be string literals (or otherwise outlive the trace).
+void     TraceComplete(const char* name, uint64_t start, int frame = -1, int tile = -1);
+// Records the start and end of a span that begins and ends on different threads
+void     TraceAsyncBegin(const char* name, uint64_t id, int frame = -1);
+void     TraceAsyncEnd(const char* name, uint64_t id, int frame = -1);
+
+// Records the lifetime of a scope as a span
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name, const int frame = -1, const int tile = -1) :
+        name(name),
+        frame(frame),
+        tile(tile),
+        start(TraceEnabled() ? TraceNow() : 0)
+        { }
+    ~TraceSpan()
+        { if(start) TraceComplete(name, start, frame, tile); }
+
+private:
+    const char* name;
+    int         frame, tile;
+    uint64_t    start;
+};
+
+#endif
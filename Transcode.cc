@@ -0,0 +1,76 @@
+#include <algorithm>
+
+#include "Transcode.h"
+
+float InitializeDecoder(CudaDecoder& decoder, CUVIDFrameQueue& queue, CUvideoctxlock& lock, EncodeConfig& configuration,
+                        PipelineDepths& depths)
+{
+    int decodedW, decodedH, decodedFRN, decodedFRD, isProgressive;
+
+    if(!decoder.InitVideoDecoder(configuration.inputFileName, lock, &queue, configuration.width, configuration.height,
+                                 &depths))
+        return -1;
+
+    // Queued frames hold decode surfaces, so more would only stall the decoder
+    depths.queueSize = std::min(depths.queueSize ? depths.queueSize : FrameQueue::cnDefaultSize, depths.decodeSurfaces);
+    queue.setCapacity(depths.queueSize);
+
+    decoder.GetCodecParam(&decodedW, &decodedH, &decodedFRN, &decodedFRD, &isProgressive);
+
+    float fpsRatio = MatchSourceFormat(configuration, decodedW, decodedH, decodedFRN, decodedFRD, isProgressive);
+    queue.init(configuration.width, configuration.height);
+
+    return fpsRatio;
+}
+
+float MatchSourceFormat(EncodeConfig& configuration, int width, int height, int frameRateNumerator,
+                        int frameRateDenominator, const bool progressive)
+{
+    if (frameRateNumerator <= 0 || frameRateDenominator <= 0) {
+        frameRateNumerator = 30;
+        frameRateDenominator = 1;
+    }
+
+    if(configuration.width <= 0 || configuration.height <= 0) {
+        configuration.width  = width;
+        configuration.height = height;
+    }
+
+    float fpsRatio = 1.f;
+    if (configuration.fps <= 0)
+        configuration.fps = frameRateNumerator / frameRateDenominator;
+    else
+        fpsRatio = (float)configuration.fps * frameRateDenominator / frameRateNumerator;
+
+    configuration.pictureStruct = progressive ? NV_ENC_PIC_STRUCT_FRAME : 0;
+
+    return fpsRatio;
+}
+
+
+int MatchFPS(const float fpsRatio, const int decodedFrames, const int encodedFrames)
+{
+    if (fpsRatio < 1.f)
+    {
+        // need to drop frame
+        if (decodedFrames * fpsRatio < (encodedFrames + 1))
+            return -1;
+    }
+    else if (fpsRatio > 1.f)
+    {
+        // need to duplicate frame	 
+        auto duplicate = 0;
+        while (decodedFrames*fpsRatio > encodedFrames + duplicate + 1)
+            duplicate++;
+
+        return duplicate;
+    }
+
+    return 0;
+}
+
+NV_ENC_PIC_STRUCT GetPictureStruct(const CUVIDPARSERDISPINFO& info)
+{
+    return info.progressive_frame || info.repeat_first_field >= 2 ? NV_ENC_PIC_STRUCT_FRAME :
+        (info.top_field_first ? NV_ENC_PIC_STRUCT_FIELD_TOP_BOTTOM : NV_ENC_PIC_STRUCT_FIELD_BOTTOM_TOP);
+}
@@ -0,0 +1,22 @@
+#ifndef _TRANSCODE
+#define _TRANSCODE
+
+#include "VideoDecoder.h"
+#include "TileVideoEncoder.h"
+
+// Decoder setup and frame-rate matching shared by the single-stream pipeline and the stream scheduler
+
+// Opens the input and sizes the frame queue, filling in the output size and rate when they are unset.
+// Returns the ratio of output to input frame rate, or a negative value when the input cannot be decoded.
+float InitializeDecoder(CudaDecoder& decoder, CUVIDFrameQueue& queue, CUvideoctxlock& lock, EncodeConfig& configuration,
+                        PipelineDepths& depths);
+// Fills in the output size, rate and picture structure from those of the source when they are unset, as
+// InitializeDecoder does.  Returns the ratio of output to input frame rate.
+float MatchSourceFormat(EncodeConfig& configuration, int width, int height, int frameRateNumerator,
+                        int frameRateDenominator, bool progressive);
+// Number of times to repeat the next decoded frame beyond the first, or -1 to drop it
+int MatchFPS(float fpsRatio, int decodedFrames, int encodedFrames);
+// Encoder picture structure of a decoded frame
+NV_ENC_PIC_STRUCT GetPictureStruct(const CUVIDPARSERDISPINFO& info);
+
+#endif
@@ -1,7 +1,9 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <limits.h>
 #include "VideoDecoder.h"
+#include "Trace.h"
 
 static const char* getProfileName(int profile)
 {
@@ -53,8 +55,24 @@ static int CUDAAPI HandlePictureDecode(void* pUserData, CUVIDPICPARAMS* pPicPara
 {
     assert(pUserData);
     CudaDecoder* pDecoder = (CudaDecoder*)pUserData;
-    pDecoder->m_pFrameQueue->waitUntilFrameAvailable(pPicParams->CurrPicIdx);
-    assert(CUDA_SUCCESS == cuvidDecodePicture(pDecoder->m_videoDecoder, pPicParams));
+    TraceSpan span("decode");
+    {
+        TraceSpan wait("wait surface");
+        // Without a decode thread the surface would be released by the thread parsing, so it is never waited for
+        if (!pDecoder->m_pFrameQueue->waitUntilFrameAvailable(pPicParams->CurrPicIdx) &&
+            !pDecoder->m_pFrameQueue->isEndOfDecode()) {
+            fprintf(stderr, "Decode surface %d is still held for display; more decode surfaces are needed\n",
+                    pPicParams->CurrPicIdx);
+            pDecoder->m_bFailed = true;
+            return 0;
+        }
+    }
+    CUresult result = cuvidDecodePicture(pDecoder->m_videoDecoder, pPicParams);
+    if (result != CUDA_SUCCESS) {
+        fprintf(stderr, "cuvidDecodePicture failed for surface %d (error %d)\n", pPicParams->CurrPicIdx, result);
+        pDecoder->m_bFailed = true;
+        return 0;
+    }
     return 1;
 }
 
@@ -62,15 +80,30 @@ static int CUDAAPI HandlePictureDisplay(void* pUserData, CUVIDPARSERDISPINFO* pP
 {
     assert(pUserData);
     CudaDecoder* pDecoder = (CudaDecoder*)pUserData;
-    pDecoder->m_pFrameQueue->enqueue(pPicParams);
+    int nIndex = pDecoder->m_displayedFrames++;
     pDecoder->m_decodedFrames++;
 
+    // Lead-in frames decoded only to reach the first frame, and any past the last, are never queued
+    if (nIndex < pDecoder->m_firstFrame || nIndex > pDecoder->m_lastFrame)
+        return 1;
+
+    TraceSpan span("display", nIndex);
+    TraceAsyncBegin("queued", nIndex, nIndex);
+    // The parser's timestamps are unused, so the queued copy carries the time the frame was decoded
+    pPicParams->timestamp = PipelineTuner::Now();
+    pDecoder->m_pFrameQueue->enqueue(pPicParams);
+    if (nIndex == pDecoder->m_lastFrame)
+        pDecoder->m_bStop = true;
+
     return 1;
 }
 
 CudaDecoder::CudaDecoder() : m_videoSource(NULL), m_videoParser(NULL), m_videoDecoder(NULL),
-    m_ctxLock(NULL), m_decodedFrames(0), m_bFinish(false)
+    m_ctxLock(NULL), m_decodedFrames(0), m_displayedFrames(0), m_firstFrame(0), m_lastFrame(INT_MAX),
+    m_bStop(false), m_bFailed(false), m_bFinish(false), m_bThreaded(false), m_pInput(NULL), m_pInputBuffer(NULL),
+    m_nBuffered(0), m_nParsed(0), m_headerRemaining(0), m_keyframeOffset(0), m_pulledFrames(0), m_waitTime(0)
 {
+    pthread_mutex_init(&m_pullLock, NULL);
 }
 
 
@@ -79,16 +112,20 @@ CudaDecoder::~CudaDecoder(void)
     if(m_videoDecoder) cuvidDestroyDecoder(m_videoDecoder);
     if(m_videoParser)  cuvidDestroyVideoParser(m_videoParser);
     if(m_videoSource)  cuvidDestroyVideoSource(m_videoSource);
+    if(m_pInput)       fclose(m_pInput);
+    delete[] m_pInputBuffer;
+    pthread_mutex_destroy(&m_pullLock);
 }
 
-void CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock, FrameQueue* pFrameQueue,
-        int targetWidth, int targetHeight)
+bool CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock, FrameQueue* pFrameQueue,
+        int targetWidth, int targetHeight, PipelineDepths* pDepths)
 {
     assert(videoPath);
     assert(ctxLock);
     assert(pFrameQueue);
 
     m_pFrameQueue = pFrameQueue;
+    m_pFrameQueue->setBlocking(m_bThreaded);
 
     CUresult oResult;
     m_ctxLock = ctxLock;
@@ -104,7 +141,7 @@ void CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock
     if (oResult != CUDA_SUCCESS) {
         fprintf(stderr, "cuvidCreateVideoSource failed\n");
         fprintf(stderr, "Please check if the path exists, or the video is a valid H264 file\n");
-        exit(-1);
+        return false;
     }
 
     //init video decoder
@@ -113,47 +150,31 @@ void CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock
 
     if (oFormat.codec != cudaVideoCodec_H264 && oFormat.codec != cudaVideoCodec_HEVC) {
         fprintf(stderr, "The sample only supports H264/HEVC input video!\n");
-        exit(-1);
+        return false;
     }
 
     if (oFormat.chroma_format != cudaVideoChromaFormat_420) {
         fprintf(stderr, "The sample only supports 4:2:0 chroma!\n");
-        exit(-1);
+        return false;
+    }
+
+    // The video source only describes the stream; the elementary stream is fed to the parser on demand
+    if ((m_pInput = fopen(videoPath, "rb")) == NULL) {
+        fprintf(stderr, "Unable to open %s\n", videoPath);
+        return false;
     }
+    m_pInputBuffer = new unsigned char[PARSE_CHUNK_SIZE];
 
     CUVIDDECODECREATEINFO oVideoDecodeCreateInfo;
     memset(&oVideoDecodeCreateInfo, 0, sizeof(CUVIDDECODECREATEINFO));
     oVideoDecodeCreateInfo.CodecType = oFormat.codec;
     oVideoDecodeCreateInfo.ulWidth   = oFormat.coded_width;
     oVideoDecodeCreateInfo.ulHeight  = oFormat.coded_height;
-    oVideoDecodeCreateInfo.ulNumDecodeSurfaces = 8;
-    if ((oVideoDecodeCreateInfo.CodecType == cudaVideoCodec_H264) ||
-        (oVideoDecodeCreateInfo.CodecType == cudaVideoCodec_H264_SVC) ||
-        (oVideoDecodeCreateInfo.CodecType == cudaVideoCodec_H264_MVC))
-    {
-        // assume worst-case of 20 decode surfaces for H264
-        oVideoDecodeCreateInfo.ulNumDecodeSurfaces = 20;
-    }
-    if (oVideoDecodeCreateInfo.CodecType == cudaVideoCodec_VP9)
-        oVideoDecodeCreateInfo.ulNumDecodeSurfaces = 12;
-    if (oVideoDecodeCreateInfo.CodecType == cudaVideoCodec_HEVC)
-    {
-        // ref HEVC spec: A.4.1 General tier and level limits
-        int MaxLumaPS = 35651584; // currently assuming level 6.2, 8Kx4K
-        int MaxDpbPicBuf = 6;
-        int PicSizeInSamplesY = oVideoDecodeCreateInfo.ulWidth * oVideoDecodeCreateInfo.ulHeight;
-        int MaxDpbSize;
-        if (PicSizeInSamplesY <= (MaxLumaPS>>2))
-            MaxDpbSize = MaxDpbPicBuf * 4;
-        else if (PicSizeInSamplesY <= (MaxLumaPS>>1))
-            MaxDpbSize = MaxDpbPicBuf * 2;
-        else if (PicSizeInSamplesY <= ((3*MaxLumaPS)>>2))
-            MaxDpbSize = (MaxDpbPicBuf * 4) / 3;
-        else
-            MaxDpbSize = MaxDpbPicBuf;
-        MaxDpbSize = MaxDpbSize < 16 ? MaxDpbSize : 16;
-        oVideoDecodeCreateInfo.ulNumDecodeSurfaces = MaxDpbSize + 4;
-    }
+    oVideoDecodeCreateInfo.ulNumDecodeSurfaces = pDepths && pDepths->decodeSurfaces ? pDepths->decodeSurfaces :
+        GetDefaultDecodeSurfaces(oFormat.codec, oFormat.coded_width, oFormat.coded_height);
+    // Surface indices are tracked by the frame queue
+    if (oVideoDecodeCreateInfo.ulNumDecodeSurfaces > FrameQueue::cnMaximumSize)
+        oVideoDecodeCreateInfo.ulNumDecodeSurfaces = FrameQueue::cnMaximumSize;
     oVideoDecodeCreateInfo.ChromaFormat = oFormat.chroma_format;
     oVideoDecodeCreateInfo.OutputFormat = cudaVideoSurfaceFormat_NV12;
     oVideoDecodeCreateInfo.DeinterlaceMode = cudaVideoDeinterlaceMode_Weave;
@@ -171,14 +192,14 @@ void CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock
     oVideoDecodeCreateInfo.display_area.top    = 0;
     oVideoDecodeCreateInfo.display_area.bottom = oVideoDecodeCreateInfo.ulTargetHeight;
 
-    oVideoDecodeCreateInfo.ulNumOutputSurfaces = 2;
+    oVideoDecodeCreateInfo.ulNumOutputSurfaces = pDepths && pDepths->outputSurfaces ? pDepths->outputSurfaces : 2;
     oVideoDecodeCreateInfo.ulCreationFlags = cudaVideoCreate_PreferCUVID;
     oVideoDecodeCreateInfo.vidLock = m_ctxLock;
 
     oResult = cuvidCreateDecoder(&m_videoDecoder, &oVideoDecodeCreateInfo);
     if (oResult != CUDA_SUCCESS) {
         fprintf(stderr, "cuvidCreateDecoder() failed, error code: %d\n", oResult);
-        exit(-1);
+        return false;
     }
 
     m_oVideoDecodeCreateInfo = oVideoDecodeCreateInfo;
@@ -188,7 +209,7 @@ void CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock
     memset(&oVideoParserParameters, 0, sizeof(CUVIDPARSERPARAMS));
     oVideoParserParameters.CodecType = oVideoDecodeCreateInfo.CodecType;
     oVideoParserParameters.ulMaxNumDecodeSurfaces = oVideoDecodeCreateInfo.ulNumDecodeSurfaces;
-    oVideoParserParameters.ulMaxDisplayDelay = 1;
+    oVideoParserParameters.ulMaxDisplayDelay = pDepths && pDepths->displayDelay >= 0 ? pDepths->displayDelay : 1;
     oVideoParserParameters.pUserData = this;
     oVideoParserParameters.pfnSequenceCallback = HandleVideoSequence;
     oVideoParserParameters.pfnDecodePicture = HandlePictureDecode;
@@ -197,24 +218,214 @@ void CudaDecoder::InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock
     oResult = cuvidCreateVideoParser(&m_videoParser, &oVideoParserParameters);
     if (oResult != CUDA_SUCCESS) {
         fprintf(stderr, "cuvidCreateVideoParser failed, error code: %d\n", oResult);
-        exit(-1);
+        return false;
     }
+
+    if (pDepths) {
+        pDepths->decodeSurfaces = oVideoDecodeCreateInfo.ulNumDecodeSurfaces;
+        pDepths->outputSurfaces = oVideoDecodeCreateInfo.ulNumOutputSurfaces;
+        pDepths->displayDelay   = oVideoParserParameters.ulMaxDisplayDelay;
+    }
+
+    return true;
 }
 
-void CudaDecoder::Start()
+bool CudaDecoder::ProbeDisplaySize(const char* videoPath, int& width, int& height)
 {
-    CUresult oResult;
+    CUVIDSOURCEPARAMS oVideoSourceParameters;
+    CUvideosource videoSource;
+    CUVIDEOFORMAT oFormat;
+
+    memset(&oVideoSourceParameters, 0, sizeof(CUVIDSOURCEPARAMS));
+    oVideoSourceParameters.pfnVideoDataHandler = HandleVideoData;
+
+    if (cuvidCreateVideoSource(&videoSource, videoPath, &oVideoSourceParameters) != CUDA_SUCCESS)
+        return false;
 
-    oResult = cuvidSetVideoSourceState(m_videoSource, cudaVideoState_Started);
-    assert(oResult == CUDA_SUCCESS);
+    CUresult oResult = cuvidGetSourceVideoFormat(videoSource, &oFormat, 0);
+    cuvidDestroyVideoSource(videoSource);
+    if (oResult != CUDA_SUCCESS)
+        return false;
 
-    while(cuvidGetVideoSourceState(m_videoSource) == cudaVideoState_Started);
+    width  = oFormat.display_area.right - oFormat.display_area.left;
+    height = oFormat.display_area.bottom - oFormat.display_area.top;
+    return width > 0 && height > 0;
+}
+
+unsigned int CudaDecoder::GetDefaultDecodeSurfaces(cudaVideoCodec codec, int width, int height)
+{
+    if ((codec == cudaVideoCodec_H264) ||
+        (codec == cudaVideoCodec_H264_SVC) ||
+        (codec == cudaVideoCodec_H264_MVC))
+    {
+        // assume worst-case of 20 decode surfaces for H264
+        return 20;
+    }
+    if (codec == cudaVideoCodec_VP9)
+        return 12;
+    if (codec == cudaVideoCodec_HEVC)
+    {
+        // ref HEVC spec: A.4.1 General tier and level limits
+        int MaxLumaPS = 35651584; // currently assuming level 6.2, 8Kx4K
+        int MaxDpbPicBuf = 6;
+        int PicSizeInSamplesY = width * height;
+        int MaxDpbSize;
+        if (PicSizeInSamplesY <= (MaxLumaPS>>2))
+            MaxDpbSize = MaxDpbPicBuf * 4;
+        else if (PicSizeInSamplesY <= (MaxLumaPS>>1))
+            MaxDpbSize = MaxDpbPicBuf * 2;
+        else if (PicSizeInSamplesY <= ((3*MaxLumaPS)>>2))
+            MaxDpbSize = (MaxDpbPicBuf * 4) / 3;
+        else
+            MaxDpbSize = MaxDpbPicBuf;
+        MaxDpbSize = MaxDpbSize < 16 ? MaxDpbSize : 16;
+        return MaxDpbSize + 4;
+    }
+    return 8;
+}
+
+void CudaDecoder::SetFrameRange(int first, int last, long long headerBytes, long long keyframeOffset, int keyframe)
+{
+    assert(m_pInput);
+    assert(keyframe <= first && first <= last);
+
+    m_firstFrame = first;
+    m_lastFrame = last;
+    m_pulledFrames = first;
+
+    if (keyframeOffset > 0) {
+        m_displayedFrames = keyframe;
+        m_keyframeOffset = keyframeOffset;
+        if ((m_headerRemaining = headerBytes) == 0)
+            fseeko(m_pInput, keyframeOffset, SEEK_SET);
+    }
+}
+
+void CudaDecoder::Start()
+{
+    assert(m_bThreaded);
+
+    // Backpressure comes from the frame queue blocking the parser callbacks
+    while(!m_bFailed && Parse());
 
     m_bFinish = true;
 
     m_pFrameQueue->endDecode();
 }
 
+// Offset of the first Annex B start code at or after nFrom, or nEnd when there is none
+static size_t FindStartCode(const unsigned char* pBuffer, size_t nFrom, size_t nEnd)
+{
+    for (size_t i = nFrom; i + 2 < nEnd; i++)
+        if (pBuffer[i] == 0 && pBuffer[i + 1] == 0 && pBuffer[i + 2] == 1)
+            return i;
+
+    return nEnd;
+}
+
+bool CudaDecoder::Parse()
+{
+    CUVIDSOURCEDATAPACKET oPacket;
+    memset(&oPacket, 0, sizeof(oPacket));
+
+    // Once the last frame has been displayed, the end of stream flushes the parser
+    if (m_bStop || m_nParsed == m_nBuffered) {
+        size_t nChunkSize = PARSE_CHUNK_SIZE;
+        if (m_headerRemaining > 0 && m_headerRemaining < (long long)nChunkSize)
+            nChunkSize = m_headerRemaining;
+
+        m_nParsed = 0;
+        m_nBuffered = m_bStop ? 0 : fread(m_pInputBuffer, 1, nChunkSize, m_pInput);
+        if (m_headerRemaining > 0 && (m_headerRemaining -= m_nBuffered) == 0)
+            fseeko(m_pInput, m_keyframeOffset, SEEK_SET);
+    }
+
+    // A chunk can display more pictures than the frame queue holds.  Without a decode thread nothing would
+    // drain the queue while the parser runs, so the chunk is fed up to the start of the next NAL unit
+    // (which displays at most one picture), and NextFrame takes the frame before parsing any further.
+    size_t nEnd = m_bThreaded ? m_nBuffered : FindStartCode(m_pInputBuffer, m_nParsed + 3, m_nBuffered);
+
+    oPacket.payload = m_pInputBuffer + m_nParsed;
+    oPacket.payload_size = nEnd - m_nParsed;
+    m_nParsed = nEnd;
+    if (oPacket.payload_size == 0)
+        oPacket.flags = CUVID_PKT_ENDOFSTREAM;
+
+    if (cuvidParseVideoData(m_videoParser, &oPacket) != CUDA_SUCCESS)
+        fprintf(stderr, "cuvidParseVideoData failed\n");
+
+    return oPacket.payload_size > 0;
+}
+
+bool CudaDecoder::NextFrame(DecodedFrame& frame)
+{
+    bool bTimedOut;
+
+    return NextFrame(frame, ULLONG_MAX, bTimedOut);
+}
+
+bool CudaDecoder::NextFrame(DecodedFrame& frame, unsigned long long deadline, bool& timedOut)
+{
+    bool bHaveFrame;
+
+    timedOut = false;
+    pthread_mutex_lock(&m_pullLock);
+    while (!(bHaveFrame = m_pFrameQueue->dequeue(&frame.info)) && !m_pFrameQueue->isEndOfDecode())
+    {
+        if (m_bThreaded && PipelineTuner::Now() >= deadline) {
+            timedOut = true;
+            break;
+        }
+        else if (m_bThreaded) {
+            unsigned long long start = PipelineTuner::Now();
+            m_pFrameQueue->waitForQueueUpdate();
+            m_waitTime += PipelineTuner::Now() - start;
+        }
+        else if (m_bFailed || !Parse()) {
+            m_bFinish = true;
+            m_pFrameQueue->endDecode();
+        }
+    }
+    // Frames displayed while the end of the input was being reached
+    if (!bHaveFrame && !timedOut)
+        bHaveFrame = m_pFrameQueue->dequeue(&frame.info);
+    frame.index = bHaveFrame ? m_pulledFrames++ : -1;
+    frame.decoded = bHaveFrame ? frame.info.timestamp : 0;
+    pthread_mutex_unlock(&m_pullLock);
+
+    if (!bHaveFrame)
+        return false;
+
+    TraceAsyncEnd("queued", frame.index, frame.index);
+
+    CUVIDPROCPARAMS oVPP;
+    memset(&oVPP, 0, sizeof(oVPP));
+    oVPP.progressive_frame = frame.info.progressive_frame;
+    oVPP.second_field = 0;
+    oVPP.top_field_first = frame.info.top_field_first;
+    oVPP.unpaired_field = (frame.info.progressive_frame == 1 || frame.info.repeat_first_field <= 1);
+
+    TraceSpan span("map", frame.index);
+    frame.device = 0;
+    if (cuvidMapVideoFrame(m_videoDecoder, frame.info.picture_index, &frame.device, &frame.pitch, &oVPP) != CUDA_SUCCESS) {
+        fprintf(stderr, "cuvidMapVideoFrame failed for frame %d\n", frame.index);
+        m_pFrameQueue->releaseFrame(&frame.info);
+        return false;
+    }
+
+    return true;
+}
+
+void CudaDecoder::ReleaseFrame(DecodedFrame& frame)
+{
+    TraceSpan span("unmap", frame.index);
+
+    if (frame.device)
+        cuvidUnmapVideoFrame(m_videoDecoder, frame.device);
+    frame.device = 0;
+    m_pFrameQueue->releaseFrame(&frame.info);
+}
+
 void CudaDecoder::GetCodecParam(int* width, int* height, int* frame_rate_num, int* frame_rate_den, int* is_progressive)
 {
     assert (width != NULL && height != NULL && frame_rate_num != NULL && frame_rate_den != NULL);
@@ -4,6 +4,21 @@
 #include "dynlink_nvcuvid.h" // <nvcuvid.h>
 #include "dynlink_cuda.h"    // <cuda.h>
 #include "FrameQueue.h"
+#include "PipelineTuner.h"
+
+#include <stdio.h>
+
+#define PARSE_CHUNK_SIZE 16*1024
+
+// A decoded frame mapped for reading by the caller; returned to the decoder with ReleaseFrame
+typedef struct DecodedFrame
+{
+    CUVIDPARSERDISPINFO info;
+    CUdeviceptr         device;
+    unsigned int        pitch;
+    int                 index;   // Display order
+    unsigned long long  decoded; // When the frame was displayed by the decoder (PipelineTuner::Now)
+} DecodedFrame;
 
 class CudaDecoder
 {
@@ -12,11 +27,45 @@ public:
     virtual ~CudaDecoder(void);
 
     bool IsFinished()            { return m_bFinish; }
-    virtual void InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock, FrameQueue* pFrameQueue,
-            int targetWidth = 0, int targetHeight = 0);
+    // Whether a picture could not be decoded, which ends decoding early
+    bool HasFailed() const       { return m_bFailed; }
+    // Nonzero decoder depths in pDepths are used as given; the remainder are filled with the values chosen.
+    // Returns false, having reported why, when the input cannot be decoded.
+    virtual bool InitVideoDecoder(const char* videoPath, CUvideoctxlock ctxLock, FrameQueue* pFrameQueue,
+            int targetWidth = 0, int targetHeight = 0, PipelineDepths* pDepths = NULL);
+    // Decodes the whole input on the calling thread, handing frames to the frame queue.  SetThreaded must
+    // be called (after InitVideoDecoder) before the thread is created so that NextFrame waits for it rather
+    // than parsing, and so that the parser may block on a full frame queue.
     virtual void Start();
+    void SetThreaded()           { m_bThreaded = true; m_pFrameQueue->setBlocking(true); }
+    // Restricts output to display frames [first, last], and must be called before decoding starts.  Earlier
+    // frames are dropped before reaching the frame queue, and parsing stops once last has been displayed.
+    // With a keyframe offset, the stream header is parsed and input then resumes at that IDR, which
+    // displays keyframe first.
+    void SetFrameRange(int first, int last, long long headerBytes = 0, long long keyframeOffset = 0,
+                       int keyframe = 0);
+    // Returns the next frame in display order, or false once every frame has been returned (or decoding
+    // has failed).  Without a thread running Start, input is parsed on the calling thread, a NAL unit at a
+    // time, until a frame is displayed; several threads may pull concurrently.  Frames should be released
+    // promptly: each outstanding frame holds a decode surface.  A decode thread blocks while every surface
+    // is held, but parsing on the calling thread cannot wait for itself, and fails instead.
+    virtual bool NextFrame(DecodedFrame& frame);
+    // As NextFrame, but a threaded decoder waits only until deadline (PipelineTuner::Now), returning false
+    // with timedOut set when no frame has been displayed by then.  A deadline that has passed only polls.
+    bool NextFrame(DecodedFrame& frame, unsigned long long deadline, bool& timedOut);
+    virtual void ReleaseFrame(DecodedFrame& frame);
+    // Feeds the next chunk of input to the parser (only its next NAL unit without a decode thread); returns
+    // false at the end of the input
+    bool Parse();
+    // Microseconds NextFrame has spent waiting on the decode thread
+    unsigned long long GetWaitTime() { return m_waitTime; }
     virtual void GetCodecParam(int* width, int* height, int* frame_rate_num, int* frame_rate_den, int* is_progressive);
     virtual void* GetDecoder()   { return m_videoDecoder; }
+    // Decode surfaces allocated for a stream of the given codec and coded size when not set explicitly
+    static unsigned int GetDefaultDecodeSurfaces(cudaVideoCodec codec, int width, int height);
+    // Reads the display size of the input from its headers, without creating a decoder (cuvidInit must have
+    // been called); returns false when the input cannot be read
+    static bool ProbeDisplaySize(const char* videoPath, int& width, int& height);
 
 public:
     CUvideosource  m_videoSource;
@@ -27,9 +76,23 @@ public:
 
     FrameQueue*    m_pFrameQueue;
     int            m_decodedFrames;
+    int            m_displayedFrames;  // Display index of the next frame output by the parser
+    int            m_firstFrame, m_lastFrame;
+    volatile bool  m_bStop;            // The last frame has been displayed
+    volatile bool  m_bFailed;
 
 protected:
     bool m_bFinish;
+    volatile bool  m_bThreaded;
+    FILE*          m_pInput;
+    unsigned char* m_pInputBuffer;
+    size_t         m_nBuffered;        // Bytes of input in the buffer
+    size_t         m_nParsed;          // Of those, the bytes fed to the parser
+    long long      m_headerRemaining;  // Header bytes to parse before seeking to the keyframe
+    long long      m_keyframeOffset;
+    pthread_mutex_t m_pullLock;
+    int            m_pulledFrames;
+    unsigned long long m_waitTime;
 };
 
 #endif